@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <tiny_gltf.h>
+#include "gltf_file.h"
+
+
+// number of components of an accessor type
+int gltfComponentCount(int type) {
+    switch (type) {
+    case TINYGLTF_TYPE_SCALAR: return 1;
+    case TINYGLTF_TYPE_VEC2: return 2;
+    case TINYGLTF_TYPE_VEC3: return 3;
+    case TINYGLTF_TYPE_VEC4: return 4;
+    case TINYGLTF_TYPE_MAT2: return 4;
+    case TINYGLTF_TYPE_MAT3: return 9;
+    case TINYGLTF_TYPE_MAT4: return 16;
+    default: return 0;
+    }
+}
+
+// read one component and convert it to float, normalized integers map to [0,1] or [-1,1]
+float gltfReadComponent(const unsigned char* src, int componentType, bool normalized) {
+    switch (componentType) {
+    case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+        float v;
+        memcpy(&v, src, sizeof(v));
+        return v;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+        float v = *src;
+        return normalized ? v / 255.0f : v;
+    }
+    case TINYGLTF_COMPONENT_TYPE_BYTE: {
+        float v = (float)(signed char)*src;
+        return normalized ? std::max(v / 127.0f, -1.0f) : v;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+        unsigned short v;
+        memcpy(&v, src, sizeof(v));
+        return normalized ? v / 65535.0f : (float)v;
+    }
+    case TINYGLTF_COMPONENT_TYPE_SHORT: {
+        short v;
+        memcpy(&v, src, sizeof(v));
+        return normalized ? std::max(v / 32767.0f, -1.0f) : (float)v;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+        unsigned int v;
+        memcpy(&v, src, sizeof(v));
+        return (float)v;
+    }
+    default:
+        return 0.0f;
+    }
+}
+
+// read one unsigned integer index
+size_t gltfReadIndex(const unsigned char* src, int componentType) {
+    switch (componentType) {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        return *src;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+        unsigned short v;
+        memcpy(&v, src, sizeof(v));
+        return v;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+        unsigned int v;
+        memcpy(&v, src, sizeof(v));
+        return v;
+    }
+    default:
+        return 0;
+    }
+}
+
+// count elements of elementSize bytes, stride apart, from offset into a bufferView. null when
+// the view or its buffer does not exist or the elements would reach past the buffer's end
+const unsigned char* gltfViewElements(const tinygltf::Model& model, const GLTF_BufferData& buffers, int viewIndex, size_t offset,
+    size_t count, size_t stride, size_t elementSize) {
+    if (viewIndex < 0 || viewIndex >= (int)model.bufferViews.size()) return nullptr;
+    const tinygltf::BufferView& view = model.bufferViews[viewIndex];
+    if (view.buffer < 0 || view.buffer >= (int)model.buffers.size() || !buffers.data(view.buffer)) return nullptr;
+    size_t size = buffers.size(view.buffer);
+    if (view.byteOffset > size || offset > size - view.byteOffset) return nullptr;
+    size_t available = size - view.byteOffset - offset;
+    //(count - 1) * stride + elementSize <= available, without overflowing
+    if (count > 0 && (elementSize > available || (count > 1 && (stride == 0 || count - 1 > (available - elementSize) / stride))))
+        return nullptr;
+    return buffers.data(view.buffer) + view.byteOffset + offset;
+}
+
+// read a whole accessor as tightly packed floats, sparse values applied
+bool gltfReadFloats(const tinygltf::Model& model, const GLTF_BufferData& buffers, int accessorIndex, std::vector<float>& out) {
+    out.clear();
+    if (accessorIndex < 0 || accessorIndex >= (int)model.accessors.size()) return false;
+    const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+    int components = gltfComponentCount(accessor.type);
+    int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+    if (components == 0 || componentSize <= 0) return false;
+    size_t elementSize = (size_t)components * componentSize;
+
+    //an accessor without a bufferView is all zeros
+    const unsigned char* data = nullptr;
+    int stride = 0;
+    if (accessor.bufferView >= 0) {
+        if (accessor.bufferView >= (int)model.bufferViews.size()) return false;
+        stride = accessor.ByteStride(model.bufferViews[accessor.bufferView]);
+        if (stride <= 0) return false;
+        data = gltfViewElements(model, buffers, accessor.bufferView, accessor.byteOffset, accessor.count, stride, elementSize);
+        if (!data) return false;
+    }
+    //sparse indices and values are checked before anything is written
+    const unsigned char* indices = nullptr;
+    const unsigned char* values = nullptr;
+    int indexSize = 0;
+    if (accessor.sparse.isSparse) {
+        indexSize = tinygltf::GetComponentSizeInBytes(accessor.sparse.indices.componentType);
+        if (indexSize <= 0 || accessor.sparse.count < 0) return false;
+        indices = gltfViewElements(model, buffers, accessor.sparse.indices.bufferView, accessor.sparse.indices.byteOffset,
+            accessor.sparse.count, indexSize, indexSize);
+        values = gltfViewElements(model, buffers, accessor.sparse.values.bufferView, accessor.sparse.values.byteOffset,
+            accessor.sparse.count, elementSize, elementSize);
+        if (!indices || !values) return false;
+    }
+    out.assign(accessor.count * components, 0.0f);
+
+    if (data) {
+        for (size_t i = 0; i < accessor.count; ++i) {
+            for (int c = 0; c < components; ++c) {
+                out[i * components + c] = gltfReadComponent(data + i * stride + c * componentSize,
+                    accessor.componentType, accessor.normalized);
+            }
+        }
+    }
+
+    if (accessor.sparse.isSparse) {
+        for (int i = 0; i < accessor.sparse.count; ++i) {
+            size_t target = gltfReadIndex(indices + i * indexSize, accessor.sparse.indices.componentType);
+            if (target >= accessor.count) continue;
+            for (int c = 0; c < components; ++c) {
+                out[target * components + c] = gltfReadComponent(values + (i * components + c) * componentSize,
+                    accessor.componentType, accessor.normalized);
+            }
+        }
+    }
+    return true;
+}
+
+// read a whole accessor as tightly packed elements in its own format, sparse values applied
+bool gltfReadElements(const tinygltf::Model& model, const GLTF_BufferData& buffers, int accessorIndex,
+    std::vector<unsigned char>& out) {
+    out.clear();
+    if (accessorIndex < 0 || accessorIndex >= (int)model.accessors.size()) return false;
+    const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+    int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+    if (componentSize <= 0) return false;
+    size_t elementSize = gltfComponentCount(accessor.type) * (size_t)componentSize;
+    if (elementSize == 0) return false;
+
+    //an accessor without a bufferView is all zeros
+    const unsigned char* data = nullptr;
+    int stride = 0;
+    if (accessor.bufferView >= 0 && accessor.count > 0) {
+        if (accessor.bufferView >= (int)model.bufferViews.size()) return false;
+        stride = accessor.ByteStride(model.bufferViews[accessor.bufferView]);
+        if (stride <= 0) return false;
+        data = gltfViewElements(model, buffers, accessor.bufferView, accessor.byteOffset, accessor.count, stride, elementSize);
+        if (!data) return false;
+    }
+    //sparse indices and values are checked before anything is written
+    const unsigned char* indices = nullptr;
+    const unsigned char* values = nullptr;
+    int indexSize = 0;
+    if (accessor.sparse.isSparse) {
+        indexSize = tinygltf::GetComponentSizeInBytes(accessor.sparse.indices.componentType);
+        if (indexSize <= 0 || accessor.sparse.count < 0) return false;
+        indices = gltfViewElements(model, buffers, accessor.sparse.indices.bufferView, accessor.sparse.indices.byteOffset,
+            accessor.sparse.count, indexSize, indexSize);
+        values = gltfViewElements(model, buffers, accessor.sparse.values.bufferView, accessor.sparse.values.byteOffset,
+            accessor.sparse.count, elementSize, elementSize);
+        if (!indices || !values) return false;
+    }
+    out.assign(accessor.count * elementSize, 0);
+
+    if (data) {
+        if ((size_t)stride == elementSize) {
+            memcpy(out.data(), data, out.size());
+        }
+        else {
+            for (size_t i = 0; i < accessor.count; ++i) {
+                memcpy(out.data() + i * elementSize, data + i * stride, elementSize);
+            }
+        }
+    }
+
+    if (accessor.sparse.isSparse) {
+        for (int i = 0; i < accessor.sparse.count; ++i) {
+            size_t target = gltfReadIndex(indices + i * indexSize, accessor.sparse.indices.componentType);
+            if (target >= accessor.count) continue;
+            memcpy(out.data() + target * elementSize, values + i * elementSize, elementSize);
+        }
+    }
+    return true;
+}
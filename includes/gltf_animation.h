@@ -0,0 +1,347 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <tiny_gltf.h>
+#include "gltf_accessor.h"
+#include "gltf_file.h"
+#include "gltf_trace.h"
+#include "gltf_transforms.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define GLTF_ANIMATION_SSE
+#endif
+
+
+// keyframe playback of glTF animations and joint matrices of skins. clips and skins are
+// read once per file and shared, an animator is the playback state of one model
+class GLTF_Animator
+{
+public:
+    enum Path { Translation, Rotation, Scale };
+    enum Interpolation { Linear, Step, CubicSpline };
+    struct Sampler {
+        std::vector<float> times;
+        std::vector<float> values;      //4 floats per element, cubic splines store in-tangent, value, out-tangent per key
+        Interpolation interpolation = Linear;
+    };
+    struct Channel {
+        int node = -1;
+        Path path = Translation;
+        int sampler = 0;
+    };
+    struct Clip {
+        std::string name;
+        std::vector<Sampler> samplers;
+        std::vector<Channel> channels;
+        float start = 0.0f;             //first and last key of all samplers
+        float end = 0.0f;
+    };
+    struct Skin {
+        std::vector<int> joints;        //nodes
+        std::vector<glm::mat4> inverseBindMatrices;
+    };
+
+    //read every animation and skin of the model, the buffer bytes are not needed afterwards
+    static void read(const tinygltf::Model& model, const GLTF_BufferData& buffers, std::vector<Clip>& clips,
+        std::vector<Skin>& skins);
+    //joint matrices of a skin, in the space of the mesh node at meshSlot: count matrices into out
+    static void jointMatrices(const Skin& skin, const GLTF_Transforms& transforms, int meshSlot, glm::mat4* out, size_t count);
+
+    void play(int clip, bool loop = true, float speed = 1.0f);
+    void stop() { play(-1); }
+    int clip() const { return clipIndex; }
+    float time() const { return clock; }
+    //advance the clock and pose the animated nodes, false when the pose did not change
+    bool advance(const Clip& clip, float seconds, GLTF_Transforms& transforms);
+
+private:
+    int clipIndex = -1;
+    bool looping = true;
+    float speed = 1.0f;
+    float clock = 0.0f;                 //seconds into the clip
+    bool posed = false;                 //the nodes show the pose at clock
+    std::vector<uint32_t> cursors;      //key of the last sample, per sampler
+
+    static size_t findKey(const std::vector<float>& times, float t, uint32_t& cursor);
+    void sample(const Sampler& sampler, uint32_t& cursor, float t, bool rotation, float* out);
+};
+
+
+// a + (b - a) * t on four floats
+static inline void gltfLerp4(const float* a, const float* b, float t, float* out) {
+#ifdef GLTF_ANIMATION_SSE
+    __m128 va = _mm_loadu_ps(a);
+    _mm_storeu_ps(out, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b), va), _mm_set1_ps(t))));
+#else
+    for (int i = 0; i < 4; ++i) out[i] = a[i] + (b[i] - a[i]) * t;
+#endif
+}
+
+static inline void gltfNormalize4(float* q) {
+#ifdef GLTF_ANIMATION_SSE
+    __m128 v = _mm_loadu_ps(q);
+    __m128 square = _mm_mul_ps(v, v);
+    square = _mm_add_ps(square, _mm_shuffle_ps(square, square, _MM_SHUFFLE(2, 3, 0, 1)));
+    square = _mm_add_ps(square, _mm_shuffle_ps(square, square, _MM_SHUFFLE(1, 0, 3, 2)));
+    if (_mm_cvtss_f32(square) > 0.0f) _mm_storeu_ps(q, _mm_div_ps(v, _mm_sqrt_ps(square)));
+#else
+    float length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    if (length > 0.0f) {
+        for (int i = 0; i < 4; ++i) q[i] /= length;
+    }
+#endif
+}
+
+// quaternion blend along the shorter arc: a normalized lerp whose t is bent towards slerp,
+// which keeps it within about 1e-3 of the true angle without any trigonometry
+static inline void gltfNlerp4(const float* a, const float* b, float t, float* out) {
+    float cosine = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+    float d = std::fabs(cosine);
+    float k0 = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+    float k1 = 0.848013f + d * (-1.06021f + d * 0.215638f);
+    float k = k0 * (t - 0.5f) * (t - 0.5f) + k1;
+    float u = t + t * (t - 0.5f) * (t - 1.0f) * k;
+    float sign = cosine < 0.0f ? -1.0f : 1.0f;
+#ifdef GLTF_ANIMATION_SSE
+    __m128 va = _mm_loadu_ps(a);
+    __m128 vb = _mm_mul_ps(_mm_loadu_ps(b), _mm_set1_ps(sign));
+    _mm_storeu_ps(out, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), _mm_set1_ps(u))));
+#else
+    for (int i = 0; i < 4; ++i) out[i] = a[i] + (b[i] * sign - a[i]) * u;
+#endif
+    gltfNormalize4(out);
+}
+
+// cubic Hermite spline between two keys dt apart, tangents scaled by dt as glTF defines them
+static inline void gltfHermite4(const float* v0, const float* outTangent0, const float* inTangent1, const float* v1,
+    float dt, float t, float* out) {
+    float t2 = t * t, t3 = t2 * t;
+    float w0 = 2.0f * t3 - 3.0f * t2 + 1.0f;
+    float w1 = (t3 - 2.0f * t2 + t) * dt;
+    float w2 = -2.0f * t3 + 3.0f * t2;
+    float w3 = (t3 - t2) * dt;
+#ifdef GLTF_ANIMATION_SSE
+    __m128 r = _mm_mul_ps(_mm_loadu_ps(v0), _mm_set1_ps(w0));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(outTangent0), _mm_set1_ps(w1)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(v1), _mm_set1_ps(w2)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(inTangent1), _mm_set1_ps(w3)));
+    _mm_storeu_ps(out, r);
+#else
+    for (int i = 0; i < 4; ++i) out[i] = v0[i] * w0 + outTangent0[i] * w1 + v1[i] * w2 + inTangent1[i] * w3;
+#endif
+}
+
+// out = a * b, out may be either of them
+static inline void gltfMultiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+#ifdef GLTF_ANIMATION_SSE
+    __m128 a0 = _mm_loadu_ps(&a[0][0]);
+    __m128 a1 = _mm_loadu_ps(&a[1][0]);
+    __m128 a2 = _mm_loadu_ps(&a[2][0]);
+    __m128 a3 = _mm_loadu_ps(&a[3][0]);
+    for (int column = 0; column < 4; ++column) {
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[column][0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[column][1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[column][2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[column][3])));
+        _mm_storeu_ps(&out[column][0], r);
+    }
+#else
+    out = a * b;
+#endif
+}
+
+
+void GLTF_Animator::read(const tinygltf::Model& model, const GLTF_BufferData& buffers, std::vector<Clip>& clips,
+    std::vector<Skin>& skins) {
+    clips.clear();
+    skins.clear();
+    std::vector<float> values;
+    for (const tinygltf::Animation& animation : model.animations) {
+        Clip clip;
+        clip.name = animation.name;
+        clip.start = 1e30f;
+        clip.end = -1e30f;
+        //samplers are read when a channel uses them, morph target weights are not drawn
+        std::vector<int> samplerIndex(animation.samplers.size(), -1);
+        for (const tinygltf::AnimationChannel& source : animation.channels) {
+            Channel channel;
+            channel.node = source.target_node;
+            int components = 3;
+            if (source.target_path == "translation") channel.path = Translation;
+            else if (source.target_path == "scale") channel.path = Scale;
+            else if (source.target_path == "rotation") {
+                channel.path = Rotation;
+                components = 4;
+            }
+            else continue;
+            if (channel.node < 0 || channel.node >= (int)model.nodes.size()) continue;
+            if (source.sampler < 0 || source.sampler >= (int)animation.samplers.size()) continue;
+
+            if (samplerIndex[source.sampler] < 0) {
+                const tinygltf::AnimationSampler& input = animation.samplers[source.sampler];
+                Sampler sampler;
+                if (input.interpolation == "STEP") sampler.interpolation = Step;
+                else if (input.interpolation == "CUBICSPLINE") sampler.interpolation = CubicSpline;
+                size_t perKey = sampler.interpolation == CubicSpline ? 3 : 1;
+                if (!gltfReadFloats(model, buffers, input.input, sampler.times) || sampler.times.empty() ||
+                    !gltfReadFloats(model, buffers, input.output, values) ||
+                    values.size() != sampler.times.size() * perKey * components) {
+                    GLTF_LOG_WARN("animation sampler skipped: " << animation.name);
+                    continue;
+                }
+                //padded to four floats so every element is one SIMD load
+                sampler.values.assign(values.size() / components * 4, 0.0f);
+                for (size_t i = 0; i < values.size() / components; ++i) {
+                    std::copy(values.begin() + i * components, values.begin() + (i + 1) * components, sampler.values.begin() + i * 4);
+                }
+                clip.start = std::min(clip.start, sampler.times.front());
+                clip.end = std::max(clip.end, sampler.times.back());
+                samplerIndex[source.sampler] = (int)clip.samplers.size();
+                clip.samplers.push_back(std::move(sampler));
+            }
+            channel.sampler = samplerIndex[source.sampler];
+            //a sampler read for rotations has the wrong width for translations and the other way round
+            size_t perKey = clip.samplers[channel.sampler].interpolation == CubicSpline ? 3 : 1;
+            const tinygltf::Accessor& output = model.accessors[animation.samplers[source.sampler].output];
+            if (output.count != clip.samplers[channel.sampler].times.size() * perKey ||
+                gltfComponentCount(output.type) != components) continue;
+            clip.channels.push_back(channel);
+        }
+        if (clip.start > clip.end) clip.start = clip.end = 0.0f;
+        clips.push_back(std::move(clip));
+    }
+
+    for (const tinygltf::Skin& source : model.skins) {
+        Skin skin;
+        skin.joints = source.joints;
+        skin.inverseBindMatrices.assign(skin.joints.size(), glm::mat4(1.0f));
+        if (source.inverseBindMatrices >= 0 && gltfReadFloats(model, buffers, source.inverseBindMatrices, values)) {
+            for (size_t i = 0; i < skin.joints.size() && (i + 1) * 16 <= values.size(); ++i) {
+                skin.inverseBindMatrices[i] = glm::make_mat4(values.data() + i * 16);
+            }
+        }
+        skins.push_back(std::move(skin));
+    }
+}
+
+void GLTF_Animator::jointMatrices(const Skin& skin, const GLTF_Transforms& transforms, int meshSlot, glm::mat4* out, size_t count) {
+    //joints are posed in the scene, the mesh node's own transform is applied again by the draw
+    glm::mat4 toMesh = glm::inverse(transforms.world(meshSlot));
+    count = std::min(count, skin.joints.size());
+    for (size_t i = 0; i < count; ++i) {
+        int slot = transforms.slot(skin.joints[i]);
+        if (slot < 0) {
+            out[i] = skin.inverseBindMatrices[i];
+            continue;
+        }
+        gltfMultiply(transforms.world(slot), skin.inverseBindMatrices[i], out[i]);
+        gltfMultiply(toMesh, out[i], out[i]);
+    }
+}
+
+void GLTF_Animator::play(int clip, bool loop, float rate) {
+    clipIndex = clip;
+    looping = loop;
+    speed = rate;
+    clock = 0.0f;
+    posed = false;
+    cursors.clear();
+}
+
+bool GLTF_Animator::advance(const Clip& clip, float seconds, GLTF_Transforms& transforms) {
+    if (cursors.size() != clip.samplers.size()) cursors.assign(clip.samplers.size(), 0);
+    float previous = clock;
+    float duration = clip.end - clip.start;
+    clock += seconds * speed;
+    if (looping && duration > 0.0f) {
+        clock = std::fmod(clock, duration);
+        if (clock < 0.0f) clock += duration;
+    }
+    else {
+        clock = std::min(std::max(clock, 0.0f), duration);
+    }
+    //paused, or held on the last key
+    if (posed && clock == previous) return false;
+    posed = true;
+
+    float t = clip.start + clock;
+    float value[4];
+    for (const Channel& channel : clip.channels) {
+        sample(clip.samplers[channel.sampler], cursors[channel.sampler], t, channel.path == Rotation, value);
+        switch (channel.path) {
+        case Translation:
+            transforms.setTranslation(channel.node, glm::vec3(value[0], value[1], value[2]));
+            break;
+        case Rotation:
+            transforms.setRotation(channel.node, glm::quat(value[3], value[0], value[1], value[2]));
+            break;
+        case Scale:
+            transforms.setScale(channel.node, glm::vec3(value[0], value[1], value[2]));
+            break;
+        }
+    }
+    return true;
+}
+
+// key k with times[k] <= t < times[k + 1], searched from the key of the last sample: playback moves
+// a key or two per frame, so this is O(1) amortized, and only jumps fall back to bisection
+size_t GLTF_Animator::findKey(const std::vector<float>& times, float t, uint32_t& cursor) {
+    size_t last = times.size() - 1;
+    size_t key = std::min<size_t>(cursor, last - 1);
+    if (t < times[key]) {
+        //looped around or played backwards
+        key = t < times[1] ? 0 : (size_t)(std::upper_bound(times.begin(), times.begin() + key, t) - times.begin()) - 1;
+    }
+    else {
+        for (int step = 0; key + 1 < last && t >= times[key + 1]; ++key) {
+            if (++step == 4) {
+                key = (size_t)(std::upper_bound(times.begin() + key + 1, times.begin() + last, t) - times.begin()) - 1;
+                break;
+            }
+        }
+    }
+    cursor = (uint32_t)key;
+    return key;
+}
+
+void GLTF_Animator::sample(const Sampler& sampler, uint32_t& cursor, float t, bool rotation, float* out) {
+    const std::vector<float>& times = sampler.times;
+    const float* values = sampler.values.data();
+    //cubic splines keep the value in the middle of each key
+    size_t perKey = sampler.interpolation == CubicSpline ? 3 : 1;
+    size_t valueOffset = sampler.interpolation == CubicSpline ? 1 : 0;
+    size_t last = times.size() - 1;
+    if (last == 0 || t <= times[0] || t >= times[last]) {
+        size_t key = (last == 0 || t <= times[0]) ? 0 : last;
+        std::copy(values + (key * perKey + valueOffset) * 4, values + (key * perKey + valueOffset) * 4 + 4, out);
+        return;
+    }
+
+    size_t key = findKey(times, t, cursor);
+    float dt = times[key + 1] - times[key];
+    float u = dt > 0.0f ? (t - times[key]) / dt : 0.0f;
+    switch (sampler.interpolation) {
+    case Step:
+        std::copy(values + key * 4, values + key * 4 + 4, out);
+        break;
+    case Linear:
+        if (rotation) gltfNlerp4(values + key * 4, values + (key + 1) * 4, u, out);
+        else gltfLerp4(values + key * 4, values + (key + 1) * 4, u, out);
+        break;
+    case CubicSpline:
+        gltfHermite4(values + (key * 3 + 1) * 4, values + (key * 3 + 2) * 4, values + (key + 1) * 3 * 4,
+            values + ((key + 1) * 3 + 1) * 4, dt, u, out);
+        if (rotation) gltfNormalize4(out);
+        break;
+    }
+}
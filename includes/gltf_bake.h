@@ -0,0 +1,719 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <tiny_gltf.h>
+#include "gltf_cache.h"
+#include "gltf_file.h"
+#include "gltf_textures.h"
+
+
+// baked scene: what the loader makes of a glTF file (scene tables, buffer bytes and
+// decoded texture levels) in one versioned blob. later loads map the blob and upload
+// straight from it, without JSON parsing or image decoding.
+// layout: header, 16 byte aligned payloads (buffers, then texture levels), then the
+// table stream the header points at
+class GLTF_BakedScene
+{
+public:
+    static const uint32_t formatVersion = 4;
+    static const uint32_t gammaOption = 1u << 31;       //options: texture caps mask, plus sRGB textures
+    static const uint32_t batchShift = 20;              //and the static batching settings from this bit on
+    static const uint32_t optimizeShift = 24;           //and the mesh optimizer settings from this bit on
+    static const uint32_t vertexShift = 28;             //and the vertex format settings from this one
+    static const uint32_t batchVerticesShift = 32;      //and the static batching vertex limit in the high word
+
+    //where the blob of a source file goes, next to it when directory is empty
+    static std::string pathFor(const std::string& source, const std::string& directory);
+    static bool write(const std::string& bakedPath, const std::string& source, const std::string& contentKey, uint64_t options,
+        const tinygltf::Model& model, const GLTF_BufferData& data, const std::vector<GLTF_TextureData>& images,
+        const std::vector<std::string>& textureKeys);
+    //false when the blob is missing, of another version or options, or older than its sources
+    static bool read(const std::string& bakedPath, uint64_t options, tinygltf::Model& model, GLTF_BufferData& data,
+        std::vector<GLTF_TextureData>& images, std::vector<std::string>& textureKeys, std::string& contentKey);
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t options;
+        uint64_t tableOffset;
+        uint64_t tableSize;
+    };
+    //source files the blob was made from, a changed size or time makes it stale
+    struct Dependency {
+        std::string path;
+        uint64_t size = 0;
+        int64_t time = 0;
+    };
+    static bool stamp(Dependency& dependency);
+
+    class Writer;
+    class Reader;
+    //one field list for both directions, so the two cannot drift apart
+    template <typename Stream, typename Model>
+    static void transfer(Stream& stream, Model& model);
+};
+
+
+class GLTF_BakedScene::Writer
+{
+public:
+    std::vector<unsigned char> bytes;
+    bool ok = true;
+
+    template <typename T>
+    void integer(const T& value) { raw((int64_t)value); }
+    void real(const double& value) { raw(value); }
+    void text(const std::string& value) {
+        integer(value.size());
+        bytes.insert(bytes.end(), value.begin(), value.end());
+    }
+    void reals(const std::vector<double>& values) {
+        integer(values.size());
+        for (double value : values) real(value);
+    }
+    void integers(const std::vector<int>& values) {
+        integer(values.size());
+        for (int value : values) integer(value);
+    }
+    void texts(const std::vector<std::string>& values) {
+        integer(values.size());
+        for (const std::string& value : values) text(value);
+    }
+    void indices(const std::map<std::string, int>& values) {
+        integer(values.size());
+        for (auto& value : values) {
+            text(value.first);
+            integer(value.second);
+        }
+    }
+    template <typename V>
+    size_t count(const V& values) {
+        integer(values.size());
+        return values.size();
+    }
+    void value(const tinygltf::Value& value);
+    void extensions(const tinygltf::ExtensionMap& values) {
+        integer(values.size());
+        for (auto& entry : values) {
+            text(entry.first);
+            value(entry.second);
+        }
+    }
+    void parameters(const tinygltf::ParameterMap& values);
+
+private:
+    template <typename T>
+    void raw(const T& value) {
+        const unsigned char* begin = (const unsigned char*)&value;
+        bytes.insert(bytes.end(), begin, begin + sizeof(T));
+    }
+};
+
+
+class GLTF_BakedScene::Reader
+{
+public:
+    const unsigned char* cursor;
+    const unsigned char* end;
+    bool ok = true;
+
+    Reader(const unsigned char* begin, size_t size) : cursor(begin), end(begin + size) {}
+
+    template <typename T>
+    void integer(T& value) {
+        int64_t stored = 0;
+        if (raw(stored)) value = (T)stored;
+    }
+    void real(double& value) { raw(value); }
+    void text(std::string& value) {
+        size_t size = 0;
+        integer(size);
+        if (!fits(size)) return;
+        value.assign((const char*)cursor, size);
+        cursor += size;
+    }
+    void reals(std::vector<double>& values) {
+        count(values);
+        for (double& value : values) real(value);
+    }
+    void integers(std::vector<int>& values) {
+        count(values);
+        for (int& value : values) integer(value);
+    }
+    void texts(std::vector<std::string>& values) {
+        count(values);
+        for (std::string& value : values) text(value);
+    }
+    void indices(std::map<std::string, int>& values) {
+        size_t size = 0;
+        integer(size);
+        if (!fits(size)) return;
+        values.clear();
+        for (size_t i = 0; i < size && ok; ++i) {
+            std::string key;
+            text(key);
+            integer(values[key]);
+        }
+    }
+    //every element takes at least a byte, so a count past the end is corrupt
+    template <typename V>
+    size_t count(V& values) {
+        size_t size = 0;
+        integer(size);
+        if (!fits(size)) return 0;
+        values.clear();
+        values.resize(size);
+        return size;
+    }
+    void value(tinygltf::Value& value, int depth = 0);
+    void extensions(tinygltf::ExtensionMap& values) {
+        size_t size = 0;
+        integer(size);
+        if (!fits(size)) return;
+        values.clear();
+        for (size_t i = 0; i < size && ok; ++i) {
+            std::string key;
+            text(key);
+            value(values[key]);
+        }
+    }
+    void parameters(tinygltf::ParameterMap& values);
+
+private:
+    bool fits(size_t size) {
+        if (ok && size <= (size_t)(end - cursor)) return true;
+        ok = false;
+        return false;
+    }
+    template <typename T>
+    bool raw(T& value) {
+        if (!fits(sizeof(T))) return false;
+        memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+};
+
+
+// tagged: 0 null, 1 bool, 2 int, 3 real, 4 string, 5 array, 6 object
+void GLTF_BakedScene::Writer::value(const tinygltf::Value& value) {
+    if (value.IsBool()) {
+        integer(1);
+        integer(value.Get<bool>());
+    }
+    else if (value.IsInt()) {
+        integer(2);
+        integer(value.Get<int>());
+    }
+    else if (value.IsReal()) {
+        integer(3);
+        real(value.Get<double>());
+    }
+    else if (value.IsString()) {
+        integer(4);
+        text(value.Get<std::string>());
+    }
+    else if (value.IsArray()) {
+        integer(5);
+        integer(value.ArrayLen());
+        for (size_t i = 0; i < value.ArrayLen(); ++i) {
+            this->value(value.Get((int)i));
+        }
+    }
+    else if (value.IsObject()) {
+        integer(6);
+        std::vector<std::string> keys = value.Keys();
+        integer(keys.size());
+        for (const std::string& key : keys) {
+            text(key);
+            this->value(value.Get(key));
+        }
+    }
+    else {
+        integer(0);
+    }
+}
+
+void GLTF_BakedScene::Reader::value(tinygltf::Value& value, int depth) {
+    int tag = 0;
+    integer(tag);
+    if (!ok || depth > 64) {
+        ok = false;
+        return;
+    }
+    switch (tag) {
+    case 1: {
+        bool stored = false;
+        integer(stored);
+        value = tinygltf::Value(stored);
+        break;
+    }
+    case 2: {
+        int stored = 0;
+        integer(stored);
+        value = tinygltf::Value(stored);
+        break;
+    }
+    case 3: {
+        double stored = 0.0;
+        real(stored);
+        value = tinygltf::Value(stored);
+        break;
+    }
+    case 4: {
+        std::string stored;
+        text(stored);
+        value = tinygltf::Value(stored);
+        break;
+    }
+    case 5: {
+        tinygltf::Value::Array stored;
+        count(stored);
+        for (tinygltf::Value& element : stored) {
+            this->value(element, depth + 1);
+        }
+        value = tinygltf::Value(std::move(stored));
+        break;
+    }
+    case 6: {
+        size_t size = 0;
+        integer(size);
+        if (!fits(size)) return;
+        tinygltf::Value::Object stored;
+        for (size_t i = 0; i < size && ok; ++i) {
+            std::string key;
+            text(key);
+            this->value(stored[key], depth + 1);
+        }
+        value = tinygltf::Value(std::move(stored));
+        break;
+    }
+    default:
+        value = tinygltf::Value();
+        break;
+    }
+}
+
+void GLTF_BakedScene::Writer::parameters(const tinygltf::ParameterMap& values) {
+    integer(values.size());
+    for (auto& entry : values) {
+        const tinygltf::Parameter& parameter = entry.second;
+        text(entry.first);
+        integer(parameter.bool_value);
+        integer(parameter.has_number_value);
+        text(parameter.string_value);
+        reals(parameter.number_array);
+        integer(parameter.json_double_value.size());
+        for (auto& number : parameter.json_double_value) {
+            text(number.first);
+            real(number.second);
+        }
+        real(parameter.number_value);
+    }
+}
+
+void GLTF_BakedScene::Reader::parameters(tinygltf::ParameterMap& values) {
+    size_t size = 0;
+    integer(size);
+    if (!fits(size)) return;
+    values.clear();
+    for (size_t i = 0; i < size && ok; ++i) {
+        std::string key;
+        text(key);
+        tinygltf::Parameter& parameter = values[key];
+        integer(parameter.bool_value);
+        integer(parameter.has_number_value);
+        text(parameter.string_value);
+        reals(parameter.number_array);
+        size_t numbers = 0;
+        integer(numbers);
+        if (!fits(numbers)) return;
+        for (size_t n = 0; n < numbers && ok; ++n) {
+            std::string name;
+            text(name);
+            real(parameter.json_double_value[name]);
+        }
+        real(parameter.number_value);
+    }
+}
+
+template <typename Stream, typename Model>
+void GLTF_BakedScene::transfer(Stream& s, Model& model) {
+    s.integer(model.defaultScene);
+    s.texts(model.extensionsUsed);
+    s.texts(model.extensionsRequired);
+    s.count(model.accessors);
+    for (auto& accessor : model.accessors) {
+        s.integer(accessor.bufferView);
+        s.text(accessor.name);
+        s.integer(accessor.byteOffset);
+        s.integer(accessor.normalized);
+        s.integer(accessor.componentType);
+        s.integer(accessor.count);
+        s.integer(accessor.type);
+        s.reals(accessor.minValues);
+        s.reals(accessor.maxValues);
+        s.integer(accessor.sparse.count);
+        s.integer(accessor.sparse.isSparse);
+        s.integer(accessor.sparse.indices.byteOffset);
+        s.integer(accessor.sparse.indices.bufferView);
+        s.integer(accessor.sparse.indices.componentType);
+        s.integer(accessor.sparse.values.bufferView);
+        s.integer(accessor.sparse.values.byteOffset);
+        s.extensions(accessor.extensions);
+    }
+    s.count(model.bufferViews);
+    for (auto& view : model.bufferViews) {
+        s.text(view.name);
+        s.integer(view.buffer);
+        s.integer(view.byteOffset);
+        s.integer(view.byteLength);
+        s.integer(view.byteStride);
+        s.integer(view.target);
+    }
+    s.count(model.buffers);
+    for (auto& buffer : model.buffers) {
+        s.text(buffer.name);
+        s.text(buffer.uri);
+    }
+    s.count(model.meshes);
+    for (auto& mesh : model.meshes) {
+        s.text(mesh.name);
+        s.reals(mesh.weights);
+        s.count(mesh.primitives);
+        for (auto& primitive : mesh.primitives) {
+            s.indices(primitive.attributes);
+            s.integer(primitive.material);
+            s.integer(primitive.indices);
+            s.integer(primitive.mode);
+            s.count(primitive.targets);
+            for (auto& target : primitive.targets) {
+                s.indices(target);
+            }
+            s.extensions(primitive.extensions);
+        }
+        s.extensions(mesh.extensions);
+    }
+    s.count(model.nodes);
+    for (auto& node : model.nodes) {
+        s.text(node.name);
+        s.integer(node.camera);
+        s.integer(node.skin);
+        s.integer(node.mesh);
+        s.integer(node.light);
+        s.integers(node.children);
+        s.reals(node.rotation);
+        s.reals(node.scale);
+        s.reals(node.translation);
+        s.reals(node.matrix);
+        s.reals(node.weights);
+        s.extensions(node.extensions);
+    }
+    s.count(model.materials);
+    for (auto& material : model.materials) {
+        s.text(material.name);
+        s.reals(material.emissiveFactor);
+        s.text(material.alphaMode);
+        s.real(material.alphaCutoff);
+        s.integer(material.doubleSided);
+        s.reals(material.pbrMetallicRoughness.baseColorFactor);
+        s.integer(material.pbrMetallicRoughness.baseColorTexture.index);
+        s.integer(material.pbrMetallicRoughness.baseColorTexture.texCoord);
+        s.real(material.pbrMetallicRoughness.metallicFactor);
+        s.real(material.pbrMetallicRoughness.roughnessFactor);
+        s.integer(material.pbrMetallicRoughness.metallicRoughnessTexture.index);
+        s.integer(material.pbrMetallicRoughness.metallicRoughnessTexture.texCoord);
+        s.integer(material.normalTexture.index);
+        s.integer(material.normalTexture.texCoord);
+        s.real(material.normalTexture.scale);
+        s.integer(material.occlusionTexture.index);
+        s.integer(material.occlusionTexture.texCoord);
+        s.real(material.occlusionTexture.strength);
+        s.integer(material.emissiveTexture.index);
+        s.integer(material.emissiveTexture.texCoord);
+        s.parameters(material.values);
+        s.parameters(material.additionalValues);
+        s.extensions(material.extensions);
+    }
+    s.count(model.textures);
+    for (auto& texture : model.textures) {
+        s.text(texture.name);
+        s.integer(texture.sampler);
+        s.integer(texture.source);
+        s.extensions(texture.extensions);
+    }
+    s.count(model.samplers);
+    for (auto& sampler : model.samplers) {
+        s.text(sampler.name);
+        s.integer(sampler.minFilter);
+        s.integer(sampler.magFilter);
+        s.integer(sampler.wrapS);
+        s.integer(sampler.wrapT);
+    }
+    //image metadata only, the pixels are baked separately
+    s.count(model.images);
+    for (auto& image : model.images) {
+        s.text(image.name);
+        s.integer(image.width);
+        s.integer(image.height);
+        s.integer(image.component);
+        s.integer(image.bits);
+        s.integer(image.pixel_type);
+        s.integer(image.bufferView);
+        s.text(image.mimeType);
+        s.text(image.uri);
+    }
+    s.count(model.scenes);
+    for (auto& scene : model.scenes) {
+        s.text(scene.name);
+        s.integers(scene.nodes);
+    }
+    s.count(model.lights);
+    for (auto& light : model.lights) {
+        s.text(light.name);
+        s.text(light.type);
+        s.reals(light.color);
+        s.real(light.intensity);
+        s.real(light.range);
+        s.real(light.spot.innerConeAngle);
+        s.real(light.spot.outerConeAngle);
+    }
+    s.count(model.skins);
+    for (auto& skin : model.skins) {
+        s.text(skin.name);
+        s.integer(skin.inverseBindMatrices);
+        s.integer(skin.skeleton);
+        s.integers(skin.joints);
+    }
+    s.count(model.animations);
+    for (auto& animation : model.animations) {
+        s.text(animation.name);
+        s.count(animation.channels);
+        for (auto& channel : animation.channels) {
+            s.integer(channel.sampler);
+            s.integer(channel.target_node);
+            s.text(channel.target_path);
+        }
+        s.count(animation.samplers);
+        for (auto& sampler : animation.samplers) {
+            s.integer(sampler.input);
+            s.integer(sampler.output);
+            s.text(sampler.interpolation);
+        }
+    }
+}
+
+std::string GLTF_BakedScene::pathFor(const std::string& source, const std::string& directory) {
+    if (directory.empty()) return source + ".bake";
+    //files of the same name in different folders must not share a blob
+    std::error_code error;
+    std::string canonical = std::filesystem::weakly_canonical(source, error).string();
+    if (error) canonical = source;
+    uint64_t hash = gltfHashBytes((const unsigned char*)canonical.data(), canonical.size());
+    return directory + "/" + std::filesystem::path(source).filename().string() + "." + std::to_string(hash) + ".bake";
+}
+
+bool GLTF_BakedScene::stamp(Dependency& dependency) {
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(dependency.path, error);
+    if (error) return false;
+    std::filesystem::file_time_type time = std::filesystem::last_write_time(dependency.path, error);
+    if (error) return false;
+    dependency.size = (uint64_t)size;
+    dependency.time = (int64_t)time.time_since_epoch().count();
+    return true;
+}
+
+bool GLTF_BakedScene::write(const std::string& bakedPath, const std::string& source, const std::string& contentKey, uint64_t options,
+    const tinygltf::Model& model, const GLTF_BufferData& data, const std::vector<GLTF_TextureData>& images,
+    const std::vector<std::string>& textureKeys) {
+    //the file itself plus every external buffer and image it names
+    std::vector<Dependency> dependencies(1);
+    dependencies[0].path = source;
+    size_t slash = source.find_last_of("/\\");
+    std::string baseDir = slash == std::string::npos ? "" : source.substr(0, slash + 1);
+    for (const tinygltf::Buffer& buffer : model.buffers) {
+        if (buffer.uri.empty() || buffer.uri.compare(0, 5, "data:") == 0) continue;
+        dependencies.push_back(Dependency());
+        dependencies.back().path = baseDir + GLTF_BufferData::decodeUri(buffer.uri);
+    }
+    for (const tinygltf::Image& image : model.images) {
+        if (image.uri.empty() || image.uri.compare(0, 5, "data:") == 0) continue;
+        dependencies.push_back(Dependency());
+        dependencies.back().path = baseDir + GLTF_BufferData::decodeUri(image.uri);
+    }
+    for (Dependency& dependency : dependencies) {
+        if (!stamp(dependency)) return false;
+    }
+
+    //payload offsets first, the table stream records them
+    const uint64_t alignment = 16;
+    uint64_t offset = sizeof(Header);
+    auto place = [&](size_t size) {
+        offset = (offset + alignment - 1) / alignment * alignment;
+        uint64_t placed = offset;
+        offset += size;
+        return placed;
+    };
+    std::vector<uint64_t> bufferOffsets(model.buffers.size());
+    for (size_t i = 0; i < model.buffers.size(); ++i) {
+        bufferOffsets[i] = place(data.size((int)i));
+    }
+    std::vector<uint64_t> imageOffsets(images.size());
+    for (size_t i = 0; i < images.size(); ++i) {
+        imageOffsets[i] = place(images[i].size());
+    }
+
+    Writer table;
+    table.text(contentKey);
+    table.integer(dependencies.size());
+    for (const Dependency& dependency : dependencies) {
+        table.text(dependency.path);
+        table.integer(dependency.size);
+        table.integer(dependency.time);
+    }
+    transfer(table, model);
+    for (size_t i = 0; i < model.buffers.size(); ++i) {
+        table.integer(bufferOffsets[i]);
+        table.integer(data.size((int)i));
+    }
+    table.integer(images.size());
+    for (size_t i = 0; i < images.size(); ++i) {
+        const GLTF_TextureData& image = images[i];
+        table.integer(image.internalFormat);
+        table.integer(image.format);
+        table.integer(image.type);
+        table.integer(image.compressed);
+        table.integer(image.components);
+        table.integer(image.greyscale);
+        table.integer(image.levels.size());
+        for (const GLTF_TextureData::Level& level : image.levels) {
+            table.integer(level.width);
+            table.integer(level.height);
+            table.integer(level.offset);
+            table.integer(level.size);
+        }
+        table.integer(imageOffsets[i]);
+        table.integer(image.size());
+    }
+    table.texts(textureKeys);
+
+    Header header;
+    memcpy(header.magic, "GLTFBAKE", 8);
+    header.version = formatVersion;
+    header.reserved = 0;
+    header.options = options;
+    header.tableOffset = place(table.bytes.size());
+    header.tableSize = table.bytes.size();
+
+    //written aside and renamed, a reader never maps half a blob
+    std::string temporary = bakedPath + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        uint64_t written = 0;
+        auto put = [&](uint64_t at, const unsigned char* bytes, size_t size) {
+            static const char zeros[16] = {};
+            out.write(zeros, (std::streamsize)(at - written));
+            if (size) out.write((const char*)bytes, (std::streamsize)size);
+            written = at + size;
+        };
+        put(0, (const unsigned char*)&header, sizeof(header));
+        for (size_t i = 0; i < model.buffers.size(); ++i) {
+            put(bufferOffsets[i], data.data((int)i), data.size((int)i));
+        }
+        for (size_t i = 0; i < images.size(); ++i) {
+            put(imageOffsets[i], images[i].data(), images[i].size());
+        }
+        put(header.tableOffset, table.bytes.data(), table.bytes.size());
+        if (!out) return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, bakedPath, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+bool GLTF_BakedScene::read(const std::string& bakedPath, uint64_t options, tinygltf::Model& model, GLTF_BufferData& data,
+    std::vector<GLTF_TextureData>& images, std::vector<std::string>& textureKeys, std::string& contentKey) {
+    std::shared_ptr<GLTF_MappedFile> file = std::make_shared<GLTF_MappedFile>();
+    if (!file->open(bakedPath) || file->size() < sizeof(Header)) return false;
+    Header header;
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, "GLTFBAKE", 8) != 0 || header.version != formatVersion || header.options != options) return false;
+    if (header.tableOffset > file->size() || header.tableSize > file->size() - header.tableOffset) return false;
+
+    Reader table(file->data() + header.tableOffset, (size_t)header.tableSize);
+    table.text(contentKey);
+    std::vector<Dependency> dependencies;
+    table.count(dependencies);
+    for (Dependency& dependency : dependencies) {
+        table.text(dependency.path);
+        table.integer(dependency.size);
+        table.integer(dependency.time);
+        Dependency current;
+        current.path = dependency.path;
+        if (!table.ok || !stamp(current) || current.size != dependency.size || current.time != dependency.time) return false;
+    }
+
+    tinygltf::Model baked;
+    transfer(table, baked);
+    //every payload has to lie inside the mapping
+    auto inside = [&](uint64_t offset, uint64_t size) { return offset <= file->size() && size <= file->size() - offset; };
+    std::vector<const unsigned char*> pointers(baked.buffers.size());
+    std::vector<size_t> sizes(baked.buffers.size());
+    for (size_t i = 0; i < baked.buffers.size(); ++i) {
+        uint64_t offset = 0, size = 0;
+        table.integer(offset);
+        table.integer(size);
+        if (!table.ok || !inside(offset, size)) return false;
+        pointers[i] = file->data() + offset;
+        sizes[i] = (size_t)size;
+    }
+    std::vector<GLTF_TextureData> bakedImages;
+    table.count(bakedImages);
+    for (GLTF_TextureData& image : bakedImages) {
+        table.integer(image.internalFormat);
+        table.integer(image.format);
+        table.integer(image.type);
+        table.integer(image.compressed);
+        table.integer(image.components);
+        table.integer(image.greyscale);
+        table.count(image.levels);
+        for (GLTF_TextureData::Level& level : image.levels) {
+            table.integer(level.width);
+            table.integer(level.height);
+            table.integer(level.offset);
+            table.integer(level.size);
+        }
+        uint64_t offset = 0, size = 0;
+        table.integer(offset);
+        table.integer(size);
+        if (!table.ok || !inside(offset, size)) return false;
+        for (const GLTF_TextureData::Level& level : image.levels) {
+            if (level.offset > size || level.size > size - level.offset) return false;
+        }
+        image.mapped = file->data() + offset;
+        image.mappedSize = (size_t)size;
+        image.keepAlive = file;
+    }
+    table.texts(textureKeys);
+    if (!table.ok) return false;
+
+    model = std::move(baked);
+    data.assign(file, pointers, sizes);
+    images = std::move(bakedImages);
+    return true;
+}
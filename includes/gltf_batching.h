@@ -0,0 +1,514 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <tiny_gltf.h>
+#include "gltf_accessor.h"
+#include "gltf_file.h"
+#include "gltf_jobs.h"
+#include "gltf_trace.h"
+#include "gltf_transforms.h"
+#include "gltf_vertex.h"
+
+
+// load-time static batching for scenes of many small unique nodes: the primitives of static
+// nodes are transformed into world space and merged, by material and vertex format, into large
+// indexed primitives of one new mesh under a new root node of the default scene. each merged
+// primitive is one draw with its own bounds for culling, its parts chosen close together.
+// static means no animation channel, skin, morph target or GPU instancing on the node or
+// above it. node extras {"static": false} keep a subtree out, {"static": true} let a mesh in
+// that other nodes draw too, which is left to instancing otherwise. batched nodes stay in the
+// scene without their primitives, so moving them later moves nothing. blended materials
+// are left out, their draws are sorted back to front one at a time
+class GLTF_StaticBatcher
+{
+public:
+    struct Settings {
+        bool enabled = false;
+        bool sharedMeshes = false;      //also merge meshes that several static nodes draw
+        uint32_t maxVertices = 65536;   //per batch, larger ones need 32 bit indices
+        uint32_t mask() const { return enabled ? 1u | (sharedMeshes ? 2u : 0u) : 0u; }
+        //the limit batches were cut at, part of a baked scene's options next to mask()
+        uint32_t vertexLimit() const { return enabled ? maxVertices : 0u; }
+    };
+    struct Report {
+        size_t nodes = 0;               //static nodes whose primitives were merged
+        size_t primitives = 0;          //node primitives merged
+        size_t batches = 0;
+        size_t drawsBefore = 0;         //one per primitive of every node of the default scene
+        size_t drawsAfter = 0;
+        size_t bytes = 0;               //vertex and index data of the batches
+    };
+
+    //merge the static primitives of the default scene, the batches are built on GLTF_ThreadPool::shared()
+    static void batch(tinygltf::Model& model, GLTF_BufferData& data, const Settings& settings, Report& report);
+
+private:
+    struct Attribute {
+        std::string semantic;
+        int type;
+        int componentType;
+        bool normalized;
+        size_t elementSize;
+        size_t offset;                  //in the vertex
+    };
+    struct Item {
+        int slot;
+        int mesh;
+        int primitive;
+        size_t vertices;
+        uint32_t order;                 //Morton code of the world box center
+    };
+    //primitives of one material and vertex format
+    struct Group {
+        int material = -1;
+        std::vector<Attribute> attributes;
+        size_t stride = 0;
+        std::vector<Item> items;
+        glm::vec3 min = glm::vec3(1e30f);
+        glm::vec3 max = glm::vec3(-1e30f);
+    };
+    //one merged primitive
+    struct Batch {
+        const Group* group = nullptr;
+        size_t first = 0;               //items of the group
+        size_t end = 0;
+        size_t vertices = 0;
+        std::vector<uint8_t> merged;    //by item, those that could not be read stay where they are
+        std::vector<unsigned char> vertexBytes;
+        std::vector<uint32_t> indices;
+        glm::vec3 min = glm::vec3(1e30f);
+        glm::vec3 max = glm::vec3(-1e30f);
+        bool built = false;
+    };
+
+    static bool markedStatic(const tinygltf::Node& node, bool& value);
+    static bool batchable(const tinygltf::Model& model, const tinygltf::Primitive& primitive);
+    static uint32_t morton(const glm::vec3& unit);
+    static void build(const tinygltf::Model& model, const GLTF_BufferData& data, const GLTF_Transforms& transforms, Batch& batch);
+    static bool append(const tinygltf::Model& model, const GLTF_BufferData& data, const GLTF_Transforms& transforms, const Item& item,
+        Batch& batch, size_t base);
+};
+
+
+bool GLTF_StaticBatcher::markedStatic(const tinygltf::Node& node, bool& value) {
+    if (!node.extras.IsObject() || !node.extras.Has("static")) return false;
+    const tinygltf::Value& marked = node.extras.Get("static");
+    if (!marked.IsBool()) return false;
+    value = marked.Get<bool>();
+    return true;
+}
+
+// indexed or not triangle lists whose positions, normals and tangents are floats to transform
+bool GLTF_StaticBatcher::batchable(const tinygltf::Model& model, const tinygltf::Primitive& primitive) {
+    if (primitive.mode != -1 && primitive.mode != TINYGLTF_MODE_TRIANGLES) return false;
+    if (!primitive.targets.empty() || !primitive.attributes.count("POSITION")) return false;
+    if (primitive.material >= (int)model.materials.size()) return false;
+    if (primitive.material >= 0 && model.materials[primitive.material].alphaMode == "BLEND") return false;
+    if (primitive.indices >= (int)model.accessors.size()) return false;
+    size_t count = 0;
+    for (auto& attrib : primitive.attributes) {
+        if (GLTF_VertexFormat::location(attrib.first) < 0) continue;
+        if (attrib.second < 0 || attrib.second >= (int)model.accessors.size()) return false;
+        const tinygltf::Accessor& accessor = model.accessors[attrib.second];
+        if (count && accessor.count != count) return false;
+        count = accessor.count;
+        bool transformed = attrib.first == "POSITION" || attrib.first == "NORMAL" || attrib.first == "TANGENT";
+        if (transformed && accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) return false;
+        if ((attrib.first == "POSITION" || attrib.first == "NORMAL") && accessor.type != TINYGLTF_TYPE_VEC3) return false;
+        if (attrib.first == "TANGENT" && accessor.type != TINYGLTF_TYPE_VEC4) return false;
+    }
+    return count > 0;
+}
+
+// 10 bits per axis interleaved, coordinates in [0, 1]
+uint32_t GLTF_StaticBatcher::morton(const glm::vec3& unit) {
+    auto spread = [](float value) {
+        uint32_t x = (uint32_t)std::min(std::max(value * 1023.0f, 0.0f), 1023.0f);
+        x = (x | (x << 16)) & 0x030000FF;
+        x = (x | (x << 8)) & 0x0300F00F;
+        x = (x | (x << 4)) & 0x030C30C3;
+        x = (x | (x << 2)) & 0x09249249;
+        return x;
+    };
+    return spread(unit.x) | (spread(unit.y) << 1) | (spread(unit.z) << 2);
+}
+
+void GLTF_StaticBatcher::batch(tinygltf::Model& model, GLTF_BufferData& data, const Settings& settings, Report& report) {
+    report = Report();
+    if (!settings.enabled || model.scenes.empty()) return;
+    int sceneIndex = model.defaultScene >= 0 && model.defaultScene < (int)model.scenes.size() ? model.defaultScene : 0;
+    GLTF_Transforms transforms;
+    transforms.build(model, sceneIndex);
+
+    //a node is dynamic when it or a node above it is animated, skinned, morphed or instanced
+    std::vector<uint8_t> animated(model.nodes.size(), 0);
+    for (const tinygltf::Animation& animation : model.animations) {
+        for (const tinygltf::AnimationChannel& channel : animation.channels) {
+            if (channel.target_node >= 0 && channel.target_node < (int)model.nodes.size()) animated[channel.target_node] = 1;
+        }
+    }
+    std::vector<uint8_t> dynamic(transforms.size(), 0);
+    std::vector<uint8_t> forced(transforms.size(), 0);
+    for (int slot = 0; slot < (int)transforms.size(); ++slot) {
+        int nodeIndex = transforms.node(slot);
+        const tinygltf::Node& node = model.nodes[nodeIndex];
+        bool marked = false;
+        bool hasMark = markedStatic(node, marked);
+        int parent = transforms.parent(slot);
+        dynamic[slot] = (parent >= 0 && dynamic[parent]) || animated[nodeIndex] || node.skin >= 0 || !node.weights.empty() ||
+            node.extensions.count("EXT_mesh_gpu_instancing") || (hasMark && !marked);
+        forced[slot] = hasMark && marked;
+        if (node.mesh >= 0 && node.mesh < (int)model.meshes.size()) report.drawsBefore += model.meshes[node.mesh].primitives.size();
+    }
+
+    //a mesh is merged when every node drawing it is a static node of the scene, and only
+    //one node draws it unless shared meshes are allowed or the nodes are marked static
+    std::vector<int> users(model.meshes.size(), 0);
+    std::vector<int> staticUsers(model.meshes.size(), 0);
+    std::vector<int> forcedUsers(model.meshes.size(), 0);
+    for (const tinygltf::Node& node : model.nodes) {
+        if (node.mesh >= 0 && node.mesh < (int)model.meshes.size()) users[node.mesh]++;
+    }
+    //other scenes still draw the meshes of their nodes as they are
+    for (int other = 0; other < (int)model.scenes.size(); ++other) {
+        if (other == sceneIndex) continue;
+        GLTF_Transforms scene;
+        scene.build(model, other);
+        for (int slot = 0; slot < (int)scene.size(); ++slot) {
+            int mesh = model.nodes[scene.node(slot)].mesh;
+            if (mesh >= 0 && mesh < (int)model.meshes.size()) users[mesh] = -1;
+        }
+    }
+    for (int slot = 0; slot < (int)transforms.size(); ++slot) {
+        int mesh = model.nodes[transforms.node(slot)].mesh;
+        if (mesh < 0 || mesh >= (int)model.meshes.size() || dynamic[slot]) continue;
+        staticUsers[mesh]++;
+        if (forced[slot]) forcedUsers[mesh]++;
+    }
+    std::vector<uint8_t> mergedMesh(model.meshes.size(), 0);
+    for (size_t mesh = 0; mesh < model.meshes.size(); ++mesh) {
+        if (staticUsers[mesh] == 0 || staticUsers[mesh] != users[mesh]) continue;
+        mergedMesh[mesh] = users[mesh] == 1 || settings.sharedMeshes || forcedUsers[mesh] == users[mesh];
+    }
+
+    //group the primitives by material and vertex format
+    std::map<std::tuple<int, std::vector<std::tuple<std::string, int, int, bool>>>, size_t> groupIndex;
+    std::vector<Group> groups;
+    for (int slot = 0; slot < (int)transforms.size(); ++slot) {
+        int mesh = model.nodes[transforms.node(slot)].mesh;
+        if (mesh < 0 || mesh >= (int)model.meshes.size() || !mergedMesh[mesh]) continue;
+        const std::vector<tinygltf::Primitive>& primitives = model.meshes[mesh].primitives;
+        for (int p = 0; p < (int)primitives.size(); ++p) {
+            const tinygltf::Primitive& primitive = primitives[p];
+            if (!batchable(model, primitive)) continue;
+            std::vector<std::pair<int, std::string>> order;
+            for (auto& attrib : primitive.attributes) {
+                int location = GLTF_VertexFormat::location(attrib.first);
+                if (location >= 0) order.push_back({ location, attrib.first });
+            }
+            std::sort(order.begin(), order.end());
+            std::vector<std::tuple<std::string, int, int, bool>> format;
+            for (auto& entry : order) {
+                const tinygltf::Accessor& accessor = model.accessors[primitive.attributes.at(entry.second)];
+                format.push_back(std::make_tuple(entry.second, accessor.type, accessor.componentType, accessor.normalized));
+            }
+            auto key = std::make_tuple(primitive.material, format);
+            auto found = groupIndex.find(key);
+            if (found == groupIndex.end()) {
+                found = groupIndex.insert({ key, groups.size() }).first;
+                groups.emplace_back();
+                Group& group = groups.back();
+                group.material = primitive.material;
+                for (auto& element : format) {
+                    Attribute attribute;
+                    attribute.semantic = std::get<0>(element);
+                    attribute.type = std::get<1>(element);
+                    attribute.componentType = std::get<2>(element);
+                    attribute.normalized = std::get<3>(element);
+                    attribute.elementSize = gltfComponentCount(attribute.type) * tinygltf::GetComponentSizeInBytes(attribute.componentType);
+                    attribute.offset = group.stride;
+                    group.stride += (attribute.elementSize + 3) & ~(size_t)3;
+                    group.attributes.push_back(attribute);
+                }
+            }
+            const tinygltf::Accessor& position = model.accessors[primitive.attributes.at("POSITION")];
+            Item item = { slot, mesh, p, position.count, 0 };
+            if (item.vertices > settings.maxVertices) continue;
+            groups[found->second].items.push_back(item);
+        }
+    }
+
+    //items in Morton order of their world box centers, cut into batches by vertex count
+    std::vector<Batch> batches;
+    for (Group& group : groups) {
+        std::vector<glm::vec3> centers(group.items.size());
+        for (size_t i = 0; i < group.items.size(); ++i) {
+            const Item& item = group.items[i];
+            const tinygltf::Accessor& position = model.accessors[model.meshes[item.mesh].primitives[item.primitive].attributes.at("POSITION")];
+            glm::vec3 center(0.0f);
+            if (position.minValues.size() >= 3 && position.maxValues.size() >= 3) {
+                center = glm::vec3((position.minValues[0] + position.maxValues[0]) * 0.5, (position.minValues[1] + position.maxValues[1]) * 0.5,
+                    (position.minValues[2] + position.maxValues[2]) * 0.5);
+            }
+            centers[i] = glm::vec3(transforms.world(item.slot) * glm::vec4(center, 1.0f));
+            group.min = glm::min(group.min, centers[i]);
+            group.max = glm::max(group.max, centers[i]);
+        }
+        glm::vec3 size = glm::max(group.max - group.min, glm::vec3(1e-6f));
+        for (size_t i = 0; i < group.items.size(); ++i) {
+            group.items[i].order = morton((centers[i] - group.min) / size);
+        }
+        std::stable_sort(group.items.begin(), group.items.end(), [](const Item& a, const Item& b) { return a.order < b.order; });
+        size_t first = 0;
+        size_t vertices = 0;
+        for (size_t i = 0; i <= group.items.size(); ++i) {
+            if (i < group.items.size() && vertices + group.items[i].vertices <= settings.maxVertices) {
+                vertices += group.items[i].vertices;
+                continue;
+            }
+            //a batch of one primitive draws as often as before, unless other nodes' copies are batched
+            if (i - first > 1 || (i > first && users[group.items[first].mesh] > 1)) {
+                Batch batch;
+                batch.group = &group;
+                batch.first = first;
+                batch.end = i;
+                batch.vertices = vertices;
+                batches.push_back(std::move(batch));
+            }
+            first = i;
+            vertices = i < group.items.size() ? group.items[i].vertices : 0;
+        }
+    }
+    if (batches.empty()) {
+        report.drawsAfter = report.drawsBefore;
+        return;
+    }
+    GLTF_ThreadPool::shared().parallelFor(batches.size(), [&](size_t i) {
+        build(model, data, transforms, batches[i]);
+    });
+
+    //one new buffer: per batch a vertex view at the batch's stride and an index view
+    int buffer = (int)model.buffers.size();
+    std::vector<unsigned char> bytes;
+    tinygltf::Mesh merged;
+    merged.name = "static batches";
+    std::vector<std::vector<uint8_t>> removed(model.meshes.size());
+    std::vector<uint8_t> slotMerged(transforms.size(), 0);
+    for (Batch& batch : batches) {
+        if (!batch.built) continue;
+        const Group& group = *batch.group;
+        size_t offset = (bytes.size() + 15) & ~(size_t)15;
+        bytes.resize(offset);
+        bytes.insert(bytes.end(), batch.vertexBytes.begin(), batch.vertexBytes.end());
+        std::vector<unsigned char>().swap(batch.vertexBytes);
+        tinygltf::BufferView vertexView;
+        vertexView.buffer = buffer;
+        vertexView.byteOffset = offset;
+        vertexView.byteLength = batch.vertices * group.stride;
+        vertexView.byteStride = group.stride;
+        vertexView.target = TINYGLTF_TARGET_ARRAY_BUFFER;
+        model.bufferViews.push_back(vertexView);
+
+        tinygltf::Primitive primitive;
+        primitive.material = group.material;
+        primitive.mode = TINYGLTF_MODE_TRIANGLES;
+        for (const Attribute& attribute : group.attributes) {
+            tinygltf::Accessor accessor;
+            accessor.bufferView = (int)model.bufferViews.size() - 1;
+            accessor.byteOffset = attribute.offset;
+            accessor.componentType = attribute.componentType;
+            accessor.normalized = attribute.normalized;
+            accessor.type = attribute.type;
+            accessor.count = batch.vertices;
+            if (attribute.semantic == "POSITION") {
+                //the batch's bounds, for culling
+                accessor.minValues = { batch.min.x, batch.min.y, batch.min.z };
+                accessor.maxValues = { batch.max.x, batch.max.y, batch.max.z };
+            }
+            primitive.attributes[attribute.semantic] = (int)model.accessors.size();
+            model.accessors.push_back(accessor);
+        }
+
+        bool wide = batch.vertices > 65536;
+        size_t indexSize = wide ? 4 : 2;
+        offset = (bytes.size() + 15) & ~(size_t)15;
+        bytes.resize(offset + batch.indices.size() * indexSize);
+        for (size_t i = 0; i < batch.indices.size(); ++i) {
+            if (wide) {
+                memcpy(bytes.data() + offset + i * 4, &batch.indices[i], 4);
+            }
+            else {
+                uint16_t index = (uint16_t)batch.indices[i];
+                memcpy(bytes.data() + offset + i * 2, &index, 2);
+            }
+        }
+        tinygltf::BufferView indexView;
+        indexView.buffer = buffer;
+        indexView.byteOffset = offset;
+        indexView.byteLength = batch.indices.size() * indexSize;
+        indexView.target = TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
+        model.bufferViews.push_back(indexView);
+        tinygltf::Accessor indexAccessor;
+        indexAccessor.bufferView = (int)model.bufferViews.size() - 1;
+        indexAccessor.componentType = wide ? TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT : TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT;
+        indexAccessor.type = TINYGLTF_TYPE_SCALAR;
+        indexAccessor.count = batch.indices.size();
+        primitive.indices = (int)model.accessors.size();
+        model.accessors.push_back(indexAccessor);
+        std::vector<uint32_t>().swap(batch.indices);
+        merged.primitives.push_back(primitive);
+
+        for (size_t i = batch.first; i < batch.end; ++i) {
+            if (!batch.merged[i - batch.first]) continue;
+            const Item& item = group.items[i];
+            std::vector<uint8_t>& meshRemoved = removed[item.mesh];
+            meshRemoved.resize(model.meshes[item.mesh].primitives.size(), 0);
+            meshRemoved[item.primitive] = 1;
+            slotMerged[item.slot] = 1;
+            report.primitives++;
+        }
+        report.batches++;
+    }
+    if (bytes.empty()) {
+        report.drawsAfter = report.drawsBefore;
+        return;
+    }
+
+    //merged primitives leave their meshes, shared ones for every node since all are batched
+    for (size_t mesh = 0; mesh < model.meshes.size(); ++mesh) {
+        if (removed[mesh].empty()) continue;
+        std::vector<tinygltf::Primitive>& primitives = model.meshes[mesh].primitives;
+        size_t kept = 0;
+        for (size_t p = 0; p < primitives.size(); ++p) {
+            if (!removed[mesh][p]) primitives[kept++] = primitives[p];
+        }
+        primitives.resize(kept);
+    }
+    for (int slot = 0; slot < (int)transforms.size(); ++slot) {
+        if (!slotMerged[slot]) continue;
+        tinygltf::Node& node = model.nodes[transforms.node(slot)];
+        if (model.meshes[node.mesh].primitives.empty()) node.mesh = -1;
+        report.nodes++;
+    }
+    model.meshes.push_back(merged);
+    tinygltf::Node root;
+    root.name = "static batches";
+    root.mesh = (int)model.meshes.size() - 1;
+    model.nodes.push_back(root);
+    model.scenes[sceneIndex].nodes.push_back((int)model.nodes.size() - 1);
+
+    report.drawsAfter = report.drawsBefore - report.primitives + report.batches;
+    report.bytes = bytes.size();
+    data.append(model, std::move(bytes));
+}
+
+// copy the vertices of the batch's primitives one after the other and offset their indices
+void GLTF_StaticBatcher::build(const tinygltf::Model& model, const GLTF_BufferData& data, const GLTF_Transforms& transforms,
+    Batch& batch) {
+    GLTF_TRACE_SCOPE("static batch", "load");
+    const Group& group = *batch.group;
+    batch.vertexBytes.assign(batch.vertices * group.stride, 0);
+    batch.indices.clear();
+    batch.merged.assign(batch.end - batch.first, 0);
+    size_t base = 0;
+    for (size_t i = batch.first; i < batch.end; ++i) {
+        const Item& item = group.items[i];
+        if (!append(model, data, transforms, item, batch, base)) continue;
+        batch.merged[i - batch.first] = 1;
+        base += item.vertices;
+    }
+    batch.vertices = base;
+    batch.vertexBytes.resize(base * group.stride);
+    batch.built = base > 0;
+}
+
+// one primitive at vertex base: positions, normals and tangents into world space. a mirroring
+// transform turns the triangles around so they keep facing out. false leaves the indices as
+// they were and the vertices to be overwritten
+bool GLTF_StaticBatcher::append(const tinygltf::Model& model, const GLTF_BufferData& data, const GLTF_Transforms& transforms,
+    const Item& item, Batch& batch, size_t base) {
+    const Group& group = *batch.group;
+    const tinygltf::Primitive& primitive = model.meshes[item.mesh].primitives[item.primitive];
+    const glm::mat4& world = transforms.world(item.slot);
+    glm::mat3 linear(world);
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(linear));
+    bool mirrored = glm::dot(glm::cross(linear[0], linear[1]), linear[2]) < 0.0f;
+
+    std::vector<unsigned char> values;
+    glm::vec3 min = batch.min;
+    glm::vec3 max = batch.max;
+    for (const Attribute& attribute : group.attributes) {
+        if (!gltfReadElements(model, data, primitive.attributes.at(attribute.semantic), values)) return false;
+        for (size_t v = 0; v < item.vertices; ++v) {
+            unsigned char* target = batch.vertexBytes.data() + (base + v) * group.stride + attribute.offset;
+            const unsigned char* source = values.data() + v * attribute.elementSize;
+            if (attribute.semantic == "POSITION") {
+                float p[3];
+                memcpy(p, source, sizeof(p));
+                glm::vec3 position(world * glm::vec4(p[0], p[1], p[2], 1.0f));
+                min = glm::min(min, position);
+                max = glm::max(max, position);
+                memcpy(target, &position[0], 3 * sizeof(float));
+            }
+            else if (attribute.semantic == "NORMAL") {
+                float n[3];
+                memcpy(n, source, sizeof(n));
+                glm::vec3 normal = normalMatrix * glm::vec3(n[0], n[1], n[2]);
+                float length = glm::length(normal);
+                if (length > 0.0f) normal /= length;
+                memcpy(target, &normal[0], 3 * sizeof(float));
+            }
+            else if (attribute.semantic == "TANGENT") {
+                float t[4];
+                memcpy(t, source, sizeof(t));
+                glm::vec3 tangent = linear * glm::vec3(t[0], t[1], t[2]);
+                float length = glm::length(tangent);
+                if (length > 0.0f) tangent /= length;
+                float sign = mirrored ? -t[3] : t[3];
+                memcpy(target, &tangent[0], 3 * sizeof(float));
+                memcpy(target + 3 * sizeof(float), &sign, sizeof(float));
+            }
+            else {
+                memcpy(target, source, attribute.elementSize);
+            }
+        }
+    }
+
+    size_t first = batch.indices.size();
+    if (primitive.indices >= 0) {
+        if (!gltfReadElements(model, data, primitive.indices, values)) return false;
+        const tinygltf::Accessor& accessor = model.accessors[primitive.indices];
+        int size = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+        for (size_t k = 0; k + 2 < accessor.count; k += 3) {
+            for (int c = 0; c < 3; ++c) {
+                size_t index = gltfReadIndex(values.data() + (k + c) * size, accessor.componentType);
+                //an index past the vertices would reach into the next primitive
+                if (index >= item.vertices) {
+                    batch.indices.resize(first);
+                    return false;
+                }
+                batch.indices.push_back((uint32_t)(base + index));
+            }
+        }
+    }
+    else {
+        for (size_t v = 0; v + 2 < item.vertices; v += 3) {
+            for (int c = 0; c < 3; ++c) batch.indices.push_back((uint32_t)(base + v + c));
+        }
+    }
+    if (mirrored) {
+        for (size_t k = first; k + 2 < batch.indices.size(); k += 3) std::swap(batch.indices[k + 1], batch.indices[k + 2]);
+    }
+    batch.min = min;
+    batch.max = max;
+    return true;
+}
@@ -0,0 +1,508 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "gltf_gl.h"
+#include "gltf_lights.h"
+#include "gltf_loading.h"
+#include "gltf_trace.h"
+
+
+// load and draw benchmark: loads each asset, draws it for a number of frames and writes the
+// load phases, frame times and GL call counts as JSON. on the recording backend it needs no
+// GPU or window, so the whole executable is
+//     int main(int argc, char** argv) { return GLTF_Benchmark::main(argc, argv); }
+//     gltf_benchmark [--frames N] [--unsorted] [--stream BYTES] [--synthetic N] [--scaling] [--lights]
+//                    [--check N] [--out results.json] [--log calls.txt] [--trace trace.json] model.gltf ...
+// --unsorted submits in scene order, to compare the state changes of sorted submission with.
+// --stream loads every asset in streaming mode under that GPU budget, --synthetic N adds a
+// generated grid of N x N distinct meshes whose frames fly over it, so the streamer fetches
+// and evicts as cells come into view. --scaling draws the frames again with 1, 2, 4 ... threads
+// preparing them, up to the whole pool, for the speedup of the parallel frame preparation.
+// --lights times the clustered light assignment alone, on the CPU, for 10 to 10000 random
+// point and spot lights in front of a fixed camera, on one thread and on the whole pool.
+// --check N draws N nodes sharing one mesh headless and fails the run unless the compiled
+// scene draws them in one instanced call and the node tree in N calls.
+// the loader reports progress on stdout, --out keeps the JSON apart from it. peak resident
+// size is the process's high-water mark, so loaders are compared with one asset per run
+class GLTF_Benchmark
+{
+public:
+    struct Options {
+        std::vector<std::string> assets;
+        int frames = 100;
+        bool sortDraws = true;
+        bool recording = true;              //false draws through the driver, a context must be current
+        GLuint program = 1;                 //program handed to draw(), any name works when recording
+        std::string output;                 //JSON file, empty for stdout
+        std::string log;                    //every recorded GL call, one per line
+        std::string trace;                  //load and frame spans in the Chrome trace event format
+        size_t streamBudget = 0;            //stream under this many GPU bytes, 0 loads assets whole
+        std::string synthetic;              //generated scene, its frames move the view across it
+        int syntheticSize = 0;
+        bool scaling = false;               //repeat the frames with 1..N frame threads
+        bool lights = false;                //light assignment benchmark, needs no asset
+        int checkNodes = 0;                 //instancing check, needs no asset
+    };
+    struct Scaling {
+        size_t threads = 0;
+        double frameMean = 0.0;
+        double prepareMean = 0.0;           //DrawStats::prepareMilliseconds
+    };
+    struct Result {
+        std::string asset;
+        bool loaded = false;
+        double loadMilliseconds = 0.0;      //constructor, synchronous load with every upload
+        size_t peakResidentBytes = 0;       //of the process, after the load
+        GLTF_Model::LoadTimings phases;
+        GLTF_GL::Counters loadCalls;
+        int frames = 0;
+        double frameMean = 0.0;             //draw() CPU time in milliseconds
+        double frameMedian = 0.0;
+        double frame95 = 0.0;
+        double frameMax = 0.0;
+        double prepareMean = 0.0;           //CPU work before submission
+        GLTF_GL::Counters frameCalls;       //all frames together
+        GLTF_Model::DrawStats draw;         //of the last frame
+        GLTF_Model::CullingStats culling;
+        GLTF_Streamer::Stats streaming;     //after the last frame
+        std::vector<Scaling> scaling;
+    };
+    struct LightResult {
+        size_t lights = 0;
+        double serialMean = 0.0;            //milliseconds per assignment on one thread
+        double parallelMean = 0.0;          //on the whole pool
+        GLTF_LightClusters::Stats stats;    //of the last assignment
+    };
+
+    static Result run(const std::string& asset, const Options& options);
+    static std::vector<LightResult> runLights(const Options& options);
+    static void writeJson(std::ostream& out, const Options& options, const std::vector<Result>& results,
+        const std::vector<LightResult>& lights);
+    static int main(int argc, char** argv);
+    //size x size cubes of different sizes 2 units apart on the xz plane around the origin,
+    //each its own mesh with its own bufferViews, in a .gltf and a .bin next to it
+    static bool writeSyntheticScene(const std::string& path, int size);
+    //count nodes in a row, all drawing the same cube mesh
+    static bool writeInstancedScene(const std::string& path, int count);
+    //draws writeInstancedScene(count) on the recording backend: true when the compiled scene
+    //makes one draw call of count instances and the node tree count draw calls
+    static bool checkInstancing(int count);
+
+private:
+    static size_t peakResidentBytes();
+    static void writeCounters(std::ostream& out, const GLTF_GL::Counters& counters, double divisor);
+    static std::string quoted(const std::string& text);
+};
+
+
+GLTF_Benchmark::Result GLTF_Benchmark::run(const std::string& asset, const Options& options) {
+    Result result;
+    result.asset = asset;
+    result.frames = std::max(options.frames, 0);
+    GLTF_GL::Backend previous = GLTF_GL::backend();
+    GLTF_GL::setBackend(options.recording ? GLTF_GL::Recording : GLTF_GL::Driver);
+    GLTF_GL::resetCounters();
+    Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+    GLTF_Model::StreamingSettings streaming = GLTF_Model::streamingSettings();
+    GLTF_Model::streamingSettings().enabled = options.streamBudget > 0;
+    if (options.streamBudget > 0) GLTF_Model::streamingSettings().budgetBytes = options.streamBudget;
+    bool flying = !options.synthetic.empty() && asset == options.synthetic;
+    {
+        auto start = std::chrono::steady_clock::now();
+        GLTF_Model model(asset, camera);
+        model.sortDraws = options.sortDraws;
+        result.loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        result.peakResidentBytes = peakResidentBytes();
+        result.loaded = model.loadState() == GLTF_Model::Loaded;
+        result.phases = model.loadTimings();
+        result.loadCalls = GLTF_GL::counters();
+
+        //frame times, returns the summed prepare time
+        auto drawFrames = [&](std::vector<double>& frameTimes) {
+            double prepare = 0.0;
+            for (int frame = 0; result.loaded && frame < result.frames; ++frame) {
+                if (flying) {
+                    //from one edge of the grid to the other, looking ahead and down
+                    float extent = (float)options.syntheticSize;
+                    glm::vec3 eye(0.0f, 4.0f, extent - 2.0f * extent * frame / std::max(result.frames - 1, 1));
+                    model.setViewProjection(glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 40.0f) *
+                        glm::lookAt(eye, eye + glm::vec3(0.0f, -0.5f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+                }
+                auto frameStart = std::chrono::steady_clock::now();
+                model.draw(options.program);
+                frameTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+                prepare += model.drawStats().prepareMilliseconds;
+                GLTF_Trace::endFrame();
+            }
+            return prepare;
+        };
+        GLTF_GL::resetCounters();
+        std::vector<double> frameTimes;
+        double prepare = drawFrames(frameTimes);
+        result.frameCalls = GLTF_GL::counters();
+        result.draw = model.drawStats();
+        result.culling = model.cullingStats();
+        result.streaming = model.streamingStats();
+        if (!frameTimes.empty()) {
+            for (double time : frameTimes) result.frameMean += time;
+            result.frameMean /= frameTimes.size();
+            result.prepareMean = prepare / frameTimes.size();
+            std::sort(frameTimes.begin(), frameTimes.end());
+            result.frameMedian = frameTimes[frameTimes.size() / 2];
+            result.frame95 = frameTimes[std::min(frameTimes.size() - 1, frameTimes.size() * 95 / 100)];
+            result.frameMax = frameTimes.back();
+        }
+        result.frames = (int)frameTimes.size();
+
+        size_t poolThreads = GLTF_ThreadPool::shared().size() + 1;
+        for (size_t threads = 1; options.scaling && result.loaded && result.frames > 0; threads *= 2) {
+            threads = std::min(threads, poolThreads);
+            model.frameThreads = threads;
+            std::vector<double> times;
+            Scaling scaling;
+            scaling.threads = threads;
+            scaling.prepareMean = drawFrames(times) / times.size();
+            for (double time : times) scaling.frameMean += time;
+            scaling.frameMean /= times.size();
+            result.scaling.push_back(scaling);
+            if (threads == poolThreads) break;
+        }
+    }
+    GLTF_Model::streamingSettings() = streaming;
+    GLTF_GL::setBackend(previous);
+    return result;
+}
+
+// the same lights for every run: a tenth of them spot lights, a third with infinite range
+std::vector<GLTF_Benchmark::LightResult> GLTF_Benchmark::runLights(const Options& options) {
+    std::vector<LightResult> results;
+    glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f) *
+        glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 2.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    int frames = std::max(options.frames, 1);
+    for (size_t count = 10; count <= 10000; count *= 10) {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<GLTF_Light> lights(count);
+        for (size_t i = 0; i < count; ++i) {
+            GLTF_Light& light = lights[i];
+            light.type = i % 10 == 0 ? GLTF_Light::Spot : GLTF_Light::Point;
+            light.position = glm::vec3((unit(random) - 0.5f) * 120.0f, unit(random) * 20.0f, -unit(random) * 100.0f);
+            glm::vec3 direction(unit(random) - 0.5f, -unit(random), unit(random) - 0.5f);
+            light.direction = direction / std::max(glm::length(direction), 1e-6f);
+            light.color = glm::vec3(unit(random), unit(random), unit(random));
+            light.intensity = 0.5f + unit(random);
+            light.range = i % 3 == 0 ? 0.0f : 1.0f + unit(random) * 6.0f;
+            light.innerConeCos = 0.9f;
+            light.outerConeCos = 0.8f;
+        }
+        LightResult result;
+        result.lights = count;
+        GLTF_LightClusters clusters;
+        for (int frame = 0; frame < frames; ++frame) {
+            clusters.assign(lights, viewProjection, 1);
+            result.serialMean += clusters.stats().milliseconds;
+            clusters.assign(lights, viewProjection, 0);
+            result.parallelMean += clusters.stats().milliseconds;
+        }
+        result.serialMean /= frames;
+        result.parallelMean /= frames;
+        result.stats = clusters.stats();
+        results.push_back(result);
+    }
+    return results;
+}
+
+std::string GLTF_Benchmark::quoted(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        if ((unsigned char)c < 0x20) out += ' ';
+        else out += c;
+    }
+    return out + "\"";
+}
+
+// ru_maxrss is in kilobytes on Linux and in bytes on macOS
+size_t GLTF_Benchmark::peakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+void GLTF_Benchmark::writeCounters(std::ostream& out, const GLTF_GL::Counters& counters, double divisor) {
+    if (divisor <= 0.0) divisor = 1.0;
+    out << "{\"calls\": " << counters.calls / divisor
+        << ", \"buffersCreated\": " << counters.buffersCreated / divisor
+        << ", \"bufferBytes\": " << counters.bufferBytes / divisor
+        << ", \"texturesCreated\": " << counters.texturesCreated / divisor
+        << ", \"textureBytes\": " << counters.textureBytes / divisor
+        << ", \"textureBinds\": " << counters.textureBinds / divisor
+        << ", \"binds\": " << counters.binds / divisor
+        << ", \"uniformSets\": " << counters.uniformSets / divisor
+        << ", \"drawCalls\": " << counters.drawCalls / divisor
+        << ", \"triangles\": " << counters.triangles / divisor << "}";
+}
+
+// frame call counts are per frame, load call counts are totals
+void GLTF_Benchmark::writeJson(std::ostream& out, const Options& options, const std::vector<Result>& results,
+    const std::vector<LightResult>& lights) {
+    out << "{\n  \"backend\": " << (options.recording ? "\"recording\"" : "\"driver\"")
+        << ",\n  \"frames\": " << options.frames << ",\n  \"sorted\": " << (options.sortDraws ? "true" : "false")
+        << ",\n  \"streamBudget\": " << options.streamBudget
+        << ",\n  \"assets\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        out << (i ? "," : "") << "\n    {\n      \"asset\": " << quoted(result.asset)
+            << ",\n      \"loaded\": " << (result.loaded ? "true" : "false")
+            << ",\n      \"load\": {\"milliseconds\": " << result.loadMilliseconds
+            << ", \"peakResidentBytes\": " << result.peakResidentBytes
+            << ", \"parse\": " << result.phases.parse << ", \"decode\": " << result.phases.decode
+            << ", \"optimize\": " << result.phases.optimize << ", \"upload\": " << result.phases.upload
+            << ", \"calls\": ";
+        writeCounters(out, result.loadCalls, 1.0);
+        out << "},\n      \"frame\": {\"count\": " << result.frames << ", \"mean\": " << result.frameMean
+            << ", \"median\": " << result.frameMedian << ", \"p95\": " << result.frame95 << ", \"max\": " << result.frameMax
+            << ", \"prepareMean\": " << result.prepareMean
+            << ", \"drawCalls\": " << result.draw.drawCalls << ", \"instances\": " << result.draw.instances
+            << ", \"glCallsSkipped\": " << result.draw.glCallsSkipped << ", \"drawsCulled\": " << result.culling.drawsCulled
+            << ", \"calls\": ";
+        writeCounters(out, result.frameCalls, result.frames);
+        out << "}";
+        if (options.streamBudget > 0) {
+            const GLTF_Streamer::Stats& streaming = result.streaming;
+            out << ",\n      \"streaming\": {\"budgetBytes\": " << streaming.budgetBytes
+                << ", \"residentBytes\": " << streaming.residentBytes << ", \"inFlightBytes\": " << streaming.inFlightBytes
+                << ", \"evictedBytes\": " << streaming.evictedBytes << ", \"resident\": " << streaming.resident
+                << ", \"inFlight\": " << streaming.inFlight << ", \"evictions\": " << streaming.evictions
+                << ", \"requested\": " << streaming.requested << ", \"starved\": " << streaming.starved << "}";
+        }
+        if (!result.scaling.empty()) {
+            //speedup of the frame preparation over one thread
+            out << ",\n      \"scaling\": [";
+            for (size_t j = 0; j < result.scaling.size(); ++j) {
+                const Scaling& scaling = result.scaling[j];
+                double speedup = scaling.prepareMean > 0.0 ? result.scaling[0].prepareMean / scaling.prepareMean : 0.0;
+                out << (j ? ", " : "") << "{\"threads\": " << scaling.threads << ", \"frameMean\": " << scaling.frameMean
+                    << ", \"prepareMean\": " << scaling.prepareMean << ", \"speedup\": " << speedup << "}";
+            }
+            out << "]";
+        }
+        out << "\n    }";
+    }
+    out << "\n  ]";
+    if (!lights.empty()) {
+        out << ",\n  \"lights\": [";
+        for (size_t i = 0; i < lights.size(); ++i) {
+            const LightResult& result = lights[i];
+            out << (i ? "," : "") << "\n    {\"lights\": " << result.lights << ", \"serialMean\": " << result.serialMean
+                << ", \"parallelMean\": " << result.parallelMean << ", \"visible\": " << result.stats.visible
+                << ", \"indices\": " << result.stats.indices << ", \"maxPerCluster\": " << result.stats.maxPerCluster << "}";
+        }
+        out << "\n  ]";
+    }
+    out << "\n}\n";
+}
+
+int GLTF_Benchmark::main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "--frames" && i + 1 < argc) options.frames = std::atoi(argv[++i]);
+        else if (argument == "--unsorted") options.sortDraws = false;
+        else if (argument == "--out" && i + 1 < argc) options.output = argv[++i];
+        else if (argument == "--log" && i + 1 < argc) options.log = argv[++i];
+        else if (argument == "--trace" && i + 1 < argc) options.trace = argv[++i];
+        else if (argument == "--stream" && i + 1 < argc) options.streamBudget = (size_t)std::strtoull(argv[++i], nullptr, 10);
+        else if (argument == "--synthetic" && i + 1 < argc) options.syntheticSize = std::atoi(argv[++i]);
+        else if (argument == "--scaling") options.scaling = true;
+        else if (argument == "--lights") options.lights = true;
+        else if (argument == "--check" && i + 1 < argc) options.checkNodes = std::atoi(argv[++i]);
+        else options.assets.push_back(argument);
+    }
+    if (options.syntheticSize > 0) {
+        options.synthetic = (std::filesystem::temp_directory_path() /
+            ("gltf_synthetic_" + std::to_string(options.syntheticSize) + ".gltf")).string();
+        if (!writeSyntheticScene(options.synthetic, options.syntheticSize)) {
+            std::cout << "Failed to write synthetic scene: " << options.synthetic << std::endl;
+            return 1;
+        }
+        options.assets.push_back(options.synthetic);
+    }
+    if (options.assets.empty() && !options.lights && options.checkNodes <= 0) {
+        std::cout << "usage: " << argv[0] << " [--frames N] [--unsorted] [--stream BYTES] [--synthetic N] [--scaling] [--lights]"
+            " [--check N] [--out results.json] [--log calls.txt] [--trace trace.json] model.gltf ..." << std::endl;
+        return 2;
+    }
+    if (options.checkNodes > 0 && !checkInstancing(options.checkNodes)) return 1;
+    if (options.assets.empty() && !options.lights) return 0;
+
+    std::ofstream log;
+    if (!options.log.empty()) {
+        log.open(options.log);
+        GLTF_GL::setLog(&log);
+    }
+    GLTF_Trace::setEnabled(!options.trace.empty());
+    std::vector<Result> results;
+    bool loaded = true;
+    for (const std::string& asset : options.assets) {
+        results.push_back(run(asset, options));
+        loaded = loaded && results.back().loaded;
+    }
+    std::vector<LightResult> lights;
+    if (options.lights) lights = runLights(options);
+    GLTF_GL::setLog(nullptr);
+    if (!options.trace.empty() && !GLTF_Trace::writeChromeTrace(options.trace)) return 1;
+
+    if (options.output.empty()) {
+        writeJson(std::cout, options, results, lights);
+    }
+    else {
+        std::ofstream out(options.output);
+        writeJson(out, options, results, lights);
+        if (!out) {
+            std::cout << "Failed to write benchmark results: " << options.output << std::endl;
+            return 1;
+        }
+    }
+    return loaded ? 0 : 1;
+}
+
+bool GLTF_Benchmark::writeSyntheticScene(const std::string& path, int size) {
+    static const uint16_t faces[36] = { 0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1,
+        2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3 };
+    const size_t meshBytes = 8 * sizeof(glm::vec3) * 2 + sizeof(faces);
+    size_t count = (size_t)std::max(size, 0) * std::max(size, 0);
+    std::string binName = std::filesystem::path(path).filename().string() + ".bin";
+    std::ofstream bin(path + ".bin", std::ios::binary);
+    std::ostringstream nodes, meshes, accessors, views;
+    for (size_t i = 0; i < count; ++i) {
+        //every cube a little different, so no two meshes could be shared
+        float half = 0.3f + 0.6f * (float)((i * 7919) % 97) / 96.0f;
+        glm::vec3 corners[8];
+        glm::vec3 normals[8];
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 direction(corner & 4 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, corner & 1 ? 1.0f : -1.0f);
+            corners[corner] = direction * half;
+            normals[corner] = glm::normalize(direction);
+        }
+        bin.write((const char*)corners, sizeof(corners));
+        bin.write((const char*)normals, sizeof(normals));
+        bin.write((const char*)faces, sizeof(faces));
+
+        const char* separator = i ? ",\n" : "\n";
+        size_t offset = i * meshBytes;
+        float x = ((float)(i % size) - (size - 1) * 0.5f) * 2.0f;
+        float z = ((float)(i / size) - (size - 1) * 0.5f) * 2.0f;
+        nodes << separator << "{\"mesh\": " << i << ", \"translation\": [" << x << ", " << half << ", " << z << "]}";
+        meshes << separator << "{\"primitives\": [{\"attributes\": {\"POSITION\": " << i * 3 << ", \"NORMAL\": " << i * 3 + 1
+            << "}, \"indices\": " << i * 3 + 2 << ", \"material\": 0}]}";
+        views << separator << "{\"buffer\": 0, \"byteOffset\": " << offset << ", \"byteLength\": 96, \"target\": 34962},\n"
+            << "{\"buffer\": 0, \"byteOffset\": " << offset + 96 << ", \"byteLength\": 96, \"target\": 34962},\n"
+            << "{\"buffer\": 0, \"byteOffset\": " << offset + 192 << ", \"byteLength\": " << sizeof(faces) << ", \"target\": 34963}";
+        accessors << separator << "{\"bufferView\": " << i * 3 << ", \"componentType\": 5126, \"count\": 8, \"type\": \"VEC3\", "
+            << "\"min\": [" << -half << ", " << -half << ", " << -half << "], \"max\": [" << half << ", " << half << ", " << half << "]},\n"
+            << "{\"bufferView\": " << i * 3 + 1 << ", \"componentType\": 5126, \"count\": 8, \"type\": \"VEC3\"},\n"
+            << "{\"bufferView\": " << i * 3 + 2 << ", \"componentType\": 5123, \"count\": 36, \"type\": \"SCALAR\"}";
+    }
+    bin.close();
+
+    std::ofstream out(path);
+    out << "{\"asset\": {\"version\": \"2.0\", \"generator\": \"GLTF_Benchmark\"},\n\"scene\": 0,\n\"scenes\": [{\"nodes\": [";
+    for (size_t i = 0; i < count; ++i) out << (i ? ", " : "") << i;
+    out << "]}],\n\"nodes\": [" << nodes.str() << "],\n\"meshes\": [" << meshes.str()
+        << "],\n\"materials\": [{\"pbrMetallicRoughness\": {\"baseColorFactor\": [0.8, 0.8, 0.8, 1.0]}}],\n\"accessors\": ["
+        << accessors.str() << "],\n\"bufferViews\": [" << views.str() << "],\n\"buffers\": [{\"uri\": \"" << binName
+        << "\", \"byteLength\": " << count * meshBytes << "}]}\n";
+    return (bool)out && (bool)bin;
+}
+
+bool GLTF_Benchmark::writeInstancedScene(const std::string& path, int count) {
+    static const uint16_t faces[36] = { 0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1,
+        2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3 };
+    glm::vec3 corners[8];
+    for (int corner = 0; corner < 8; ++corner) {
+        corners[corner] = glm::vec3(corner & 4 ? 0.5f : -0.5f, corner & 2 ? 0.5f : -0.5f, corner & 1 ? 0.5f : -0.5f);
+    }
+    std::string binName = std::filesystem::path(path).filename().string() + ".bin";
+    std::ofstream bin(path + ".bin", std::ios::binary);
+    bin.write((const char*)corners, sizeof(corners));
+    bin.write((const char*)faces, sizeof(faces));
+    bin.close();
+
+    std::ofstream out(path);
+    out << "{\"asset\": {\"version\": \"2.0\", \"generator\": \"GLTF_Benchmark\"},\n\"scene\": 0,\n\"scenes\": [{\"nodes\": [";
+    for (int i = 0; i < count; ++i) out << (i ? ", " : "") << i;
+    out << "]}],\n\"nodes\": [";
+    for (int i = 0; i < count; ++i) out << (i ? ",\n" : "\n") << "{\"mesh\": 0, \"translation\": [" << i * 2 << ", 0, 0]}";
+    out << "],\n\"meshes\": [{\"primitives\": [{\"attributes\": {\"POSITION\": 0}, \"indices\": 1, \"material\": 0}]}],\n"
+        << "\"materials\": [{\"pbrMetallicRoughness\": {\"baseColorFactor\": [0.8, 0.8, 0.8, 1.0]}}],\n"
+        << "\"accessors\": [{\"bufferView\": 0, \"componentType\": 5126, \"count\": 8, \"type\": \"VEC3\", "
+        << "\"min\": [-0.5, -0.5, -0.5], \"max\": [0.5, 0.5, 0.5]},\n"
+        << "{\"bufferView\": 1, \"componentType\": 5123, \"count\": 36, \"type\": \"SCALAR\"}],\n"
+        << "\"bufferViews\": [{\"buffer\": 0, \"byteLength\": " << sizeof(corners) << ", \"target\": 34962},\n"
+        << "{\"buffer\": 0, \"byteOffset\": " << sizeof(corners) << ", \"byteLength\": " << sizeof(faces) << ", \"target\": 34963}],\n"
+        << "\"buffers\": [{\"uri\": \"" << binName << "\", \"byteLength\": " << sizeof(corners) + sizeof(faces) << "}]}\n";
+    return (bool)out && (bool)bin;
+}
+
+// culling is off, every node must be drawn wherever the camera looks
+bool GLTF_Benchmark::checkInstancing(int count) {
+    std::string path = (std::filesystem::temp_directory_path() / ("gltf_instanced_" + std::to_string(count) + ".gltf")).string();
+    if (!writeInstancedScene(path, count)) {
+        std::cout << "Failed to write instanced scene: " << path << std::endl;
+        return false;
+    }
+    GLTF_GL::Backend previous = GLTF_GL::backend();
+    GLTF_GL::setBackend(GLTF_GL::Recording);
+    Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+    bool passed = false;
+    {
+        GLTF_Model model(path, camera);
+        model.frustumCulling = false;
+        model.draw(1);
+        GLTF_Model::DrawStats compiled = model.drawStats();
+        model.useCompiledScene = false;
+        model.draw(1);
+        GLTF_Model::DrawStats tree = model.drawStats();
+        passed = model.loadState() == GLTF_Model::Loaded && compiled.drawCalls == 1 && compiled.instances == (size_t)count &&
+            tree.drawCalls == (size_t)count;
+        std::cout << "instancing check, " << count << " nodes: compiled " << compiled.drawCalls << " draws of "
+            << compiled.instances << " instances, node tree " << tree.drawCalls << " draws, "
+            << (passed ? "passed" : "FAILED") << std::endl;
+    }
+    GLTF_GL::setBackend(previous);
+    return passed;
+}
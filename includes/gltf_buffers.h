@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include <GLFW/glfw3.h>
+
+#include <tiny_gltf.h>
+#include "gltf_file.h"
+#include "gltf_gl.h"
+
+
+// uploads every bufferView a model draws from exactly once, packed into a few
+// large vertex and index buffers; VAOs and draws address them by offset.
+// allocate() reserves the storage, the data can then follow in chunks.
+// an arena may also hold just the meshes of a subset (streaming): plan() lays it out
+// without touching GL, reserve() and evict() then create and drop its storage
+class GLTF_BufferArena
+{
+public:
+    enum Role { Vertex = 0, Index = 1 };
+    struct Stats {
+        size_t bytesUploaded = 0;
+        size_t bufferObjects = 0;
+        size_t viewsUploaded = 0;
+    };
+    static const size_t maxArenaBytes = 256 * 1024 * 1024;   //start another buffer object past this size
+    static const size_t alignment = 16;
+
+    void allocate(const tinygltf::Model& model);
+    //layout only; with meshes, just their views, trimmed to the bytes their accessors read
+    void plan(const tinygltf::Model& model, const std::vector<int>* meshes = nullptr);
+    void reserve();
+    //frees the storage, the layout stays for the next reserve()
+    void evict();
+    //copy [begin, begin + length) of a view's range into the arena, returns the bytes copied
+    size_t upload(const tinygltf::Model& model, const GLTF_BufferData& data, Role role, int view, size_t begin, size_t length);
+    //touch the source pages of every range so a later upload does not fault them in. any thread
+    void prefetch(const tinygltf::Model& model, const GLTF_BufferData& data) const;
+    void release();
+    bool contains(Role role, int view) const { return find(role, view) >= 0; }
+    bool resident(Role role, int view) const;
+    //buffer, address and length are 0 for a view the layout does not hold
+    GLuint buffer(Role role, int view) const;
+    //where byte byteOffset of a view ended up in its buffer
+    size_t address(Role role, int view, size_t byteOffset) const;
+    size_t length(Role role, int view) const;
+    //bufferViews held for a role, ascending
+    const std::vector<int>& views(Role role) const { return viewIds[role]; }
+    //bytes of storage reserve() creates
+    size_t bytes() const;
+    const std::vector<GLuint>& bufferObjects() const { return arenas; }
+    const Stats& stats() const { return uploadStats; }
+
+private:
+    struct Range {
+        int arena = -1;
+        size_t begin = 0;               //first byte of the view held
+        size_t offset = 0;
+        size_t length = 0;
+        size_t uploaded = 0;
+    };
+    std::vector<int> viewIds[2];        //per role, sorted; ranges[role][i] holds viewIds[role][i]
+    std::vector<Range> ranges[2];
+    std::vector<GLuint> arenas;
+    std::vector<Role> arenaRoles;
+    std::vector<size_t> arenaSizes;
+    Stats uploadStats;
+
+    int find(Role role, int view) const;
+    void markUsed(const tinygltf::Model& model, int accessorIndex, bool trim, std::map<int, Range>& used);
+    void layout(Role role, const std::map<int, Range>& used);
+};
+
+
+int GLTF_BufferArena::find(Role role, int view) const {
+    const std::vector<int>& ids = viewIds[role];
+    auto it = std::lower_bound(ids.begin(), ids.end(), view);
+    if (it == ids.end() || *it != view) return -1;
+    return (int)(it - ids.begin());
+}
+
+bool GLTF_BufferArena::resident(Role role, int view) const {
+    int i = find(role, view);
+    return i >= 0 && arenas[ranges[role][i].arena] && ranges[role][i].uploaded == ranges[role][i].length;
+}
+
+GLuint GLTF_BufferArena::buffer(Role role, int view) const {
+    int i = find(role, view);
+    return i >= 0 && ranges[role][i].arena >= 0 ? arenas[ranges[role][i].arena] : 0;
+}
+
+size_t GLTF_BufferArena::address(Role role, int view, size_t byteOffset) const {
+    int i = find(role, view);
+    if (i < 0) return 0;
+    const Range& range = ranges[role][i];
+    return range.offset + byteOffset - range.begin;
+}
+
+size_t GLTF_BufferArena::length(Role role, int view) const {
+    int i = find(role, view);
+    return i >= 0 ? ranges[role][i].length : 0;
+}
+
+size_t GLTF_BufferArena::bytes() const {
+    size_t total = 0;
+    for (size_t size : arenaSizes) total += size;
+    return total;
+}
+
+void GLTF_BufferArena::allocate(const tinygltf::Model& model) {
+    plan(model);
+    reserve();
+}
+
+void GLTF_BufferArena::plan(const tinygltf::Model& model, const std::vector<int>* meshes) {
+    release();
+    std::map<int, Range> used[2];
+
+    //a view is uploaded once per role it is drawn with, however many accessors share it
+    auto markMesh = [&](const tinygltf::Mesh& mesh) {
+        for (const tinygltf::Primitive& primitive : mesh.primitives) {
+            markUsed(model, primitive.indices, meshes != nullptr, used[Index]);
+            for (auto& attrib : primitive.attributes) {
+                markUsed(model, attrib.second, meshes != nullptr, used[Vertex]);
+            }
+        }
+    };
+    if (meshes) {
+        for (int mesh : *meshes) {
+            if (mesh >= 0 && mesh < (int)model.meshes.size()) markMesh(model.meshes[mesh]);
+        }
+    }
+    else {
+        for (const tinygltf::Mesh& mesh : model.meshes) markMesh(mesh);
+    }
+    layout(Vertex, used[Vertex]);
+    layout(Index, used[Index]);
+}
+
+void GLTF_BufferArena::reserve() {
+    //index buffer bindings are VAO state, keep them out of whatever VAO is bound
+    GLTF_GL::bindVertexArray(0);
+    for (size_t i = 0; i < arenaSizes.size(); ++i) {
+        if (arenas[i]) continue;
+        GLenum target = arenaRoles[i] == Index ? GL_ELEMENT_ARRAY_BUFFER : GL_ARRAY_BUFFER;
+        GLTF_GL::genBuffers(1, &arenas[i]);
+        GLTF_GL::bindBuffer(target, arenas[i]);
+        GLTF_GL::bufferData(target, arenaSizes[i], NULL, GL_STATIC_DRAW);
+        uploadStats.bufferObjects++;
+    }
+    GLTF_GL::bindBuffer(GL_ARRAY_BUFFER, 0);
+    GLTF_GL::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void GLTF_BufferArena::evict() {
+    for (GLuint& buffer : arenas) {
+        if (buffer) GLTF_GL::deleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+    for (int role = Vertex; role <= Index; ++role) {
+        for (Range& range : ranges[role]) range.uploaded = 0;
+    }
+    uploadStats = Stats();
+}
+
+size_t GLTF_BufferArena::upload(const tinygltf::Model& model, const GLTF_BufferData& data, Role role, int view, size_t begin, size_t length) {
+    int i = find(role, view);
+    if (i < 0) return 0;
+    Range& range = ranges[role][i];
+    if (begin >= range.length || !arenas[range.arena]) return 0;
+    length = std::min(length, range.length - begin);
+    const tinygltf::BufferView& bufferView = model.bufferViews[view];
+
+    GLenum target = role == Index ? GL_ELEMENT_ARRAY_BUFFER : GL_ARRAY_BUFFER;
+    if (target == GL_ELEMENT_ARRAY_BUFFER) GLTF_GL::bindVertexArray(0);
+    GLTF_GL::bindBuffer(target, arenas[range.arena]);
+    GLTF_GL::bufferSubData(target, range.offset + begin, length, data.data(bufferView.buffer) + bufferView.byteOffset + range.begin + begin);
+    GLTF_GL::bindBuffer(target, 0);
+
+    range.uploaded += length;
+    uploadStats.bytesUploaded += length;
+    if (range.uploaded == range.length) uploadStats.viewsUploaded++;
+    return length;
+}
+
+void GLTF_BufferArena::prefetch(const tinygltf::Model& model, const GLTF_BufferData& data) const {
+    const size_t page = 4096;
+    volatile unsigned char sink = 0;
+    for (int role = Vertex; role <= Index; ++role) {
+        for (size_t i = 0; i < ranges[role].size(); ++i) {
+            const Range& range = ranges[role][i];
+            const tinygltf::BufferView& bufferView = model.bufferViews[viewIds[role][i]];
+            const unsigned char* source = data.data(bufferView.buffer) + bufferView.byteOffset + range.begin;
+            for (size_t at = 0; at < range.length; at += page) sink = sink + source[at];
+            if (range.length) sink = sink + source[range.length - 1];
+        }
+    }
+}
+
+void GLTF_BufferArena::markUsed(const tinygltf::Model& model, int accessorIndex, bool trim, std::map<int, Range>& used) {
+    if (accessorIndex < 0 || accessorIndex >= (int)model.accessors.size()) return;
+    const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+    int view = accessor.bufferView;
+    if (view < 0 || view >= (int)model.bufferViews.size()) return;
+    const tinygltf::BufferView& bufferView = model.bufferViews[view];
+    size_t begin = 0;
+    size_t end = bufferView.byteLength;
+    if (trim && accessor.count > 0) {
+        //the last element ends one element size past its start, not one stride
+        int stride = accessor.ByteStride(bufferView);
+        int elementSize = tinygltf::GetComponentSizeInBytes(accessor.componentType) * tinygltf::GetNumComponentsInType(accessor.type);
+        if (stride > 0 && elementSize > 0) {
+            begin = accessor.byteOffset / alignment * alignment;
+            end = std::min(end, accessor.byteOffset + (accessor.count - 1) * stride + elementSize);
+        }
+    }
+    Range& range = used[view];
+    if (range.arena < 0) {
+        range.arena = 0;
+        range.begin = begin;
+        range.length = end - begin;
+        return;
+    }
+    size_t first = std::min(range.begin, begin);
+    range.length = std::max(range.begin + range.length, end) - first;
+    range.begin = first;
+}
+
+// place the used views of one role back to back, opening a new arena when one fills up
+void GLTF_BufferArena::layout(Role role, const std::map<int, Range>& used) {
+    int arena = -1;
+    for (auto& entry : used) {
+        Range range = entry.second;
+        size_t offset = arena < 0 ? 0 : (arenaSizes[arena] + alignment - 1) / alignment * alignment;
+        if (arena < 0 || (offset + range.length > maxArenaBytes && offset > 0)) {
+            arena = (int)arenaSizes.size();
+            arenaSizes.push_back(0);
+            arenaRoles.push_back(role);
+            arenas.push_back(0);
+            offset = 0;
+        }
+        range.arena = arena;
+        range.offset = offset;
+        range.uploaded = 0;
+        arenaSizes[arena] = offset + range.length;
+        viewIds[role].push_back(entry.first);
+        ranges[role].push_back(range);
+    }
+}
+
+void GLTF_BufferArena::release() {
+    for (GLuint buffer : arenas) {
+        if (buffer) GLTF_GL::deleteBuffers(1, &buffer);
+    }
+    arenas.clear();
+    arenaRoles.clear();
+    arenaSizes.clear();
+    for (int role = Vertex; role <= Index; ++role) {
+        viewIds[role].clear();
+        ranges[role].clear();
+    }
+    uploadStats = Stats();
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <GLFW/glfw3.h>
+#include "gltf_gl.h"
+
+
+// 64 bit hash of a byte range, a word at a time; good enough to key caches on content
+uint64_t gltfHashBytes(const unsigned char* bytes, size_t size, uint64_t seed = 0) {
+    const uint64_t prime = 0x9E3779B97F4A7C15ull;
+    uint64_t hash = seed ^ (size * prime);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, bytes + i, size - i);
+    hash = (hash ^ tail) * prime;
+    return hash ^ (hash >> 32);
+}
+
+
+// GL names whose owner may die on any thread; they are deleted by collect() on the GL thread
+class GLTF_ReleaseQueue
+{
+public:
+    static GLTF_ReleaseQueue& shared();
+    void texture(GLuint name) { push(textures, name); }
+    void buffer(GLuint name) { push(buffers, name); }
+    void vertexArray(GLuint name) { push(vertexArrays, name); }
+    void collect();
+
+private:
+    std::mutex mutex;
+    std::vector<GLuint> textures;
+    std::vector<GLuint> buffers;
+    std::vector<GLuint> vertexArrays;
+
+    void push(std::vector<GLuint>& names, GLuint name);
+};
+
+
+// a texture object shared by every model that samples the same image the same way
+struct GLTF_SharedTexture {
+    GLuint id = 0;
+    std::atomic<size_t> bytes{ 0 };  //uploaded size, 0 until the data is in
+    GLTF_SharedTexture() {}
+    GLTF_SharedTexture(const GLTF_SharedTexture&) = delete;
+    GLTF_SharedTexture& operator=(const GLTF_SharedTexture&) = delete;
+    ~GLTF_SharedTexture() {
+        if (id) GLTF_ReleaseQueue::shared().texture(id);
+    }
+};
+
+
+// process-wide map of live shared resources. entries are weak, so a resource is freed
+// with its last user and loaded again by the next request. thread safe
+template <typename T>
+class GLTF_ResourceCache
+{
+public:
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t live = 0;
+    };
+
+    //a live entry or null
+    std::shared_ptr<T> find(const std::string& key);
+    //count a lookup as a hit or a miss; callers decide which lookups count
+    void record(bool hit);
+    void insert(const std::string& key, const std::shared_ptr<T>& value);
+    Stats stats();
+    //visit every live value once, however many keys it is stored under
+    template <typename F>
+    void forEach(F&& visit);
+
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::weak_ptr<T>> entries;
+    size_t hits = 0;
+    size_t misses = 0;
+
+    void prune();
+};
+
+
+GLTF_ReleaseQueue& GLTF_ReleaseQueue::shared() {
+    static GLTF_ReleaseQueue queue;
+    return queue;
+}
+
+void GLTF_ReleaseQueue::push(std::vector<GLuint>& names, GLuint name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    names.push_back(name);
+}
+
+void GLTF_ReleaseQueue::collect() {
+    std::vector<GLuint> deadTextures, deadBuffers, deadVertexArrays;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        deadTextures.swap(textures);
+        deadBuffers.swap(buffers);
+        deadVertexArrays.swap(vertexArrays);
+    }
+    if (!deadTextures.empty()) GLTF_GL::deleteTextures((GLsizei)deadTextures.size(), deadTextures.data());
+    if (!deadBuffers.empty()) GLTF_GL::deleteBuffers((GLsizei)deadBuffers.size(), deadBuffers.data());
+    if (!deadVertexArrays.empty()) GLTF_GL::deleteVertexArrays((GLsizei)deadVertexArrays.size(), deadVertexArrays.data());
+}
+
+template <typename T>
+std::shared_ptr<T> GLTF_ResourceCache<T>::find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = entries.find(key);
+    return entry == entries.end() ? nullptr : entry->second.lock();
+}
+
+template <typename T>
+void GLTF_ResourceCache<T>::record(bool hit) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (hit) hits++;
+    else misses++;
+}
+
+template <typename T>
+void GLTF_ResourceCache<T>::insert(const std::string& key, const std::shared_ptr<T>& value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    prune();
+    entries[key] = value;
+}
+
+template <typename T>
+typename GLTF_ResourceCache<T>::Stats GLTF_ResourceCache<T>::stats() {
+    Stats result;
+    forEach([&](T&) { result.live++; });
+    std::lock_guard<std::mutex> lock(mutex);
+    result.hits = hits;
+    result.misses = misses;
+    return result;
+}
+
+template <typename T>
+template <typename F>
+void GLTF_ResourceCache<T>::forEach(F&& visit) {
+    //locked first, visit runs without the mutex held
+    std::vector<std::shared_ptr<T>> live;
+    std::unordered_set<T*> seen;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& entry : entries) {
+            std::shared_ptr<T> value = entry.second.lock();
+            if (value && seen.insert(value.get()).second) live.push_back(value);
+        }
+    }
+    for (auto& value : live) {
+        visit(*value);
+    }
+}
+
+template <typename T>
+void GLTF_ResourceCache<T>::prune() {
+    for (auto entry = entries.begin(); entry != entries.end();) {
+        if (entry->second.expired()) entry = entries.erase(entry);
+        else ++entry;
+    }
+}
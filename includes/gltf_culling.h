@@ -0,0 +1,339 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define GLTF_CULLING_SSE
+#endif
+
+
+// axis aligned box, empty while min > max
+struct GLTF_Aabb {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    GLTF_Aabb() {}
+    GLTF_Aabb(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+    //stands in for geometry without bounds, never culled
+    static GLTF_Aabb unbounded() { return GLTF_Aabb(glm::vec3(-1e30f), glm::vec3(1e30f)); }
+
+    bool empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return (max - min) * 0.5f; }
+    void expand(const GLTF_Aabb& box) {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+    //box around this box transformed by matrix
+    GLTF_Aabb transformed(const glm::mat4& matrix) const;
+};
+
+
+// the six planes of a view-projection matrix, a point p is inside when
+// a*p.x + b*p.y + c*p.z + d >= 0 for every plane
+class GLTF_Frustum
+{
+public:
+    enum Result { Outside, Intersects, Inside };
+
+    GLTF_Frustum();                                     //contains everything
+    explicit GLTF_Frustum(const glm::mat4& viewProjection, bool farPlane = true);
+    Result classify(const GLTF_Aabb& box) const;
+
+private:
+    //SoA, padded to 8 with planes that contain everything so SSE tests 4 at a time
+    alignas(16) float a[8];
+    alignas(16) float b[8];
+    alignas(16) float c[8];
+    alignas(16) float d[8];
+
+    void setPlane(int i, const glm::vec4& plane);
+};
+
+
+// bounding volume hierarchy over item boxes. nodes are stored parents first and every
+// node covers a contiguous range of the item order, so a whole subtree can be accepted
+// or rejected at once. moving items refits only the nodes above them
+class GLTF_Bvh
+{
+public:
+    struct Stats {
+        size_t items = 0;
+        size_t nodesTested = 0;             //node and leaf item boxes tested against the frustum
+        size_t itemsCulled = 0;
+    };
+
+    void build(const std::vector<GLTF_Aabb>& boxes);
+    //change the box of an item, parents follow on the next refit
+    void update(int item, const GLTF_Aabb& box);
+    void refit();
+    //visible[item] is 1 when the item's box touches the frustum, 0 otherwise
+    void cull(const GLTF_Frustum& frustum, std::vector<uint8_t>& visible, Stats& stats) const;
+    //disjoint subtrees that hold every item between them, at least count where the tree
+    //allows, for culling on several threads
+    void split(size_t count, std::vector<int>& roots) const;
+    //cull only the items below node, visible must be sized already; returns the visible items
+    size_t cullSubtree(const GLTF_Frustum& frustum, int node, std::vector<uint8_t>& visible, size_t& nodesTested) const;
+
+    size_t size() const { return itemBoxes.size(); }
+    bool empty() const { return nodes.empty(); }
+    const GLTF_Aabb& bounds() const { return nodes[0].box; }
+    const GLTF_Aabb& box(int item) const { return itemBoxes[item]; }
+
+private:
+    static const int leafSize = 4;
+    struct Node {
+        GLTF_Aabb box;
+        int begin = 0;                      //range in order
+        int end = 0;
+        int left = -1;                      //children are left and left + 1, -1 for a leaf
+        int parent = -1;
+    };
+    std::vector<Node> nodes;
+    std::vector<int> order;                 //items grouped by node
+    std::vector<int> leafOfItem;
+    std::vector<GLTF_Aabb> itemBoxes;
+    std::vector<uint8_t> stale;             //nodes whose box needs refitting
+    std::vector<int> staleNodes;
+
+    void fitNode(int node);
+    void markStale(int node);
+};
+
+
+GLTF_Aabb GLTF_Aabb::transformed(const glm::mat4& matrix) const {
+    if (empty()) return *this;
+    glm::vec3 c = glm::vec3(matrix * glm::vec4(center(), 1.0f));
+    glm::vec3 e = extent();
+    glm::vec3 r = glm::abs(glm::vec3(matrix[0])) * e.x + glm::abs(glm::vec3(matrix[1])) * e.y + glm::abs(glm::vec3(matrix[2])) * e.z;
+    return GLTF_Aabb(c - r, c + r);
+}
+
+GLTF_Frustum::GLTF_Frustum() {
+    for (int i = 0; i < 8; ++i) {
+        setPlane(i, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    }
+}
+
+GLTF_Frustum::GLTF_Frustum(const glm::mat4& m, bool farPlane) : GLTF_Frustum() {
+    //rows of the column-major matrix, planes are left, right, bottom, top, near, far
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+    setPlane(0, row3 + row0);
+    setPlane(1, row3 - row0);
+    setPlane(2, row3 + row1);
+    setPlane(3, row3 - row1);
+    setPlane(4, row3 + row2);
+    if (farPlane) setPlane(5, row3 - row2);
+}
+
+void GLTF_Frustum::setPlane(int i, const glm::vec4& plane) {
+    a[i] = plane.x;
+    b[i] = plane.y;
+    c[i] = plane.z;
+    d[i] = plane.w;
+}
+
+// the box is out when its corner furthest along a plane normal is behind the plane;
+// planes are not normalized, distance and radius scale alike
+GLTF_Frustum::Result GLTF_Frustum::classify(const GLTF_Aabb& box) const {
+    if (box.empty()) return Outside;
+    glm::vec3 center = box.center();
+    glm::vec3 extent = box.extent();
+#ifdef GLTF_CULLING_SSE
+    __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+    __m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+    __m128 signBits = _mm_set1_ps(-0.0f);
+    __m128 zero = _mm_setzero_ps();
+    int outside = 0, intersects = 0;
+    for (int i = 0; i < 8; i += 4) {
+        __m128 pa = _mm_load_ps(a + i), pb = _mm_load_ps(b + i), pc = _mm_load_ps(c + i);
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pa, cx), _mm_mul_ps(pb, cy)),
+            _mm_add_ps(_mm_mul_ps(pc, cz), _mm_load_ps(d + i)));
+        __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signBits, pa), ex), _mm_mul_ps(_mm_andnot_ps(signBits, pb), ey)),
+            _mm_mul_ps(_mm_andnot_ps(signBits, pc), ez));
+        outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+        intersects |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), zero));
+    }
+    if (outside) return Outside;
+    return intersects ? Intersects : Inside;
+#else
+    Result result = Inside;
+    for (int i = 0; i < 8; ++i) {
+        float distance = a[i] * center.x + b[i] * center.y + c[i] * center.z + d[i];
+        float radius = std::abs(a[i]) * extent.x + std::abs(b[i]) * extent.y + std::abs(c[i]) * extent.z;
+        if (distance + radius < 0.0f) return Outside;
+        if (distance - radius < 0.0f) result = Intersects;
+    }
+    return result;
+#endif
+}
+
+// top-down median split on the longest axis of the item centers
+void GLTF_Bvh::build(const std::vector<GLTF_Aabb>& boxes) {
+    *this = GLTF_Bvh();
+    itemBoxes = boxes;
+    leafOfItem.assign(boxes.size(), -1);
+    if (boxes.empty()) return;
+    order.resize(boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        order[i] = (int)i;
+    }
+    std::vector<glm::vec3> centers(boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        centers[i] = boxes[i].empty() ? glm::vec3(0.0f) : boxes[i].center();
+    }
+
+    Node root;
+    root.end = (int)boxes.size();
+    nodes.push_back(root);
+    std::vector<int> stack(1, 0);
+    while (!stack.empty()) {
+        int index = stack.back();
+        stack.pop_back();
+        int begin = nodes[index].begin, end = nodes[index].end;
+        if (end - begin <= leafSize) {
+            for (int i = begin; i < end; ++i) {
+                leafOfItem[order[i]] = index;
+            }
+            continue;
+        }
+        GLTF_Aabb spread;
+        for (int i = begin; i < end; ++i) {
+            spread.expand(GLTF_Aabb(centers[order[i]], centers[order[i]]));
+        }
+        glm::vec3 size = spread.max - spread.min;
+        int axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+        int middle = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+            [&](int x, int y) { return centers[x][axis] < centers[y][axis]; });
+
+        Node left, right;
+        left.begin = begin;
+        left.end = middle;
+        right.begin = middle;
+        right.end = end;
+        left.parent = right.parent = index;
+        nodes[index].left = (int)nodes.size();
+        nodes.push_back(left);
+        nodes.push_back(right);
+        stack.push_back(nodes[index].left);
+        stack.push_back(nodes[index].left + 1);
+    }
+    stale.assign(nodes.size(), 0);
+    //children come after their parent, fitting backwards sees them first
+    for (int i = (int)nodes.size() - 1; i >= 0; --i) {
+        fitNode(i);
+    }
+}
+
+void GLTF_Bvh::update(int item, const GLTF_Aabb& box) {
+    if (item < 0 || item >= (int)itemBoxes.size()) return;
+    itemBoxes[item] = box;
+    if (leafOfItem[item] >= 0) markStale(leafOfItem[item]);
+}
+
+void GLTF_Bvh::markStale(int node) {
+    //a stale node has stale ancestors already
+    for (; node >= 0 && !stale[node]; node = nodes[node].parent) {
+        stale[node] = 1;
+        staleNodes.push_back(node);
+    }
+}
+
+void GLTF_Bvh::refit() {
+    if (staleNodes.empty()) return;
+    std::sort(staleNodes.begin(), staleNodes.end(), [](int x, int y) { return x > y; });
+    for (int node : staleNodes) {
+        fitNode(node);
+        stale[node] = 0;
+    }
+    staleNodes.clear();
+}
+
+void GLTF_Bvh::fitNode(int index) {
+    Node& node = nodes[index];
+    node.box = GLTF_Aabb();
+    if (node.left >= 0) {
+        node.box.expand(nodes[node.left].box);
+        node.box.expand(nodes[node.left + 1].box);
+        return;
+    }
+    for (int i = node.begin; i < node.end; ++i) {
+        node.box.expand(itemBoxes[order[i]]);
+    }
+}
+
+void GLTF_Bvh::cull(const GLTF_Frustum& frustum, std::vector<uint8_t>& visible, Stats& stats) const {
+    visible.assign(itemBoxes.size(), 0);
+    stats = Stats();
+    stats.items = itemBoxes.size();
+    if (nodes.empty()) return;
+    stats.itemsCulled = stats.items - cullSubtree(frustum, 0, visible, stats.nodesTested);
+}
+
+// breadth first from the root, leaves stay as they are
+void GLTF_Bvh::split(size_t count, std::vector<int>& roots) const {
+    roots.clear();
+    if (nodes.empty()) return;
+    roots.push_back(0);
+    std::vector<int> next;
+    while (roots.size() < count) {
+        next.clear();
+        bool split = false;
+        for (int node : roots) {
+            if (nodes[node].left < 0) {
+                next.push_back(node);
+                continue;
+            }
+            next.push_back(nodes[node].left);
+            next.push_back(nodes[node].left + 1);
+            split = true;
+        }
+        roots.swap(next);
+        if (!split) break;
+    }
+}
+
+size_t GLTF_Bvh::cullSubtree(const GLTF_Frustum& frustum, int root, std::vector<uint8_t>& visible, size_t& nodesTested) const {
+    size_t visibleItems = 0;
+    int stack[64];
+    int top = 0;
+    stack[top++] = root;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        nodesTested++;
+        GLTF_Frustum::Result result = frustum.classify(node.box);
+        if (result == GLTF_Frustum::Outside) continue;
+        if (result == GLTF_Frustum::Inside) {
+            for (int i = node.begin; i < node.end; ++i) {
+                visible[order[i]] = 1;
+            }
+            visibleItems += node.end - node.begin;
+        }
+        else if (node.left < 0) {
+            for (int i = node.begin; i < node.end; ++i) {
+                if (node.end - node.begin > 1) {
+                    nodesTested++;
+                    if (frustum.classify(itemBoxes[order[i]]) == GLTF_Frustum::Outside) continue;
+                }
+                visible[order[i]] = 1;
+                visibleItems++;
+            }
+        }
+        else {
+            stack[top++] = node.left;
+            stack[top++] = node.left + 1;
+        }
+    }
+    return visibleItems;
+}
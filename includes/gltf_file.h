@@ -0,0 +1,222 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <tiny_gltf.h>
+
+
+// read-only memory mapping of a whole file
+class GLTF_MappedFile
+{
+public:
+    GLTF_MappedFile() {}
+    ~GLTF_MappedFile() { close(); }
+    GLTF_MappedFile(const GLTF_MappedFile&) = delete;
+    GLTF_MappedFile& operator=(const GLTF_MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+    //binary glTF starts with the magic "glTF", anything else is parsed as JSON
+    bool isBinary() const { return length >= 12 && memcmp(bytes, "glTF", 4) == 0; }
+    //BIN chunk of a binary glTF, null if there is none
+    const unsigned char* binaryChunk(size_t* chunkSize) const;
+
+private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+};
+
+
+// bytes of every glTF buffer. the BIN chunk of a GLB points into the file's mapping, which
+// is open for parsing anyway, and the copy tinygltf made of it is dropped once parsed.
+// tinygltf has no way to skip buffer payloads, so that copy still exists while it parses.
+// external .bin files and data: URIs keep the copy tinygltf read, mapping them again
+// would only add a second open and more resident pages
+class GLTF_BufferData
+{
+public:
+    void map(tinygltf::Model& model, const std::shared_ptr<GLTF_MappedFile>& file);
+    //buffers that already sit in one mapping, as in a baked scene
+    void assign(const std::shared_ptr<GLTF_MappedFile>& file, const std::vector<const unsigned char*>& buffers,
+        const std::vector<size_t>& bufferSizes);
+    //add a buffer of generated bytes to the model, returns its index
+    int append(tinygltf::Model& model, std::vector<unsigned char>&& bytes);
+    const unsigned char* data(int buffer) const { return pointers[buffer]; }
+    size_t size(int buffer) const { return sizes[buffer]; }
+    size_t mappedBytes() const;
+    //unmap everything, data() is null afterwards
+    void release();
+    static std::string decodeUri(const std::string& uri);
+
+private:
+    std::vector<std::shared_ptr<GLTF_MappedFile>> files;     //keeps the mappings alive
+    std::vector<const unsigned char*> pointers;
+    std::vector<size_t> sizes;
+};
+
+
+bool GLTF_MappedFile::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        close();
+        return false;
+    }
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        close();
+        return false;
+    }
+    bytes = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!bytes) {
+        close();
+        return false;
+    }
+    length = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    //the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if (view == MAP_FAILED) return false;
+    madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+    bytes = (const unsigned char*)view;
+    length = (size_t)info.st_size;
+#endif
+    return true;
+}
+
+void GLTF_MappedFile::close() {
+#ifdef _WIN32
+    if (bytes) UnmapViewOfFile(bytes);
+    if (mapping != NULL) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = NULL;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (bytes) munmap((void*)bytes, length);
+#endif
+    bytes = nullptr;
+    length = 0;
+}
+
+const unsigned char* GLTF_MappedFile::binaryChunk(size_t* chunkSize) const {
+    //12 byte header, then chunks of (length, type, data) padded to 4 bytes
+    if (!isBinary()) return nullptr;
+    size_t offset = 12;
+    while (offset + 8 <= length) {
+        uint32_t chunkLength, chunkType;
+        memcpy(&chunkLength, bytes + offset, 4);
+        memcpy(&chunkType, bytes + offset + 4, 4);
+        if (offset + 8 + chunkLength > length) return nullptr;
+        if (chunkType == 0x004E4942) {      //"BIN\0"
+            *chunkSize = chunkLength;
+            return bytes + offset + 8;
+        }
+        offset += 8 + ((chunkLength + 3) & ~3u);
+    }
+    return nullptr;
+}
+
+void GLTF_BufferData::map(tinygltf::Model& model, const std::shared_ptr<GLTF_MappedFile>& file) {
+    files.clear();
+    pointers.assign(model.buffers.size(), nullptr);
+    sizes.assign(model.buffers.size(), 0);
+    for (size_t i = 0; i < model.buffers.size(); ++i) {
+        tinygltf::Buffer& buffer = model.buffers[i];
+        pointers[i] = buffer.data.data();
+        sizes[i] = buffer.data.size();
+
+        if (!buffer.uri.empty() || !file) continue;
+        size_t chunkSize = 0;
+        const unsigned char* chunk = file->binaryChunk(&chunkSize);
+        //the chunk may be padded past byteLength, never shorter
+        if (chunk && chunkSize >= buffer.data.size()) {
+            if (files.empty()) files.push_back(file);
+            pointers[i] = chunk;
+            sizes[i] = buffer.data.size();
+            std::vector<unsigned char>().swap(buffer.data);
+        }
+    }
+}
+
+void GLTF_BufferData::assign(const std::shared_ptr<GLTF_MappedFile>& file, const std::vector<const unsigned char*>& buffers,
+    const std::vector<size_t>& bufferSizes) {
+    files.assign(1, file);
+    pointers = buffers;
+    sizes = bufferSizes;
+}
+
+int GLTF_BufferData::append(tinygltf::Model& model, std::vector<unsigned char>&& bytes) {
+    //the model keeps the bytes, moving the vector later does not move them
+    tinygltf::Buffer buffer;
+    buffer.data = std::move(bytes);
+    model.buffers.push_back(std::move(buffer));
+    pointers.push_back(model.buffers.back().data.data());
+    sizes.push_back(model.buffers.back().data.size());
+    return (int)model.buffers.size() - 1;
+}
+
+void GLTF_BufferData::release() {
+    files.clear();
+    pointers.assign(pointers.size(), nullptr);
+    sizes.assign(sizes.size(), 0);
+}
+
+size_t GLTF_BufferData::mappedBytes() const {
+    size_t total = 0;
+    for (auto& file : files) {
+        total += file->size();
+    }
+    return total;
+}
+
+std::string GLTF_BufferData::decodeUri(const std::string& uri) {
+    std::string decoded;
+    for (size_t i = 0; i < uri.size(); ++i) {
+        if (uri[i] == '%' && i + 2 < uri.size()) {
+            decoded += (char)strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16);
+            i += 2;
+        }
+        else {
+            decoded += uri[i];
+        }
+    }
+    return decoded;
+}
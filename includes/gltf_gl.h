@@ -0,0 +1,498 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <GLFW/glfw3.h>
+
+
+// every GL call of the loader goes through here. the driver backend forwards to GL; the
+// recording backend needs no context: it hands out names, answers the few queries the
+// loader makes and drops everything else, so loading and drawing can run and be measured
+// without a GPU. both count the calls, the recording one can also log them. GL thread only
+class GLTF_GL
+{
+public:
+    enum Backend { Driver, Recording };
+    struct Counters {
+        size_t calls = 0;
+        size_t buffersCreated = 0;
+        size_t bufferBytes = 0;         //given to glBufferData and glBufferSubData, or mapped for writing
+        size_t texturesCreated = 0;
+        size_t textureBytes = 0;        //level data given to glTexImage2D and glCompressedTexImage2D
+        size_t textureBinds = 0;
+        size_t binds = 0;               //programs, vertex arrays, buffers and textures
+        size_t uniformSets = 0;         //glUniform* and uniform block bindings
+        size_t drawCalls = 0;
+        size_t triangles = 0;           //instances included
+    };
+
+    static Backend backend() { return state().backend; }
+    //switch before any GL object exists, names do not carry over
+    static void setBackend(Backend backend) { state().backend = backend; }
+    static const Counters& counters() { return state().counters; }
+    static void resetCounters() { state().counters = Counters(); }
+    //recording backend: one line per call, null to stop
+    static void setLog(std::ostream* stream) { state().log = stream; }
+
+    //buffers
+    static void genBuffers(GLsizei n, GLuint* buffers);
+    static void deleteBuffers(GLsizei n, const GLuint* buffers);
+    static void bindBuffer(GLenum target, GLuint buffer);
+    static void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+    static void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    static void bufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+    static void bufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data);
+    static void* mapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+    static GLboolean unmapBuffer(GLenum target);
+    //vertex arrays
+    static void genVertexArrays(GLsizei n, GLuint* arrays);
+    static void deleteVertexArrays(GLsizei n, const GLuint* arrays);
+    static void bindVertexArray(GLuint array);
+    static void enableVertexAttribArray(GLuint index);
+    static void vertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer);
+    static void vertexAttribIPointer(GLuint index, GLint size, GLenum type, GLsizei stride, const void* pointer);
+    static void vertexAttribDivisor(GLuint index, GLuint divisor);
+    //textures
+    static void genTextures(GLsizei n, GLuint* textures);
+    static void deleteTextures(GLsizei n, const GLuint* textures);
+    static void activeTexture(GLenum unit);
+    static void bindTexture(GLenum target, GLuint texture);
+    static void texParameteri(GLenum target, GLenum name, GLint value);
+    static void texParameterf(GLenum target, GLenum name, GLfloat value);
+    static void pixelStorei(GLenum name, GLint value);
+    static void texImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border,
+        GLenum format, GLenum type, const void* pixels);
+    static void compressedTexImage2D(GLenum target, GLint level, GLenum internalFormat, GLsizei width, GLsizei height,
+        GLint border, GLsizei imageSize, const void* data);
+    static void generateMipmap(GLenum target);
+    static void texBuffer(GLenum target, GLenum internalFormat, GLuint buffer);
+    //programs
+    static void useProgram(GLuint program);
+    static GLint getUniformLocation(GLuint program, const GLchar* name);
+    static GLuint getUniformBlockIndex(GLuint program, const GLchar* name);
+    static void uniformBlockBinding(GLuint program, GLuint block, GLuint binding);
+    static void uniform1i(GLint location, GLint value);
+    static void uniform1f(GLint location, GLfloat value);
+    static void uniform3fv(GLint location, GLsizei count, const GLfloat* value);
+    static void uniform4fv(GLint location, GLsizei count, const GLfloat* value);
+    static void uniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+    //fixed function state
+    static void enable(GLenum capability);
+    static void disable(GLenum capability);
+    static GLboolean isEnabled(GLenum capability);
+    static void depthMask(GLboolean write);
+    static void blendFunc(GLenum source, GLenum destination);
+    static void blendFuncSeparate(GLenum sourceRGB, GLenum destinationRGB, GLenum sourceAlpha, GLenum destinationAlpha);
+    //drawing and queries
+    static void drawElements(GLenum mode, GLsizei count, GLenum type, const void* indices);
+    static void drawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances);
+    static void getIntegerv(GLenum name, GLint* data);
+    static const GLubyte* getStringi(GLenum name, GLuint index);
+    static void genQueries(GLsizei n, GLuint* queries);
+    static void deleteQueries(GLsizei n, const GLuint* queries);
+    static void beginQuery(GLenum target, GLuint query);
+    static void endQuery(GLenum target);
+    static void getQueryObjectiv(GLuint query, GLenum name, GLint* value);
+    static void getQueryObjectui64v(GLuint query, GLenum name, GLuint64* value);
+
+private:
+    struct State {
+        Backend backend = Driver;
+        Counters counters;
+        std::ostream* log = nullptr;
+        //recording backend
+        GLuint nextName = 1;
+        std::map<std::string, GLint> uniformNames;      //locations and block indices by name
+        std::vector<unsigned char> mapped;              //what a mapped buffer points at
+    };
+    static State& state();
+    //count the call, log it when recording; true if the driver must not be called
+    template <typename... Args>
+    static bool record(const char* name, const Args&... args);
+    static void newNames(GLsizei n, GLuint* names);
+    static GLint nameIndex(const GLchar* name);
+    static size_t pixelBytes(GLenum format, GLenum type);
+    static size_t triangles(GLenum mode, GLsizei count);
+};
+
+
+GLTF_GL::State& GLTF_GL::state() {
+    static State current;
+    return current;
+}
+
+template <typename... Args>
+bool GLTF_GL::record(const char* name, const Args&... args) {
+    State& current = state();
+    current.counters.calls++;
+    if (current.backend != Recording) return false;
+    if (current.log) {
+        *current.log << name << "(";
+        const char* separator = "";
+        ((*current.log << separator << args, separator = ", "), ...);
+        *current.log << ")\n";
+    }
+    return true;
+}
+
+void GLTF_GL::newNames(GLsizei n, GLuint* names) {
+    for (GLsizei i = 0; i < n; ++i) {
+        names[i] = state().nextName++;
+    }
+}
+
+// recorded programs know every uniform, the same name gets the same location in all of them
+GLint GLTF_GL::nameIndex(const GLchar* name) {
+    std::map<std::string, GLint>& names = state().uniformNames;
+    auto known = names.find(name);
+    if (known != names.end()) return known->second;
+    GLint index = (GLint)names.size();
+    names[name] = index;
+    return index;
+}
+
+size_t GLTF_GL::pixelBytes(GLenum format, GLenum type) {
+    size_t components = 4;
+    if (format == GL_RED || format == GL_RED_INTEGER) components = 1;
+    else if (format == GL_RG || format == GL_RG_INTEGER) components = 2;
+    else if (format == GL_RGB || format == GL_BGR || format == GL_RGB_INTEGER) components = 3;
+    size_t size = 1;
+    if (type == GL_UNSIGNED_SHORT || type == GL_SHORT || type == GL_HALF_FLOAT) size = 2;
+    else if (type == GL_UNSIGNED_INT || type == GL_INT || type == GL_FLOAT) size = 4;
+    return components * size;
+}
+
+size_t GLTF_GL::triangles(GLenum mode, GLsizei count) {
+    if (mode == GL_TRIANGLES) return count / 3;
+    if (mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN) return count > 2 ? count - 2 : 0;
+    return 0;
+}
+
+void GLTF_GL::genBuffers(GLsizei n, GLuint* buffers) {
+    state().counters.buffersCreated += n;
+    if (record("glGenBuffers", n)) {
+        newNames(n, buffers);
+        return;
+    }
+    glGenBuffers(n, buffers);
+}
+
+void GLTF_GL::deleteBuffers(GLsizei n, const GLuint* buffers) {
+    if (record("glDeleteBuffers", n)) return;
+    glDeleteBuffers(n, buffers);
+}
+
+void GLTF_GL::bindBuffer(GLenum target, GLuint buffer) {
+    state().counters.binds++;
+    if (record("glBindBuffer", target, buffer)) return;
+    glBindBuffer(target, buffer);
+}
+
+void GLTF_GL::bindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+    state().counters.binds++;
+    if (record("glBindBufferBase", target, index, buffer)) return;
+    glBindBufferBase(target, index, buffer);
+}
+
+void GLTF_GL::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    state().counters.binds++;
+    if (record("glBindBufferRange", target, index, buffer, offset, size)) return;
+    glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void GLTF_GL::bufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+    if (data) state().counters.bufferBytes += size;
+    if (record("glBufferData", target, size, usage)) return;
+    glBufferData(target, size, data, usage);
+}
+
+void GLTF_GL::bufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {
+    state().counters.bufferBytes += size;
+    if (record("glBufferSubData", target, offset, size)) return;
+    glBufferSubData(target, offset, size, data);
+}
+
+void* GLTF_GL::mapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access) {
+    if (access & GL_MAP_WRITE_BIT) state().counters.bufferBytes += length;
+    if (record("glMapBufferRange", target, offset, length, access)) {
+        state().mapped.resize(length);
+        return state().mapped.data();
+    }
+    return glMapBufferRange(target, offset, length, access);
+}
+
+GLboolean GLTF_GL::unmapBuffer(GLenum target) {
+    if (record("glUnmapBuffer", target)) return GL_TRUE;
+    return glUnmapBuffer(target);
+}
+
+void GLTF_GL::genVertexArrays(GLsizei n, GLuint* arrays) {
+    if (record("glGenVertexArrays", n)) {
+        newNames(n, arrays);
+        return;
+    }
+    glGenVertexArrays(n, arrays);
+}
+
+void GLTF_GL::deleteVertexArrays(GLsizei n, const GLuint* arrays) {
+    if (record("glDeleteVertexArrays", n)) return;
+    glDeleteVertexArrays(n, arrays);
+}
+
+void GLTF_GL::bindVertexArray(GLuint array) {
+    state().counters.binds++;
+    if (record("glBindVertexArray", array)) return;
+    glBindVertexArray(array);
+}
+
+void GLTF_GL::enableVertexAttribArray(GLuint index) {
+    if (record("glEnableVertexAttribArray", index)) return;
+    glEnableVertexAttribArray(index);
+}
+
+void GLTF_GL::vertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer) {
+    if (record("glVertexAttribPointer", index, size, type, (int)normalized, stride, (uintptr_t)pointer)) return;
+    glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+}
+
+void GLTF_GL::vertexAttribIPointer(GLuint index, GLint size, GLenum type, GLsizei stride, const void* pointer) {
+    if (record("glVertexAttribIPointer", index, size, type, stride, (uintptr_t)pointer)) return;
+    glVertexAttribIPointer(index, size, type, stride, pointer);
+}
+
+void GLTF_GL::vertexAttribDivisor(GLuint index, GLuint divisor) {
+    if (record("glVertexAttribDivisor", index, divisor)) return;
+    glVertexAttribDivisor(index, divisor);
+}
+
+void GLTF_GL::genTextures(GLsizei n, GLuint* textures) {
+    state().counters.texturesCreated += n;
+    if (record("glGenTextures", n)) {
+        newNames(n, textures);
+        return;
+    }
+    glGenTextures(n, textures);
+}
+
+void GLTF_GL::deleteTextures(GLsizei n, const GLuint* textures) {
+    if (record("glDeleteTextures", n)) return;
+    glDeleteTextures(n, textures);
+}
+
+void GLTF_GL::activeTexture(GLenum unit) {
+    if (record("glActiveTexture", unit)) return;
+    glActiveTexture(unit);
+}
+
+void GLTF_GL::bindTexture(GLenum target, GLuint texture) {
+    state().counters.textureBinds++;
+    state().counters.binds++;
+    if (record("glBindTexture", target, texture)) return;
+    glBindTexture(target, texture);
+}
+
+void GLTF_GL::texParameteri(GLenum target, GLenum name, GLint value) {
+    if (record("glTexParameteri", target, name, value)) return;
+    glTexParameteri(target, name, value);
+}
+
+void GLTF_GL::texParameterf(GLenum target, GLenum name, GLfloat value) {
+    if (record("glTexParameterf", target, name, value)) return;
+    glTexParameterf(target, name, value);
+}
+
+void GLTF_GL::pixelStorei(GLenum name, GLint value) {
+    if (record("glPixelStorei", name, value)) return;
+    glPixelStorei(name, value);
+}
+
+void GLTF_GL::texImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border,
+    GLenum format, GLenum type, const void* pixels) {
+    state().counters.textureBytes += (size_t)width * height * pixelBytes(format, type);
+    if (record("glTexImage2D", target, level, internalFormat, width, height, format, type)) return;
+    glTexImage2D(target, level, internalFormat, width, height, border, format, type, pixels);
+}
+
+void GLTF_GL::compressedTexImage2D(GLenum target, GLint level, GLenum internalFormat, GLsizei width, GLsizei height,
+    GLint border, GLsizei imageSize, const void* data) {
+    state().counters.textureBytes += imageSize;
+    if (record("glCompressedTexImage2D", target, level, internalFormat, width, height, imageSize)) return;
+    glCompressedTexImage2D(target, level, internalFormat, width, height, border, imageSize, data);
+}
+
+void GLTF_GL::generateMipmap(GLenum target) {
+    if (record("glGenerateMipmap", target)) return;
+    glGenerateMipmap(target);
+}
+
+void GLTF_GL::texBuffer(GLenum target, GLenum internalFormat, GLuint buffer) {
+    if (record("glTexBuffer", target, internalFormat, buffer)) return;
+    glTexBuffer(target, internalFormat, buffer);
+}
+
+void GLTF_GL::useProgram(GLuint program) {
+    state().counters.binds++;
+    if (record("glUseProgram", program)) return;
+    glUseProgram(program);
+}
+
+GLint GLTF_GL::getUniformLocation(GLuint program, const GLchar* name) {
+    if (record("glGetUniformLocation", program, name)) return nameIndex(name);
+    return glGetUniformLocation(program, name);
+}
+
+GLuint GLTF_GL::getUniformBlockIndex(GLuint program, const GLchar* name) {
+    if (record("glGetUniformBlockIndex", program, name)) return (GLuint)nameIndex(name);
+    return glGetUniformBlockIndex(program, name);
+}
+
+void GLTF_GL::uniformBlockBinding(GLuint program, GLuint block, GLuint binding) {
+    state().counters.uniformSets++;
+    if (record("glUniformBlockBinding", program, block, binding)) return;
+    glUniformBlockBinding(program, block, binding);
+}
+
+void GLTF_GL::uniform1i(GLint location, GLint value) {
+    state().counters.uniformSets++;
+    if (record("glUniform1i", location, value)) return;
+    glUniform1i(location, value);
+}
+
+void GLTF_GL::uniform1f(GLint location, GLfloat value) {
+    state().counters.uniformSets++;
+    if (record("glUniform1f", location, value)) return;
+    glUniform1f(location, value);
+}
+
+void GLTF_GL::uniform3fv(GLint location, GLsizei count, const GLfloat* value) {
+    state().counters.uniformSets++;
+    if (record("glUniform3fv", location, count)) return;
+    glUniform3fv(location, count, value);
+}
+
+void GLTF_GL::uniform4fv(GLint location, GLsizei count, const GLfloat* value) {
+    state().counters.uniformSets++;
+    if (record("glUniform4fv", location, count)) return;
+    glUniform4fv(location, count, value);
+}
+
+void GLTF_GL::uniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
+    state().counters.uniformSets++;
+    if (record("glUniformMatrix4fv", location, count, (int)transpose)) return;
+    glUniformMatrix4fv(location, count, transpose, value);
+}
+
+void GLTF_GL::enable(GLenum capability) {
+    if (record("glEnable", capability)) return;
+    glEnable(capability);
+}
+
+void GLTF_GL::disable(GLenum capability) {
+    if (record("glDisable", capability)) return;
+    glDisable(capability);
+}
+
+// a recording starts with every capability disabled, as GL does but for dithering
+GLboolean GLTF_GL::isEnabled(GLenum capability) {
+    if (record("glIsEnabled", capability)) return GL_FALSE;
+    return glIsEnabled(capability);
+}
+
+void GLTF_GL::depthMask(GLboolean write) {
+    if (record("glDepthMask", (int)write)) return;
+    glDepthMask(write);
+}
+
+void GLTF_GL::blendFunc(GLenum source, GLenum destination) {
+    if (record("glBlendFunc", source, destination)) return;
+    glBlendFunc(source, destination);
+}
+
+void GLTF_GL::blendFuncSeparate(GLenum sourceRGB, GLenum destinationRGB, GLenum sourceAlpha, GLenum destinationAlpha) {
+    if (record("glBlendFuncSeparate", sourceRGB, destinationRGB, sourceAlpha, destinationAlpha)) return;
+    glBlendFuncSeparate(sourceRGB, destinationRGB, sourceAlpha, destinationAlpha);
+}
+
+void GLTF_GL::drawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {
+    state().counters.drawCalls++;
+    state().counters.triangles += triangles(mode, count);
+    if (record("glDrawElements", mode, count, type, (uintptr_t)indices)) return;
+    glDrawElements(mode, count, type, indices);
+}
+
+void GLTF_GL::drawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances) {
+    state().counters.drawCalls++;
+    state().counters.triangles += triangles(mode, count) * std::max(instances, 0);
+    if (record("glDrawElementsInstanced", mode, count, type, (uintptr_t)indices, instances)) return;
+    glDrawElementsInstanced(mode, count, type, indices, instances);
+}
+
+// a recording has a 1280x720 viewport, the largest uniform buffer alignment GL allows, GL's initial
+// depth writes and blend function and no extensions
+void GLTF_GL::getIntegerv(GLenum name, GLint* data) {
+    if (!record("glGetIntegerv", name)) {
+        glGetIntegerv(name, data);
+        return;
+    }
+    if (name == GL_VIEWPORT) {
+        data[0] = 0;
+        data[1] = 0;
+        data[2] = 1280;
+        data[3] = 720;
+    }
+    else if (name == GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT) data[0] = 256;
+    else if (name == GL_DEPTH_WRITEMASK) data[0] = GL_TRUE;
+    else if (name == GL_BLEND_SRC_RGB || name == GL_BLEND_SRC_ALPHA) data[0] = GL_ONE;
+    else if (name == GL_BLEND_DST_RGB || name == GL_BLEND_DST_ALPHA) data[0] = GL_ZERO;
+    else data[0] = 0;
+}
+
+const GLubyte* GLTF_GL::getStringi(GLenum name, GLuint index) {
+    if (record("glGetStringi", name, index)) return (const GLubyte*)"";
+    return glGetStringi(name, index);
+}
+
+void GLTF_GL::genQueries(GLsizei n, GLuint* queries) {
+    if (record("glGenQueries", n)) {
+        newNames(n, queries);
+        return;
+    }
+    glGenQueries(n, queries);
+}
+
+void GLTF_GL::deleteQueries(GLsizei n, const GLuint* queries) {
+    if (record("glDeleteQueries", n)) return;
+    glDeleteQueries(n, queries);
+}
+
+void GLTF_GL::beginQuery(GLenum target, GLuint query) {
+    if (record("glBeginQuery", target, query)) return;
+    glBeginQuery(target, query);
+}
+
+void GLTF_GL::endQuery(GLenum target) {
+    if (record("glEndQuery", target)) return;
+    glEndQuery(target);
+}
+
+// recorded queries are always available and measure nothing
+void GLTF_GL::getQueryObjectiv(GLuint query, GLenum name, GLint* value) {
+    if (record("glGetQueryObjectiv", query, name)) {
+        *value = name == GL_QUERY_RESULT_AVAILABLE ? GL_TRUE : 0;
+        return;
+    }
+    glGetQueryObjectiv(query, name, value);
+}
+
+void GLTF_GL::getQueryObjectui64v(GLuint query, GLenum name, GLuint64* value) {
+    if (record("glGetQueryObjectui64v", query, name)) {
+        *value = 0;
+        return;
+    }
+    glGetQueryObjectui64v(query, name, value);
+}
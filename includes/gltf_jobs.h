@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// fixed set of worker threads for the CPU side of loading (parsing, decoding) and of frames
+// (culling, draw packets). every worker owns a deque: tasks it submits go to its back and
+// it takes its newest work first, idle workers steal the oldest work of the others. tasks
+// from other threads go to a shared queue that workers take from before they steal
+class GLTF_ThreadPool
+{
+public:
+    explicit GLTF_ThreadPool(unsigned threads = 0);     //0 picks one thread per core minus the caller
+    ~GLTF_ThreadPool();
+    GLTF_ThreadPool(const GLTF_ThreadPool&) = delete;
+    GLTF_ThreadPool& operator=(const GLTF_ThreadPool&) = delete;
+
+    //process-wide pool used by the loader
+    static GLTF_ThreadPool& shared();
+
+    size_t size() const { return workers.size(); }
+    template <typename F>
+    std::future<decltype(std::declval<F>()())> submit(F&& task);
+    //run body(0..count-1) on the pool and the calling thread, returns when all are done;
+    //safe to call from inside a pool task. maxThreads caps the threads taking part,
+    //the caller included, 0 for all of them
+    void parallelFor(size_t count, const std::function<void(size_t)>& body, size_t maxThreads = 0);
+    //fork-join over [0, count) in chunks of chunkSize: body(chunk, begin, end). chunks are
+    //numbered in order, so per-chunk output merged by chunk index is deterministic
+    void parallelChunks(size_t count, size_t chunkSize, const std::function<void(size_t, size_t, size_t)>& body,
+        size_t maxThreads = 0);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+    struct Worker {
+        const GLTF_ThreadPool* pool = nullptr;
+        size_t index = 0;
+    };
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues;     //one per worker, then the shared one
+    std::atomic<size_t> pending{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void push(std::function<void()> task);
+    bool take(size_t worker, std::function<void()>& task);
+    void workerLoop(size_t worker);
+    static Worker& currentWorker();
+};
+
+
+GLTF_ThreadPool::GLTF_ThreadPool(unsigned threads) {
+    if (threads == 0) {
+        unsigned cores = std::thread::hardware_concurrency();
+        threads = cores > 1 ? cores - 1 : 1;
+    }
+    for (unsigned i = 0; i <= threads; ++i) {
+        queues.emplace_back(new Queue());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(&GLTF_ThreadPool::workerLoop, this, (size_t)i);
+    }
+}
+
+GLTF_ThreadPool::~GLTF_ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+GLTF_ThreadPool& GLTF_ThreadPool::shared() {
+    static GLTF_ThreadPool pool;
+    return pool;
+}
+
+template <typename F>
+std::future<decltype(std::declval<F>()())> GLTF_ThreadPool::submit(F&& task) {
+    typedef decltype(std::declval<F>()()) Result;
+    std::shared_ptr<std::packaged_task<Result()>> packaged =
+        std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+    std::future<Result> result = packaged->get_future();
+    push([packaged]() { (*packaged)(); });
+    return result;
+}
+
+// the pool and index of the calling worker thread, no pool for other threads
+GLTF_ThreadPool::Worker& GLTF_ThreadPool::currentWorker() {
+    thread_local Worker worker;
+    return worker;
+}
+
+void GLTF_ThreadPool::push(std::function<void()> task) {
+    const Worker& caller = currentWorker();
+    Queue& queue = *queues[caller.pool == this ? caller.index : queues.size() - 1];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        //taken so a worker between its check and its wait cannot miss the wake up
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        pending++;
+    }
+    wake.notify_one();
+}
+
+// own newest task, else the oldest shared one, else the oldest of another worker
+bool GLTF_ThreadPool::take(size_t worker, std::function<void()>& task) {
+    {
+        Queue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    //queues is not resized once workers run, workers may still be starting
+    size_t count = queues.size() - 1;
+    for (size_t i = 0; i < count; ++i) {
+        //the shared queue first, then the next workers round
+        Queue& victim = *queues[i == 0 ? count : (worker + i) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void GLTF_ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body, size_t maxThreads) {
+    if (count == 0) return;
+    //helpers that start after the work is gone just return, so the caller never
+    //waits on a task that needs its own thread to run
+    struct Shared {
+        std::atomic<size_t> next{ 0 };
+        std::atomic<size_t> finished{ 0 };
+        std::function<void(size_t)> body;
+        size_t count = 0;
+        std::mutex mutex;
+        std::condition_variable done;
+        void run() {
+            size_t i;
+            while ((i = next.fetch_add(1)) < count) {
+                body(i);
+                if (finished.fetch_add(1) + 1 == count) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    done.notify_all();
+                }
+            }
+        }
+    };
+    std::shared_ptr<Shared> shared = std::make_shared<Shared>();
+    shared->body = body;
+    shared->count = count;
+
+    size_t helpers = std::min(count - 1, workers.size());
+    if (maxThreads > 0) helpers = std::min(helpers, maxThreads - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        push([shared]() { shared->run(); });
+    }
+    shared->run();
+
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->done.wait(lock, [&]() { return shared->finished.load() == count; });
+}
+
+void GLTF_ThreadPool::parallelChunks(size_t count, size_t chunkSize, const std::function<void(size_t, size_t, size_t)>& body,
+    size_t maxThreads) {
+    chunkSize = std::max<size_t>(chunkSize, 1);
+    parallelFor((count + chunkSize - 1) / chunkSize, [&](size_t chunk) {
+        body(chunk, chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+    }, maxThreads);
+}
+
+void GLTF_ThreadPool::workerLoop(size_t worker) {
+    currentWorker().pool = this;
+    currentWorker().index = worker;
+    for (;;) {
+        std::function<void()> task;
+        if (take(worker, task)) {
+            pending--;
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this]() { return stopping || pending.load() > 0; });
+        if (stopping && pending.load() == 0) return;
+    }
+}
@@ -0,0 +1,409 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <tiny_gltf.h>
+#include "gltf_jobs.h"
+#include "gltf_transforms.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define GLTF_LIGHTS_SSE
+#endif
+
+
+// a KHR_lights_punctual light, in the space of its node or, once placed, in world space
+struct GLTF_Light {
+    enum Type { Directional, Point, Spot };
+    Type type = Point;
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f);    //where it shines, unit length
+    glm::vec3 color = glm::vec3(1.0f);
+    float intensity = 1.0f;
+    float range = 0.0f;                                     //0 for the infinite range of the extension
+    float innerConeCos = 1.0f;                              //spot lights, cosines of the cone angles
+    float outerConeCos = 0.70710678f;
+};
+
+
+// the lights of one scene: every node of it with a KHR_lights_punctual light, placed by the
+// world matrix of its node, so lights follow animation and moved nodes like meshes do
+class GLTF_SceneLights
+{
+public:
+    void build(const tinygltf::Model& model, const GLTF_Transforms& transforms);
+    //place the lights again if the transforms changed since the last call, true if they did
+    bool update(const GLTF_Transforms& transforms);
+    const std::vector<GLTF_Light>& lights() const { return placed; }
+    size_t size() const { return placed.size(); }
+    unsigned version() const { return changeCount; }    //bumped whenever the lights are placed
+
+private:
+    std::vector<GLTF_Light> local;      //as the extension defines them, shining down -z
+    std::vector<int> slots;             //transform slot of the node of each light
+    std::vector<GLTF_Light> placed;
+    unsigned transformsVersion = 0;
+    bool current = false;
+    unsigned changeCount = 0;
+};
+
+
+// clustered light assignment. the view is cut into gridX by gridY tiles over the screen and
+// gridZ slices spaced exponentially in view depth; every cluster gets the compact list of the
+// point and spot lights whose bounds touch it, so a fragment shades only the lights of its
+// cluster. a light's bounds are the screen rectangle and depth range of the box around its
+// sphere (around the cone for spot lights): conservative, a light is never missed.
+// lights are bounded on several threads with SSE, each depth slice is binned as one task
+class GLTF_LightClusters
+{
+public:
+    struct Settings {
+        int gridX = 16;
+        int gridY = 9;
+        int gridZ = 24;
+        //lights of infinite range end where color * intensity / distance^2 falls below this
+        float cutoff = 1.0f / 256.0f;
+        float maxDepth = 1000.0f;                       //far end of the slices for projections without one
+    };
+    struct Stats {
+        size_t lights = 0;                              //point and spot lights given
+        size_t visible = 0;                             //of those, touching the view
+        size_t directional = 0;                         //lit everywhere, in no cluster
+        size_t indices = 0;                             //entries of all cluster lists
+        size_t maxPerCluster = 0;
+        double milliseconds = 0.0;
+    };
+    Settings settings;
+
+    //lights in world space, viewProjection a perspective or orthographic view-projection.
+    //maxThreads caps the threads of GLTF_ThreadPool::shared() taking part, 1 stays on the caller
+    void assign(const std::vector<GLTF_Light>& lights, const glm::mat4& viewProjection, size_t maxThreads = 0);
+    //three texels per light, the directional lights first:
+    //position and range, color * intensity and spot scale, direction and spot offset
+    const std::vector<glm::vec4>& lightData() const { return data; }
+    size_t directionalCount() const { return counters.directional; }
+    //first list entry and light count of each cluster, x fastest, then y, then z
+    const std::vector<uint32_t>& clusters() const { return ranges; }
+    //light numbers into lightData, cluster after cluster
+    const std::vector<uint32_t>& indices() const { return list; }
+    //the grid of the last assign; the slice of view depth w is log(w) * depthScale + depthBias
+    int grid(int axis) const { return dimensions[axis]; }
+    size_t clusterCount() const { return (size_t)dimensions[0] * dimensions[1] * dimensions[2]; }
+    float depthScale() const { return scale; }
+    float depthBias() const { return bias; }
+    const Stats& stats() const { return counters; }
+
+private:
+    struct Bounds {
+        int x0, x1, y0, y1, z0, z1;     //clusters touched, inclusive; x0 > x1 out of view
+    };
+    std::vector<glm::vec4> data;
+    std::vector<uint32_t> ranges;
+    std::vector<uint32_t> list;
+    std::vector<glm::vec4> spheres;     //center, radius by local light
+    std::vector<Bounds> bounds;
+    std::vector<std::vector<uint32_t>> sliceLists;
+    int dimensions[3] = { 1, 1, 1 };
+    float scale = 0.0f;
+    float bias = 0.0f;
+    float nearDepth = 0.0f;
+    float farDepth = 0.0f;
+    Stats counters;
+    static const size_t boundChunk = 256;   //lights per task when bounding
+
+    void bound(const glm::vec4& sphere, const glm::mat4& viewProjection, Bounds& out) const;
+    int slice(float depth) const;
+    static void run(size_t count, const std::function<void(size_t)>& body, size_t maxThreads);
+};
+
+
+void GLTF_SceneLights::build(const tinygltf::Model& model, const GLTF_Transforms& transforms) {
+    local.clear();
+    slots.clear();
+    for (size_t slot = 0; slot < transforms.size(); ++slot) {
+        const tinygltf::Node& node = model.nodes[transforms.node((int)slot)];
+        if (node.light < 0 || node.light >= (int)model.lights.size()) continue;
+        const tinygltf::Light& source = model.lights[node.light];
+        GLTF_Light light;
+        if (source.type == "directional") {
+            light.type = GLTF_Light::Directional;
+        }
+        else if (source.type == "point") {
+            light.type = GLTF_Light::Point;
+        }
+        else if (source.type == "spot") {
+            light.type = GLTF_Light::Spot;
+            //the extension keeps the inner angle below the outer one, both within [0, pi/2]
+            double outer = std::min(std::max(source.spot.outerConeAngle, 0.0), 1.5707963267948966);
+            double inner = std::min(std::max(source.spot.innerConeAngle, 0.0), outer);
+            light.innerConeCos = (float)std::cos(inner);
+            light.outerConeCos = (float)std::cos(outer);
+        }
+        else {
+            continue;
+        }
+        if (source.color.size() >= 3) light.color = glm::vec3(source.color[0], source.color[1], source.color[2]);
+        light.intensity = (float)source.intensity;
+        light.range = source.range > 0.0 ? (float)source.range : 0.0f;
+        local.push_back(light);
+        slots.push_back((int)slot);
+    }
+    placed = local;
+    current = false;
+    update(transforms);
+}
+
+// node scale moves and turns a light but leaves its range and intensity alone
+bool GLTF_SceneLights::update(const GLTF_Transforms& transforms) {
+    if (current && transformsVersion == transforms.version()) return false;
+    current = true;
+    transformsVersion = transforms.version();
+    for (size_t i = 0; i < placed.size(); ++i) {
+        const glm::mat4& world = transforms.world(slots[i]);
+        placed[i].position = glm::vec3(world[3]);
+        glm::vec3 direction = glm::mat3(world) * local[i].direction;
+        float length = glm::length(direction);
+        placed[i].direction = length > 0.0f ? direction / length : local[i].direction;
+    }
+    changeCount++;
+    return true;
+}
+
+void GLTF_LightClusters::run(size_t count, const std::function<void(size_t)>& body, size_t maxThreads) {
+    if (maxThreads == 1 || count <= 1) {
+        for (size_t i = 0; i < count; ++i) body(i);
+        return;
+    }
+    GLTF_ThreadPool::shared().parallelFor(count, body, maxThreads);
+}
+
+int GLTF_LightClusters::slice(float depth) const {
+    int z = (int)std::floor(std::log(depth) * scale + bias);
+    return std::min(std::max(z, 0), dimensions[2] - 1);
+}
+
+void GLTF_LightClusters::assign(const std::vector<GLTF_Light>& lights, const glm::mat4& viewProjection, size_t maxThreads) {
+    auto start = std::chrono::steady_clock::now();
+    counters = Stats();
+    dimensions[0] = std::max(settings.gridX, 1);
+    dimensions[1] = std::max(settings.gridY, 1);
+    dimensions[2] = std::max(settings.gridZ, 1);
+
+    //depth range from the matrix: with clip z = -A * w + B (w the view depth), ndc z is -1 at
+    //w = B / (A - 1) and 1 at w = B / (A + 1). orthographic matrices have no depth in w
+    glm::vec4 rowZ(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+    glm::vec4 rowW(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+    float lengthW = glm::dot(glm::vec3(rowW), glm::vec3(rowW));
+    bool perspective = lengthW > 1e-12f;
+    scale = 0.0f;
+    bias = 0.0f;
+    nearDepth = 0.0f;
+    farDepth = 0.0f;
+    if (perspective) {
+        float a = -glm::dot(glm::vec3(rowZ), glm::vec3(rowW)) / lengthW;
+        float b = rowZ.w + a * rowW.w;
+        nearDepth = std::fabs(a - 1.0f) > 1e-6f ? b / (a - 1.0f) : 0.0f;
+        farDepth = std::fabs(a + 1.0f) > 1e-6f ? b / (a + 1.0f) : 0.0f;
+        if (nearDepth > farDepth && farDepth > 0.0f) std::swap(nearDepth, farDepth);
+        if (!(nearDepth > 0.0f)) nearDepth = 0.01f;
+        if (!(farDepth > nearDepth) || farDepth > settings.maxDepth) farDepth = std::max(settings.maxDepth, nearDepth * 2.0f);
+        scale = dimensions[2] / std::log(farDepth / nearDepth);
+        bias = -std::log(nearDepth) * scale;
+    }
+    else {
+        dimensions[2] = 1;
+    }
+
+    //pack the lights, directional ones first
+    size_t directional = 0;
+    for (const GLTF_Light& light : lights) {
+        if (light.type == GLTF_Light::Directional) directional++;
+    }
+    size_t localCount = lights.size() - directional;
+    counters.directional = directional;
+    counters.lights = localCount;
+    data.resize(3 * lights.size());
+    spheres.resize(localCount);
+    size_t nextDirectional = 0;
+    size_t nextLocal = 0;
+    for (const GLTF_Light& light : lights) {
+        bool isDirectional = light.type == GLTF_Light::Directional;
+        size_t index = isDirectional ? nextDirectional++ : directional + nextLocal;
+        float brightest = std::max(light.color.x, std::max(light.color.y, light.color.z)) * light.intensity;
+        float range = light.range > 0.0f ? light.range : std::sqrt(std::max(brightest, 0.0f) / settings.cutoff);
+        //spot attenuation is clamp(dot(-l, direction) * scale + offset, 0, 1), 1 for point lights
+        float spotScale = 0.0f;
+        float spotOffset = 1.0f;
+        if (light.type == GLTF_Light::Spot) {
+            spotScale = 1.0f / std::max(light.innerConeCos - light.outerConeCos, 0.001f);
+            spotOffset = -light.outerConeCos * spotScale;
+        }
+        data[3 * index] = glm::vec4(light.position, isDirectional ? 0.0f : range);
+        data[3 * index + 1] = glm::vec4(light.color * light.intensity, spotScale);
+        data[3 * index + 2] = glm::vec4(light.direction, spotOffset);
+        if (isDirectional) continue;
+        //sphere around the cone: wide cones fit the cap circle, narrow ones the apex and the tip
+        glm::vec4 sphere(light.position, range);
+        if (light.type == GLTF_Light::Spot) {
+            float cosine = std::max(light.outerConeCos, 0.0f);
+            if (cosine < 0.70710678f) {
+                sphere = glm::vec4(light.position + light.direction * (range * cosine), range * std::sqrt(1.0f - cosine * cosine));
+            }
+            else {
+                float half = range / (2.0f * cosine);
+                sphere = glm::vec4(light.position + light.direction * half, half);
+            }
+        }
+        spheres[nextLocal++] = sphere;
+    }
+
+    bounds.resize(localCount);
+    run((localCount + boundChunk - 1) / boundChunk, [&](size_t chunk) {
+        size_t end = std::min(localCount, (chunk + 1) * boundChunk);
+        for (size_t i = chunk * boundChunk; i < end; ++i) {
+            bound(spheres[i], viewProjection, bounds[i]);
+        }
+    }, maxThreads);
+
+    //each slice counts its clusters' lights, turns the counts into offsets and fills its
+    //list in light order, so the lists come out the same on any number of threads
+    size_t tiles = (size_t)dimensions[0] * dimensions[1];
+    ranges.assign(2 * tiles * dimensions[2], 0);
+    sliceLists.resize(dimensions[2]);
+    run(dimensions[2], [&](size_t z) {
+        uint32_t* sliceRanges = &ranges[2 * tiles * z];
+        for (size_t i = 0; i < localCount; ++i) {
+            const Bounds& b = bounds[i];
+            if (b.x0 > b.x1 || (int)z < b.z0 || (int)z > b.z1) continue;
+            for (int y = b.y0; y <= b.y1; ++y) {
+                for (int x = b.x0; x <= b.x1; ++x) sliceRanges[2 * (y * dimensions[0] + x) + 1]++;
+            }
+        }
+        uint32_t offset = 0;
+        for (size_t tile = 0; tile < tiles; ++tile) {
+            sliceRanges[2 * tile] = offset;
+            offset += sliceRanges[2 * tile + 1];
+        }
+        std::vector<uint32_t>& sliceList = sliceLists[z];
+        sliceList.resize(offset);
+        for (size_t i = 0; i < localCount; ++i) {
+            const Bounds& b = bounds[i];
+            if (b.x0 > b.x1 || (int)z < b.z0 || (int)z > b.z1) continue;
+            for (int y = b.y0; y <= b.y1; ++y) {
+                for (int x = b.x0; x <= b.x1; ++x) sliceList[sliceRanges[2 * (y * dimensions[0] + x)]++] = (uint32_t)(directional + i);
+            }
+        }
+        //the fill moved every offset to the end of its list
+        for (size_t tile = 0; tile < tiles; ++tile) sliceRanges[2 * tile] -= sliceRanges[2 * tile + 1];
+    }, maxThreads);
+
+    size_t total = 0;
+    for (const std::vector<uint32_t>& sliceList : sliceLists) total += sliceList.size();
+    list.resize(total);
+    uint32_t base = 0;
+    for (int z = 0; z < dimensions[2]; ++z) {
+        uint32_t* sliceRanges = &ranges[2 * tiles * z];
+        for (size_t tile = 0; tile < tiles; ++tile) {
+            sliceRanges[2 * tile] += base;
+            counters.maxPerCluster = std::max<size_t>(counters.maxPerCluster, sliceRanges[2 * tile + 1]);
+        }
+        std::copy(sliceLists[z].begin(), sliceLists[z].end(), list.begin() + base);
+        base += (uint32_t)sliceLists[z].size();
+    }
+    for (const Bounds& b : bounds) {
+        if (b.x0 <= b.x1) counters.visible++;
+    }
+    counters.indices = total;
+    counters.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// clusters touched by the box around a sphere: its 8 corners in clip space give the screen
+// rectangle and the view depth range. a corner behind the eye makes the whole screen
+void GLTF_LightClusters::bound(const glm::vec4& sphere, const glm::mat4& m, Bounds& out) const {
+    out = { 1, 0, 0, -1, 0, -1 };
+    float x0 = sphere.x - sphere.w, x1 = sphere.x + sphere.w;
+    float y0 = sphere.y - sphere.w, y1 = sphere.y + sphere.w;
+    float z0 = sphere.z - sphere.w, z1 = sphere.z + sphere.w;
+    float minX, maxX, minY, maxY, minW, maxW;
+#ifdef GLTF_LIGHTS_SSE
+    //4 corners at a time: x and y vary across the lanes, z is one per half
+    __m128 cx = _mm_setr_ps(x0, x1, x0, x1);
+    __m128 cy = _mm_setr_ps(y0, y0, y1, y1);
+    __m128 clip[3][2];                  //x, y, w rows, near and far half
+    const int rows[3] = { 0, 1, 3 };
+    for (int r = 0; r < 3; ++r) {
+        int row = rows[r];
+        __m128 xy = _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(m[0][row])), _mm_mul_ps(cy, _mm_set1_ps(m[1][row])));
+        clip[r][0] = _mm_add_ps(xy, _mm_set1_ps(m[2][row] * z0 + m[3][row]));
+        clip[r][1] = _mm_add_ps(xy, _mm_set1_ps(m[2][row] * z1 + m[3][row]));
+    }
+    auto horizontalMin = [](__m128 v) {
+        v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtss_f32(_mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2))));
+    };
+    auto horizontalMax = [](__m128 v) {
+        v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtss_f32(_mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2))));
+    };
+    minW = horizontalMin(_mm_min_ps(clip[2][0], clip[2][1]));
+    maxW = horizontalMax(_mm_max_ps(clip[2][0], clip[2][1]));
+    if (maxW <= 0.0f) return;
+    if (minW > 1e-6f) {
+        __m128 ndcX0 = _mm_div_ps(clip[0][0], clip[2][0]), ndcX1 = _mm_div_ps(clip[0][1], clip[2][1]);
+        __m128 ndcY0 = _mm_div_ps(clip[1][0], clip[2][0]), ndcY1 = _mm_div_ps(clip[1][1], clip[2][1]);
+        minX = horizontalMin(_mm_min_ps(ndcX0, ndcX1));
+        maxX = horizontalMax(_mm_max_ps(ndcX0, ndcX1));
+        minY = horizontalMin(_mm_min_ps(ndcY0, ndcY1));
+        maxY = horizontalMax(_mm_max_ps(ndcY0, ndcY1));
+    }
+#else
+    float clipX[8], clipY[8], clipW[8];
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec4 clip = m * glm::vec4(corner & 1 ? x1 : x0, corner & 2 ? y1 : y0, corner & 4 ? z1 : z0, 1.0f);
+        clipX[corner] = clip.x;
+        clipY[corner] = clip.y;
+        clipW[corner] = clip.w;
+    }
+    minW = *std::min_element(clipW, clipW + 8);
+    maxW = *std::max_element(clipW, clipW + 8);
+    if (maxW <= 0.0f) return;
+    if (minW > 1e-6f) {
+        minX = minY = 1e30f;
+        maxX = maxY = -1e30f;
+        for (int corner = 0; corner < 8; ++corner) {
+            minX = std::min(minX, clipX[corner] / clipW[corner]);
+            maxX = std::max(maxX, clipX[corner] / clipW[corner]);
+            minY = std::min(minY, clipY[corner] / clipW[corner]);
+            maxY = std::max(maxY, clipY[corner] / clipW[corner]);
+        }
+    }
+#endif
+    if (minW <= 1e-6f) {
+        minX = minY = -1.0f;
+        maxX = maxY = 1.0f;
+    }
+    if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f) return;
+    if (nearDepth > 0.0f && (maxW < nearDepth || minW > farDepth)) return;
+    auto tile = [](float ndc, int count) {
+        return std::min(std::max((int)std::floor((ndc * 0.5f + 0.5f) * count), 0), count - 1);
+    };
+    out.x0 = tile(minX, dimensions[0]);
+    out.x1 = tile(maxX, dimensions[0]);
+    out.y0 = tile(minY, dimensions[1]);
+    out.y1 = tile(maxY, dimensions[1]);
+    if (nearDepth > 0.0f) {
+        out.z0 = slice(std::max(minW, nearDepth));
+        out.z1 = slice(std::min(maxW, farDepth));
+    }
+    else {
+        out.z0 = 0;
+        out.z1 = 0;
+    }
+}
@@ -1,7 +1,14 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <deque>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
 
 #include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
@@ -9,6 +16,25 @@
 #include <camera.h>
 
 #include <tiny_gltf.h>
+#include "gltf_accessor.h"
+#include "gltf_animation.h"
+#include "gltf_bake.h"
+#include "gltf_batching.h"
+#include "gltf_buffers.h"
+#include "gltf_cache.h"
+#include "gltf_culling.h"
+#include "gltf_file.h"
+#include "gltf_gl.h"
+#include "gltf_jobs.h"
+#include "gltf_lights.h"
+#include "gltf_optimize.h"
+#include "gltf_sort.h"
+#include "gltf_state.h"
+#include "gltf_streaming.h"
+#include "gltf_textures.h"
+#include "gltf_trace.h"
+#include "gltf_transforms.h"
+#include "gltf_vertex.h"
 #define TINYGLTF_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -17,17 +43,228 @@
 
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
+//instanced draws feed the model matrix as a mat4 attribute at locations 8-11
+//and set the "instanced" uniform, single draws keep using the "model" uniform
+#define GLTF_INSTANCE_MATRIX_LOCATION 8
+
+//alpha-masked materials set the "alphaCutoff" uniform for the shader to discard below,
+//every other draw sets it to -1. blended draws come last, back to front, without depth
+//writes; single-sided materials are drawn with back faces culled
+
+//a shader that declares this uniform block gets its lights from one buffer, written only
+//when the lights change; otherwise the pointLight[i]/directionalLight[i] uniforms are set
+//    layout(std140) uniform GLTFLights {
+//        ivec4 lightCounts;                                  //x point lights, y directional lights
+//        vec4 pointLightPosition[GLTF_MAX_LIGHTS];           //w intensity
+//        vec4 pointLightColor[GLTF_MAX_LIGHTS];
+//        vec4 directionalLightDirection[GLTF_MAX_LIGHTS];    //w intensity
+//        vec4 directionalLightColor[GLTF_MAX_LIGHTS];
+//    };
+#define GLTF_MAX_LIGHTS 32
+#define GLTF_LIGHTS_BINDING 0
+
+//a shader that declares gltfLightClusters shades the compiled scene with clustered lights:
+//every KHR_lights_punctual light, placed by its node, spot lights included, assigned to view
+//clusters every frame (see GLTF_LightClusters). texel layouts are those of its accessors
+//    uniform samplerBuffer gltfLightData;        //3 texels per light, directional lights first
+//    uniform usamplerBuffer gltfLightClusters;   //rg: first entry in gltfLightIndices, light count
+//    uniform usamplerBuffer gltfLightIndices;    //r: light number in gltfLightData
+//    uniform vec4 gltfClusterGrid;               //tiles x and y, depth slices, directional lights
+//    uniform vec4 gltfClusterDepth;              //slice scale and bias, 1 / viewport width and height
+//a fragment's cluster is (slice * grid.y + tile.y) * grid.x + tile.x, clamped to the grid, with
+//    tile = ivec2(gl_FragCoord.xy * gltfClusterDepth.zw * gltfClusterGrid.xy)
+//    slice = int(log(1.0 / gl_FragCoord.w) * gltfClusterDepth.x + gltfClusterDepth.y)
+#define GLTF_LIGHT_DATA_UNIT 4
+#define GLTF_LIGHT_CLUSTERS_UNIT 5
+#define GLTF_LIGHT_INDICES_UNIT 6
+
+//vertex attributes come in at the GLTF_*_LOCATION locations of gltf_vertex.h
+
+//skinned draws set the "skinned" uniform and bind their joint palette to this block, JOINTS_0
+//and WEIGHTS_0 come in at GLTF_JOINTS_LOCATION and GLTF_WEIGHTS_LOCATION (uvec4 and vec4). the
+//matrices are in the space of the mesh node, so the model matrix still applies after them
+//    layout(std140) uniform GLTFJoints {
+//        mat4 jointMatrix[GLTF_MAX_JOINTS];
+//    };
+#define GLTF_MAX_JOINTS 256
+#define GLTF_JOINTS_BINDING 1
+
 
 class GLTF_Model
 {
 public:
     bool gammaCorrection;
+    bool useCompiledScene = true;                       //draw from the flat render list, false draws the node tree recursively
     void draw(Shader& shader);                          //draw the model
+    void draw(GLuint program);                          //same with the program of a shader
+    bool sortDraws = true;                              //submit compiled draws by pass, state and depth, false keeps scene order
+    //move a node at runtime, children follow on the next draw
+    void setNodeTransform(int node, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale);
+    void setNodeMatrix(int node, const glm::mat4& matrix);
+    //counters of the last draw
+    struct DrawStats {
+        size_t drawCalls = 0;
+        size_t instances = 0;
+        size_t glCalls = 0;                             //GL calls made by the draw
+        size_t glCallsSkipped = 0;                      //redundant state changes left out
+        double gpuMilliseconds = 0.0;                   //with gpuTiming, the latest result, a few frames old
+        double prepareMilliseconds = 0.0;               //CPU: transforms, culling and draw packets before submission
+    };
+    bool gpuTiming = false;                             //time draw() on the GPU with timer queries
+    const DrawStats& drawStats() const { return stats; }
+    //threads preparing a compiled frame (transforms, culling, draw packets) on
+    //GLTF_ThreadPool::shared(), the render thread included: 1 keeps it all on the render
+    //thread, 0 uses the whole pool. GL calls stay on the render thread, the frame is the same
+    size_t frameThreads = 0;
+    const GLTF_BufferArena::Stats& bufferStats() const { return asset->buffers.stats(); }
+
+    //view-frustum culling of the compiled scene against the frustum given to setViewProjection,
+    //or else the camera of the constructor with its zoom as field of view over the viewport
+    bool frustumCulling = true;
+    void setViewProjection(const glm::mat4& viewProjection);
+    struct CullingStats {
+        size_t draws = 0;
+        size_t nodesTested = 0;                         //BVH nodes and draw boxes tested
+        size_t drawsCulled = 0;
+        double milliseconds = 0.0;                      //refit and traversal
+    };
+    const CullingStats& cullingStats() const { return cullStats; }
+
+    //KHR_lights_punctual lights of the compiled scene in world space, they follow their nodes.
+    //the clusters are assigned on frameThreads threads, only for shaders that read them
+    const std::vector<GLTF_Light>& lights() const { return sceneLights.lights(); }
+    GLTF_LightClusters::Settings& lightClusterSettings() { return lightClusters.settings; }
+    const GLTF_LightClusters::Stats& lightClusterStats() const { return lightClusters.stats(); }
+
+    //asynchronous loading: parsing and image decoding run on worker threads, the GL
+    //uploads are queued and drained by draw() within uploadBudget every frame.
+    //until then draw() shows the primitives whose buffers are already resident
+    static std::shared_ptr<GLTF_Model> loadAsync(std::string const& path, Camera& camera, bool gamma = false);
+    enum LoadState { Loading, Loaded, Failed };
+    LoadState loadState() const { return asset ? asset->state : Failed; }
+    struct UploadBudget {
+        double milliseconds = 2.0;
+        size_t bytes = 8 * 1024 * 1024;
+    };
+    UploadBudget uploadBudget;                          //GL upload work allowed per frame while loading
+    void processUploads();                              //called by draw(), may be called directly as well
+    //where the load of the asset went, in milliseconds
+    struct LoadTimings {
+        double parse = 0.0;                             //glTF or baked blob
+        double decode = 0.0;                            //images
+        double optimize = 0.0;                          //meshopt decoding, mesh optimization, animation data
+        double upload = 0.0;                            //GL upload jobs, summed over frames
+        double total = 0.0;                             //from the request to the last upload
+    };
+    LoadTimings loadTimings() const { return asset ? asset->timings : LoadTimings(); }
+
+    //models of the same file (by canonical path or by content) share one parsed asset,
+    //its GPU buffers and textures; identical images are shared across files too
+    struct CacheStats {
+        size_t assetHits = 0;
+        size_t assetMisses = 0;
+        size_t liveAssets = 0;
+        size_t textureHits = 0;
+        size_t textureMisses = 0;
+        size_t liveTextures = 0;
+        size_t residentBytes = 0;                       //buffer and texture bytes of all live assets
+    };
+    static CacheStats cacheStats();
+
+    //baked scene cache: the first load of a file writes what the loader made of it to a
+    //.bake blob (in directory, or next to the file when empty), later loads map that
+    //blob instead of parsing and decoding. set before loading
+    struct BakeSettings {
+        bool enabled = false;
+        std::string directory;
+    };
+    static BakeSettings& bakeSettings();
+
+    //load-time mesh optimization (off by default), set before loading. a baked scene
+    //keeps the optimized geometry; reports are only made when the file is parsed
+    static GLTF_MeshOptimizer::Settings& optimizeSettings();
+    const std::vector<GLTF_MeshOptimizer::MeshReport>& meshReports() const { return asset->meshReports; }
+
+    //load-time vertex layout (on by default), set before loading: one interleaved vertex buffer
+    //per primitive and generated tangents for normal maps. streaming assets keep their layout
+    //so their meshes are still read only when they come into view
+    static GLTF_VertexFormat::Settings& vertexSettings();
+
+    //load-time static batching (off by default), set before loading: the primitives of static
+    //nodes merged per material into world-space batches, see GLTF_StaticBatcher. streaming
+    //assets are not batched; the report is only made when the file is parsed
+    static GLTF_StaticBatcher::Settings& batchSettings();
+    const GLTF_StaticBatcher::Report& batchReport() const { return asset->batchReport; }
+
+    //GPU-resident mode: once its uploads finish an asset drops the buffer bytes, file mappings
+    //and pixels, keeping only the glTF structure and what draws need. set before loading
+    struct ResidencySettings {
+        bool gpuResident = false;
+    };
+    static ResidencySettings& residencySettings();
+    //approximate memory of this model, the asset part is shared with other models of the file
+    struct MemoryReport {
+        size_t cpuBytes = 0;                            //glTF structure, buffer bytes, mappings, pixels, draw data
+        size_t gpuBytes = 0;                            //vertex, index, instance and light buffers, textures
+        size_t cpuBytesReleased = 0;                    //dropped by GPU-resident mode, cpuBytes before is the sum
+        bool released = false;
+    };
+    MemoryReport memoryReport() const;
+
+    //out-of-core streaming for scenes larger than the GPU: the load keeps only the glTF
+    //structure and bounds, meshes and textures are fetched, uploaded and evicted while drawing,
+    //those largest on screen first, to stay under budgetBytes. a draw shows its bounding box
+    //until its mesh is in and white texels until its textures are. set before loading; the
+    //budget and in-flight limit may change at any time, they apply to each streaming asset
+    struct StreamingSettings {
+        bool enabled = false;
+        size_t budgetBytes = 512 * 1024 * 1024;
+        size_t maxInFlight = 8;                         //fetches running or waiting for their upload
+    };
+    static StreamingSettings& streamingSettings();
+    GLTF_Streamer::Stats streamingStats() const { return asset ? asset->streamer.stats() : GLTF_Streamer::Stats(); }
+
+    //animation of the compiled scene. updateAnimation advances the playing clip, poses the
+    //nodes and computes the joint matrices of skins on the CPU, draw() uploads them.
+    //updateAnimations does the same for many models (each listed once) on the thread pool
+    int animationCount() const { return asset ? (int)asset->animations.size() : 0; }
+    void playAnimation(int clip, bool loop = true, float speed = 1.0f);
+    void stopAnimation() { animator.stop(); }
+    void updateAnimation(float seconds);
+    static void updateAnimations(const std::vector<GLTF_Model*>& models, float seconds);
+    //CPU cost of animating: updates the models frames times by step seconds, nothing is drawn
+    struct AnimationBenchmark {
+        size_t instances = 0;                           //models times frames
+        double milliseconds = 0.0;
+        double instancesPerMillisecond = 0.0;
+    };
+    static AnimationBenchmark benchmarkAnimations(const std::vector<GLTF_Model*>& models, int frames,
+        float step = 1.0f / 60.0f);
 
     //class constructor
-    GLTF_Model(std::string const& path, Camera &camera,bool gamma = false) : gammaCorrection(gamma){
-        if (!loadModel(model, path.c_str())) return;
-        //define texture unit index
+    GLTF_Model(std::string const& path, Camera &camera,bool gamma = false) : GLTF_Model(camera, gamma) {
+        asset = acquireAsset(path, gamma, false);
+        //synchronous load finishes the asset right away, also when another model started it
+        while (asset->state == Loading) {
+            asset->pump(nullptr);
+            followRedirect();
+        }
+        processUploads();
+    }
+    ~GLTF_Model() {
+        if (asset && asset->pumpOwner == this) asset->pumpOwner = nullptr;
+        //vertex and index buffers, VAOs and textures belong to the asset and go with its last model
+        asset.reset();
+        if (instanceVbo) GLTF_GL::deleteBuffers(1, &instanceVbo);
+        if (jointBuffer) GLTF_GL::deleteBuffers(1, &jointBuffer);
+        if (clusterBuffers[0]) GLTF_GL::deleteBuffers(3, clusterBuffers);
+        if (clusterTextures[0]) GLTF_GL::deleteTextures(3, clusterTextures);
+        GLTF_ReleaseQueue::shared().collect();
+    }
+
+private:
+    GLTF_Model(Camera& camera, bool gamma) : gammaCorrection(gamma) {
+        //define texture unit index, compileScene needs them while loading
         textureUnitIndices["baseColorTexture"] = 0;
         textureUnitIndices["metallicRoughnessTexture"] = 1;
         textureUnitIndices["normalTexture"] = 2;
@@ -37,32 +274,11 @@ public:
         metallicFactor = -1.0f;
         roughnessFactor = -1.0f;
 
-        mycamera = camera;
-    }
-    ~GLTF_Model() {
-        for (GLuint i = 0; i < VaosAndEbos.first.size();i++) {
-            glDeleteVertexArrays(1, &VaosAndEbos.first[i]);
-        }
-        // cleanup vbos but do not delete index buffers yet
-        for (auto it = VaosAndEbos.second.cbegin(); it != VaosAndEbos.second.cend();) {
-            tinygltf::BufferView bufferView = model.bufferViews[it->first];
-            if (bufferView.target != GL_ELEMENT_ARRAY_BUFFER) {
-                glDeleteBuffers(1, &VaosAndEbos.second[it->first]);
-                VaosAndEbos.second.erase(it++);
-            }
-            else {
-                ++it;
-            }
-        }
+        mycamera = &camera;
     }
 
-private:
-    Camera mycamera;
-    std::vector<GLuint> textureIDs;; //textures index
+    Camera* mycamera;
     std::map<std::string, int> textureUnitIndices; //textures unit index
-    std::pair<std::map<int, GLuint>, std::map<int, GLuint>> VaosAndEbos;//vaos and ebos to bound
-    //model to loaded
-    tinygltf::Model model;         
     //none-textures mesh factors
     glm::vec4 baseColorFactor;     
     float metallicFactor;
@@ -78,223 +294,1531 @@ private:
         glm::vec3 color;     
         float intensity;      
     };
-    std::vector<PointLight> pointLights;
-    std::vector<DirectionalLight> directionalLights;
-
-
-    bool loadModel(tinygltf::Model& model, const char* filename);
-
-    void bindMesh(std::map<int, GLuint>& vbos,
-        tinygltf::Model& model, tinygltf::Mesh& mesh);
-    void bindModelNodes(std::map<int, GLuint>& vaos, std::map<int, GLuint>& vbos, tinygltf::Model& model,
-        tinygltf::Node& node);
-    std::pair<std::map<int, GLuint>, std::map<int, GLuint>> bindModel(tinygltf::Model& model);
-    void drawMesh(const std::map<int, GLuint>& vbos,
-        tinygltf::Model& model, tinygltf::Mesh& mesh, Shader& shader);
-    void drawModelNodes(const std::pair<std::map<int, GLuint>, std::map<int, GLuint>> VaosAndEbos,
-        tinygltf::Model& model, tinygltf::Node& node, Shader& shader);
-    void drawModel(const std::pair<std::map<int, GLuint>, std::map<int, GLuint>> VaosAndEbos,
-        tinygltf::Model& model, Shader& shader);
+    //loading
+    static const size_t uploadChunkBytes = 1024 * 1024;     //buffer uploads are split so one view cannot blow the budget
+    struct Asset;
+    struct ParsedFile {
+        tinygltf::Model model;
+        GLTF_BufferData data;
+        std::vector<GLTF_TextureData> images;
+        std::vector<std::vector<unsigned char>> encodedImages;  //streaming decodes them on demand instead
+        std::string contentKey;
+        std::string duplicateKey;                           //an asset with the same content is live under this key
+        std::vector<std::string> textureKeys;               //texture cache key by texture, empty without an image
+        std::vector<std::shared_ptr<GLTF_SharedTexture>> textures;  //already on the GPU, found while decoding
+        std::vector<GLTF_MeshOptimizer::MeshReport> meshReports;
+        GLTF_StaticBatcher::Report batchReport;
+        std::vector<GLTF_Animator::Clip> animations;
+        std::vector<GLTF_Animator::Skin> skins;
+        LoadTimings timings;
+    };
+    //everything loaded from one file, shared by all of its models
+    struct Asset : std::enable_shared_from_this<Asset> {
+        std::string key;
+        std::string path;
+        bool gamma = false;
+        GLTF_TextureDecoder::Caps caps;
+        //model to loaded
+        tinygltf::Model model;
+        GLTF_BufferData bufferData;     //buffer bytes, mapped from the files where possible
+        GLTF_BufferArena buffers;       //vertex and index data of all bufferViews
+        std::pair<std::vector<std::vector<GLuint>>, std::map<int, GLuint>> VaosAndEbos;//vaos by mesh and primitive, arena buffers by index bufferView
+        std::vector<GLuint> textureIDs; //textures index
+        std::vector<std::shared_ptr<GLTF_SharedTexture>> textures;
+        std::vector<std::string> textureKeys;
+        std::vector<uint8_t> ownTextures;                   //created here and still to be uploaded
+        std::vector<GLTF_TextureData> imageData;            //decoded images by image index, dropped once uploaded
+        std::vector<PointLight> pointLights;
+        std::vector<DirectionalLight> directionalLights;
+        std::vector<GLTF_MeshOptimizer::MeshReport> meshReports;
+        GLTF_StaticBatcher::Report batchReport;
+        std::vector<GLTF_Animator::Clip> animations;
+        std::vector<GLTF_Animator::Skin> skins;
+        LoadTimings timings;
+        std::chrono::steady_clock::time_point requested = std::chrono::steady_clock::now();
+        std::map<int, std::vector<glm::mat4>> gpuInstances;   //EXT_mesh_gpu_instancing matrices by node, read at bind time
+        bool gpuResident = false;                           //release the CPU payloads once uploaded
+        bool streaming = false;
+        bool released = false;
+        size_t releasedBytes = 0;
+        unsigned lightsVersion = newLightsVersion();        //changes whenever the lights do
+        GLuint lightBuffer = 0;                             //GLTFLights block, std140
+        unsigned lightBufferVersion = 0;
+        LoadState state = Loading;
+        bool bound = false;                                 //VAOs and buffer storage exist, models can compile
+        std::shared_ptr<Asset> redirect;                    //same content was already loaded, use that one
+        const GLTF_Model* pumpOwner = nullptr;              //the model whose draw() runs the uploads
+        std::future<bool> pendingLoad;                      //parse running on GLTF_ThreadPool::shared()
+        std::shared_ptr<ParsedFile> pendingModel;
+        std::deque<std::function<size_t()>> uploadJobs;     //GL work left, each job returns the bytes it uploaded
+        GLuint stagingPbo = 0;
+        //streaming, the resources are the meshes and then the textures
+        GLTF_Streamer streamer;
+        std::vector<GLTF_BufferArena> meshBuffers;          //one trimmed arena per mesh
+        std::vector<std::vector<unsigned char>> encodedImages;  //kept to decode again after an eviction
+        std::vector<uint8_t> srgbImages;
+        std::vector<GLTF_TextureData> streamedImages;       //by texture, decoded and waiting for the upload, GL thread only
+        //by resource, a texture's fetch returns its decoded image, null when it failed and for meshes
+        std::vector<std::future<std::shared_ptr<GLTF_TextureData>>> fetches;
+        std::vector<int> inFlight;
+        GLuint placeholderTexture = 0;                      //white texel of absent textures
+        GLuint placeholderVao = 0;                          //bounding boxes of absent meshes
+        GLuint placeholderBuffers[2] = {};                  //corners, indices
+        std::vector<int> placeholderBoxes;                  //first box by mesh, one box per primitive
+        size_t placeholderBytes = 0;
+        unsigned residencyVersion = 0;                      //changes whenever a resource comes or goes
+
+        Asset() {}
+        Asset(const Asset&) = delete;
+        Asset& operator=(const Asset&) = delete;
+        ~Asset();
+        //adopt the parse once done, then run upload jobs within the budget, all of them without one
+        void pump(const UploadBudget* budget);
+        void adoptParsed(ParsedFile& parsed);
+        void queueUploads();
+        size_t runUploadJob();
+        void finishUploads();
+        size_t uploadTexture(size_t textureIndex);
+        void bindStreaming();
+        void stream(const UploadBudget* budget);
+        void fetchResource(int resource);
+        size_t uploadResource(int resource);
+        void evictResource(int resource);
+        void bindMesh(std::vector<GLuint>& vaos, tinygltf::Model& model, tinygltf::Mesh& mesh, const GLTF_BufferArena& arena);
+        void bindModelNodes(std::vector<std::vector<GLuint>>& vaos, tinygltf::Model& model, tinygltf::Node& node);
+        std::pair<std::vector<std::vector<GLuint>>, std::map<int, GLuint>> bindModel(tinygltf::Model& model);
+        void updateLightBuffer();
+        void readGpuInstancing();
+        void releaseCpuData();
+        size_t cpuBytes() const;
+        size_t gpuBytes() const;
+    };
+    std::shared_ptr<Asset> asset;
+    //flat render list of the default scene, one draw per primitive and instance group (SoA)
+    static const int textureUnitCount = 4;
+    struct DrawList {
+        std::vector<GLuint> vao;
+        std::vector<GLuint> ebo;
+        std::vector<GLsizei> indexCount;
+        std::vector<GLenum> indexType;
+        std::vector<size_t> indexOffset;
+        std::vector<GLenum> mode;
+        std::vector<GLuint> textures;           //textureUnitCount ids per draw, 0 if the unit is unused
+        std::vector<int> textureIndex;          //their glTF textures, -1 if unused, for streaming
+        std::vector<glm::vec4> baseColorFactor;
+        std::vector<float> metallicFactor;
+        std::vector<float> roughnessFactor;
+        std::vector<int> matrixIndex;           //transform slot of the node, -1 for instanced draws
+        std::vector<size_t> firstInstance;      //range in instanceSlots for instanced draws
+        std::vector<GLsizei> instanceCount;
+        std::vector<int> mesh;                  //source of the draw, for residency checks while loading
+        std::vector<int> primitive;
+        std::vector<uint8_t> resident;          //vertex and index data uploaded
+        std::vector<GLTF_Aabb> bounds;          //object space, from the POSITION accessor
+        std::vector<int> skinInstance;          //joint palette of skinned draws, -1 for rigid ones
+        std::vector<uint8_t> pass;              //GLTF_DrawSort::Pass from the alpha mode
+        std::vector<uint8_t> doubleSided;
+        std::vector<float> alphaCutoff;
+        std::vector<uint32_t> stateId;          //dense material state and VAO ids for the sort keys
+        std::vector<uint32_t> vaoId;
+        size_t size() const { return vao.size(); }
+    };
+    DrawList drawList;
+    bool compiled = false;                      //drawList is built, once the asset is bound
+    GLTF_Transforms transforms;                 //world matrices of the default scene
+    //per instance transform slot and optional EXT_mesh_gpu_instancing matrix (-1 for none)
+    std::vector<int> instanceSlots;
+    std::vector<int> instanceLocals;
+    std::vector<glm::mat4> instanceLocalMatrices;
+    std::vector<glm::mat4> instanceMatrices;    //world matrices uploaded to instanceVbo
+    GLuint instanceVbo = 0;
+    unsigned instanceVersion = 0;               //transforms version the instance buffer was built from
+    DrawStats stats;
+    bool geometryPending = false;               //some draws still wait for their buffers
+    unsigned streamedVersion = 0;               //asset residency the streamed draws point at
+    //culling, one BVH item per draw
+    GLTF_Bvh bvh;
+    bool bvhBuilt = false;
+    unsigned boundsVersion = 0;                 //transforms version the BVH was fitted to
+    std::vector<std::pair<int, int>> slotDraws; //(transform slot, draw) sorted, instances included
+    std::vector<uint8_t> visibleDraws;
+    GLTF_DrawSort drawOrder;                    //this frame's visible draws in submission order
+    std::vector<std::vector<GLTF_DrawSort::Item>> packetChunks;    //draw packets per chunk of the draw list
+    std::vector<int> cullRoots;                 //BVH subtrees culled as one task
+    static const size_t frameChunk = 1024;      //draws per task when preparing a frame
+    bool hasViewProjection = false;
+    glm::mat4 viewProjection;
+    CullingStats cullStats;
+    //animation and skinning
+    GLTF_Animator animator;
+    struct SkinInstance {
+        int slot;                               //mesh node
+        int skin;
+    };
+    std::vector<SkinInstance> skinInstances;    //one joint palette each
+    std::vector<glm::mat4> jointMatrices;       //palettes jointStride apart
+    size_t jointStride = 0;                     //bytes, a multiple of the uniform buffer offset alignment
+    unsigned jointsVersion = 0;                 //transforms version the palettes were computed from
+    unsigned jointsUploaded = 0;
+    GLuint jointBuffer = 0;
+    //clustered lights
+    GLTF_SceneLights sceneLights;
+    GLTF_LightClusters lightClusters;
+    GLuint clusterBuffers[3] = {};              //light data, cluster ranges, light indices
+    GLuint clusterTextures[3] = {};             //buffer textures over them
+    //uniform locations, looked up once per shader program
+    struct ShaderBindings {
+        GLuint program = 0;
+        GLint model = -1;
+        GLint baseColorFactor = -1;
+        GLint metallicFactor = -1;
+        GLint roughnessFactor = -1;
+        GLint instanced = -1;
+        GLint skinned = -1;
+        GLint alphaCutoff = -1;
+        GLuint lightBlock = GL_INVALID_INDEX;   //GLTFLights, if the shader declares it
+        GLuint jointBlock = GL_INVALID_INDEX;   //GLTFJoints
+        GLint numPointLights = -1;
+        GLint numDirLights = -1;
+        GLint lightClusters = -1;               //gltfLightClusters, the shader shades clustered lights
+        GLint clusterGrid = -1;
+        GLint clusterDepth = -1;
+        std::vector<GLint> pointLight;          //position, color, intensity per light
+        std::vector<GLint> directionalLight;    //direction, color, intensity per light
+    };
+    std::map<GLuint, ShaderBindings> shaderBindings;
+    GLTF_StateCache glState;                    //bindings and uniforms set during the current draw
+    GLTF_GpuTimer gpuTimer;
+
+
+    static GLTF_ResourceCache<Asset>& assetCache();
+    static GLTF_ResourceCache<GLTF_SharedTexture>& textureCache();
+    static std::shared_ptr<Asset> acquireAsset(std::string const& path, bool gamma, bool async);
+    static void startLoad(Asset& asset, bool dedupContent);
+    void followRedirect();
+    static bool loadModel(ParsedFile& parsed, const char* filename, bool gamma, const GLTF_TextureDecoder::Caps& caps,
+        bool dedupContent, bool streaming);
+    static std::vector<uint8_t> colorImages(tinygltf::Model& model, bool gamma);
+    static bool decodeImage(tinygltf::Image& image, int index, const std::vector<unsigned char>& encoded, bool srgb,
+        const GLTF_TextureDecoder::Caps& caps, GLTF_TextureData& out, std::string& error);
+    static void decodeImages(ParsedFile& parsed, std::vector<std::vector<unsigned char>>& encoded, bool gamma,
+        const GLTF_TextureDecoder::Caps& caps, bool decodeAll);
+    static bool findDuplicate(ParsedFile& parsed);
+    static void findSharedTextures(ParsedFile& parsed);
+    static bool deferImageDecode(tinygltf::Image* image, const int imageIndex, std::string* err, std::string* warn,
+        int reqWidth, int reqHeight, const unsigned char* bytes, int size, void* userData);
+    void refreshResidency();
+    void refreshStreamedDraws();
+    void requestStreaming(const glm::mat4& frameMatrix);
+
+    void drawMesh(const std::vector<GLuint>& vaos, const std::map<int, GLuint>& vbos,
+        tinygltf::Model& model, tinygltf::Mesh& mesh, GLuint program);
+    void drawModelNodes(const std::pair<std::vector<std::vector<GLuint>>, std::map<int, GLuint>>& VaosAndEbos,
+        tinygltf::Model& model, tinygltf::Node& node, GLuint program);
+    void drawModel(const std::pair<std::vector<std::vector<GLuint>>, std::map<int, GLuint>>& VaosAndEbos,
+        tinygltf::Model& model, GLuint program);
+    void compileScene(tinygltf::Model& model);
+    void compilePrimitive(tinygltf::Model& model, int meshIndex, int primitiveIndex, GLuint vao,
+        int matrixIndex, size_t firstInstance, GLsizei instanceCount, int skinInstance = -1);
+    void assignStateIds();
+    void enableInstanceAttributes(GLuint vao);
+    void forChunks(size_t count, size_t chunkSize, const std::function<void(size_t, size_t, size_t)>& body) const;
+    void updateInstanceBuffer();
+    void updateSkins();
+    void uploadJoints();
+    GLTF_Aabb worldBounds(size_t draw) const;
+    glm::mat4 frameViewProjection() const;
+    void cullScene(const glm::mat4& frustumMatrix);
+    void buildDrawOrder(const glm::mat4& frameMatrix);
+    ShaderBindings& bindShader(GLuint program);
+    void bindLights(ShaderBindings& bindings);
+    void assignLights(const glm::mat4& frameMatrix);
+    void bindLightClusters(ShaderBindings& bindings);
+    static unsigned newLightsVersion();
+    static std::map<GLuint, unsigned>& programLights();     //lights version last written to each program
+    void drawCompiled(GLuint program);
     void dbgModel(tinygltf::Model& model);              //debug my class
-    void bindVbo(std::map<int, GLuint>& vbos, tinygltf::Model& model, size_t indice);
     glm::mat4 getModelMatrix(tinygltf::Node& node, float angle);
 };
 
 
-bool GLTF_Model::loadModel(tinygltf::Model& model, const char* filename) {
+GLTF_ResourceCache<GLTF_Model::Asset>& GLTF_Model::assetCache() {
+    static GLTF_ResourceCache<Asset> cache;
+    return cache;
+}
+
+GLTF_ResourceCache<GLTF_SharedTexture>& GLTF_Model::textureCache() {
+    static GLTF_ResourceCache<GLTF_SharedTexture> cache;
+    return cache;
+}
+
+GLTF_Model::BakeSettings& GLTF_Model::bakeSettings() {
+    static BakeSettings settings;
+    return settings;
+}
+
+GLTF_MeshOptimizer::Settings& GLTF_Model::optimizeSettings() {
+    static GLTF_MeshOptimizer::Settings settings;
+    return settings;
+}
+
+GLTF_VertexFormat::Settings& GLTF_Model::vertexSettings() {
+    static GLTF_VertexFormat::Settings settings;
+    return settings;
+}
+
+GLTF_StaticBatcher::Settings& GLTF_Model::batchSettings() {
+    static GLTF_StaticBatcher::Settings settings;
+    return settings;
+}
+
+GLTF_Model::ResidencySettings& GLTF_Model::residencySettings() {
+    static ResidencySettings settings;
+    return settings;
+}
+
+GLTF_Model::StreamingSettings& GLTF_Model::streamingSettings() {
+    static StreamingSettings settings;
+    return settings;
+}
+
+GLTF_Model::CacheStats GLTF_Model::cacheStats() {
+    CacheStats result;
+    GLTF_ResourceCache<Asset>::Stats assets = assetCache().stats();
+    GLTF_ResourceCache<GLTF_SharedTexture>::Stats textures = textureCache().stats();
+    result.assetHits = assets.hits;
+    result.assetMisses = assets.misses;
+    result.liveAssets = assets.live;
+    result.textureHits = textures.hits;
+    result.textureMisses = textures.misses;
+    result.liveTextures = textures.live;
+    assetCache().forEach([&](Asset& asset) {
+        result.residentBytes += asset.buffers.stats().bytesUploaded + (asset.streaming ? asset.streamer.stats().residentBytes : 0);
+    });
+    textureCache().forEach([&](GLTF_SharedTexture& texture) { result.residentBytes += texture.bytes; });
+    return result;
+}
+
+// the live asset of a file, or a new one whose parse has been started
+std::shared_ptr<GLTF_Model::Asset> GLTF_Model::acquireAsset(std::string const& path, bool gamma, bool async) {
+    std::error_code error;
+    std::string key = std::filesystem::weakly_canonical(path, error).string();
+    if (error) key = path;
+    //gamma correction changes the texture formats, so it is part of the key, as is streaming
+    bool streaming = streamingSettings().enabled;
+    key += gamma ? "|srgb" : "|linear";
+    if (streaming) key += "|stream";
+    std::shared_ptr<Asset> asset = assetCache().find(key);
+    if (asset) {
+        assetCache().record(true);
+        return asset;
+    }
+    asset = std::make_shared<Asset>();
+    asset->key = key;
+    asset->path = path;
+    asset->gamma = gamma;
+    //format support is queried here, on the GL thread, and decoding picks from it
+    asset->caps = GLTF_TextureDecoder::queryCaps();
+    asset->streaming = streaming;
+    //a streamed asset reads its buffers and images again after evictions
+    asset->gpuResident = residencySettings().gpuResident && !streaming;
+    assetCache().insert(key, asset);
+    if (async) {
+        startLoad(*asset, true);
+    }
+    else {
+        std::shared_ptr<ParsedFile> parsed = std::make_shared<ParsedFile>();
+        std::promise<bool> done;
+        done.set_value(loadModel(*parsed, path.c_str(), gamma, asset->caps, true, streaming));
+        asset->pendingModel = parsed;
+        asset->pendingLoad = done.get_future();
+    }
+    return asset;
+}
+
+void GLTF_Model::startLoad(Asset& asset, bool dedupContent) {
+    //the worker only touches its own parse, which is handed over once it is done
+    std::shared_ptr<ParsedFile> parsed = std::make_shared<ParsedFile>();
+    asset.pendingModel = parsed;
+    std::string path = asset.path;
+    bool gamma = asset.gamma;
+    GLTF_TextureDecoder::Caps caps = asset.caps;
+    bool streaming = asset.streaming;
+    asset.pendingLoad = GLTF_ThreadPool::shared().submit([parsed, path, gamma, caps, dedupContent, streaming]() {
+        return loadModel(*parsed, path.c_str(), gamma, caps, dedupContent, streaming);
+    });
+}
+
+void GLTF_Model::followRedirect() {
+    while (asset && asset->redirect) {
+        if (asset->pumpOwner == this) asset->pumpOwner = nullptr;
+        std::shared_ptr<Asset> target = asset->redirect;
+        asset = target;
+    }
+}
+
+// parse the file and decode its images, CPU only so it can run on any thread.
+// with dedupContent a file whose bytes match a live asset is not parsed at all.
+// streaming keeps the images encoded and neither reads nor writes a baked blob
+bool GLTF_Model::loadModel(ParsedFile& parsed, const char* filename, bool gamma, const GLTF_TextureDecoder::Caps& caps,
+    bool dedupContent, bool streaming) {
+    tinygltf::Model& model = parsed.model;
+    //a phase ends: its time goes into the timings and, while tracing, into a span
+    auto phase = [](const char* name, std::chrono::steady_clock::time_point since) {
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        GLTF_TRACE_SPAN(name, "load", since, end);
+        return std::chrono::duration<double, std::milli>(end - since).count();
+    };
+    auto start = std::chrono::steady_clock::now();
+    //a baked blob that is still newer than its sources replaces parsing and decoding
+    const GLTF_MeshOptimizer::Settings optimize = optimizeSettings();
+    const GLTF_VertexFormat::Settings vertex = vertexSettings();
+    const GLTF_StaticBatcher::Settings batch = batchSettings();
+    uint64_t bakeOptions = caps.mask() | (gamma ? GLTF_BakedScene::gammaOption : 0) |
+        (optimize.mask() << GLTF_BakedScene::optimizeShift) | (vertex.mask() << GLTF_BakedScene::vertexShift) |
+        (batch.mask() << GLTF_BakedScene::batchShift) | ((uint64_t)batch.vertexLimit() << GLTF_BakedScene::batchVerticesShift);
+    std::string bakedPath = bakeSettings().enabled && !streaming ? GLTF_BakedScene::pathFor(filename, bakeSettings().directory) : "";
+    if (!bakedPath.empty() &&
+        GLTF_BakedScene::read(bakedPath, bakeOptions, model, parsed.data, parsed.images, parsed.textureKeys, parsed.contentKey)) {
+        GLTF_LOG_INFO("Loaded baked glTF: " << bakedPath);
+        parsed.timings.parse = phase("parse", start);
+        if (dedupContent && findDuplicate(parsed)) return true;
+        findSharedTextures(parsed);
+        start = std::chrono::steady_clock::now();
+        GLTF_Animator::read(model, parsed.data, parsed.animations, parsed.skins);
+        parsed.timings.optimize = phase("optimize", start);
+        return true;
+    }
+
+    //map the file once and let its magic pick the parser
+    std::shared_ptr<GLTF_MappedFile> file = std::make_shared<GLTF_MappedFile>();
+    if (!file->open(filename)) {
+        GLTF_LOG_ERROR("Failed to open glTF: " << filename);
+        return false;
+    }
+    std::string path(filename);
+    size_t slash = path.find_last_of("/\\");
+    std::string baseDir = slash == std::string::npos ? "" : path.substr(0, slash);
+
+    //a JSON glTF resolves its files relative to its folder, which makes the folder part of its content
+    uint64_t hash = gltfHashBytes(file->data(), file->size());
+    if (!file->isBinary()) {
+        std::error_code error;
+        std::string folder = std::filesystem::weakly_canonical(path, error).parent_path().string();
+        hash = gltfHashBytes((const unsigned char*)folder.data(), folder.size(), hash);
+    }
+    parsed.contentKey = "#" + std::to_string(hash) + (gamma ? "|srgb" : "|linear") + (streaming ? "|stream" : "");
+    if (dedupContent && findDuplicate(parsed)) return true;
+
     tinygltf::TinyGLTF loader;
-    std::string err_binary;
-    std::string warn_binary;
-    std::string err_ascii;
-    std::string warn_ascii;
-    //load binary gltf file first
-    bool res = loader.LoadBinaryFromFile(&model, &err_binary, &warn_binary, filename);
-    //if binary gltf not exists , load ASCII gltf
-    if (!res) {
-        res = loader.LoadASCIIFromFile(&model, &err_ascii, &warn_ascii, filename);
+    //images are only collected while parsing and decoded in parallel afterwards
+    std::vector<std::vector<unsigned char>> encodedImages;
+    loader.SetImageLoader(&GLTF_Model::deferImageDecode, &encodedImages);
+    std::string err;
+    std::string warn;
+    bool res;
+    if (file->isBinary()) {
+        res = loader.LoadBinaryFromMemory(&model, &err, &warn, file->data(), (unsigned int)file->size(), baseDir);
+    }
+    else {
+        res = loader.LoadASCIIFromString(&model, &err, &warn, (const char*)file->data(), (unsigned int)file->size(), baseDir);
     }
+    if (!warn.empty()) GLTF_LOG_WARN(warn);
+    if (!err.empty()) GLTF_LOG_ERROR(err);
     if (!res) {
-        std::cout << "Failed to load glTF: " << filename << std::endl;
-        if (!warn_binary.empty()) {
-            std::cout << "WARN_BINARY: " << warn_binary << std::endl;
-        }
-        if (!err_binary.empty()) {
-            std::cout << "ERR_BINARY: " << err_binary << std::endl;
-        }
-        if (!err_ascii.empty()) {
-            std::cout << "WARN_ASCII: " << err_ascii << std::endl;
+        GLTF_LOG_ERROR("Failed to load glTF: " << filename);
+        return res;
+    }
+    GLTF_LOG_INFO("Loaded glTF: " << filename);
+    parsed.timings.parse = phase("parse", start);
+
+    //a blob needs every image, also those whose textures are shared already
+    start = std::chrono::steady_clock::now();
+    if (streaming) {
+        parsed.encodedImages = std::move(encodedImages);
+        parsed.textureKeys.assign(model.textures.size(), std::string());
+        parsed.textures.assign(model.textures.size(), nullptr);
+    }
+    else {
+        decodeImages(parsed, encodedImages, gamma, caps, !bakedPath.empty());
+    }
+    parsed.timings.decode = phase("decode", start);
+    //uploads read the GLB chunk straight from the mapping
+    start = std::chrono::steady_clock::now();
+    parsed.data.map(model, file);
+    if (!GLTF_MeshOptimizer::decompress(model, parsed.data)) return false;
+    GLTF_MeshOptimizer::optimize(model, parsed.data, optimize, parsed.meshReports);
+    for (const GLTF_MeshOptimizer::MeshReport& report : parsed.meshReports) {
+        GLTF_LOG_INFO("optimized " << report.name << ": " << report.bytesBefore << " -> " << report.bytesAfter
+            << " bytes, ACMR " << report.acmrBefore << " -> " << report.acmrAfter);
+    }
+    if (!streaming) {
+        //batches before interleaving, so merged primitives still get their tangents made
+        GLTF_StaticBatcher::batch(model, parsed.data, batch, parsed.batchReport);
+        const GLTF_StaticBatcher::Report& batchReport = parsed.batchReport;
+        if (batchReport.batches) {
+            GLTF_LOG_INFO("batched " << batchReport.primitives << " primitives of " << batchReport.nodes << " static nodes into "
+                << batchReport.batches << " batches, " << batchReport.bytes << " bytes, draws " << batchReport.drawsBefore
+                << " -> " << batchReport.drawsAfter);
         }
-        if (!warn_ascii.empty()) {
-            std::cout << "ERR_ASCII: " << warn_ascii << std::endl;
+        GLTF_VertexFormat::Report vertexReport;
+        GLTF_VertexFormat::interleave(model, parsed.data, vertex, vertexReport);
+        if (vertexReport.primitives) {
+            GLTF_LOG_INFO("interleaved " << vertexReport.primitives << " primitives into " << vertexReport.vertexBuffers
+                << " vertex buffers, " << vertexReport.bytes << " bytes, tangents generated for "
+                << vertexReport.tangentsGenerated << " (" << vertexReport.verticesSplit << " vertices split), sparse accessors "
+                << vertexReport.sparseAccessors);
         }
     }
-    else
-        std::cout << "Loaded glTF: " << filename << std::endl;
-
-    //bind model
-    VaosAndEbos = bindModel(model);
+    GLTF_Animator::read(model, parsed.data, parsed.animations, parsed.skins);
+    parsed.timings.optimize = phase("optimize", start);
+    if (!bakedPath.empty()) {
+        GLTF_TRACE_SCOPE("bake", "load");
+        if (GLTF_BakedScene::write(bakedPath, filename, parsed.contentKey, bakeOptions, model, parsed.data, parsed.images, parsed.textureKeys))
+            GLTF_LOG_INFO("Baked glTF: " << bakedPath);
+        else
+            GLTF_LOG_WARN("Failed to bake glTF: " << bakedPath);
+    }
     //debug model
     //dbgModel(model);
     return res;
 }
 
-void GLTF_Model:: bindMesh(std::map<int, GLuint>& vbos,
-    tinygltf::Model& model, tinygltf::Mesh& mesh) {
+// by image, 1 for the images sampled as base color or emission, which get sRGB formats
+// when gamma correction is on
+std::vector<uint8_t> GLTF_Model::colorImages(tinygltf::Model& model, bool gamma) {
+    std::vector<uint8_t> srgb(model.images.size(), 0);
+    if (gamma) {
+        for (tinygltf::Material& material : model.materials) {
+            int colorTextures[2] = { -1, -1 };
+            if (material.values.find("baseColorTexture") != material.values.end())
+                colorTextures[0] = material.values["baseColorTexture"].TextureIndex();
+            if (material.additionalValues.find("emissiveTexture") != material.additionalValues.end())
+                colorTextures[1] = material.additionalValues["emissiveTexture"].TextureIndex();
+            for (int texture : colorTextures) {
+                if (texture < 0 || texture >= (int)model.textures.size()) continue;
+                int source = GLTF_TextureDecoder::textureSource(model.textures[texture]);
+                if (source >= 0 && source < (int)srgb.size()) srgb[source] = 1;
+            }
+        }
+    }
+    return srgb;
+}
+
+// decode or transcode one image into upload-ready levels, any thread
+bool GLTF_Model::decodeImage(tinygltf::Image& image, int index, const std::vector<unsigned char>& encoded, bool srgb,
+    const GLTF_TextureDecoder::Caps& caps, GLTF_TextureData& out, std::string& error) {
+    GLTF_TRACE_SCOPE("decode image", "load");
+    if (GLTF_TextureDecoder::isKtx2(encoded.data(), encoded.size())) {
+        if (GLTF_TextureDecoder::decodeKtx2(encoded.data(), encoded.size(), srgb, caps, out)) return true;
+        error = "cannot decode KTX2 image";
+        return false;
+    }
+    //keep one and two channel images small, they are swizzled back at upload
+    std::string warn;
+    tinygltf::LoadImageDataOption option;
+    option.preserve_channels = true;
+    if (!tinygltf::LoadImageData(&image, index, &error, &warn, 0, 0, encoded.data(), (int)encoded.size(), &option))
+        return false;
+    return GLTF_TextureDecoder::fromPixels(image, srgb, out);
+}
+
+// decode every image in parallel. with gamma correction on, images sampled as base color
+// or emission get sRGB formats
+void GLTF_Model::decodeImages(ParsedFile& parsed, std::vector<std::vector<unsigned char>>& encoded, bool gamma,
+    const GLTF_TextureDecoder::Caps& caps, bool decodeAll) {
+    tinygltf::Model& model = parsed.model;
+    std::vector<uint8_t> srgb = colorImages(model, gamma);
+
+    //textures that sample an image already on the GPU the same way reuse that texture,
+    //only the images some texture still needs are decoded
+    std::vector<uint64_t> hashes(encoded.size(), 0);
+    GLTF_ThreadPool::shared().parallelFor(encoded.size(), [&](size_t i) {
+        hashes[i] = gltfHashBytes(encoded[i].data(), encoded[i].size());
+    });
+    std::vector<int> sources(model.textures.size(), -1);
+    parsed.textureKeys.assign(model.textures.size(), std::string());
+    for (size_t i = 0; i < model.textures.size(); ++i) {
+        int source = GLTF_TextureDecoder::textureSource(model.textures[i]);
+        if (source < 0 || source >= (int)encoded.size() || source >= (int)model.images.size() || encoded[source].empty())
+            continue;
+        sources[i] = source;
+        GLTF_SamplerState sampler = GLTF_TextureDecoder::sampler(model, model.textures[i]);
+        parsed.textureKeys[i] = std::to_string(hashes[source]) + (srgb[source] ? "|srgb|" : "|linear|") +
+            std::to_string(sampler.minFilter) + "," + std::to_string(sampler.magFilter) + "," +
+            std::to_string(sampler.wrapS) + "," + std::to_string(sampler.wrapT);
+    }
+    findSharedTextures(parsed);
+    std::vector<uint8_t> needed(model.images.size(), 0);
+    for (size_t i = 0; i < model.textures.size(); ++i) {
+        if (sources[i] >= 0 && (decodeAll || !parsed.textures[i])) needed[sources[i]] = 1;
+    }
+
+    parsed.images.assign(model.images.size(), GLTF_TextureData());
+    std::vector<std::string> imageErrors(encoded.size());
+    GLTF_ThreadPool::shared().parallelFor(encoded.size(), [&](size_t i) {
+        if (i >= model.images.size() || !needed[i]) return;
+        decodeImage(model.images[i], (int)i, encoded[i], srgb[i] != 0, caps, parsed.images[i], imageErrors[i]);
+        std::vector<unsigned char>().swap(encoded[i]);
+    });
+    for (size_t i = 0; i < imageErrors.size(); ++i) {
+        if (!imageErrors[i].empty()) GLTF_LOG_ERROR("image " << i << ": " << imageErrors[i]);
+    }
+}
+
+// a live asset with the same content, its models are shared instead of loading this one
+bool GLTF_Model::findDuplicate(ParsedFile& parsed) {
+    bool live = assetCache().find(parsed.contentKey) != nullptr;
+    assetCache().record(live);
+    if (live) parsed.duplicateKey = parsed.contentKey;
+    return live;
+}
+
+void GLTF_Model::findSharedTextures(ParsedFile& parsed) {
+    parsed.textures.assign(parsed.textureKeys.size(), nullptr);
+    for (size_t i = 0; i < parsed.textureKeys.size(); ++i) {
+        if (parsed.textureKeys[i].empty()) continue;
+        //a texture whose data never arrived (its asset went away mid-load) is not reused
+        std::shared_ptr<GLTF_SharedTexture> shared = textureCache().find(parsed.textureKeys[i]);
+        if (shared && shared->bytes == 0) shared.reset();
+        textureCache().record(shared != nullptr);
+        parsed.textures[i] = shared;
+    }
+}
+
+bool GLTF_Model::deferImageDecode(tinygltf::Image*, const int imageIndex, std::string*, std::string*,
+    int, int, const unsigned char* bytes, int size, void* userData) {
+    std::vector<std::vector<unsigned char>>& encoded = *static_cast<std::vector<std::vector<unsigned char>>*>(userData);
+    if (imageIndex >= (int)encoded.size()) encoded.resize(imageIndex + 1);
+    encoded[imageIndex].assign(bytes, bytes + size);
+    return true;
+}
+
+std::shared_ptr<GLTF_Model> GLTF_Model::loadAsync(std::string const& path, Camera& camera, bool gamma) {
+    std::shared_ptr<GLTF_Model> result(new GLTF_Model(camera, gamma));
+    result->asset = acquireAsset(path, gamma, true);
+    return result;
+}
+
+GLTF_Model::Asset::~Asset() {
+    //may run on a loader thread, the GL names are deleted by the next collect()
+    GLTF_ReleaseQueue& release = GLTF_ReleaseQueue::shared();
+    for (auto& vaos : VaosAndEbos.first) {
+        for (GLuint vao : vaos) {
+            if (vao) release.vertexArray(vao);
+        }
+    }
+    for (GLuint buffer : buffers.bufferObjects()) {
+        release.buffer(buffer);
+    }
+    //streamed meshes and textures belong to this asset alone
+    for (const GLTF_BufferArena& arena : meshBuffers) {
+        for (GLuint buffer : arena.bufferObjects()) {
+            if (buffer) release.buffer(buffer);
+        }
+    }
+    for (size_t i = 0; streaming && i < textureIDs.size(); ++i) {
+        if (textureIDs[i] && textureIDs[i] != placeholderTexture) release.texture(textureIDs[i]);
+    }
+    if (placeholderTexture) release.texture(placeholderTexture);
+    if (placeholderVao) release.vertexArray(placeholderVao);
+    for (GLuint buffer : placeholderBuffers) {
+        if (buffer) release.buffer(buffer);
+    }
+    if (stagingPbo) release.buffer(stagingPbo);
+    if (lightBuffer) release.buffer(lightBuffer);
+    //textures are released with the last asset that shares them
+}
+
+void GLTF_Model::Asset::pump(const UploadBudget* budget) {
+    if (redirect) return;
+    if (state == Loaded && streaming) {
+        stream(budget);
+        return;
+    }
+    if (state != Loading) return;
+    if (pendingLoad.valid()) {
+        if (budget && pendingLoad.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+        bool ok = pendingLoad.get();
+        std::shared_ptr<ParsedFile> parsed = std::move(pendingModel);
+        if (ok && !parsed->duplicateKey.empty()) {
+            //the same bytes are loaded under another path, models move over to that asset
+            redirect = assetCache().find(parsed->duplicateKey);
+            if (redirect) {
+                assetCache().insert(key, redirect);
+                return;
+            }
+            //it went away since the check, load it here after all
+            startLoad(*this, false);
+            return;
+        }
+        adoptParsed(*parsed);
+        if (!ok) {
+            state = Failed;
+            return;
+        }
+        assetCache().insert(parsed->contentKey, shared_from_this());
+        queueUploads();
+    }
+
+    //at least one job per frame, then stop at whichever budget runs out first
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t bytes = 0;
+    while (!uploadJobs.empty()) {
+        bytes += runUploadJob();
+        if (!budget) continue;
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (bytes >= budget->bytes || elapsed >= budget->milliseconds) break;
+    }
+    if (uploadJobs.empty()) finishUploads();
+}
+
+void GLTF_Model::Asset::adoptParsed(ParsedFile& parsed) {
+    model = std::move(parsed.model);
+    bufferData = std::move(parsed.data);
+    imageData = std::move(parsed.images);
+    encodedImages = std::move(parsed.encodedImages);
+    textureKeys = std::move(parsed.textureKeys);
+    textures = std::move(parsed.textures);
+    meshReports = std::move(parsed.meshReports);
+    batchReport = parsed.batchReport;
+    animations = std::move(parsed.animations);
+    skins = std::move(parsed.skins);
+    timings = parsed.timings;
+}
+
+// the first job reserves GL storage and builds VAOs, the jobs it queues afterwards
+// only fill in data
+void GLTF_Model::Asset::queueUploads() {
+    uploadJobs.push_back([this]() -> size_t {
+        VaosAndEbos = bindModel(model);
+        bound = true;
+        for (int role = GLTF_BufferArena::Vertex; role <= GLTF_BufferArena::Index; ++role) {
+            GLTF_BufferArena::Role arenaRole = (GLTF_BufferArena::Role)role;
+            for (int view : buffers.views(arenaRole)) {
+                for (size_t begin = 0; begin < buffers.length(arenaRole, view); begin += uploadChunkBytes) {
+                    uploadJobs.push_back([this, arenaRole, view, begin]() {
+                        return buffers.upload(model, bufferData, arenaRole, view, begin, uploadChunkBytes);
+                    });
+                }
+            }
+        }
+        for (size_t i = 0; i < model.textures.size(); ++i) {
+            if (ownTextures[i]) uploadJobs.push_back([this, i]() { return uploadTexture(i); });
+        }
+        return 0;
+    });
+}
+
+size_t GLTF_Model::Asset::runUploadJob() {
+    //popped first, jobs may queue more jobs
+    std::function<size_t()> job = std::move(uploadJobs.front());
+    uploadJobs.pop_front();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t bytes = job();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    GLTF_TRACE_SPAN("upload job", "load", start, end);
+    timings.upload += std::chrono::duration<double, std::milli>(end - start).count();
+    return bytes;
+}
+
+void GLTF_Model::Asset::finishUploads() {
+    std::vector<GLTF_TextureData>().swap(imageData);
+    state = Loaded;
+    timings.total = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - requested).count();
+    if (streaming) {
+        GLTF_LOG_INFO("streaming " << meshBuffers.size() << " meshes and " << textureIDs.size() << " textures: " << path);
+    }
+    else {
+        GLTF_LOG_INFO("uploaded " << buffers.stats().viewsUploaded << " bufferViews, "
+            << buffers.stats().bytesUploaded << " bytes into " << buffers.stats().bufferObjects << " buffers: " << path);
+    }
+    if (gpuResident) releaseCpuData();
+}
+
+// everything drawn is on the GPU now: keep the glTF structure, drop the payloads
+void GLTF_Model::Asset::releaseCpuData() {
+    size_t before = cpuBytes();
+    for (tinygltf::Buffer& buffer : model.buffers) {
+        std::vector<unsigned char>().swap(buffer.data);
+    }
+    for (tinygltf::Image& image : model.images) {
+        std::vector<unsigned char>().swap(image.image);
+    }
+    bufferData.release();
+    std::vector<GLTF_TextureData>().swap(imageData);
+    released = true;
+    releasedBytes = before - cpuBytes();
+    GLTF_LOG_INFO("released " << releasedBytes << " bytes of CPU data: " << path);
+}
+
+template <typename T>
+static size_t gltfVectorBytes(const std::vector<T>& values) {
+    return values.capacity() * sizeof(T);
+}
+
+size_t GLTF_Model::Asset::cpuBytes() const {
+    size_t bytes = bufferData.mappedBytes();
+    //the glTF structure itself, roughly
+    bytes += gltfVectorBytes(model.accessors) + gltfVectorBytes(model.bufferViews) + gltfVectorBytes(model.nodes) +
+        gltfVectorBytes(model.meshes) + gltfVectorBytes(model.materials) + gltfVectorBytes(model.textures) +
+        gltfVectorBytes(model.images) + gltfVectorBytes(model.buffers);
+    for (const tinygltf::Mesh& mesh : model.meshes) {
+        bytes += gltfVectorBytes(mesh.primitives);
+    }
+    for (const tinygltf::Buffer& buffer : model.buffers) {
+        bytes += buffer.data.capacity();
+    }
+    for (const tinygltf::Image& image : model.images) {
+        bytes += image.image.capacity();
+    }
+    for (const GLTF_TextureData& image : imageData) {
+        bytes += image.bytes.capacity();
+    }
+    for (const std::vector<unsigned char>& image : encodedImages) {
+        bytes += image.capacity();
+    }
+    for (const GLTF_TextureData& image : streamedImages) {
+        bytes += image.bytes.capacity();
+    }
+    return bytes;
+}
+
+size_t GLTF_Model::Asset::gpuBytes() const {
+    size_t bytes = buffers.stats().bytesUploaded;
+    if (streaming) bytes += streamer.stats().residentBytes + placeholderBytes;
+    for (const std::shared_ptr<GLTF_SharedTexture>& texture : textures) {
+        if (texture) bytes += texture->bytes;
+    }
+    if (lightBuffer) bytes += (1 + 4 * GLTF_MAX_LIGHTS) * sizeof(glm::vec4);
+    return bytes;
+}
+
+GLTF_Model::MemoryReport GLTF_Model::memoryReport() const {
+    MemoryReport report;
+    //this model's own draw data
+    report.cpuBytes = gltfVectorBytes(drawList.vao) + gltfVectorBytes(drawList.ebo) + gltfVectorBytes(drawList.indexCount) +
+        gltfVectorBytes(drawList.indexType) + gltfVectorBytes(drawList.indexOffset) + gltfVectorBytes(drawList.mode) +
+        gltfVectorBytes(drawList.textures) + gltfVectorBytes(drawList.textureIndex) + gltfVectorBytes(drawList.baseColorFactor) + gltfVectorBytes(drawList.metallicFactor) +
+        gltfVectorBytes(drawList.roughnessFactor) + gltfVectorBytes(drawList.matrixIndex) + gltfVectorBytes(drawList.firstInstance) +
+        gltfVectorBytes(drawList.instanceCount) + gltfVectorBytes(drawList.mesh) + gltfVectorBytes(drawList.primitive) +
+        gltfVectorBytes(drawList.resident) + gltfVectorBytes(drawList.bounds) + gltfVectorBytes(instanceMatrices) +
+        gltfVectorBytes(drawList.skinInstance) + gltfVectorBytes(drawList.pass) + gltfVectorBytes(drawList.doubleSided) +
+        gltfVectorBytes(drawList.alphaCutoff) + gltfVectorBytes(drawList.stateId) + gltfVectorBytes(drawList.vaoId) +
+        gltfVectorBytes(instanceLocalMatrices) + gltfVectorBytes(jointMatrices) +
+        gltfVectorBytes(lightClusters.lightData()) + gltfVectorBytes(lightClusters.clusters()) + gltfVectorBytes(lightClusters.indices()) +
+        transforms.size() * 2 * sizeof(glm::mat4);
+    report.gpuBytes = instanceVbo ? instanceMatrices.size() * sizeof(glm::mat4) : 0;
+    if (jointBuffer) report.gpuBytes += jointStride * skinInstances.size();
+    if (clusterBuffers[0]) {
+        report.gpuBytes += gltfVectorBytes(lightClusters.lightData()) + gltfVectorBytes(lightClusters.clusters()) +
+            gltfVectorBytes(lightClusters.indices());
+    }
+    if (!asset) return report;
+    report.cpuBytes += asset->cpuBytes();
+    report.gpuBytes += asset->gpuBytes();
+    report.cpuBytesReleased = asset->releasedBytes;
+    report.released = asset->released;
+    return report;
+}
 
+void GLTF_Model::processUploads() {
+    GLTF_TRACE_SCOPE("uploads", "frame");
+    GLTF_ReleaseQueue::shared().collect();
+    followRedirect();
+    if (!asset) return;
+    //one model drives the uploads of a shared asset, so the budget is spent once per frame;
+    //a streaming asset keeps uploading after its load
+    bool pumping = asset->state == Loading || (asset->state == Loaded && asset->streaming);
+    if (pumping && (!asset->pumpOwner || asset->pumpOwner == this)) {
+        asset->pumpOwner = this;
+        asset->pump(&uploadBudget);
+        followRedirect();
+    }
+    if (asset->bound && !compiled) {
+        compileScene(asset->model);
+        compiled = true;
+        geometryPending = true;
+    }
+    if (asset->streaming) refreshStreamedDraws();
+    else refreshResidency();
+}
+
+// mark the draws whose index and vertex views are all uploaded
+void GLTF_Model::refreshResidency() {
+    if (!geometryPending) return;
+    geometryPending = false;
+    tinygltf::Model& model = asset->model;
+    GLTF_BufferArena& buffers = asset->buffers;
+    for (size_t i = 0; i < drawList.size(); ++i) {
+        if (drawList.resident[i]) continue;
+        const tinygltf::Primitive& primitive = model.meshes[drawList.mesh[i]].primitives[drawList.primitive[i]];
+        bool resident = buffers.resident(GLTF_BufferArena::Index, model.accessors[primitive.indices].bufferView);
+        for (auto& attrib : primitive.attributes) {
+            int view = model.accessors[attrib.second].bufferView;
+            if (buffers.contains(GLTF_BufferArena::Vertex, view) && !buffers.resident(GLTF_BufferArena::Vertex, view))
+                resident = false;
+        }
+        drawList.resident[i] = resident ? 1 : 0;
+        if (!resident) geometryPending = true;
+    }
+}
+
+// streaming: point every draw at its mesh when that is resident and at its bounding box while
+// it is not, and at whichever of its textures are resident, when anything came or went
+void GLTF_Model::refreshStreamedDraws() {
+    if (!geometryPending && streamedVersion == asset->residencyVersion) return;
+    geometryPending = false;
+    streamedVersion = asset->residencyVersion;
+    tinygltf::Model& model = asset->model;
+    for (size_t i = 0; i < drawList.size(); ++i) {
+        int mesh = drawList.mesh[i];
+        const std::vector<GLuint>& vaos = asset->VaosAndEbos.first[mesh];
+        GLuint vao = vaos.empty() ? 0 : vaos[drawList.primitive[i]];
+        if (vao) {
+            const tinygltf::Primitive& primitive = model.meshes[mesh].primitives[drawList.primitive[i]];
+            const tinygltf::Accessor& indices = model.accessors[primitive.indices];
+            const GLTF_BufferArena& arena = asset->meshBuffers[mesh];
+            drawList.ebo[i] = arena.buffer(GLTF_BufferArena::Index, indices.bufferView);
+            drawList.indexCount[i] = (GLsizei)indices.count;
+            drawList.indexType[i] = indices.componentType;
+            drawList.indexOffset[i] = arena.address(GLTF_BufferArena::Index, indices.bufferView, indices.byteOffset);
+            drawList.mode[i] = primitive.mode >= 0 ? primitive.mode : GL_TRIANGLES;
+            drawList.resident[i] = 1;
+        }
+        else {
+            //a box says where something is coming, skinned draws have no bounds to show
+            vao = asset->placeholderVao;
+            drawList.ebo[i] = asset->placeholderBuffers[1];
+            drawList.indexCount[i] = 36;
+            drawList.indexType[i] = GL_UNSIGNED_INT;
+            drawList.indexOffset[i] = (asset->placeholderBoxes[mesh] + drawList.primitive[i]) * 36 * sizeof(uint32_t);
+            drawList.mode[i] = GL_TRIANGLES;
+            drawList.resident[i] = drawList.skinInstance[i] < 0 ? 1 : 0;
+        }
+        if (drawList.vao[i] != vao && drawList.matrixIndex[i] < 0) enableInstanceAttributes(vao);
+        drawList.vao[i] = vao;
+        for (int unit = 0; unit < textureUnitCount; ++unit) {
+            int texture = drawList.textureIndex[i * textureUnitCount + unit];
+            drawList.textures[i * textureUnitCount + unit] = texture >= 0 ? asset->textureIDs[texture] : 0;
+        }
+    }
+    assignStateIds();
+}
+
+// one VAO per primitive with its index buffer and every attribute that has a location,
+// joints as integers. an interleaved primitive reads all of them from one buffer at one stride
+void GLTF_Model::Asset::bindMesh(std::vector<GLuint>& vaos, tinygltf::Model& model, tinygltf::Mesh& mesh,
+    const GLTF_BufferArena& arena) {
+    vaos.assign(mesh.primitives.size(), 0);
     for (size_t i = 0; i < mesh.primitives.size(); ++i) {
-        tinygltf::Primitive primitive = mesh.primitives[i];
-        tinygltf::Accessor indexAccessor = model.accessors[primitive.indices];
-        bindVbo(vbos, model, primitive.indices);
-        
-        //bind attribute pointer and bind vbo
+        const tinygltf::Primitive& primitive = mesh.primitives[i];
+        GLTF_GL::genVertexArrays(1, &vaos[i]);
+        GLTF_GL::bindVertexArray(vaos[i]);
+        if (primitive.indices >= 0) {
+            int indexView = model.accessors[primitive.indices].bufferView;
+            if (arena.contains(GLTF_BufferArena::Index, indexView))
+                GLTF_GL::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.buffer(GLTF_BufferArena::Index, indexView));
+        }
+
+        //bind attribute pointer into the vertex arena
         for (auto& attrib : primitive.attributes) {
-            tinygltf::Accessor accessor = model.accessors[attrib.second];
-            bindVbo(vbos, model, attrib.second);
-            int byteStride =
-                accessor.ByteStride(model.bufferViews[accessor.bufferView]);
-            glBindBuffer(GL_ARRAY_BUFFER, vbos[accessor.bufferView]);
+            const tinygltf::Accessor& accessor = model.accessors[attrib.second];
+            int location = GLTF_VertexFormat::location(attrib.first);
+            if (location < 0) {
+                GLTF_LOG_DEBUG("vaa missing: " << attrib.first);
+                continue;
+            }
+            if (!arena.contains(GLTF_BufferArena::Vertex, accessor.bufferView)) continue;
+            int byteStride = accessor.ByteStride(model.bufferViews[accessor.bufferView]);
+            GLTF_GL::bindBuffer(GL_ARRAY_BUFFER, arena.buffer(GLTF_BufferArena::Vertex, accessor.bufferView));
 
             int size = 1;
             if (accessor.type != TINYGLTF_TYPE_SCALAR) {
                 size = accessor.type;
             }
-
-            int vaa = -1;
-            if (attrib.first.compare("POSITION") == 0) vaa = 0;
-            if (attrib.first.compare("NORMAL") == 0) vaa = 1;
-            if (attrib.first.compare("TEXCOORD_0") == 0) vaa = 2;
-            if (vaa > -1) {
-                glEnableVertexAttribArray(vaa);
-                glVertexAttribPointer(vaa, size, accessor.componentType,
-                    accessor.normalized ? GL_TRUE : GL_FALSE,
-                    byteStride, BUFFER_OFFSET(accessor.byteOffset));
-            }
+            const void* offset = BUFFER_OFFSET(arena.address(GLTF_BufferArena::Vertex, accessor.bufferView, accessor.byteOffset));
+            GLTF_GL::enableVertexAttribArray(location);
+            if (GLTF_VertexFormat::integer(attrib.first))
+                GLTF_GL::vertexAttribIPointer(location, size, accessor.componentType, byteStride, offset);
             else
-                std::cout << "vaa missing: " << attrib.first << std::endl;
+                GLTF_GL::vertexAttribPointer(location, size, accessor.componentType, accessor.normalized ? GL_TRUE : GL_FALSE,
+                    byteStride, offset);
         }
-
-        
     }
+    GLTF_GL::bindVertexArray(0);
 }
 
-void GLTF_Model :: bindModelNodes(std::map<int, GLuint>& vaos, std::map<int, GLuint>& vbos, tinygltf::Model& model,
-    tinygltf::Node& node) {
-    // allocate vaos to each mesh
-    if ((node.mesh >= 0) && (node.mesh < model.meshes.size())) {
-        GLuint vao;
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
-        std::cout << std::endl;
-        bindMesh(vbos, model, model.meshes[node.mesh]);
-        std::cout << "mesh" << node.mesh << ": " << vao << std::endl;
-        vaos[node.mesh] = vao;
+void GLTF_Model::Asset::bindModelNodes(std::vector<std::vector<GLuint>>& vaos, tinygltf::Model& model, tinygltf::Node& node) {
+    // allocate vaos to each mesh, once however many nodes draw it
+    if ((node.mesh >= 0) && (node.mesh < model.meshes.size()) && vaos[node.mesh].empty()) {
+        bindMesh(vaos[node.mesh], model, model.meshes[node.mesh], buffers);
+        GLTF_LOG_DEBUG("mesh" << node.mesh << ": " << vaos[node.mesh].size() << " vaos");
     }
 
     for (size_t i = 0; i < node.children.size(); i++) {
         assert((node.children[i] >= 0) && (node.children[i] < model.nodes.size()));
-        bindModelNodes(vaos, vbos, model, model.nodes[node.children[i]]);
+        bindModelNodes(vaos, model, model.nodes[node.children[i]]);
     }
 }
 
-std::pair<std::map<int, GLuint>, std::map<int, GLuint>> GLTF_Model :: bindModel(tinygltf::Model& model) {
+std::pair<std::vector<std::vector<GLuint>>, std::map<int, GLuint>> GLTF_Model::Asset::bindModel(tinygltf::Model& model) {
     std::map<int, GLuint> vbos;
-    std::map<int, GLuint> vaos;
+    std::vector<std::vector<GLuint>> vaos(model.meshes.size());
 
-    const tinygltf::Scene& scene = model.scenes[model.defaultScene];
-    for (size_t i = 0; i < scene.nodes.size(); ++i) {
-        assert((scene.nodes[i] >= 0) && (scene.nodes[i] < model.nodes.size()));
-        bindModelNodes(vaos, vbos, model, model.nodes[scene.nodes[i]]);
-    }
-    glBindVertexArray(0);
-
-    // get lights imformation
-    for (auto& node : model.nodes) {
-        if (node.name.find("LightComponent0") != std::string::npos) {
-            for (auto& childIndex : node.children) {
-                auto& childNode = model.nodes[childIndex];
-                if (childNode.light >= 0) {
-                    auto& light = model.lights[childNode.light];
-                    if (light.type == "point") {
-                        PointLight pointLight;
-                        //calculate the location
-                        glm::vec3 rotationEuler = glm::vec3(node.rotation[0], node.rotation[1], node.rotation[2]);
-                        glm::quat rotationQuat = glm::quat(rotationEuler);
-                        glm::mat4 rotationMatrix = glm::mat4_cast(rotationQuat);
-                        glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), 
-                            glm::vec3(node.translation[0], node.translation[1], node.translation[2])) * rotationMatrix;
-                        pointLight.position = glm::vec3(modelMatrix[3]);
-
-                        pointLight.color = glm::vec3(light.color[0], light.color[1], light.color[2]);
-                        pointLight.intensity = light.intensity;
-                        pointLights.push_back(pointLight);
-                    }
-                    else if (light.type == "directional") {
-                        glm::quat q(node.rotation[0], node.rotation[1], node.rotation[2], node.rotation[3]);
-                        //glm::quat rotationY = glm::angleAxis(glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-                        glm::vec3 direction = q * glm::vec3(0.0f, 0.0f, -1.0f);
-
-                        DirectionalLight directionalLight;
-                        directionalLight.direction = direction;
-                        directionalLight.color = glm::vec3(light.color[0], light.color[1], light.color[2]);
-                        directionalLight.intensity = light.intensity;
-                        directionalLights.push_back(directionalLight);
-                    }
-                }
-            }
+    //reserve one range per bufferView, VAOs point into the arenas before the data arrives.
+    //streaming makes the storage and VAO of a mesh when the mesh comes in
+    if (streaming) {
+        bindStreaming();
+    }
+    else {
+        buffers.allocate(model);
+        const tinygltf::Scene& scene = model.scenes[model.defaultScene >= 0 ? model.defaultScene : 0];
+        for (size_t i = 0; i < scene.nodes.size(); ++i) {
+            assert((scene.nodes[i] >= 0) && (scene.nodes[i] < model.nodes.size()));
+            bindModelNodes(vaos, model, model.nodes[scene.nodes[i]]);
+        }
+        for (int view : buffers.views(GLTF_BufferArena::Index)) {
+            vbos[view] = buffers.buffer(GLTF_BufferArena::Index, view);
+        }
+    }
+
+    //point and directional lights of the default scene at rest, for the GLTFLights block and
+    //the pointLight[i]/directionalLight[i] uniforms; spot lights need the clustered path
+    if (!model.scenes.empty()) {
+        GLTF_Transforms rest;
+        rest.build(model, model.defaultScene >= 0 ? model.defaultScene : 0);
+        GLTF_SceneLights sceneLights;
+        sceneLights.build(model, rest);
+        pointLights.clear();
+        directionalLights.clear();
+        for (const GLTF_Light& light : sceneLights.lights()) {
+            if (light.type == GLTF_Light::Point) pointLights.push_back({ light.position, light.color, light.intensity });
+            else if (light.type == GLTF_Light::Directional) directionalLights.push_back({ light.direction, light.color, light.intensity });
         }
     }
 
+    lightsVersion = newLightsVersion();
+    readGpuInstancing();
+
     //bind textures
     //resize my textureID size
-    textureIDs.resize(model.textures.size());
+    textureIDs.assign(model.textures.size(), 0);
+    textures.resize(model.textures.size());
+    textureKeys.resize(model.textures.size());
+    ownTextures.assign(model.textures.size(), 0);
 
-    //load all textures in a model
+    //create all textures in a model, a white texel stands in until uploadTexture runs
+    const unsigned char placeholder[4] = { 255, 255, 255, 255 };
     for (size_t i = 0; i < model.textures.size(); i++) {
         tinygltf::Texture& tex = model.textures[i];
+        if (streaming) {
+            textureIDs[i] = placeholderTexture;
+            continue;
+        }
 
-        if (tex.source > -1) {
+        //the same image sampled the same way is already on the GPU, from this or another file
+        if (textures[i]) {
+            textureIDs[i] = textures[i]->id;
+            continue;
+        }
+        if (GLTF_TextureDecoder::textureSource(tex) > -1) {
             GLuint texid;
-            glGenTextures(1, &texid);
+            GLTF_GL::genTextures(1, &texid);
+
+            GLTF_GL::bindTexture(GL_TEXTURE_2D, texid);
+            GLTF_GL::pixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            GLTF_GL::texParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            GLTF_GL::texParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            GLTF_GL::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            GLTF_GL::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            GLTF_GL::texImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+            // Store the texture ID
+            textureIDs[i] = texid;
+            textures[i] = std::make_shared<GLTF_SharedTexture>();
+            textures[i]->id = texid;
+            ownTextures[i] = 1;
+            if (!textureKeys[i].empty()) textureCache().insert(textureKeys[i], textures[i]);
+        }
+    }
 
-            tinygltf::Image& image = model.images[tex.source];
+    return { vaos, vbos };
+}
 
-            glBindTexture(GL_TEXTURE_2D, texid);
-            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+size_t GLTF_Model::Asset::uploadTexture(size_t textureIndex) {
+    tinygltf::Texture& tex = model.textures[textureIndex];
+    int source = GLTF_TextureDecoder::textureSource(tex);
+    if (source < 0 || source >= (int)imageData.size() || textureIDs[textureIndex] == 0) return 0;
+    //an image that failed to decode keeps the white placeholder
+    if (!imageData[source].valid()) return 0;
+    if (!stagingPbo) GLTF_GL::genBuffers(1, &stagingPbo);
+    size_t bytes = GLTF_TextureDecoder::upload(textureIDs[textureIndex], imageData[source],
+        GLTF_TextureDecoder::sampler(model, tex), stagingPbo);
+    textures[textureIndex]->bytes = bytes;
+    return bytes;
+}
 
-            GLenum format = GL_RGBA;
+// streaming: a trimmed layout and a byte estimate per mesh and texture, and the boxes and
+// texel drawn in their place. no mesh data is read and no image decoded yet
+void GLTF_Model::Asset::bindStreaming() {
+    size_t meshCount = model.meshes.size();
+    meshBuffers.assign(meshCount, GLTF_BufferArena());
+    streamedImages.assign(model.textures.size(), GLTF_TextureData());
+    fetches.clear();
+    fetches.resize(meshCount + model.textures.size());
+    inFlight.clear();
+    srgbImages = colorImages(model, gamma);
+    streamer.reset(meshCount + model.textures.size());
+    std::vector<int> mesh(1);
+    for (size_t m = 0; m < meshCount; ++m) {
+        mesh[0] = (int)m;
+        meshBuffers[m].plan(model, &mesh);
+        streamer.setBytes((int)m, meshBuffers[m].bytes());
+    }
+    for (size_t i = 0; i < model.textures.size(); ++i) {
+        int source = GLTF_TextureDecoder::textureSource(model.textures[i]);
+        if (source < 0 || source >= (int)encodedImages.size()) continue;
+        streamer.setBytes((int)(meshCount + i),
+            GLTF_TextureDecoder::estimateBytes(encodedImages[source].data(), encodedImages[source].size()));
+    }
 
-            if (image.component == 1) {
-                format = GL_RED;
+    //a box per primitive from its POSITION bounds, corners by bit: x 4, y 2, z 1
+    static const uint32_t faces[36] = { 0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1,
+        2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3 };
+    std::vector<glm::vec3> corners;
+    std::vector<uint32_t> indices;
+    placeholderBoxes.assign(meshCount, 0);
+    for (size_t m = 0; m < meshCount; ++m) {
+        placeholderBoxes[m] = (int)(corners.size() / 8);
+        for (const tinygltf::Primitive& primitive : model.meshes[m].primitives) {
+            glm::vec3 low(0.0f);
+            glm::vec3 high(0.0f);
+            auto position = primitive.attributes.find("POSITION");
+            if (position != primitive.attributes.end()) {
+                const tinygltf::Accessor& accessor = model.accessors[position->second];
+                if (accessor.minValues.size() == 3 && accessor.maxValues.size() == 3) {
+                    low = glm::vec3(accessor.minValues[0], accessor.minValues[1], accessor.minValues[2]);
+                    high = glm::vec3(accessor.maxValues[0], accessor.maxValues[1], accessor.maxValues[2]);
+                }
             }
-            else if (image.component == 2) {
-                format = GL_RG;
+            uint32_t first = (uint32_t)corners.size();
+            for (int corner = 0; corner < 8; ++corner) {
+                corners.push_back(glm::vec3(corner & 4 ? high.x : low.x, corner & 2 ? high.y : low.y, corner & 1 ? high.z : low.z));
             }
-            else if (image.component == 3) {
-                format = GL_RGB;
+            for (uint32_t index : faces) {
+                indices.push_back(first + index);
             }
-            GLenum type = GL_UNSIGNED_BYTE;
-            if (image.bits == 8) {
+        }
+    }
+    GLTF_GL::genVertexArrays(1, &placeholderVao);
+    GLTF_GL::bindVertexArray(placeholderVao);
+    GLTF_GL::genBuffers(2, placeholderBuffers);
+    GLTF_GL::bindBuffer(GL_ARRAY_BUFFER, placeholderBuffers[0]);
+    GLTF_GL::bufferData(GL_ARRAY_BUFFER, corners.size() * sizeof(glm::vec3), corners.data(), GL_STATIC_DRAW);
+    GLTF_GL::enableVertexAttribArray(0);
+    GLTF_GL::vertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), BUFFER_OFFSET(0));
+    GLTF_GL::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, placeholderBuffers[1]);
+    GLTF_GL::bufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+    GLTF_GL::bindVertexArray(0);
+    GLTF_GL::bindBuffer(GL_ARRAY_BUFFER, 0);
+    placeholderBytes = corners.size() * sizeof(glm::vec3) + indices.size() * sizeof(uint32_t);
+
+    const unsigned char white[4] = { 255, 255, 255, 255 };
+    GLTF_GL::genTextures(1, &placeholderTexture);
+    GLTF_GL::bindTexture(GL_TEXTURE_2D, placeholderTexture);
+    GLTF_GL::pixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    GLTF_GL::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    GLTF_GL::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    GLTF_GL::texImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+    placeholderBytes += sizeof(white);
+}
 
+// streaming, once a frame: upload the finished fetches within the budget, then let the
+// streamer evict and start fetches for what the draws requested since the last call
+void GLTF_Model::Asset::stream(const UploadBudget* budget) {
+    GLTF_TRACE_SCOPE("stream", "frame");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t bytes = 0;
+    size_t waiting = 0;
+    for (int resource : inFlight) {
+        std::future<std::shared_ptr<GLTF_TextureData>>& fetch = fetches[resource];
+        if (fetch.valid()) {
+            if (fetch.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                inFlight[waiting++] = resource;
+                continue;
             }
-            else if (image.bits == 16) {
-                type = GL_UNSIGNED_SHORT;
+            //a failed fetch is uploaded as nothing and keeps its placeholder
+            std::shared_ptr<GLTF_TextureData> image = fetch.get();
+            if (image) streamedImages[resource - meshBuffers.size()] = std::move(*image);
+            streamer.setState(resource, GLTF_Streamer::Ready);
+        }
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (budget && (bytes >= budget->bytes || elapsed >= budget->milliseconds)) {
+            inFlight[waiting++] = resource;
+            continue;
+        }
+        bytes += uploadResource(resource);
+        streamer.setState(resource, GLTF_Streamer::Resident);
+        residencyVersion++;
+    }
+    inFlight.resize(waiting);
+
+    const StreamingSettings settings = streamingSettings();
+    streamer.setBudget(settings.budgetBytes, settings.maxInFlight);
+    std::vector<int> fetch;
+    std::vector<int> evict;
+    streamer.schedule(fetch, evict);
+    for (int resource : evict) {
+        evictResource(resource);
+    }
+    if (!evict.empty()) residencyVersion++;
+    for (int resource : fetch) {
+        fetchResource(resource);
+    }
+}
+
+// the CPU half of bringing a resource in, on a worker: page in the mesh's bytes or decode
+// the texture's image. the task holds the asset only while it runs and decodes into its own
+// image, stream() moves it into streamedImages on the GL thread
+void GLTF_Model::Asset::fetchResource(int resource) {
+    std::weak_ptr<Asset> weak = shared_from_this();
+    fetches[resource] = GLTF_ThreadPool::shared().submit([weak, resource]() -> std::shared_ptr<GLTF_TextureData> {
+        std::shared_ptr<Asset> self = weak.lock();
+        if (!self) return nullptr;
+        GLTF_TRACE_SCOPE("fetch", "stream");
+        size_t meshCount = self->meshBuffers.size();
+        if (resource < (int)meshCount) {
+            self->meshBuffers[resource].prefetch(self->model, self->bufferData);
+            return nullptr;
+        }
+        size_t texture = resource - meshCount;
+        int source = GLTF_TextureDecoder::textureSource(self->model.textures[texture]);
+        if (source < 0 || source >= (int)self->encodedImages.size() || source >= (int)self->srgbImages.size()) return nullptr;
+        //a fresh image, textures sharing this one may be decoding it at the same time
+        tinygltf::Image image;
+        std::shared_ptr<GLTF_TextureData> decoded = std::make_shared<GLTF_TextureData>();
+        std::string error;
+        if (decodeImage(image, source, self->encodedImages[source], self->srgbImages[source] != 0, self->caps, *decoded, error))
+            return decoded;
+        GLTF_LOG_ERROR("image " << source << ": " << error);
+        return nullptr;
+    });
+    inFlight.push_back(resource);
+}
+
+// the GL half, returns the bytes uploaded
+size_t GLTF_Model::Asset::uploadResource(int resource) {
+    size_t meshCount = meshBuffers.size();
+    if (resource < (int)meshCount) {
+        GLTF_BufferArena& arena = meshBuffers[resource];
+        arena.reserve();
+        size_t bytes = 0;
+        for (int role = GLTF_BufferArena::Vertex; role <= GLTF_BufferArena::Index; ++role) {
+            GLTF_BufferArena::Role arenaRole = (GLTF_BufferArena::Role)role;
+            for (int view : arena.views(arenaRole)) {
+                bytes += arena.upload(model, bufferData, arenaRole, view, 0, arena.length(arenaRole, view));
             }
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0,
-                format, type, &image.image.at(0));
-            // Store the texture ID
-            textureIDs[i] = texid;
         }
+        bindMesh(VaosAndEbos.first[resource], model, model.meshes[resource], arena);
+        return bytes;
+    }
+    size_t texture = resource - meshCount;
+    size_t bytes = 0;
+    if (streamedImages[texture].valid()) {
+        GLuint id;
+        GLTF_GL::genTextures(1, &id);
+        if (!stagingPbo) GLTF_GL::genBuffers(1, &stagingPbo);
+        bytes = GLTF_TextureDecoder::upload(id, streamedImages[texture], GLTF_TextureDecoder::sampler(model, model.textures[texture]),
+            stagingPbo);
+        textureIDs[texture] = id;
     }
+    streamedImages[texture] = GLTF_TextureData();
+    //the estimate made from the header becomes the real size
+    streamer.setBytes(resource, bytes);
+    return bytes;
+}
 
-    return { vaos, vbos };
+void GLTF_Model::Asset::evictResource(int resource) {
+    size_t meshCount = meshBuffers.size();
+    if (resource < (int)meshCount) {
+        for (GLuint& vao : VaosAndEbos.first[resource]) {
+            GLTF_GL::deleteVertexArrays(1, &vao);
+        }
+        VaosAndEbos.first[resource].clear();
+        meshBuffers[resource].evict();
+        return;
+    }
+    GLuint& id = textureIDs[resource - meshCount];
+    if (id && id != placeholderTexture) GLTF_GL::deleteTextures(1, &id);
+    id = placeholderTexture;
+}
+
+void GLTF_Model::compileScene(tinygltf::Model& model) {
+    drawList = DrawList();
+    instanceSlots.clear();
+    instanceLocals.clear();
+    instanceLocalMatrices.clear();
+    skinInstances.clear();
+    transforms.build(model, model.defaultScene >= 0 ? model.defaultScene : 0);
+    sceneLights.build(model, transforms);
+    bvhBuilt = false;
+
+    //group the nodes that draw the same mesh, transform slots are in depth-first order already
+    std::map<int, std::vector<std::pair<int, int>>> meshInstances;       //mesh -> (slot, local matrix)
+    std::vector<int> skinnedSlots;
+    for (int slot = 0; slot < (int)transforms.size(); ++slot) {
+        tinygltf::Node& node = model.nodes[transforms.node(slot)];
+        if ((node.mesh < 0) || (node.mesh >= (int)model.meshes.size())) continue;
+        if (node.skin >= 0 && node.skin < (int)asset->skins.size()) {
+            //a skinned node deforms its own copy of the mesh, it is never instanced
+            skinnedSlots.push_back(slot);
+            continue;
+        }
+        std::vector<std::pair<int, int>>& instances = meshInstances[node.mesh];
+        size_t firstLocal = instanceLocalMatrices.size();
+        auto gpuInstances = asset->gpuInstances.find(transforms.node(slot));
+        if (gpuInstances != asset->gpuInstances.end())
+            instanceLocalMatrices.insert(instanceLocalMatrices.end(), gpuInstances->second.begin(), gpuInstances->second.end());
+        if (instanceLocalMatrices.size() == firstLocal) {
+            instances.push_back({ slot, -1 });
+        }
+        for (size_t local = firstLocal; local < instanceLocalMatrices.size(); ++local) {
+            instances.push_back({ slot, (int)local });
+        }
+    }
+
+    bool instanced = false;
+    for (auto& group : meshInstances) {
+        tinygltf::Mesh& mesh = model.meshes[group.first];
+        //streamed draws get their vertex arrays as the meshes come in
+        std::vector<GLuint> vaos = asset->streaming ? std::vector<GLuint>(mesh.primitives.size(), 0) :
+            asset->VaosAndEbos.first.at(group.first);
+        const std::vector<std::pair<int, int>>& instances = group.second;
+        if (instances.size() == 1 && instances[0].second < 0) {
+            for (size_t i = 0; i < mesh.primitives.size(); ++i) {
+                compilePrimitive(model, group.first, (int)i, vaos[i], instances[0].first, 0, 1);
+            }
+            continue;
+        }
+        //every primitive of the mesh shares one instance range
+        size_t firstInstance = instanceSlots.size();
+        for (auto& instance : instances) {
+            instanceSlots.push_back(instance.first);
+            instanceLocals.push_back(instance.second);
+        }
+        for (size_t i = 0; i < mesh.primitives.size(); ++i) {
+            compilePrimitive(model, group.first, (int)i, vaos[i], -1, firstInstance, (GLsizei)instances.size());
+        }
+        instanced = true;
+        for (GLuint vao : vaos) {
+            if (vao) enableInstanceAttributes(vao);
+        }
+    }
+
+    for (int slot : skinnedSlots) {
+        tinygltf::Node& node = model.nodes[transforms.node(slot)];
+        int skinInstance = (int)skinInstances.size();
+        skinInstances.push_back({ slot, node.skin });
+        if (asset->skins[node.skin].joints.size() > GLTF_MAX_JOINTS)
+            GLTF_LOG_WARN("skin has more than " << GLTF_MAX_JOINTS << " joints: " << node.skin);
+        for (size_t i = 0; i < model.meshes[node.mesh].primitives.size(); ++i) {
+            GLuint vao = asset->streaming ? 0 : asset->VaosAndEbos.first.at(node.mesh)[i];
+            compilePrimitive(model, node.mesh, (int)i, vao, slot, 0, 1, skinInstance);
+        }
+    }
+
+    if (instanced && !instanceVbo) GLTF_GL::genBuffers(1, &instanceVbo);
+    instanceMatrices.resize(instanceSlots.size());
+    instanceVersion = 0;
+
+    //every palette is bound with glBindBufferRange, so they start on the alignment GL asks for
+    if (!skinInstances.empty()) {
+        GLint alignment = 256;
+        GLTF_GL::getIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        jointStride = GLTF_MAX_JOINTS * sizeof(glm::mat4);
+        while (alignment > 0 && jointStride % alignment) jointStride += sizeof(glm::mat4);
+        if (!jointBuffer) GLTF_GL::genBuffers(1, &jointBuffer);
+    }
+    jointMatrices.assign(skinInstances.size() * jointStride / sizeof(glm::mat4), glm::mat4(1.0f));
+    jointsVersion = 0;
+    jointsUploaded = 0;
+    assignStateIds();
 }
 
-void GLTF_Model :: drawMesh(const std::map<int, GLuint>& vbos,
-    tinygltf::Model& model, tinygltf::Mesh& mesh, Shader& shader) {
+// the instance matrix is a per-instance attribute of the mesh VAO
+void GLTF_Model::enableInstanceAttributes(GLuint vao) {
+    GLTF_GL::bindVertexArray(vao);
+    for (int column = 0; column < 4; ++column) {
+        GLTF_GL::enableVertexAttribArray(GLTF_INSTANCE_MATRIX_LOCATION + column);
+        GLTF_GL::vertexAttribDivisor(GLTF_INSTANCE_MATRIX_LOCATION + column, 1);
+    }
+    GLTF_GL::bindVertexArray(0);
+}
+
+// dense ids for the sort keys. material states are numbered in the order of their texture
+// sets, so materials that differ only in factors still sort next to each other
+void GLTF_Model::assignStateIds() {
+    typedef std::pair<std::array<GLuint, textureUnitCount>, std::array<float, 7>> MaterialState;
+    auto materialState = [this](size_t draw) {
+        MaterialState state;
+        std::copy(&drawList.textures[draw * textureUnitCount], &drawList.textures[draw * textureUnitCount] + textureUnitCount,
+            state.first.begin());
+        const glm::vec4& color = drawList.baseColorFactor[draw];
+        state.second = { color.x, color.y, color.z, color.w, drawList.metallicFactor[draw], drawList.roughnessFactor[draw],
+            drawList.alphaCutoff[draw] };
+        return state;
+    };
+    std::map<MaterialState, uint32_t> states;
+    std::map<GLuint, uint32_t> vaos;
+    for (size_t i = 0; i < drawList.size(); ++i) {
+        states[materialState(i)] = 0;
+        vaos[drawList.vao[i]] = 0;
+    }
+    uint32_t next = 0;
+    for (auto& state : states) state.second = next++;
+    next = 0;
+    for (auto& vao : vaos) vao.second = next++;
+    drawList.stateId.resize(drawList.size());
+    drawList.vaoId.resize(drawList.size());
+    for (size_t i = 0; i < drawList.size(); ++i) {
+        drawList.stateId[i] = states[materialState(i)];
+        drawList.vaoId[i] = vaos[drawList.vao[i]];
+    }
+}
+
+// EXT_mesh_gpu_instancing: TRS per instance, applied under the node transform. read once
+// while the buffer bytes are still there, models compile from these matrices
+void GLTF_Model::Asset::readGpuInstancing() {
+    gpuInstances.clear();
+    for (size_t n = 0; n < model.nodes.size(); ++n) {
+        tinygltf::Node& node = model.nodes[n];
+        auto extension = node.extensions.find("EXT_mesh_gpu_instancing");
+        if (extension == node.extensions.end() || !extension->second.Has("attributes")) continue;
+        const tinygltf::Value& attributes = extension->second.Get("attributes");
+
+        std::vector<float> translations, rotations, scales;
+        size_t count = 0;
+        if (attributes.Has("TRANSLATION") && gltfReadFloats(model, bufferData, attributes.Get("TRANSLATION").GetNumberAsInt(), translations))
+            count = translations.size() / 3;
+        if (attributes.Has("ROTATION") && gltfReadFloats(model, bufferData, attributes.Get("ROTATION").GetNumberAsInt(), rotations))
+            count = rotations.size() / 4;
+        if (attributes.Has("SCALE") && gltfReadFloats(model, bufferData, attributes.Get("SCALE").GetNumberAsInt(), scales))
+            count = scales.size() / 3;
+
+        std::vector<glm::mat4>& matrices = gpuInstances[(int)n];
+        for (size_t i = 0; i < count; ++i) {
+            glm::mat4 matrix(1.0f);
+            if (translations.size() >= (i + 1) * 3)
+                matrix = glm::translate(matrix, glm::vec3(translations[i * 3], translations[i * 3 + 1], translations[i * 3 + 2]));
+            if (rotations.size() >= (i + 1) * 4)
+                matrix *= glm::mat4_cast(glm::quat(rotations[i * 4 + 3], rotations[i * 4], rotations[i * 4 + 1], rotations[i * 4 + 2]));
+            if (scales.size() >= (i + 1) * 3)
+                matrix = glm::scale(matrix, glm::vec3(scales[i * 3], scales[i * 3 + 1], scales[i * 3 + 2]));
+            matrices.push_back(matrix);
+        }
+    }
+}
+
+// resolve everything drawMesh looks up per frame into one draw record
+void GLTF_Model::compilePrimitive(tinygltf::Model& model, int meshIndex, int primitiveIndex, GLuint vao,
+    int matrixIndex, size_t firstInstance, GLsizei instanceCount, int skinInstance) {
+    tinygltf::Primitive& primitive = model.meshes[meshIndex].primitives[primitiveIndex];
+    if (primitive.indices < 0 || primitive.indices >= (int)model.accessors.size()) return;
+    const tinygltf::Accessor& indexAccessor = model.accessors[primitive.indices];
+
+    bool streamed = asset->streaming;
+    //a malformed file's index view may be missing from the arena, that primitive is not drawn
+    GLuint ebo = 0;
+    if (!streamed) {
+        auto found = asset->VaosAndEbos.second.find(indexAccessor.bufferView);
+        if (found == asset->VaosAndEbos.second.end() || !asset->buffers.contains(GLTF_BufferArena::Index, indexAccessor.bufferView)) {
+            GLTF_LOG_WARN("primitive " << primitiveIndex << " of mesh " << meshIndex << " has no index buffer, skipped");
+            return;
+        }
+        ebo = found->second;
+    }
+    drawList.vao.push_back(vao);
+    drawList.ebo.push_back(ebo);
+    drawList.indexCount.push_back((GLsizei)indexAccessor.count);
+    drawList.indexType.push_back(indexAccessor.componentType);
+    drawList.indexOffset.push_back(streamed ? 0 : asset->buffers.address(GLTF_BufferArena::Index, indexAccessor.bufferView, indexAccessor.byteOffset));
+    drawList.mode.push_back(primitive.mode >= 0 ? primitive.mode : GL_TRIANGLES);
+    drawList.matrixIndex.push_back(matrixIndex);
+    drawList.firstInstance.push_back(firstInstance);
+    drawList.instanceCount.push_back(instanceCount);
+    drawList.mesh.push_back(meshIndex);
+    drawList.primitive.push_back(primitiveIndex);
+    drawList.resident.push_back(0);
+    drawList.skinInstance.push_back(skinInstance);
+    //joints move skinned vertices anywhere, those draws are never culled
+    GLTF_Aabb bounds = GLTF_Aabb::unbounded();
+    auto position = primitive.attributes.find("POSITION");
+    if (position != primitive.attributes.end() && skinInstance < 0) {
+        const tinygltf::Accessor& accessor = model.accessors[position->second];
+        if (accessor.minValues.size() == 3 && accessor.maxValues.size() == 3) {
+            bounds = GLTF_Aabb(glm::vec3(accessor.minValues[0], accessor.minValues[1], accessor.minValues[2]),
+                glm::vec3(accessor.maxValues[0], accessor.maxValues[1], accessor.maxValues[2]));
+        }
+    }
+    drawList.bounds.push_back(bounds);
+
+    //-1 tells the shader to sample the texture instead
+    glm::vec4 baseColor(-1.0f, -1.0f, -1.0f, -1.0f);
+    float metallic = -1.0f;
+    float roughness = -1.0f;
+    int textures[textureUnitCount] = { -1, -1, -1, -1 };
+    GLTF_DrawSort::Pass pass = GLTF_DrawSort::Opaque;
+    bool doubleSided = false;
+    float alphaCutoff = 0.5f;
+
+    if (primitive.material >= 0) {
+        const tinygltf::Material& material = model.materials[primitive.material];
+        if (material.alphaMode == "MASK") pass = GLTF_DrawSort::Mask;
+        else if (material.alphaMode == "BLEND") pass = GLTF_DrawSort::Blend;
+        doubleSided = material.doubleSided;
+        alphaCutoff = (float)material.alphaCutoff;
+        auto value = material.values.find("baseColorTexture");
+        if (value != material.values.end()) {
+            textures[textureUnitIndices["baseColorTexture"]] = value->second.TextureIndex();
+        }
+        else if ((value = material.values.find("baseColorFactor")) != material.values.end()) {
+            const std::vector<double>& factor = value->second.number_array;
+            baseColor = glm::vec4(factor[0], factor[1], factor[2], factor[3]);
+        }
+        value = material.values.find("metallicRoughnessTexture");
+        if (value != material.values.end()) {
+            textures[textureUnitIndices["metallicRoughnessTexture"]] = value->second.TextureIndex();
+        }
+        else {
+            if ((value = material.values.find("metallicFactor")) != material.values.end())
+                metallic = (float)value->second.number_value;
+            if ((value = material.values.find("roughnessFactor")) != material.values.end())
+                roughness = (float)value->second.number_value;
+        }
+        value = material.additionalValues.find("normalTexture");
+        if (value != material.additionalValues.end()) {
+            textures[textureUnitIndices["normalTexture"]] = value->second.TextureIndex();
+        }
+        value = material.additionalValues.find("occlusionTexture");
+        if (value != material.additionalValues.end()) {
+            textures[textureUnitIndices["occlusionTexture"]] = value->second.TextureIndex();
+        }
+    }
+    for (int unit = 0; unit < textureUnitCount; ++unit) {
+        drawList.textures.push_back(textures[unit] >= 0 ? asset->textureIDs[textures[unit]] : 0);
+        drawList.textureIndex.push_back(textures[unit]);
+    }
+    drawList.baseColorFactor.push_back(baseColor);
+    drawList.metallicFactor.push_back(metallic);
+    drawList.roughnessFactor.push_back(roughness);
+    drawList.pass.push_back((uint8_t)pass);
+    drawList.doubleSided.push_back(doubleSided ? 1 : 0);
+    drawList.alphaCutoff.push_back(alphaCutoff);
+}
+
+void GLTF_Model :: drawMesh(const std::vector<GLuint>& vaos, const std::map<int, GLuint>& vbos,
+    tinygltf::Model& model, tinygltf::Mesh& mesh, GLuint program) {
+    ShaderBindings& bindings = bindShader(program);
     for (size_t i = 0; i < mesh.primitives.size(); ++i) {
         tinygltf::Primitive& primitive = mesh.primitives[i];
 
@@ -303,16 +1827,13 @@ void GLTF_Model :: drawMesh(const std::map<int, GLuint>& vbos,
         metallicFactor = -1.0f;
         roughnessFactor = -1.0f;
         
-        // bind indices VBO
+        //bind vao for every primitive, then indices VBO; primitives without one are not drawn
+        if (primitive.indices < 0 || primitive.indices >= (int)model.accessors.size()) continue;
         tinygltf::Accessor& indexAccessor = model.accessors[primitive.indices];
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbos.at(indexAccessor.bufferView));
-
-        // bind attributes VBOs and configure vertex attribute pointers
-        for (auto& attrib : primitive.attributes) {
-            int accessorIdx = attrib.second;
-            tinygltf::Accessor& accessor = model.accessors[accessorIdx];
-            glBindBuffer(GL_ARRAY_BUFFER, vbos.at(accessor.bufferView));
-        }
+        auto ebo = vbos.find(indexAccessor.bufferView);
+        if (ebo == vbos.end() || !asset->buffers.contains(GLTF_BufferArena::Index, indexAccessor.bufferView)) continue;
+        glState.bindVertexArray(vaos[i]);
+        glState.bindElementBuffer(ebo->second);
         //bind all textures
         int materialIndex = primitive.material;
         if (materialIndex >= 0) {
@@ -322,193 +1843,650 @@ void GLTF_Model :: drawMesh(const std::map<int, GLuint>& vbos,
             // diffuse/basecolor
             if (material.values.find("baseColorTexture") != material.values.end()) {
                 int textureIndex = material.values["baseColorTexture"].TextureIndex();
-                GLuint textureId = textureIDs[textureIndex];
-                shader.setVec4("baseColorFactor", baseColorFactor);
+                GLuint textureId = asset->textureIDs[textureIndex];
+                glState.uniform4f(bindings.baseColorFactor, baseColorFactor);
                 //use Texture
-                //active texture
-                int textureUnitIndex = textureUnitIndices["baseColorTexture"];
-                glActiveTexture(GL_TEXTURE0 + textureUnitIndex);
-
-                // now set the sampler to the correct texture unit
-                glUniform1i(glGetUniformLocation(shader.ID, "baseColorTexture"), textureUnitIndex);
-                // and finally bind the texture
-                glBindTexture(GL_TEXTURE_2D, textureId);
+                //the sampler already points at its unit, see bindShader
+                glState.bindTexture(textureUnitIndices["baseColorTexture"], textureId);
             }
             else if (material.values.find("baseColorFactor") != material.values.end()) {
                 //use basecolor factor
                 tinygltf::Parameter param = material.values["baseColorFactor"];
                 baseColorFactor = glm::vec4(param.number_array[0], param.number_array[1], param.number_array[2], param.number_array[3]);
                 //set baseColorFactor uniform
-                shader.setVec4("baseColorFactor", baseColorFactor);
+                glState.uniform4f(bindings.baseColorFactor, baseColorFactor);
             }
             // metallicRoughnessTexture
             if (material.values.find("metallicRoughnessTexture") != material.values.end()) {
                 int textureIndex = material.values["metallicRoughnessTexture"].TextureIndex();
-                GLuint textureId = textureIDs[textureIndex];
-
-                //active texture
-                int textureUnitIndex = textureUnitIndices["metallicRoughnessTexture"];
-                glActiveTexture(GL_TEXTURE0 + textureUnitIndex);
+                GLuint textureId = asset->textureIDs[textureIndex];
 
-                // now set the sampler to the correct texture unit
-                glUniform1i(glGetUniformLocation(shader.ID, "metallicRoughnessTexture"), textureUnitIndex);
-                // and finally bind the texture
-                glBindTexture(GL_TEXTURE_2D, textureId);
+                //the sampler already points at its unit, see bindShader
+                glState.bindTexture(textureUnitIndices["metallicRoughnessTexture"], textureId);
             }
             else {
                 if (material.values.find("metallicFactor") != material.values.end()) {
                     tinygltf::Parameter metallicParam = material.values["metallicFactor"];
                     metallicFactor = metallicParam.number_value;
                     //set metallic texture
-                    shader.setFloat("metallicFactor", metallicFactor);
+                    glState.uniform1f(bindings.metallicFactor, metallicFactor);
                 }
                 if (material.values.find("roughnessFactor") != material.values.end()) {
                     tinygltf::Parameter roughnessParam = material.values["roughnessFactor"];
                     roughnessFactor = roughnessParam.number_value;
                     //set roughness texture
-                    shader.setFloat("roughnessFactor", roughnessFactor);
+                    glState.uniform1f(bindings.roughnessFactor, roughnessFactor);
                 }
             }
             // normalTexture
             if (material.additionalValues.find("normalTexture") != material.additionalValues.end()) {
                 int textureIndex = material.additionalValues["normalTexture"].TextureIndex();
-                GLuint textureId = textureIDs[textureIndex];
+                GLuint textureId = asset->textureIDs[textureIndex];
                 
-                //active texture
-                int textureUnitIndex = textureUnitIndices["normalTexture"];
-                glActiveTexture(GL_TEXTURE0 + textureUnitIndex);
-
-                // now set the sampler to the correct texture unit
-                glUniform1i(glGetUniformLocation(shader.ID, "normalTexture"), textureUnitIndex);
-                // and finally bind the texture
-                glBindTexture(GL_TEXTURE_2D, textureId);
+                //the sampler already points at its unit, see bindShader
+                glState.bindTexture(textureUnitIndices["normalTexture"], textureId);
             }
             // occlusionTexture
             if (material.additionalValues.find("occlusionTexture") != material.additionalValues.end()) {
                 int textureIndex = material.additionalValues["occlusionTexture"].TextureIndex();
-                GLuint textureId = textureIDs[textureIndex];
+                GLuint textureId = asset->textureIDs[textureIndex];
                 
-                //active texture
-                int textureUnitIndex = textureUnitIndices["occlusionTexture"];
-                glActiveTexture(GL_TEXTURE0 + textureUnitIndex);
-
-                // now set the sampler to the correct texture unit
-                glUniform1i(glGetUniformLocation(shader.ID, "occlusionTexture"), textureUnitIndex);
-                // and finally bind the texture
-                glBindTexture(GL_TEXTURE_2D, textureId);
+                //the sampler already points at its unit, see bindShader
+                glState.bindTexture(textureUnitIndices["occlusionTexture"], textureId);
             }
         }
 
         // draw elements
-        glDrawElements(primitive.mode, indexAccessor.count, indexAccessor.componentType,
-            BUFFER_OFFSET(indexAccessor.byteOffset));
+        GLTF_GL::drawElements(primitive.mode, indexAccessor.count, indexAccessor.componentType,
+            BUFFER_OFFSET(asset->buffers.address(GLTF_BufferArena::Index, indexAccessor.bufferView, indexAccessor.byteOffset)));
+        glState.issued();
+        stats.drawCalls++;
+        stats.instances++;
     }
 }
 
 // recursively draw node and children nodes of model
-void GLTF_Model :: drawModelNodes(const std::pair<std::map<int, GLuint>, std::map<int, GLuint>> VaosAndEbos,
-    tinygltf::Model& model, tinygltf::Node& node, Shader& shader) {
+void GLTF_Model :: drawModelNodes(const std::pair<std::vector<std::vector<GLuint>>, std::map<int, GLuint>>& VaosAndEbos,
+    tinygltf::Model& model, tinygltf::Node& node, GLuint program) {
     if ((node.mesh >= 0) && (node.mesh < model.meshes.size())) {
         //set model matrix for every mesh
         float rotationSpeed = 0.5f;
         float angle = glfwGetTime() * rotationSpeed; // Use the elapsed time to calculate the angle
         glm::mat4 Model = getModelMatrix(node, angle);
-        shader.use();
-        shader.setMat4("model",Model);
+        ShaderBindings& bindings = bindShader(program);
+        GLTF_GL::uniformMatrix4fv(bindings.model, 1, GL_FALSE, &Model[0][0]);
+        glState.issued();
 
-        //bind vao for every model
-        glBindVertexArray(VaosAndEbos.first.at(node.mesh));
-        drawMesh(VaosAndEbos.second, model, model.meshes[node.mesh], shader);
+        drawMesh(VaosAndEbos.first.at(node.mesh), VaosAndEbos.second, model, model.meshes[node.mesh], program);
     }
     for (size_t i = 0; i < node.children.size(); i++) {
-        drawModelNodes(VaosAndEbos, model, model.nodes[node.children[i]], shader);
+        drawModelNodes(VaosAndEbos, model, model.nodes[node.children[i]], program);
+    }
+}
+// lights versions are unique across assets, so a program can remember whose lights it holds
+unsigned GLTF_Model::newLightsVersion() {
+    static std::atomic<unsigned> next{ 0 };
+    return ++next;
+}
+
+std::map<GLuint, unsigned>& GLTF_Model::programLights() {
+    static std::map<GLuint, unsigned> written;
+    return written;
+}
+
+// use the shader's program and return its uniform locations, looked up the first time it is seen
+GLTF_Model::ShaderBindings& GLTF_Model::bindShader(GLuint program) {
+    glState.useProgram(program);
+    auto known = shaderBindings.find(program);
+    if (known != shaderBindings.end()) return known->second;
+
+    ShaderBindings& bindings = shaderBindings[program];
+    bindings.program = program;
+    bindings.model = GLTF_GL::getUniformLocation(program, "model");
+    bindings.baseColorFactor = GLTF_GL::getUniformLocation(program, "baseColorFactor");
+    bindings.metallicFactor = GLTF_GL::getUniformLocation(program, "metallicFactor");
+    bindings.roughnessFactor = GLTF_GL::getUniformLocation(program, "roughnessFactor");
+    bindings.instanced = GLTF_GL::getUniformLocation(program, "instanced");
+    bindings.skinned = GLTF_GL::getUniformLocation(program, "skinned");
+    bindings.alphaCutoff = GLTF_GL::getUniformLocation(program, "alphaCutoff");
+    bindings.numPointLights = GLTF_GL::getUniformLocation(program, "numPointLights");
+    bindings.numDirLights = GLTF_GL::getUniformLocation(program, "numDirLights");
+    bindings.lightClusters = GLTF_GL::getUniformLocation(program, "gltfLightClusters");
+    bindings.clusterGrid = GLTF_GL::getUniformLocation(program, "gltfClusterGrid");
+    bindings.clusterDepth = GLTF_GL::getUniformLocation(program, "gltfClusterDepth");
+    bindings.lightBlock = GLTF_GL::getUniformBlockIndex(program, "GLTFLights");
+    if (bindings.lightBlock != GL_INVALID_INDEX) {
+        GLTF_GL::uniformBlockBinding(program, bindings.lightBlock, GLTF_LIGHTS_BINDING);
+    }
+    bindings.jointBlock = GLTF_GL::getUniformBlockIndex(program, "GLTFJoints");
+    if (bindings.jointBlock != GL_INVALID_INDEX) {
+        GLTF_GL::uniformBlockBinding(program, bindings.jointBlock, GLTF_JOINTS_BINDING);
+    }
+    //samplers never change unit, set them once
+    for (auto& unit : textureUnitIndices) {
+        GLTF_GL::uniform1i(GLTF_GL::getUniformLocation(program, unit.first.c_str()), unit.second);
+    }
+    if (bindings.lightClusters >= 0) {
+        GLTF_GL::uniform1i(GLTF_GL::getUniformLocation(program, "gltfLightData"), GLTF_LIGHT_DATA_UNIT);
+        GLTF_GL::uniform1i(bindings.lightClusters, GLTF_LIGHT_CLUSTERS_UNIT);
+        GLTF_GL::uniform1i(GLTF_GL::getUniformLocation(program, "gltfLightIndices"), GLTF_LIGHT_INDICES_UNIT);
     }
+    return bindings;
 }
-void GLTF_Model :: drawModel(const std::pair<std::map<int, GLuint>, std::map<int, GLuint>> VaosAndEbos,
-    tinygltf::Model& model, Shader& shader) {
+
+// write the lights into the GLTFLights buffer when they changed since the last write
+void GLTF_Model::Asset::updateLightBuffer() {
+    if (lightBuffer && lightBufferVersion == lightsVersion) return;
+    lightBufferVersion = lightsVersion;
+    //std140: an ivec4 then four vec4 arrays
+    std::vector<glm::vec4> block(1 + 4 * GLTF_MAX_LIGHTS, glm::vec4(0.0f));
+    int numPoint = (int)std::min(pointLights.size(), (size_t)GLTF_MAX_LIGHTS);
+    int numDir = (int)std::min(directionalLights.size(), (size_t)GLTF_MAX_LIGHTS);
+    int counts[4] = { numPoint, numDir, 0, 0 };
+    memcpy(&block[0], counts, sizeof(counts));
+    glm::vec4* pointPosition = &block[1];
+    glm::vec4* pointColor = pointPosition + GLTF_MAX_LIGHTS;
+    glm::vec4* dirDirection = pointColor + GLTF_MAX_LIGHTS;
+    glm::vec4* dirColor = dirDirection + GLTF_MAX_LIGHTS;
+    for (int i = 0; i < numPoint; i++) {
+        pointPosition[i] = glm::vec4(pointLights[i].position, pointLights[i].intensity);
+        pointColor[i] = glm::vec4(pointLights[i].color, 0.0f);
+    }
+    for (int i = 0; i < numDir; i++) {
+        dirDirection[i] = glm::vec4(directionalLights[i].direction, directionalLights[i].intensity);
+        dirColor[i] = glm::vec4(directionalLights[i].color, 0.0f);
+    }
+    if (!lightBuffer) GLTF_GL::genBuffers(1, &lightBuffer);
+    GLTF_GL::bindBuffer(GL_UNIFORM_BUFFER, lightBuffer);
+    GLTF_GL::bufferData(GL_UNIFORM_BUFFER, block.size() * sizeof(glm::vec4), block.data(), GL_DYNAMIC_DRAW);
+    GLTF_GL::bindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// hand the lights to the current shader: one buffer binding when it declares the GLTFLights
+// block, otherwise plain uniforms, written only when the program last saw other lights
+void GLTF_Model::bindLights(ShaderBindings& bindings) {
+    if (bindings.lightBlock != GL_INVALID_INDEX) {
+        asset->updateLightBuffer();
+        glState.bindUniformBuffer(GLTF_LIGHTS_BINDING, asset->lightBuffer);
+        return;
+    }
+    const std::vector<PointLight>& pointLights = asset->pointLights;
+    const std::vector<DirectionalLight>& directionalLights = asset->directionalLights;
+    size_t calls = 2 + 3 * (pointLights.size() + directionalLights.size());
+    //uniforms belong to the program, which other models may have written since
+    unsigned& written = programLights()[bindings.program];
+    if (written == asset->lightsVersion) {
+        glState.skipped(calls);
+        return;
+    }
+    written = asset->lightsVersion;
+    glState.issued(calls);
+
     //set lights' number and attribut
-    shader.use();
-    shader.setInt("numPointLights", pointLights.size());
-    shader.setInt("numDirLights", directionalLights.size());
+    GLTF_GL::uniform1i(bindings.numPointLights, (int)pointLights.size());
+    GLTF_GL::uniform1i(bindings.numDirLights, (int)directionalLights.size());
     std::string number;
-    for (int i = 0; i < pointLights.size(); i++) {
+    //per light locations are looked up as the shader first meets that many lights
+    for (size_t i = bindings.pointLight.size() / 3; i < pointLights.size(); i++) {
         number = std::to_string(i);
-        shader.setVec3(("pointLight["+ number + "].position").c_str(), pointLights[i].position);
-        shader.setVec3(("pointLight[" + number + "].color").c_str(), pointLights[i].color);
-        shader.setFloat(("pointLight[" + number + "].intensity").c_str(), pointLights[i].intensity);
+        bindings.pointLight.push_back(GLTF_GL::getUniformLocation(bindings.program, ("pointLight[" + number + "].position").c_str()));
+        bindings.pointLight.push_back(GLTF_GL::getUniformLocation(bindings.program, ("pointLight[" + number + "].color").c_str()));
+        bindings.pointLight.push_back(GLTF_GL::getUniformLocation(bindings.program, ("pointLight[" + number + "].intensity").c_str()));
     }
-    for (int i = 0; i < directionalLights.size(); i++) {
+    for (size_t i = bindings.directionalLight.size() / 3; i < directionalLights.size(); i++) {
         number = std::to_string(i);
-        //shader.setVec3(("directionalLight[" + number + "].direction").c_str(), glm::vec3(0.0f,-0.5f,0.5f));
-        shader.setVec3(("directionalLight[" + number + "].direction").c_str(), directionalLights[i].direction);
-        shader.setVec3(("directionalLight[" + number + "].color").c_str(), directionalLights[i].color);
-        shader.setFloat(("directionalLight[" + number + "].intensity").c_str(), directionalLights[i].intensity);
+        bindings.directionalLight.push_back(GLTF_GL::getUniformLocation(bindings.program, ("directionalLight[" + number + "].direction").c_str()));
+        bindings.directionalLight.push_back(GLTF_GL::getUniformLocation(bindings.program, ("directionalLight[" + number + "].color").c_str()));
+        bindings.directionalLight.push_back(GLTF_GL::getUniformLocation(bindings.program, ("directionalLight[" + number + "].intensity").c_str()));
+    }
+    for (size_t i = 0; i < pointLights.size(); i++) {
+        GLTF_GL::uniform3fv(bindings.pointLight[3 * i], 1, &pointLights[i].position[0]);
+        GLTF_GL::uniform3fv(bindings.pointLight[3 * i + 1], 1, &pointLights[i].color[0]);
+        GLTF_GL::uniform1f(bindings.pointLight[3 * i + 2], pointLights[i].intensity);
     }
+    for (size_t i = 0; i < directionalLights.size(); i++) {
+        GLTF_GL::uniform3fv(bindings.directionalLight[3 * i], 1, &directionalLights[i].direction[0]);
+        GLTF_GL::uniform3fv(bindings.directionalLight[3 * i + 1], 1, &directionalLights[i].color[0]);
+        GLTF_GL::uniform1f(bindings.directionalLight[3 * i + 2], directionalLights[i].intensity);
+    }
+}
+
+// place the lights that moved and assign them to the clusters of this frame's view
+void GLTF_Model::assignLights(const glm::mat4& frameMatrix) {
+    GLTF_TRACE_SCOPE("lights", "frame");
+    sceneLights.update(transforms);
+    lightClusters.assign(sceneLights.lights(), frameMatrix, frameThreads);
+}
+
+// upload the clusters of this frame to their buffer textures and point the shader at them.
+// the buffers are respecified whole every frame, the driver orphans the old storage
+void GLTF_Model::bindLightClusters(ShaderBindings& bindings) {
+    static const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+    const void* contents[3] = { lightClusters.lightData().data(), lightClusters.clusters().data(), lightClusters.indices().data() };
+    size_t bytes[3] = { gltfVectorBytes(lightClusters.lightData()), gltfVectorBytes(lightClusters.clusters()),
+        gltfVectorBytes(lightClusters.indices()) };
+    bool created = clusterBuffers[0] == 0;
+    if (created) {
+        GLTF_GL::genBuffers(3, clusterBuffers);
+        GLTF_GL::genTextures(3, clusterTextures);
+    }
+    for (int i = 0; i < 3; ++i) {
+        GLTF_GL::bindBuffer(GL_TEXTURE_BUFFER, clusterBuffers[i]);
+        GLTF_GL::bufferData(GL_TEXTURE_BUFFER, bytes[i], bytes[i] ? contents[i] : nullptr, GL_STREAM_DRAW);
+        glState.bindTexture(GLTF_LIGHT_DATA_UNIT + i, clusterTextures[i], GL_TEXTURE_BUFFER);
+        if (created) GLTF_GL::texBuffer(GL_TEXTURE_BUFFER, formats[i], clusterBuffers[i]);
+    }
+    GLTF_GL::bindBuffer(GL_TEXTURE_BUFFER, 0);
+    GLint viewport[4];
+    GLTF_GL::getIntegerv(GL_VIEWPORT, viewport);
+    glState.issued(created ? 13 : 8);
+    glState.uniform4f(bindings.clusterGrid, glm::vec4(lightClusters.grid(0), lightClusters.grid(1), lightClusters.grid(2),
+        (float)lightClusters.directionalCount()));
+    glState.uniform4f(bindings.clusterDepth, glm::vec4(lightClusters.depthScale(), lightClusters.depthBias(),
+        viewport[2] > 0 ? 1.0f / viewport[2] : 0.0f, viewport[3] > 0 ? 1.0f / viewport[3] : 0.0f));
+}
+
+void GLTF_Model :: drawModel(const std::pair<std::vector<std::vector<GLuint>>, std::map<int, GLuint>>& VaosAndEbos,
+    tinygltf::Model& model, GLuint program) {
+    stats = DrawStats();
+    bindLights(bindShader(program));
     
     const tinygltf::Scene& scene = model.scenes[model.defaultScene];
     for (size_t i = 0; i < scene.nodes.size(); ++i) {
-        drawModelNodes(VaosAndEbos, model, model.nodes[scene.nodes[i]], shader);
+        drawModelNodes(VaosAndEbos, model, model.nodes[scene.nodes[i]], program);
     }
-    glBindVertexArray(0);
+    glState.bindVertexArray(0);
+}
+
+// draw the render list built by compileScene in one pass
+// the CPU work before submission may run on the pool, see frameThreads
+void GLTF_Model::drawCompiled(GLuint program) {
+    auto start = std::chrono::steady_clock::now();
+    ShaderBindings& bindings = bindShader(program);
+    bool clustered = bindings.lightClusters >= 0;
+    {
+        GLTF_TRACE_SCOPE("transforms", "frame");
+        transforms.update(frameThreads);
+        updateInstanceBuffer();
+        updateSkins();
+        uploadJoints();
+    }
+    glm::mat4 frameMatrix = frustumCulling || sortDraws || asset->streaming || clustered ? frameViewProjection() : glm::mat4(1.0f);
+    if (frustumCulling) cullScene(frameMatrix);
+    if (asset->streaming) requestStreaming(frameMatrix);
+    buildDrawOrder(frameMatrix);
+    if (clustered) assignLights(frameMatrix);
+    stats = DrawStats();
+    stats.prepareMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    GLTF_TRACE_SCOPE("submit", "frame");
+    glState.capture();
+    bindLights(bindings);
+    if (clustered) bindLightClusters(bindings);
+    glState.uniform1i(bindings.instanced, 0);
+    glState.uniform1i(bindings.skinned, 0);
+    if (instanceVbo) glState.bindArrayBuffer(instanceVbo);
+
+    int boundMatrix = -1;
+    for (size_t n = 0; n < drawOrder.size(); ++n) {
+        size_t i = drawOrder.draw(n);
+        bool blended = drawList.pass[i] == GLTF_DrawSort::Blend;
+        glState.setEnabled(GL_BLEND, blended);
+        if (blended) glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glState.depthMask(!blended);
+        glState.setEnabled(GL_CULL_FACE, !drawList.doubleSided[i]);
+        glState.uniform1f(bindings.alphaCutoff, drawList.pass[i] == GLTF_DrawSort::Mask ? drawList.alphaCutoff[i] : -1.0f);
+        bool instanced = drawList.matrixIndex[i] < 0;
+        glState.uniform1i(bindings.instanced, instanced ? 1 : 0);
+        int skinInstance = drawList.skinInstance[i];
+        glState.uniform1i(bindings.skinned, skinInstance >= 0 ? 1 : 0);
+        if (skinInstance >= 0) {
+            glState.bindUniformRange(GLTF_JOINTS_BINDING, jointBuffer, skinInstance * jointStride,
+                GLTF_MAX_JOINTS * sizeof(glm::mat4));
+        }
+        if (!instanced && drawList.matrixIndex[i] != boundMatrix) {
+            boundMatrix = drawList.matrixIndex[i];
+            GLTF_GL::uniformMatrix4fv(bindings.model, 1, GL_FALSE, &transforms.world(boundMatrix)[0][0]);
+            glState.issued();
+        }
+        glState.bindVertexArray(drawList.vao[i]);
+        if (instanced) {
+            //point the instance attributes at this draw's range, GL 3.3 has no base instance
+            size_t offset = drawList.firstInstance[i] * sizeof(glm::mat4);
+            for (int column = 0; column < 4; ++column) {
+                GLTF_GL::vertexAttribPointer(GLTF_INSTANCE_MATRIX_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                    BUFFER_OFFSET(offset + column * sizeof(glm::vec4)));
+            }
+            glState.issued(4);
+        }
+        glState.bindElementBuffer(drawList.ebo[i]);
+
+        const GLuint* textures = &drawList.textures[i * textureUnitCount];
+        for (int unit = 0; unit < textureUnitCount; ++unit) {
+            if (textures[unit] == 0) continue;
+            glState.bindTexture(unit, textures[unit]);
+        }
+        glState.uniform4f(bindings.baseColorFactor, drawList.baseColorFactor[i]);
+        glState.uniform1f(bindings.metallicFactor, drawList.metallicFactor[i]);
+        glState.uniform1f(bindings.roughnessFactor, drawList.roughnessFactor[i]);
+
+        if (instanced) {
+            GLTF_GL::drawElementsInstanced(drawList.mode[i], drawList.indexCount[i], drawList.indexType[i],
+                BUFFER_OFFSET(drawList.indexOffset[i]), drawList.instanceCount[i]);
+        }
+        else {
+            GLTF_GL::drawElements(drawList.mode[i], drawList.indexCount[i], drawList.indexType[i],
+                BUFFER_OFFSET(drawList.indexOffset[i]));
+        }
+        glState.issued();
+        stats.drawCalls++;
+        stats.instances += drawList.instanceCount[i];
+    }
+    //the application's blend, culling and depth writes for whatever it draws next
+    glState.restore();
+    glState.bindVertexArray(0);
+}
+
+void GLTF_Model::setViewProjection(const glm::mat4& matrix) {
+    viewProjection = matrix;
+    hasViewProjection = true;
+}
+
+// world box of a draw, around all of its instances
+GLTF_Aabb GLTF_Model::worldBounds(size_t draw) const {
+    const GLTF_Aabb& bounds = drawList.bounds[draw];
+    if (drawList.matrixIndex[draw] >= 0) return bounds.transformed(transforms.world(drawList.matrixIndex[draw]));
+    GLTF_Aabb result;
+    for (size_t i = drawList.firstInstance[draw]; i < drawList.firstInstance[draw] + drawList.instanceCount[draw]; ++i) {
+        const glm::mat4& world = transforms.world(instanceSlots[i]);
+        result.expand(bounds.transformed(instanceLocals[i] < 0 ? world : world * instanceLocalMatrices[instanceLocals[i]]));
+    }
+    return result;
+}
+
+// the matrix given to setViewProjection, or else the camera's with its zoom as field of view
+glm::mat4 GLTF_Model::frameViewProjection() const {
+    if (hasViewProjection) return viewProjection;
+    GLint viewport[4];
+    GLTF_GL::getIntegerv(GL_VIEWPORT, viewport);
+    float aspect = viewport[3] > 0 ? (float)viewport[2] / (float)viewport[3] : 1.0f;
+    return glm::perspective(glm::radians(mycamera->Zoom), aspect, 0.1f, 100.0f) * mycamera->GetViewMatrix();
+}
+
+// the visible, resident draws in the order they are submitted: by sort key, else scene order.
+// depth is the clip space z of the draw's box center, which grows with view distance
+// packets are made per chunk of the draw list, on the pool, and merged in chunk order
+void GLTF_Model::buildDrawOrder(const glm::mat4& frameMatrix) {
+    GLTF_TRACE_SCOPE("sort", "frame");
+    drawOrder.clear();
+    //culling fitted the boxes this frame already
+    bool fitted = frustumCulling && bvhBuilt && boundsVersion == transforms.version();
+    packetChunks.resize((drawList.size() + frameChunk - 1) / frameChunk);
+    forChunks(drawList.size(), frameChunk, [&](size_t chunk, size_t begin, size_t end) {
+        std::vector<GLTF_DrawSort::Item>& packets = packetChunks[chunk];
+        packets.clear();
+        for (size_t i = begin; i < end; ++i) {
+            if (!drawList.resident[i] || (frustumCulling && !visibleDraws[i])) continue;
+            if (!sortDraws) {
+                packets.push_back({ 0, (uint32_t)i });
+                continue;
+            }
+            glm::vec3 center = fitted ? bvh.box((int)i).center() : worldBounds(i).center();
+            float depth = (frameMatrix * glm::vec4(center, 1.0f)).z;
+            packets.push_back({ GLTF_DrawSort::key((GLTF_DrawSort::Pass)drawList.pass[i], drawList.doubleSided[i] != 0,
+                drawList.stateId[i], drawList.vaoId[i], depth), (uint32_t)i });
+        }
+    });
+    for (const std::vector<GLTF_DrawSort::Item>& packets : packetChunks) {
+        drawOrder.append(packets.data(), packets.size());
+    }
+    if (sortDraws) drawOrder.sort();
+}
+
+// body(chunk, begin, end) over [0, count), on the pool unless frameThreads is 1 or it is one chunk
+void GLTF_Model::forChunks(size_t count, size_t chunkSize, const std::function<void(size_t, size_t, size_t)>& body) const {
+    if (frameThreads == 1 || count <= chunkSize) {
+        for (size_t chunk = 0; chunk * chunkSize < count; ++chunk) {
+            body(chunk, chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+        }
+        return;
+    }
+    GLTF_ThreadPool::shared().parallelChunks(count, chunkSize, body, frameThreads);
+}
+
+// streaming: request the meshes and textures of the draws in view, by how large they are
+// on screen, the extent of their box over its distance
+void GLTF_Model::requestStreaming(const glm::mat4& frameMatrix) {
+    GLTF_TRACE_SCOPE("stream requests", "frame");
+    bool fitted = frustumCulling && bvhBuilt && boundsVersion == transforms.version();
+    int meshCount = (int)asset->meshBuffers.size();
+    for (size_t i = 0; i < drawList.size(); ++i) {
+        if (frustumCulling && !visibleDraws[i]) continue;
+        GLTF_Aabb box = fitted ? bvh.box((int)i) : worldBounds(i);
+        float distance = std::max((frameMatrix * glm::vec4(box.center(), 1.0f)).w, 0.1f);
+        float priority = glm::length(box.extent()) / distance;
+        //unbounded draws (skinned) come first
+        if (!(priority < 1e30f)) priority = 1e30f;
+        asset->streamer.request(drawList.mesh[i], priority);
+        for (int unit = 0; unit < textureUnitCount; ++unit) {
+            int texture = drawList.textureIndex[i * textureUnitCount + unit];
+            if (texture >= 0) asset->streamer.request(meshCount + texture, priority);
+        }
+    }
+}
+
+// refit the boxes of the draws below moved nodes, then find the draws in the frustum
+void GLTF_Model::cullScene(const glm::mat4& frustumMatrix) {
+    GLTF_TRACE_SCOPE("cull", "frame");
+    auto start = std::chrono::steady_clock::now();
+    if (!bvhBuilt) {
+        std::vector<GLTF_Aabb> boxes(drawList.size());
+        forChunks(drawList.size(), frameChunk, [&](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) boxes[i] = worldBounds(i);
+        });
+        slotDraws.clear();
+        for (size_t i = 0; i < drawList.size(); ++i) {
+            if (drawList.matrixIndex[i] >= 0) slotDraws.push_back({ drawList.matrixIndex[i], (int)i });
+            for (size_t j = drawList.firstInstance[i]; drawList.matrixIndex[i] < 0 && j < drawList.firstInstance[i] + drawList.instanceCount[i]; ++j) {
+                slotDraws.push_back({ instanceSlots[j], (int)i });
+            }
+        }
+        std::sort(slotDraws.begin(), slotDraws.end());
+        bvh.build(boxes);
+        bvhBuilt = true;
+        boundsVersion = transforms.version();
+    }
+    else if (boundsVersion != transforms.version()) {
+        //one update since the last frame tells what moved, otherwise everything is refitted
+        std::vector<int> moved;
+        if (transforms.version() == boundsVersion + 1) {
+            for (const std::pair<int, int>& range : transforms.lastUpdated()) {
+                auto entry = std::lower_bound(slotDraws.begin(), slotDraws.end(), std::make_pair(range.first, -1));
+                for (; entry != slotDraws.end() && entry->first < range.second; ++entry) {
+                    moved.push_back(entry->second);
+                }
+            }
+            std::sort(moved.begin(), moved.end());
+            moved.erase(std::unique(moved.begin(), moved.end()), moved.end());
+        }
+        else {
+            for (size_t i = 0; i < drawList.size(); ++i) {
+                moved.push_back((int)i);
+            }
+        }
+        //the boxes in parallel, the tree serially
+        std::vector<GLTF_Aabb> boxes(moved.size());
+        forChunks(moved.size(), frameChunk, [&](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) boxes[i] = worldBounds(moved[i]);
+        });
+        for (size_t i = 0; i < moved.size(); ++i) {
+            bvh.update(moved[i], boxes[i]);
+        }
+        bvh.refit();
+        boundsVersion = transforms.version();
+    }
+
+    //disjoint subtrees, a few per thread, each culled as one task into its own items' flags.
+    //the camera's far plane is a guess, only the given matrix culls by distance
+    GLTF_Frustum frustum(frustumMatrix, hasViewProjection);
+    size_t threads = frameThreads > 0 ? frameThreads : GLTF_ThreadPool::shared().size() + 1;
+    visibleDraws.assign(drawList.size(), 0);
+    bvh.split(threads > 1 && drawList.size() > frameChunk ? threads * 4 : 1, cullRoots);
+    std::vector<size_t> nodesTested(cullRoots.size(), 0);
+    std::vector<size_t> visible(cullRoots.size(), 0);
+    forChunks(cullRoots.size(), 1, [&](size_t root, size_t, size_t) {
+        visible[root] = bvh.cullSubtree(frustum, cullRoots[root], visibleDraws, nodesTested[root]);
+    });
+
+    cullStats.draws = drawList.size();
+    cullStats.nodesTested = 0;
+    cullStats.drawsCulled = drawList.size();
+    for (size_t root = 0; root < cullRoots.size(); ++root) {
+        cullStats.nodesTested += nodesTested[root];
+        cullStats.drawsCulled -= visible[root];
+    }
+    cullStats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// rebuild the instance matrices when any transform moved since the last upload
+void GLTF_Model::updateInstanceBuffer() {
+    if (!instanceVbo || instanceVersion == transforms.version()) return;
+    instanceVersion = transforms.version();
+    forChunks(instanceSlots.size(), frameChunk, [this](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const glm::mat4& world = transforms.world(instanceSlots[i]);
+            instanceMatrices[i] = instanceLocals[i] < 0 ? world : world * instanceLocalMatrices[instanceLocals[i]];
+        }
+    });
+    GLTF_GL::bindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+    GLTF_GL::bufferData(GL_ARRAY_BUFFER, instanceMatrices.size() * sizeof(glm::mat4), instanceMatrices.data(), GL_DYNAMIC_DRAW);
+}
+
+void GLTF_Model::playAnimation(int clip, bool loop, float speed) {
+    animator.play(clip, loop, speed);
+}
+
+// CPU only, so models can be updated on any thread as long as each is on one
+void GLTF_Model::updateAnimation(float seconds) {
+    if (!compiled) return;
+    GLTF_TRACE_SCOPE("animate", "frame");
+    int clip = animator.clip();
+    if (clip >= 0 && clip < (int)asset->animations.size() && animator.advance(asset->animations[clip], seconds, transforms))
+        transforms.update();
+    updateSkins();
+}
+
+void GLTF_Model::updateAnimations(const std::vector<GLTF_Model*>& models, float seconds) {
+    //a few models per task, small rigs take less time than handing them out
+    const size_t batch = 8;
+    GLTF_ThreadPool::shared().parallelFor((models.size() + batch - 1) / batch, [&](size_t task) {
+        size_t end = std::min(models.size(), (task + 1) * batch);
+        for (size_t i = task * batch; i < end; ++i) {
+            models[i]->updateAnimation(seconds);
+        }
+    });
+}
+
+GLTF_Model::AnimationBenchmark GLTF_Model::benchmarkAnimations(const std::vector<GLTF_Model*>& models, int frames, float step) {
+    AnimationBenchmark result;
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        updateAnimations(models, step);
+    }
+    result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    result.instances = models.size() * (size_t)std::max(frames, 0);
+    result.instancesPerMillisecond = result.milliseconds > 0.0 ? result.instances / result.milliseconds : 0.0;
+    GLTF_LOG_INFO("animated " << result.instances << " instances in " << result.milliseconds << " ms, "
+        << result.instancesPerMillisecond << " per ms");
+    return result;
+}
+
+// joint palettes of every skinned node, when any transform moved since they were computed
+void GLTF_Model::updateSkins() {
+    if (skinInstances.empty() || jointsVersion == transforms.version()) return;
+    jointsVersion = transforms.version();
+    size_t palette = jointStride / sizeof(glm::mat4);
+    //a palette is up to GLTF_MAX_JOINTS matrix products, a few skins make a task
+    forChunks(skinInstances.size(), 8, [this, palette](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            GLTF_Animator::jointMatrices(asset->skins[skinInstances[i].skin], transforms, skinInstances[i].slot,
+                &jointMatrices[i * palette], GLTF_MAX_JOINTS);
+        }
+    });
+}
+
+void GLTF_Model::uploadJoints() {
+    if (!jointBuffer || jointsUploaded == jointsVersion) return;
+    jointsUploaded = jointsVersion;
+    size_t palette = jointStride / sizeof(glm::mat4);
+    GLTF_GL::bindBuffer(GL_UNIFORM_BUFFER, jointBuffer);
+    //orphan last frame's palettes, then write only the joints each skin has
+    GLTF_GL::bufferData(GL_UNIFORM_BUFFER, jointStride * skinInstances.size(), nullptr, GL_DYNAMIC_DRAW);
+    for (size_t i = 0; i < skinInstances.size(); ++i) {
+        size_t joints = std::min<size_t>(asset->skins[skinInstances[i].skin].joints.size(), GLTF_MAX_JOINTS);
+        GLTF_GL::bufferSubData(GL_UNIFORM_BUFFER, i * jointStride, joints * sizeof(glm::mat4), &jointMatrices[i * palette]);
+    }
+    GLTF_GL::bindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
 void GLTF_Model :: dbgModel(tinygltf::Model& model) {
     for (auto& mesh : model.meshes) {
-        std::cout << "mesh : " << mesh.name << std::endl;
+        GLTF_LOG_DEBUG("mesh : " << mesh.name);
         for (auto& primitive : mesh.primitives) {
             const tinygltf::Accessor& indexAccessor =
                 model.accessors[primitive.indices];
 
-            std::cout << "indexaccessor: count " << indexAccessor.count << ", type "
-                << indexAccessor.componentType << std::endl;
+            GLTF_LOG_DEBUG("indexaccessor: count " << indexAccessor.count << ", type "
+                << indexAccessor.componentType);
 
             tinygltf::Material& mat = model.materials[primitive.material];
             for (auto& mats : mat.values) {
-                std::cout << "mat : " << mats.first.c_str() << std::endl;
+                GLTF_LOG_DEBUG("mat : " << mats.first.c_str());
             }
 
             for (auto& image : model.images) {
-                std::cout << "image name : " << image.uri << std::endl;
-                std::cout << "  size : " << image.image.size() << std::endl;
-                std::cout << "  w/h : " << image.width << "/" << image.height
-                    << std::endl;
+                GLTF_LOG_DEBUG("image name : " << image.uri);
+                GLTF_LOG_DEBUG("  size : " << image.image.size());
+                GLTF_LOG_DEBUG("  w/h : " << image.width << "/" << image.height);
             }
 
-            std::cout << "indices : " << primitive.indices << std::endl;
-            std::cout << "mode     : "
-                << "(" << primitive.mode << ")" << std::endl;
+            GLTF_LOG_DEBUG("indices : " << primitive.indices);
+            GLTF_LOG_DEBUG("mode     : "
+                << "(" << primitive.mode << ")");
 
             for (auto& attrib : primitive.attributes) {
-                std::cout << "attribute : " << attrib.first.c_str() << std::endl;
+                GLTF_LOG_DEBUG("attribute : " << attrib.first.c_str());
             }
         }
     }
 }
 
 void GLTF_Model :: draw(Shader& shader) {
-    drawModel(VaosAndEbos, model, shader);
+    draw(shader.ID);
 }
 
-void GLTF_Model::bindVbo(std::map<int, GLuint>& vbos, tinygltf::Model& model, size_t indice) {
-    //bind indice vbo
-    tinygltf::BufferView& bufferView = model.bufferViews[indice];
-    if (bufferView.target != GL_ARRAY_BUFFER && bufferView.target != GL_ELEMENT_ARRAY_BUFFER) {
-        std::cout << "WARN: bufferView.target is neither GL_ARRAY_BUFFER nor GL_ELEMENT_ARRAY_BUFFER" << std::endl;
-        exit(1);  // Skip unsupported bufferView.
-    }
-    std::cout << "vbo's key: " << indice << std::endl;
-    std::cout << " bufferView.byteLength: " << bufferView.byteLength
-        << ", bufferview.byteOffset = " << bufferView.byteOffset
-        << std::endl;
+void GLTF_Model :: draw(GLuint program) {
+    GLTF_TRACE_SCOPE("draw", "frame");
+    if (gpuTiming) gpuTimer.begin();
+    processUploads();
+    //the application may have touched any GL state since the last draw
+    glState.invalidate();
+    if (useCompiledScene)
+        drawCompiled(program);
+    else if (loadState() == Loaded && !asset->streaming)
+        drawModel(asset->VaosAndEbos, asset->model, program);
+    stats.glCalls = glState.counters().issued;
+    stats.glCallsSkipped = glState.counters().skipped;
+    if (gpuTiming) gpuTimer.end();
+    stats.gpuMilliseconds = gpuTimer.milliseconds();
+}
 
-    const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
-    vbos[indice] = vbo;
-    glBindBuffer(bufferView.target, vbo);
+void GLTF_Model::setNodeTransform(int node, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale) {
+    transforms.setLocalTransform(node, translation, rotation, scale);
+}
 
-    glBufferData(bufferView.target, bufferView.byteLength,
-        &buffer.data.at(0) + bufferView.byteOffset, GL_STATIC_DRAW);
+void GLTF_Model::setNodeMatrix(int node, const glm::mat4& matrix) {
+    transforms.setLocalMatrix(node, matrix);
 }
 
 glm::mat4 GLTF_Model::getModelMatrix(tinygltf::Node& node, float globalAngle)
@@ -553,4 +2531,4 @@ glm::mat4 GLTF_Model::getModelMatrix(tinygltf::Node& node, float globalAngle)
     //modelMatrix = globalRotation * modelMatrix;
 
     return modelMatrix;
-}
\ No newline at end of file
+}
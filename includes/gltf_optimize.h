@@ -0,0 +1,900 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <tiny_gltf.h>
+#include "gltf_accessor.h"
+#include "gltf_file.h"
+#include "gltf_trace.h"
+
+
+// load-time geometry rewrite: triangles reordered for the post-transform vertex cache
+// and for overdraw, vertices renumbered in fetch order, indices narrowed and attributes
+// quantized as KHR_mesh_quantization allows. the result goes to one new buffer, the
+// rewritten primitives point at new accessors and the old data is simply not uploaded
+class GLTF_MeshOptimizer
+{
+public:
+    struct Settings {
+        bool enabled = false;
+        bool reorder = true;            //vertex cache and overdraw order, vertices in fetch order
+        bool narrowIndices = true;      //16 bit indices where the vertex count allows
+        bool quantize = true;           //int16 positions, snorm8 normals and tangents, unorm16 texcoords
+        uint32_t mask() const { return enabled ? 1u | (reorder ? 2u : 0u) | (narrowIndices ? 4u : 0u) | (quantize ? 8u : 0u) : 0u; }
+    };
+    struct MeshReport {
+        std::string name;
+        size_t bytesBefore = 0;         //index and vertex data drawn by the mesh
+        size_t bytesAfter = 0;
+        double acmrBefore = 0.0;        //average cache miss ratio: vertices transformed per triangle
+        double acmrAfter = 0.0;
+    };
+    static const uint32_t cacheSize = 16;   //FIFO entries assumed by the cache order and the ACMR
+    static constexpr float overdrawThreshold = 1.05f;  //clusters may cost this much ACMR over the whole mesh
+
+    //EXT_meshopt_compression views are decoded into a plain buffer, false on corrupt data
+    static bool decompress(tinygltf::Model& model, GLTF_BufferData& data);
+    static void optimize(tinygltf::Model& model, GLTF_BufferData& data, const Settings& settings, std::vector<MeshReport>& reports);
+
+    //building blocks on triangle lists
+    static size_t cacheMisses(const std::vector<uint32_t>& indices, size_t vertexCount);
+    //tipsify, clusters receives the first triangle of every run that restarted with a cold cache
+    static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<size_t>& clusters);
+    //cluster order, outward facing clusters first; positions are 3 floats per vertex
+    static void optimizeOverdraw(std::vector<uint32_t>& indices, size_t vertexCount, const std::vector<float>& positions,
+        const std::vector<size_t>& clusters);
+    //renumber vertices by first use, unused ones are dropped; newToOld[new vertex] = old vertex
+    static void optimizeVertexFetch(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>& newToOld);
+
+    //meshoptimizer bitstreams, as EXT_meshopt_compression stores them
+    static bool decodeVertexBuffer(unsigned char* destination, size_t count, size_t stride, const unsigned char* buffer, size_t size);
+    static bool decodeIndexBuffer(unsigned char* destination, size_t count, size_t indexSize, const unsigned char* buffer, size_t size);
+    static bool decodeIndexSequence(unsigned char* destination, size_t count, size_t indexSize, const unsigned char* buffer, size_t size);
+    static void decodeFilter(const std::string& filter, unsigned char* data, size_t count, size_t stride);
+
+private:
+    //new views, accessors and bytes of the optimized buffer
+    struct Output {
+        tinygltf::Model* model;
+        int buffer;
+        std::vector<unsigned char> bytes;
+        bool quantized = false;         //some attribute uses a KHR_mesh_quantization format
+        int view(const void* data, size_t length, size_t stride, int target);
+        int accessor(int view, int componentType, bool normalized, int type, size_t count);
+    };
+    //indices is what readPrimitive read, reordered in place
+    static void optimizePrimitive(tinygltf::Model& model, const GLTF_BufferData& data, tinygltf::Primitive& primitive,
+        std::vector<uint32_t>& indices, const Settings& settings, const glm::vec4* dequantize, Output& output, MeshReport& report,
+        size_t& missesBefore, size_t& missesAfter, size_t& triangles);
+    //the triangle list of an optimizable primitive whose attributes all lie in their buffers, false leaves it as it is
+    static bool readPrimitive(const tinygltf::Model& model, const GLTF_BufferData& data, const tinygltf::Primitive& primitive,
+        std::vector<uint32_t>& indices);
+    static bool readIndices(const tinygltf::Model& model, const GLTF_BufferData& data, int accessorIndex, std::vector<uint32_t>& indices);
+    static bool optimizable(const tinygltf::Model& model, const tinygltf::Primitive& primitive);
+    static size_t accessorBytes(const tinygltf::Model& model, int accessorIndex);
+    static const unsigned char* decodeBytes(const unsigned char* data, const unsigned char* end, unsigned char* buffer, size_t size);
+    static unsigned int decodeVByte(const unsigned char*& data);
+    static void writeIndex(unsigned char* destination, size_t i, size_t indexSize, unsigned int value);
+};
+
+
+bool GLTF_MeshOptimizer::decompress(tinygltf::Model& model, GLTF_BufferData& data) {
+    std::vector<unsigned char> bytes;
+    bool found = false;
+    for (size_t i = 0; i < model.bufferViews.size(); ++i) {
+        tinygltf::BufferView& view = model.bufferViews[i];
+        auto extension = view.extensions.find("EXT_meshopt_compression");
+        if (extension == view.extensions.end()) continue;
+        const tinygltf::Value& value = extension->second;
+        int buffer = value.Get("buffer").GetNumberAsInt();
+        size_t byteOffset = value.Has("byteOffset") ? (size_t)value.Get("byteOffset").GetNumberAsDouble() : 0;
+        size_t byteLength = (size_t)value.Get("byteLength").GetNumberAsDouble();
+        size_t stride = (size_t)value.Get("byteStride").GetNumberAsInt();
+        size_t count = (size_t)value.Get("count").GetNumberAsDouble();
+        std::string mode = value.Get("mode").Get<std::string>();
+        std::string filter = value.Has("filter") ? value.Get("filter").Get<std::string>() : "NONE";
+        if (buffer < 0 || buffer >= (int)model.buffers.size() || byteOffset + byteLength > data.size(buffer) || stride == 0) {
+            GLTF_LOG_ERROR("Bad EXT_meshopt_compression bufferView: " << i);
+            return false;
+        }
+
+        size_t offset = (bytes.size() + 15) & ~(size_t)15;
+        bytes.resize(offset + count * stride);
+        const unsigned char* source = data.data(buffer) + byteOffset;
+        bool decoded = false;
+        if (mode == "ATTRIBUTES")
+            decoded = decodeVertexBuffer(bytes.data() + offset, count, stride, source, byteLength);
+        else if (mode == "TRIANGLES")
+            decoded = decodeIndexBuffer(bytes.data() + offset, count, stride, source, byteLength);
+        else if (mode == "INDICES")
+            decoded = decodeIndexSequence(bytes.data() + offset, count, stride, source, byteLength);
+        if (!decoded) {
+            GLTF_LOG_ERROR("Failed to decode EXT_meshopt_compression bufferView: " << i);
+            return false;
+        }
+        if (mode == "ATTRIBUTES") decodeFilter(filter, bytes.data() + offset, count, stride);
+
+        view.buffer = (int)model.buffers.size();
+        view.byteOffset = offset;
+        view.byteLength = count * stride;
+        view.extensions.erase(extension);
+        found = true;
+    }
+    if (!found) return true;
+
+    data.append(model, std::move(bytes));
+    for (std::vector<std::string>* names : { &model.extensionsUsed, &model.extensionsRequired }) {
+        names->erase(std::remove(names->begin(), names->end(), "EXT_meshopt_compression"), names->end());
+    }
+    return true;
+}
+
+void GLTF_MeshOptimizer::optimize(tinygltf::Model& model, GLTF_BufferData& data, const Settings& settings,
+    std::vector<MeshReport>& reports) {
+    reports.clear();
+    if (!settings.enabled) return;
+    Output output;
+    output.model = &model;
+    output.buffer = (int)model.buffers.size();
+
+    //the dequantization transform goes on a node, which skins and instancing would apply in the wrong place
+    std::vector<uint8_t> quantizable(model.meshes.size(), settings.quantize ? 1 : 0);
+    for (const tinygltf::Node& node : model.nodes) {
+        if (node.mesh < 0 || node.mesh >= (int)model.meshes.size()) continue;
+        if (node.skin >= 0 || node.extensions.count("EXT_mesh_gpu_instancing")) quantizable[node.mesh] = 0;
+    }
+
+    //dequantization (offset, step) of the meshes whose positions were quantized
+    std::vector<glm::vec4> dequantizers(model.meshes.size(), glm::vec4(0.0f));
+    for (size_t m = 0; m < model.meshes.size(); ++m) {
+        tinygltf::Mesh& mesh = model.meshes[m];
+        MeshReport report;
+        report.name = mesh.name.empty() ? "mesh " + std::to_string(m) : mesh.name;
+
+        //one transform for the whole mesh, so positions share the bounds of all primitives. a primitive
+        //left as it is keeps float positions the transform would shrink, so then none are quantized
+        std::vector<std::vector<uint32_t>> indices(mesh.primitives.size());
+        std::vector<uint8_t> readable(mesh.primitives.size(), 0);
+        bool quantizePositions = quantizable[m] != 0;
+        glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+        std::vector<float> positions;
+        for (size_t p = 0; p < mesh.primitives.size(); ++p) {
+            const tinygltf::Primitive& primitive = mesh.primitives[p];
+            readable[p] = readPrimitive(model, data, primitive, indices[p]) ? 1 : 0;
+            if (!quantizePositions) continue;
+            auto position = primitive.attributes.find("POSITION");
+            if (!readable[p] || position == primitive.attributes.end() ||
+                gltfComponentCount(model.accessors[position->second].type) != 3 ||
+                !gltfReadFloats(model, data, position->second, positions)) {
+                quantizePositions = false;
+                continue;
+            }
+            for (size_t i = 0; i + 2 < positions.size(); i += 3) {
+                low = glm::min(low, glm::vec3(positions[i], positions[i + 1], positions[i + 2]));
+                high = glm::max(high, glm::vec3(positions[i], positions[i + 1], positions[i + 2]));
+            }
+        }
+        glm::vec4 dequantize(0.0f);
+        if (quantizePositions && low.x <= high.x) {
+            //uniform step keeps normals valid under the dequantization scale
+            glm::vec3 extent = (high - low) * 0.5f;
+            float step = std::max(std::max(extent.x, extent.y), extent.z) / 32767.0f;
+            dequantize = glm::vec4((low + high) * 0.5f, step > 0.0f ? step : 1.0f);
+        }
+        else
+            quantizePositions = false;
+
+        size_t missesBefore = 0, missesAfter = 0, triangles = 0;
+        bool changed = false;
+        for (size_t p = 0; p < mesh.primitives.size(); ++p) {
+            if (!readable[p]) continue;
+            optimizePrimitive(model, data, mesh.primitives[p], indices[p], settings, quantizePositions ? &dequantize : nullptr,
+                output, report, missesBefore, missesAfter, triangles);
+            changed = true;
+        }
+        if (!changed) continue;
+        if (quantizePositions) dequantizers[m] = dequantize;
+        report.acmrBefore = triangles ? (double)missesBefore / triangles : 0.0;
+        report.acmrAfter = triangles ? (double)missesAfter / triangles : 0.0;
+        reports.push_back(report);
+    }
+    if (output.bytes.empty()) return;
+
+    //quantized meshes move to a child node that carries the dequantization
+    size_t nodeCount = model.nodes.size();
+    for (size_t n = 0; n < nodeCount; ++n) {
+        int mesh = model.nodes[n].mesh;
+        if (mesh < 0 || mesh >= (int)model.meshes.size() || dequantizers[mesh].w == 0.0f) continue;
+        tinygltf::Node child;
+        child.name = model.nodes[n].name.empty() ? "dequantize" : model.nodes[n].name + " dequantize";
+        child.mesh = mesh;
+        child.translation = { dequantizers[mesh].x, dequantizers[mesh].y, dequantizers[mesh].z };
+        child.scale = { dequantizers[mesh].w, dequantizers[mesh].w, dequantizers[mesh].w };
+        model.nodes[n].mesh = -1;
+        model.nodes[n].children.push_back((int)model.nodes.size());
+        model.nodes.push_back(child);
+    }
+    if (output.quantized) {
+        for (std::vector<std::string>* names : { &model.extensionsUsed, &model.extensionsRequired }) {
+            if (std::find(names->begin(), names->end(), "KHR_mesh_quantization") == names->end())
+                names->push_back("KHR_mesh_quantization");
+        }
+    }
+    data.append(model, std::move(output.bytes));
+}
+
+bool GLTF_MeshOptimizer::optimizable(const tinygltf::Model& model, const tinygltf::Primitive& primitive) {
+    if (primitive.indices < 0 || primitive.indices >= (int)model.accessors.size()) return false;
+    if (primitive.mode != -1 && primitive.mode != TINYGLTF_MODE_TRIANGLES) return false;
+    //morph targets are indexed like the vertices and would need the same renumbering
+    if (!primitive.targets.empty()) return false;
+    if (model.accessors[primitive.indices].sparse.isSparse || model.accessors[primitive.indices].bufferView < 0) return false;
+    size_t count = 0;
+    for (auto& attrib : primitive.attributes) {
+        if (attrib.second < 0 || attrib.second >= (int)model.accessors.size()) return false;
+        const tinygltf::Accessor& accessor = model.accessors[attrib.second];
+        if (accessor.sparse.isSparse || accessor.bufferView < 0) return false;
+        if (count && accessor.count != count) return false;
+        count = accessor.count;
+    }
+    return count > 0;
+}
+
+bool GLTF_MeshOptimizer::readPrimitive(const tinygltf::Model& model, const GLTF_BufferData& data,
+    const tinygltf::Primitive& primitive, std::vector<uint32_t>& indices) {
+    if (!optimizable(model, primitive)) return false;
+    size_t vertexCount = model.accessors[primitive.attributes.begin()->second].count;
+    if (!readIndices(model, data, primitive.indices, indices) || indices.size() % 3 != 0) return false;
+    for (uint32_t index : indices) {
+        if (index >= vertexCount) return false;
+    }
+    for (auto& attrib : primitive.attributes) {
+        const tinygltf::Accessor& accessor = model.accessors[attrib.second];
+        if (accessor.bufferView >= (int)model.bufferViews.size()) return false;
+        size_t elementSize = gltfComponentCount(accessor.type) * tinygltf::GetComponentSizeInBytes(accessor.componentType);
+        int stride = accessor.ByteStride(model.bufferViews[accessor.bufferView]);
+        if (elementSize == 0 || stride <= 0 ||
+            !gltfViewElements(model, data, accessor.bufferView, accessor.byteOffset, accessor.count, stride, elementSize))
+            return false;
+    }
+    return true;
+}
+
+bool GLTF_MeshOptimizer::readIndices(const tinygltf::Model& model, const GLTF_BufferData& data, int accessorIndex,
+    std::vector<uint32_t>& indices) {
+    const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+    int size = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+    if (size <= 0) return false;
+    const unsigned char* source = gltfViewElements(model, data, accessor.bufferView, accessor.byteOffset, accessor.count, size, size);
+    if (!source) return false;
+    indices.resize(accessor.count);
+    for (size_t i = 0; i < accessor.count; ++i) {
+        indices[i] = (uint32_t)gltfReadIndex(source + i * size, accessor.componentType);
+    }
+    return true;
+}
+
+size_t GLTF_MeshOptimizer::accessorBytes(const tinygltf::Model& model, int accessorIndex) {
+    const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+    return accessor.count * gltfComponentCount(accessor.type) * tinygltf::GetComponentSizeInBytes(accessor.componentType);
+}
+
+void GLTF_MeshOptimizer::optimizePrimitive(tinygltf::Model& model, const GLTF_BufferData& data, tinygltf::Primitive& primitive,
+    std::vector<uint32_t>& indices, const Settings& settings, const glm::vec4* dequantize, Output& output, MeshReport& report,
+    size_t& missesBefore, size_t& missesAfter, size_t& triangles) {
+    size_t vertexCount = model.accessors[primitive.attributes.begin()->second].count;
+
+    size_t bytesBefore = accessorBytes(model, primitive.indices);
+    for (auto& attrib : primitive.attributes) {
+        bytesBefore += accessorBytes(model, attrib.second);
+    }
+    size_t before = cacheMisses(indices, vertexCount);
+
+    std::vector<uint32_t> newToOld;
+    if (settings.reorder) {
+        std::vector<size_t> clusters;
+        optimizeVertexCache(indices, vertexCount, clusters);
+        std::vector<float> positions;
+        auto position = primitive.attributes.find("POSITION");
+        if (position != primitive.attributes.end() && gltfReadFloats(model, data, position->second, positions) &&
+            gltfComponentCount(model.accessors[position->second].type) == 3) {
+            optimizeOverdraw(indices, vertexCount, positions, clusters);
+        }
+        optimizeVertexFetch(indices, vertexCount, newToOld);
+    }
+    else {
+        newToOld.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; ++i) {
+            newToOld[i] = (uint32_t)i;
+        }
+    }
+    size_t count = newToOld.size();
+
+    //indices, 16 bit while the largest index stays below the primitive restart value
+    const tinygltf::Accessor& indexAccessor = model.accessors[primitive.indices];
+    int indexType = indexAccessor.componentType;
+    if (settings.narrowIndices && indexType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT && count <= 65535)
+        indexType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT;
+    size_t indexSize = tinygltf::GetComponentSizeInBytes(indexType);
+    std::vector<unsigned char> packed(indices.size() * indexSize);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        writeIndex(packed.data(), i, indexSize, indices[i]);
+    }
+    int indexView = output.view(packed.data(), packed.size(), 0, TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER);
+    int newIndices = output.accessor(indexView, indexType, false, TINYGLTF_TYPE_SCALAR, indices.size());
+    size_t bytesAfter = packed.size();
+
+    std::map<std::string, int> attributes;
+    std::vector<float> values;
+    for (auto& attrib : primitive.attributes) {
+        const tinygltf::Accessor source = model.accessors[attrib.second];
+        int components = gltfComponentCount(source.type);
+        bool position = attrib.first == "POSITION" && dequantize && components == 3;
+        bool normal = settings.quantize && attrib.first == "NORMAL" && components == 3;
+        bool tangent = settings.quantize && attrib.first == "TANGENT" && components == 4;
+        bool texcoord = settings.quantize && attrib.first.compare(0, 9, "TEXCOORD_") == 0 && components == 2;
+        if ((position || normal || tangent || texcoord) && !gltfReadFloats(model, data, attrib.second, values))
+            position = normal = tangent = texcoord = false;
+        //texcoords outside [0,1] would need KHR_texture_transform to dequantize
+        if (texcoord && std::any_of(values.begin(), values.end(), [](float v) { return v < 0.0f || v > 1.0f; }))
+            texcoord = false;
+
+        int accessor = -1;
+        if (position) {
+            //int16 offsets from the mesh center in units of the dequantization step
+            std::vector<int16_t> quantized(count * 4, 0);
+            std::vector<double> low(3, 32767.0), high(3, -32767.0);
+            for (size_t v = 0; v < count; ++v) {
+                for (int c = 0; c < 3; ++c) {
+                    float q = std::round((values[newToOld[v] * 3 + c] - (*dequantize)[c]) / dequantize->w);
+                    int16_t value = (int16_t)std::max(-32767.0f, std::min(32767.0f, q));
+                    quantized[v * 4 + c] = value;
+                    low[c] = std::min(low[c], (double)value);
+                    high[c] = std::max(high[c], (double)value);
+                }
+            }
+            int view = output.view(quantized.data(), quantized.size() * sizeof(int16_t), 8, TINYGLTF_TARGET_ARRAY_BUFFER);
+            accessor = output.accessor(view, TINYGLTF_COMPONENT_TYPE_SHORT, false, TINYGLTF_TYPE_VEC3, count);
+            model.accessors[accessor].minValues = low;
+            model.accessors[accessor].maxValues = high;
+            output.quantized = true;
+        }
+        else if (normal || tangent) {
+            std::vector<int8_t> quantized(count * 4, 0);
+            for (size_t v = 0; v < count; ++v) {
+                for (int c = 0; c < components; ++c) {
+                    float q = std::round(std::max(-1.0f, std::min(1.0f, values[newToOld[v] * components + c])) * 127.0f);
+                    quantized[v * 4 + c] = (int8_t)q;
+                }
+            }
+            int view = output.view(quantized.data(), quantized.size(), 4, TINYGLTF_TARGET_ARRAY_BUFFER);
+            accessor = output.accessor(view, TINYGLTF_COMPONENT_TYPE_BYTE, true, source.type, count);
+            output.quantized = true;
+        }
+        else if (texcoord) {
+            std::vector<uint16_t> quantized(count * 2, 0);
+            for (size_t v = 0; v < count; ++v) {
+                for (int c = 0; c < 2; ++c) {
+                    quantized[v * 2 + c] = (uint16_t)std::round(values[newToOld[v] * 2 + c] * 65535.0f);
+                }
+            }
+            int view = output.view(quantized.data(), quantized.size() * sizeof(uint16_t), 4, TINYGLTF_TARGET_ARRAY_BUFFER);
+            accessor = output.accessor(view, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, true, TINYGLTF_TYPE_VEC2, count);
+            output.quantized = true;
+        }
+        else {
+            //anything else keeps its format, only the vertex order changes; readPrimitive checked the range
+            const tinygltf::BufferView& view = model.bufferViews[source.bufferView];
+            size_t elementSize = components * tinygltf::GetComponentSizeInBytes(source.componentType);
+            size_t stride = (elementSize + 3) & ~(size_t)3;
+            size_t sourceStride = source.ByteStride(view);
+            const unsigned char* from = data.data(view.buffer) + view.byteOffset + source.byteOffset;
+            std::vector<unsigned char> copied(count * stride, 0);
+            for (size_t v = 0; v < count; ++v) {
+                memcpy(&copied[v * stride], from + newToOld[v] * sourceStride, elementSize);
+            }
+            int newView = output.view(copied.data(), copied.size(), stride, TINYGLTF_TARGET_ARRAY_BUFFER);
+            accessor = output.accessor(newView, source.componentType, source.normalized, source.type, count);
+            model.accessors[accessor].minValues = source.minValues;
+            model.accessors[accessor].maxValues = source.maxValues;
+        }
+        attributes[attrib.first] = accessor;
+        bytesAfter += model.bufferViews[model.accessors[accessor].bufferView].byteLength;
+    }
+    primitive.indices = newIndices;
+    primitive.attributes = attributes;
+
+    report.bytesBefore += bytesBefore;
+    report.bytesAfter += bytesAfter;
+    missesBefore += before;
+    missesAfter += cacheMisses(indices, count);
+    triangles += indices.size() / 3;
+}
+
+int GLTF_MeshOptimizer::Output::view(const void* data, size_t length, size_t stride, int target) {
+    size_t offset = (bytes.size() + 3) & ~(size_t)3;
+    bytes.resize(offset + length);
+    memcpy(bytes.data() + offset, data, length);
+    tinygltf::BufferView view;
+    view.buffer = buffer;
+    view.byteOffset = offset;
+    view.byteLength = length;
+    view.byteStride = stride;
+    view.target = target;
+    model->bufferViews.push_back(view);
+    return (int)model->bufferViews.size() - 1;
+}
+
+int GLTF_MeshOptimizer::Output::accessor(int view, int componentType, bool normalized, int type, size_t count) {
+    tinygltf::Accessor accessor;
+    accessor.bufferView = view;
+    accessor.componentType = componentType;
+    accessor.normalized = normalized;
+    accessor.type = type;
+    accessor.count = count;
+    model->accessors.push_back(accessor);
+    return (int)model->accessors.size() - 1;
+}
+
+void GLTF_MeshOptimizer::writeIndex(unsigned char* destination, size_t i, size_t indexSize, unsigned int value) {
+    if (indexSize == 2) {
+        uint16_t narrow = (uint16_t)value;
+        memcpy(destination + i * 2, &narrow, 2);
+    }
+    else if (indexSize == 4)
+        memcpy(destination + i * 4, &value, 4);
+    else
+        destination[i] = (unsigned char)value;
+}
+
+// FIFO cache simulated with timestamps: a vertex is cached while fewer than cacheSize misses followed it
+size_t GLTF_MeshOptimizer::cacheMisses(const std::vector<uint32_t>& indices, size_t vertexCount) {
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    size_t misses = 0;
+    for (uint32_t index : indices) {
+        if (time - timestamps[index] > cacheSize) {
+            timestamps[index] = time++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+// Sander, Nehab and Barczak, "Fast triangle reordering for vertex locality and reduced overdraw":
+// fan around a vertex at a time, next the cached neighbour that is not about to be evicted
+void GLTF_MeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<size_t>& clusters) {
+    size_t triangleCount = indices.size() / 3;
+    clusters.assign(1, 0);
+    if (triangleCount == 0) return;
+
+    //triangles of every vertex
+    std::vector<uint32_t> live(vertexCount, 0);
+    for (uint32_t index : indices) {
+        live[index]++;
+    }
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            adjacency[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+        }
+    }
+
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    uint32_t time = cacheSize + 1;
+    size_t cursor = 0;
+    long fanning = indices[0];
+    while (fanning >= 0) {
+        candidates.clear();
+        for (uint32_t i = offsets[fanning]; i < offsets[fanning + 1]; ++i) {
+            uint32_t t = adjacency[i];
+            if (emitted[t]) continue;
+            for (int k = 0; k < 3; ++k) {
+                uint32_t v = indices[t * 3 + k];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - timestamps[v] > cacheSize) timestamps[v] = time++;
+            }
+            emitted[t] = 1;
+        }
+
+        long next = -1;
+        long bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) continue;
+            //prefer the oldest cached vertex whose remaining fan still fits in the cache
+            long priority = 0;
+            if (time - timestamps[v] + 2 * live[v] <= cacheSize) priority = time - timestamps[v];
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+        while (next < 0 && !deadEnd.empty()) {
+            uint32_t v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0) next = v;
+        }
+        if (next < 0) {
+            while (cursor < vertexCount && live[cursor] == 0) {
+                cursor++;
+            }
+            if (cursor < vertexCount) {
+                next = (long)cursor;
+                clusters.push_back(result.size() / 3);
+            }
+        }
+        fanning = next;
+    }
+    indices.swap(result);
+}
+
+// split the cold-cache runs further where the run so far is about as cache friendly as the
+// whole mesh, then draw the clusters that face away from the mesh center first
+void GLTF_MeshOptimizer::optimizeOverdraw(std::vector<uint32_t>& indices, size_t vertexCount, const std::vector<float>& positions,
+    const std::vector<size_t>& clusters) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || positions.size() < vertexCount * 3) return;
+    double meshAcmr = (double)cacheMisses(indices, vertexCount) / triangleCount;
+
+    std::vector<size_t> starts;
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+        size_t start = clusters[c];
+        size_t misses = 0;
+        time += cacheSize + 1;
+        starts.push_back(start);
+        for (size_t t = clusters[c]; t < end; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                uint32_t v = indices[t * 3 + k];
+                if (time - timestamps[v] > cacheSize) {
+                    timestamps[v] = time++;
+                    misses++;
+                }
+            }
+            if (t + 1 < end && (double)misses / (t + 1 - start) <= meshAcmr * overdrawThreshold) {
+                start = t + 1;
+                misses = 0;
+                time += cacheSize + 1;
+                starts.push_back(start);
+            }
+        }
+    }
+
+    //area weighted centroid and normal of every cluster
+    auto vertex = [&](uint32_t v) { return glm::vec3(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]); };
+    glm::vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+    std::vector<glm::vec3> centers(starts.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(starts.size(), glm::vec3(0.0f));
+    std::vector<float> areas(starts.size(), 0.0f);
+    for (size_t c = 0; c < starts.size(); ++c) {
+        size_t end = c + 1 < starts.size() ? starts[c + 1] : triangleCount;
+        for (size_t t = starts[c]; t < end; ++t) {
+            glm::vec3 a = vertex(indices[t * 3]), b = vertex(indices[t * 3 + 1]), d = vertex(indices[t * 3 + 2]);
+            glm::vec3 normal = glm::cross(b - a, d - a);
+            float area = glm::length(normal);
+            centers[c] += (a + b + d) * (area / 3.0f);
+            normals[c] += normal;
+            areas[c] += area;
+        }
+        meshCenter += centers[c];
+        meshArea += areas[c];
+        if (areas[c] > 0.0f) centers[c] /= areas[c];
+    }
+    if (meshArea > 0.0f) meshCenter /= meshArea;
+
+    std::vector<float> keys(starts.size());
+    std::vector<size_t> order(starts.size());
+    for (size_t c = 0; c < starts.size(); ++c) {
+        float length = glm::length(normals[c]);
+        keys[c] = length > 0.0f ? glm::dot(centers[c] - meshCenter, normals[c] / length) : 0.0f;
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y) { return keys[x] > keys[y]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (size_t c : order) {
+        size_t end = c + 1 < starts.size() ? starts[c + 1] : triangleCount;
+        result.insert(result.end(), indices.begin() + starts[c] * 3, indices.begin() + end * 3);
+    }
+    indices.swap(result);
+}
+
+void GLTF_MeshOptimizer::optimizeVertexFetch(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>& newToOld) {
+    std::vector<uint32_t> oldToNew(vertexCount, ~0u);
+    newToOld.clear();
+    for (uint32_t& index : indices) {
+        if (oldToNew[index] == ~0u) {
+            oldToNew[index] = (uint32_t)newToOld.size();
+            newToOld.push_back(index);
+        }
+        index = oldToNew[index];
+    }
+}
+
+// vertex codec: per block of vertices, per byte of the vertex, groups of 16 zigzag deltas
+// stored with 0, 2, 4 or 8 bits each; the last vertex size bytes hold the starting vertex
+const unsigned char* GLTF_MeshOptimizer::decodeBytes(const unsigned char* data, const unsigned char* end, unsigned char* buffer, size_t size) {
+    size_t headerSize = (size / 16 + 3) / 4;
+    if ((size_t)(end - data) < headerSize) return nullptr;
+    const unsigned char* header = data;
+    data += headerSize;
+    for (size_t i = 0; i < size; i += 16) {
+        //a group needs at most 24 bytes, the 32 byte tail keeps the reads inside the buffer
+        if ((size_t)(end - data) < 24) return nullptr;
+        size_t group = i / 16;
+        int bits = (header[group / 4] >> ((group % 4) * 2)) & 3;
+        unsigned char* out = buffer + i;
+        if (bits == 0) {
+            memset(out, 0, 16);
+        }
+        else if (bits == 3) {
+            memcpy(out, data, 16);
+            data += 16;
+        }
+        else {
+            //2 or 4 bit values, most significant first; the all-ones value escapes to a full byte
+            int width = bits == 1 ? 2 : 4;
+            int packedBytes = width * 2;
+            unsigned char escape = (unsigned char)((1 << width) - 1);
+            const unsigned char* extra = data + packedBytes;
+            for (int k = 0; k < 16; ++k) {
+                unsigned char byte = data[k * width / 8];
+                unsigned char value = (unsigned char)((byte >> (8 - width - (k * width) % 8)) & escape);
+                out[k] = value == escape ? *extra++ : value;
+            }
+            data = extra;
+        }
+    }
+    return data;
+}
+
+bool GLTF_MeshOptimizer::decodeVertexBuffer(unsigned char* destination, size_t count, size_t stride, const unsigned char* buffer, size_t size) {
+    if (stride == 0 || stride > 256 || stride % 4 != 0) return false;
+    if (size < 1 + stride || (buffer[0] & 0xf0) != 0xa0 || (buffer[0] & 0x0f) > 0) return false;
+    const unsigned char* data = buffer + 1;
+    const unsigned char* end = buffer + size;
+    unsigned char last[256];
+    memcpy(last, end - stride, stride);
+
+    size_t blockSize = std::min<size_t>((8192 / stride) & ~(size_t)15, 256);
+    unsigned char deltas[256];
+    for (size_t first = 0; first < count; first += blockSize) {
+        size_t block = std::min(blockSize, count - first);
+        size_t aligned = (block + 15) & ~(size_t)15;
+        unsigned char* out = destination + first * stride;
+        for (size_t k = 0; k < stride; ++k) {
+            data = decodeBytes(data, end, deltas, aligned);
+            if (!data) return false;
+            unsigned char previous = last[k];
+            for (size_t i = 0; i < block; ++i) {
+                unsigned char delta = deltas[i];
+                unsigned char value = (unsigned char)(((delta >> 1) ^ -(delta & 1)) + previous);
+                out[i * stride + k] = value;
+                previous = value;
+            }
+        }
+        memcpy(last, out + (block - 1) * stride, stride);
+    }
+    size_t tail = stride < 32 ? 32 : stride;
+    return (size_t)(end - data) == tail;
+}
+
+unsigned int GLTF_MeshOptimizer::decodeVByte(const unsigned char*& data) {
+    unsigned char lead = *data++;
+    if (lead < 128) return lead;
+    unsigned int result = lead & 127;
+    unsigned int shift = 7;
+    for (int i = 0; i < 4; ++i) {
+        unsigned char group = *data++;
+        result |= (unsigned int)(group & 127) << shift;
+        shift += 7;
+        if (group < 128) break;
+    }
+    return result;
+}
+
+// index codec: one code byte per triangle naming edges and vertices in two 16 entry FIFOs,
+// new vertices counted up from next and others delta coded; 16 aux codes sit at the end
+bool GLTF_MeshOptimizer::decodeIndexBuffer(unsigned char* destination, size_t count, size_t indexSize, const unsigned char* buffer, size_t size) {
+    if (count % 3 != 0 || (indexSize != 2 && indexSize != 4)) return false;
+    if (size < 1 + count / 3 + 16 || (buffer[0] & 0xf0) != 0xe0) return false;
+    int version = buffer[0] & 0x0f;
+    if (version > 1) return false;
+
+    unsigned int edges[16][2];
+    unsigned int vertices[16];
+    memset(edges, -1, sizeof(edges));
+    memset(vertices, -1, sizeof(vertices));
+    size_t edgeOffset = 0, vertexOffset = 0;
+    auto pushEdge = [&](unsigned int a, unsigned int b) {
+        edges[edgeOffset][0] = a;
+        edges[edgeOffset][1] = b;
+        edgeOffset = (edgeOffset + 1) & 15;
+    };
+    auto pushVertex = [&](unsigned int v, bool advance) {
+        vertices[vertexOffset] = v;
+        vertexOffset = (vertexOffset + (advance ? 1 : 0)) & 15;
+    };
+    auto decodeIndex = [&](const unsigned char*& data, unsigned int last) {
+        unsigned int v = decodeVByte(data);
+        return last + ((v >> 1) ^ (0u - (v & 1)));
+    };
+
+    unsigned int next = 0, last = 0;
+    int fecmax = version >= 1 ? 13 : 15;
+    const unsigned char* code = buffer + 1;
+    const unsigned char* data = code + count / 3;
+    const unsigned char* safeEnd = buffer + size - 16;
+    const unsigned char* auxTable = safeEnd;
+    for (size_t i = 0; i < count; i += 3) {
+        if (data > safeEnd) return false;
+        unsigned char codetri = *code++;
+        unsigned int a, b, c;
+        if (codetri < 0xf0) {
+            //edge from the FIFO plus a cached, next or explicit vertex
+            int fe = codetri >> 4;
+            a = edges[(edgeOffset - 1 - fe) & 15][0];
+            b = edges[(edgeOffset - 1 - fe) & 15][1];
+            int fec = codetri & 15;
+            bool fresh = true;
+            if (fec < fecmax) {
+                c = fec == 0 ? next : vertices[(vertexOffset - 1 - fec) & 15];
+                fresh = fec == 0;
+                next += fresh ? 1 : 0;
+            }
+            else {
+                //13 and 14 are -1 and +1 from the last explicit index
+                last = c = fec != 15 ? last + (fec - (fec ^ 3)) : decodeIndex(data, last);
+            }
+            pushVertex(c, fresh);
+            pushEdge(c, b);
+            pushEdge(a, c);
+        }
+        else {
+            int feb, fec;
+            if (codetri < 0xfe) {
+                unsigned char codeaux = auxTable[codetri & 15];
+                feb = codeaux >> 4;
+                fec = codeaux & 15;
+                a = next++;
+                b = feb == 0 ? next : vertices[(vertexOffset - feb) & 15];
+                next += feb == 0 ? 1 : 0;
+                c = fec == 0 ? next : vertices[(vertexOffset - fec) & 15];
+                next += fec == 0 ? 1 : 0;
+            }
+            else {
+                unsigned char codeaux = *data++;
+                int fea = codetri == 0xfe ? 0 : 15;
+                feb = codeaux >> 4;
+                fec = codeaux & 15;
+                if (codeaux == 0) next = 0;
+                a = fea == 0 ? next++ : 0;
+                b = feb == 0 ? next++ : vertices[(vertexOffset - feb) & 15];
+                c = fec == 0 ? next++ : vertices[(vertexOffset - fec) & 15];
+                if (fea == 15) last = a = decodeIndex(data, last);
+                if (feb == 15) last = b = decodeIndex(data, last);
+                if (fec == 15) last = c = decodeIndex(data, last);
+            }
+            pushVertex(a, true);
+            pushVertex(b, feb == 0 || feb == 15);
+            pushVertex(c, fec == 0 || fec == 15);
+            pushEdge(b, a);
+            pushEdge(c, b);
+            pushEdge(a, c);
+        }
+        writeIndex(destination, i, indexSize, a);
+        writeIndex(destination, i + 1, indexSize, b);
+        writeIndex(destination, i + 2, indexSize, c);
+    }
+    return data == safeEnd;
+}
+
+// index sequence codec: zigzag deltas against one of two running baselines
+bool GLTF_MeshOptimizer::decodeIndexSequence(unsigned char* destination, size_t count, size_t indexSize, const unsigned char* buffer, size_t size) {
+    if (indexSize != 2 && indexSize != 4) return false;
+    if (size < 1 + count + 4 || (buffer[0] & 0xf0) != 0xd0 || (buffer[0] & 0x0f) > 1) return false;
+    const unsigned char* data = buffer + 1;
+    const unsigned char* safeEnd = buffer + size - 4;
+    unsigned int last[2] = { 0, 0 };
+    for (size_t i = 0; i < count; ++i) {
+        if (data >= safeEnd) return false;
+        unsigned int v = decodeVByte(data);
+        unsigned int baseline = v & 1;
+        v >>= 1;
+        unsigned int index = last[baseline] + ((v >> 1) ^ (0u - (v & 1)));
+        last[baseline] = index;
+        writeIndex(destination, i, indexSize, index);
+    }
+    return data == safeEnd;
+}
+
+// filters undo the transforms applied before delta coding
+void GLTF_MeshOptimizer::decodeFilter(const std::string& filter, unsigned char* data, size_t count, size_t stride) {
+    if (filter == "OCTAHEDRAL" && (stride == 4 || stride == 8)) {
+        //xy octahedral, z carries the scale of one; w is left alone
+        for (size_t i = 0; i < count; ++i) {
+            float values[3];
+            float one = stride == 4 ? 127.0f : 32767.0f;
+            for (int c = 0; c < 3; ++c) {
+                if (stride == 4) values[c] = (float)(int8_t)data[i * 4 + c];
+                else {
+                    int16_t v;
+                    memcpy(&v, data + i * 8 + c * 2, 2);
+                    values[c] = (float)v;
+                }
+            }
+            float x = values[0], y = values[1];
+            float z = values[2] - std::fabs(x) - std::fabs(y);
+            float t = z < 0.0f ? z : 0.0f;
+            x += x >= 0.0f ? t : -t;
+            y += y >= 0.0f ? t : -t;
+            float length = std::sqrt(x * x + y * y + z * z);
+            float scale = length > 0.0f ? one / length : 0.0f;
+            float decoded[3] = { x * scale, y * scale, z * scale };
+            for (int c = 0; c < 3; ++c) {
+                int v = (int)(decoded[c] + (decoded[c] >= 0.0f ? 0.5f : -0.5f));
+                if (stride == 4) data[i * 4 + c] = (unsigned char)(int8_t)v;
+                else {
+                    int16_t narrow = (int16_t)v;
+                    memcpy(data + i * 8 + c * 2, &narrow, 2);
+                }
+            }
+        }
+    }
+    else if (filter == "QUATERNION" && stride == 8) {
+        //three smallest components, the fourth's index and the scale in the last one
+        const float scale = 1.0f / std::sqrt(2.0f);
+        for (size_t i = 0; i < count; ++i) {
+            int16_t q[4];
+            memcpy(q, data + i * 8, 8);
+            float ss = scale / (float)(q[3] | 3);
+            float x = q[0] * ss, y = q[1] * ss, z = q[2] * ss;
+            float ww = 1.0f - x * x - y * y - z * z;
+            float w = std::sqrt(ww >= 0.0f ? ww : 0.0f);
+            auto round = [](float v) { return (int16_t)(int)(v * 32767.0f + (v >= 0.0f ? 0.5f : -0.5f)); };
+            int largest = q[3] & 3;
+            int16_t out[4];
+            out[(largest + 1) & 3] = round(x);
+            out[(largest + 2) & 3] = round(y);
+            out[(largest + 3) & 3] = round(z);
+            out[(largest + 0) & 3] = round(w);
+            memcpy(data + i * 8, out, 8);
+        }
+    }
+    else if (filter == "EXPONENTIAL" && stride % 4 == 0) {
+        //24 bit mantissa, 8 bit exponent
+        for (size_t i = 0; i < count * stride / 4; ++i) {
+            uint32_t v;
+            memcpy(&v, data + i * 4, 4);
+            int32_t mantissa = (int32_t)(v << 8) >> 8;
+            int32_t exponent = (int32_t)v >> 24;
+            float value = std::ldexp((float)mantissa, exponent);
+            memcpy(data + i * 4, &value, 4);
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+// the order a frame's draws are submitted in, by 64-bit keys, most significant bits first:
+//   opaque and mask passes: pass | double sided | material | vertex array | depth, near first
+//   blend pass:             pass | depth, far first | double sided | material | vertex array
+// draws that share state end up next to each other within a pass, blended draws still
+// composite back to front. fields wider than their bits wrap, which only costs grouping
+class GLTF_DrawSort
+{
+public:
+    enum Pass { Opaque, Mask, Blend };
+    //a draw packet
+    struct Item {
+        uint64_t key;
+        uint32_t draw;
+    };
+    static const int passBits = 2;
+    static const int sidedBits = 1;
+    static const int materialBits = 20;
+    static const int vaoBits = 16;
+    static const int depthBits = 64 - passBits - sidedBits - materialBits - vaoBits;
+
+    //depth grows away from the viewer, any float works
+    static uint64_t key(Pass pass, bool doubleSided, uint32_t material, uint32_t vao, float depth);
+    static Pass pass(uint64_t key) { return (Pass)(key >> (64 - passBits)); }
+
+    void clear() { items.clear(); }
+    void add(uint64_t key, uint32_t draw) { items.push_back({ key, draw }); }
+    //packets made elsewhere, e.g. on other threads, in the order given
+    void append(const Item* packets, size_t count) { items.insert(items.end(), packets, packets + count); }
+    void sort();
+    size_t size() const { return items.size(); }
+    uint32_t draw(size_t i) const { return items[i].draw; }
+    uint64_t sortKey(size_t i) const { return items[i].key; }
+
+private:
+    static const size_t radixThreshold = 64;   //below this a comparison sort is faster
+    std::vector<Item> items;
+    std::vector<Item> scratch;
+
+    static uint64_t depthKey(float depth);
+};
+
+
+// floats as unsigned integers in the same order, the top depthBits kept
+uint64_t GLTF_DrawSort::depthKey(float depth) {
+    if (depth != depth) depth = 0.0f;
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    bits ^= (bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u;
+    return bits >> (32 - depthBits);
+}
+
+uint64_t GLTF_DrawSort::key(Pass pass, bool doubleSided, uint32_t material, uint32_t vao, float depth) {
+    const uint64_t depthMask = (1ull << depthBits) - 1;
+    uint64_t state = ((uint64_t)(doubleSided ? 1 : 0) << (materialBits + vaoBits)) |
+        ((uint64_t)(material & ((1u << materialBits) - 1)) << vaoBits) | (vao & ((1u << vaoBits) - 1));
+    uint64_t key = (uint64_t)pass << (64 - passBits);
+    if (pass == Blend) return key | ((depthMask - depthKey(depth)) << (64 - passBits - depthBits)) | state;
+    return key | (state << depthBits) | depthKey(depth);
+}
+
+// LSD radix sort on bytes, stable. one pass builds every histogram, bytes that are the same
+// in all keys (most of the high ones within a frame) are skipped
+void GLTF_DrawSort::sort() {
+    if (items.size() < radixThreshold) {
+        std::stable_sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.key < b.key; });
+        return;
+    }
+    size_t counts[8][256] = {};
+    for (const Item& item : items) {
+        for (int digit = 0; digit < 8; ++digit) {
+            counts[digit][(item.key >> (digit * 8)) & 0xFF]++;
+        }
+    }
+    scratch.resize(items.size());
+    for (int digit = 0; digit < 8; ++digit) {
+        size_t* count = counts[digit];
+        if (count[(items[0].key >> (digit * 8)) & 0xFF] == items.size()) continue;
+        size_t offset = 0;
+        for (int bucket = 0; bucket < 256; ++bucket) {
+            size_t n = count[bucket];
+            count[bucket] = offset;
+            offset += n;
+        }
+        for (const Item& item : items) {
+            scratch[count[(item.key >> (digit * 8)) & 0xFF]++] = item;
+        }
+        items.swap(scratch);
+    }
+}
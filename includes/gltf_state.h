@@ -0,0 +1,269 @@
+#pragma once
+
+#include <cstring>
+#include <unordered_map>
+
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include "gltf_gl.h"
+
+
+// shadow copy of the GL bindings and uniforms a draw touches, so setting what is already
+// set costs nothing. it only knows what went through it: invalidate() whenever GL state
+// may have changed behind its back (the model does so at the start of every draw).
+// capture() and restore() hand the blend, culling and depth write state back to the application
+class GLTF_StateCache
+{
+public:
+    static const int textureUnits = 16;
+    struct Counters {
+        size_t issued = 0;          //GL calls made, tracked or passed through
+        size_t skipped = 0;         //calls left out because the state was already set
+    };
+
+    GLTF_StateCache() { invalidate(); }
+    void invalidate();              //forget every binding and reset the counters
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vao);
+    void bindElementBuffer(GLuint buffer);              //VAO state, forgotten when the VAO changes
+    void bindArrayBuffer(GLuint buffer);
+    void bindUniformBuffer(GLuint index, GLuint buffer);
+    void bindUniformRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    void bindTexture(int unit, GLuint texture, GLenum target = GL_TEXTURE_2D);    //selects the unit only when binding
+    //GL_BLEND and GL_CULL_FACE are tracked, other capabilities are always set
+    void setEnabled(GLenum capability, bool enabled);
+    void depthMask(bool write);
+    void blendFunc(GLenum source, GLenum destination);
+    //read the tracked capabilities, depth writes and blend function from GL, restore() sets them back
+    void capture();
+    void restore();
+    //uniform values of the current program
+    void uniform1i(GLint location, int value);
+    void uniform1f(GLint location, float value);
+    void uniform4f(GLint location, const glm::vec4& value);
+    void issued(size_t calls = 1) { stats.issued += calls; }
+    void skipped(size_t calls = 1) { stats.skipped += calls; }
+    const Counters& counters() const { return stats; }
+
+private:
+    static const GLuint unknown = ~0u;
+    GLuint program = unknown;
+    GLuint vao = unknown;
+    GLuint elementBuffer = unknown;
+    GLuint arrayBuffer = unknown;
+    GLuint uniformBuffers[4] = { unknown, unknown, unknown, unknown };
+    GLintptr uniformOffsets[4] = { -1, -1, -1, -1 };   //-1 for the whole buffer
+    int activeUnit = -1;
+    GLuint textures[textureUnits];
+    int blend = -1;                                     //-1 unknown, else 0 or 1
+    int cullFace = -1;
+    int depthWrite = -1;
+    GLenum blendSource = unknown;
+    GLenum blendDestination = unknown;
+    struct Captured {
+        bool blend = false;
+        bool cullFace = false;
+        bool depthWrite = true;
+        GLint blendFactors[4] = { GL_ONE, GL_ZERO, GL_ONE, GL_ZERO };  //source and destination RGB, then alpha
+    } captured;
+    std::unordered_map<GLint, glm::vec4> uniforms;      //ints are kept in x
+    Counters stats;
+
+    bool same(GLint location, const glm::vec4& value);
+};
+
+
+void GLTF_StateCache::invalidate() {
+    program = unknown;
+    vao = unknown;
+    elementBuffer = unknown;
+    arrayBuffer = unknown;
+    for (GLuint& buffer : uniformBuffers) buffer = unknown;
+    activeUnit = -1;
+    for (GLuint& texture : textures) texture = unknown;
+    blend = -1;
+    cullFace = -1;
+    depthWrite = -1;
+    blendSource = unknown;
+    blendDestination = unknown;
+    uniforms.clear();
+    stats = Counters();
+}
+
+void GLTF_StateCache::useProgram(GLuint id) {
+    if (program == id) {
+        stats.skipped++;
+        return;
+    }
+    program = id;
+    uniforms.clear();
+    GLTF_GL::useProgram(id);
+    stats.issued++;
+}
+
+void GLTF_StateCache::bindVertexArray(GLuint id) {
+    if (vao == id) {
+        stats.skipped++;
+        return;
+    }
+    vao = id;
+    elementBuffer = unknown;
+    GLTF_GL::bindVertexArray(id);
+    stats.issued++;
+}
+
+void GLTF_StateCache::bindElementBuffer(GLuint buffer) {
+    if (elementBuffer == buffer) {
+        stats.skipped++;
+        return;
+    }
+    elementBuffer = buffer;
+    GLTF_GL::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+    stats.issued++;
+}
+
+void GLTF_StateCache::bindArrayBuffer(GLuint buffer) {
+    if (arrayBuffer == buffer) {
+        stats.skipped++;
+        return;
+    }
+    arrayBuffer = buffer;
+    GLTF_GL::bindBuffer(GL_ARRAY_BUFFER, buffer);
+    stats.issued++;
+}
+
+void GLTF_StateCache::bindUniformBuffer(GLuint index, GLuint buffer) {
+    if (index < 4 && uniformBuffers[index] == buffer && uniformOffsets[index] == -1) {
+        stats.skipped++;
+        return;
+    }
+    if (index < 4) {
+        uniformBuffers[index] = buffer;
+        uniformOffsets[index] = -1;
+    }
+    GLTF_GL::bindBufferBase(GL_UNIFORM_BUFFER, index, buffer);
+    stats.issued++;
+}
+
+void GLTF_StateCache::bindUniformRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    if (index < 4 && uniformBuffers[index] == buffer && uniformOffsets[index] == offset) {
+        stats.skipped++;
+        return;
+    }
+    if (index < 4) {
+        uniformBuffers[index] = buffer;
+        uniformOffsets[index] = offset;
+    }
+    GLTF_GL::bindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+    stats.issued++;
+}
+
+void GLTF_StateCache::bindTexture(int unit, GLuint texture, GLenum target) {
+    if (unit < 0 || unit >= textureUnits) return;
+    if (textures[unit] == texture) {
+        stats.skipped++;
+        return;
+    }
+    if (activeUnit != unit) {
+        activeUnit = unit;
+        GLTF_GL::activeTexture(GL_TEXTURE0 + unit);
+        stats.issued++;
+    }
+    textures[unit] = texture;
+    GLTF_GL::bindTexture(target, texture);
+    stats.issued++;
+}
+
+void GLTF_StateCache::setEnabled(GLenum capability, bool enabled) {
+    int* known = capability == GL_BLEND ? &blend : capability == GL_CULL_FACE ? &cullFace : nullptr;
+    if (known && *known == (enabled ? 1 : 0)) {
+        stats.skipped++;
+        return;
+    }
+    if (known) *known = enabled ? 1 : 0;
+    if (enabled) GLTF_GL::enable(capability);
+    else GLTF_GL::disable(capability);
+    stats.issued++;
+}
+
+void GLTF_StateCache::depthMask(bool write) {
+    if (depthWrite == (write ? 1 : 0)) {
+        stats.skipped++;
+        return;
+    }
+    depthWrite = write ? 1 : 0;
+    GLTF_GL::depthMask(write ? GL_TRUE : GL_FALSE);
+    stats.issued++;
+}
+
+void GLTF_StateCache::blendFunc(GLenum source, GLenum destination) {
+    if (blendSource == source && blendDestination == destination) {
+        stats.skipped++;
+        return;
+    }
+    blendSource = source;
+    blendDestination = destination;
+    GLTF_GL::blendFunc(source, destination);
+    stats.issued++;
+}
+
+void GLTF_StateCache::capture() {
+    captured.blend = GLTF_GL::isEnabled(GL_BLEND) == GL_TRUE;
+    captured.cullFace = GLTF_GL::isEnabled(GL_CULL_FACE) == GL_TRUE;
+    GLint write = GL_TRUE;
+    GLTF_GL::getIntegerv(GL_DEPTH_WRITEMASK, &write);
+    captured.depthWrite = write != GL_FALSE;
+    GLTF_GL::getIntegerv(GL_BLEND_SRC_RGB, &captured.blendFactors[0]);
+    GLTF_GL::getIntegerv(GL_BLEND_DST_RGB, &captured.blendFactors[1]);
+    GLTF_GL::getIntegerv(GL_BLEND_SRC_ALPHA, &captured.blendFactors[2]);
+    GLTF_GL::getIntegerv(GL_BLEND_DST_ALPHA, &captured.blendFactors[3]);
+    stats.issued += 7;
+    //what was read is known now, setting it again is skipped
+    blend = captured.blend ? 1 : 0;
+    cullFace = captured.cullFace ? 1 : 0;
+    depthWrite = captured.depthWrite ? 1 : 0;
+    bool separate = captured.blendFactors[0] != captured.blendFactors[2] || captured.blendFactors[1] != captured.blendFactors[3];
+    blendSource = separate ? unknown : (GLenum)captured.blendFactors[0];
+    blendDestination = separate ? unknown : (GLenum)captured.blendFactors[1];
+}
+
+void GLTF_StateCache::restore() {
+    setEnabled(GL_BLEND, captured.blend);
+    setEnabled(GL_CULL_FACE, captured.cullFace);
+    depthMask(captured.depthWrite);
+    const GLint* factors = captured.blendFactors;
+    if (factors[0] == factors[2] && factors[1] == factors[3]) {
+        blendFunc((GLenum)factors[0], (GLenum)factors[1]);
+        return;
+    }
+    blendSource = unknown;
+    blendDestination = unknown;
+    GLTF_GL::blendFuncSeparate(factors[0], factors[1], factors[2], factors[3]);
+    stats.issued++;
+}
+
+bool GLTF_StateCache::same(GLint location, const glm::vec4& value) {
+    auto known = uniforms.find(location);
+    if (known != uniforms.end() && memcmp(&known->second, &value, sizeof(value)) == 0) {
+        stats.skipped++;
+        return true;
+    }
+    uniforms[location] = value;
+    stats.issued++;
+    return false;
+}
+
+void GLTF_StateCache::uniform1i(GLint location, int value) {
+    if (location < 0 || same(location, glm::vec4((float)value, 0.0f, 0.0f, 0.0f))) return;
+    GLTF_GL::uniform1i(location, value);
+}
+
+void GLTF_StateCache::uniform1f(GLint location, float value) {
+    if (location < 0 || same(location, glm::vec4(value, 0.0f, 0.0f, 0.0f))) return;
+    GLTF_GL::uniform1f(location, value);
+}
+
+void GLTF_StateCache::uniform4f(GLint location, const glm::vec4& value) {
+    if (location < 0 || same(location, value)) return;
+    GLTF_GL::uniform4fv(location, 1, &value[0]);
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+
+// residency of streamed resources under a byte budget. every frame the renderer requests
+// what it is about to draw with a priority (larger first); schedule() then picks the most
+// important absent resources to fetch and evicts the least recently requested resident ones
+// to make room. the owner does the fetching, uploading and freeing and reports when a fetch
+// is done. GL thread only
+class GLTF_Streamer
+{
+public:
+    enum State {
+        Absent,
+        Fetching,                       //CPU work on a worker: page-in, decode
+        Ready,                          //fetched, waiting for its GL upload
+        Resident
+    };
+    struct Stats {
+        size_t budgetBytes = 0;
+        size_t residentBytes = 0;
+        size_t inFlightBytes = 0;       //fetching or waiting for upload
+        size_t evictedBytes = 0;        //in total
+        size_t resident = 0;
+        size_t inFlight = 0;
+        size_t evictions = 0;
+        size_t requested = 0;           //resources requested for the last scheduled frame
+        size_t starved = 0;             //of those, absent ones that did not fit in the budget
+    };
+
+    void reset(size_t count);
+    //bytes a resource takes once resident, may be corrected in any state
+    void setBytes(int resource, size_t bytes);
+    size_t bytes(int resource) const { return resources[resource].bytes; }
+    void setBudget(size_t bytes, size_t maxInFlight);
+    void request(int resource, float priority);
+    //resources to start fetching (now Fetching) and to free (now Absent), most important first
+    void schedule(std::vector<int>& fetch, std::vector<int>& evict);
+    void setState(int resource, State state);
+    State state(int resource) const { return resources[resource].state; }
+    size_t size() const { return resources.size(); }
+    const Stats& stats() const { return counters; }
+
+private:
+    struct Resource {
+        size_t bytes = 0;
+        State state = Absent;
+        uint64_t lastUsed = 0;          //frame of the last request
+        float priority = 0.0f;
+    };
+    std::vector<Resource> resources;
+    std::vector<int> requested;         //this frame, each once
+    uint64_t frame = 1;
+    size_t maxInFlight = 8;
+    Stats counters;
+
+    void account(const Resource& resource, bool add);
+};
+
+
+void GLTF_Streamer::reset(size_t count) {
+    resources.assign(count, Resource());
+    requested.clear();
+    size_t budget = counters.budgetBytes;
+    counters = Stats();
+    counters.budgetBytes = budget;
+}
+
+void GLTF_Streamer::account(const Resource& resource, bool add) {
+    size_t* bytes = nullptr;
+    size_t* count = nullptr;
+    if (resource.state == Resident) {
+        bytes = &counters.residentBytes;
+        count = &counters.resident;
+    }
+    else if (resource.state != Absent) {
+        bytes = &counters.inFlightBytes;
+        count = &counters.inFlight;
+    }
+    if (!bytes) return;
+    if (add) {
+        *bytes += resource.bytes;
+        (*count)++;
+    }
+    else {
+        *bytes -= resource.bytes;
+        (*count)--;
+    }
+}
+
+void GLTF_Streamer::setBytes(int resource, size_t bytes) {
+    account(resources[resource], false);
+    resources[resource].bytes = bytes;
+    account(resources[resource], true);
+}
+
+void GLTF_Streamer::setBudget(size_t bytes, size_t inFlight) {
+    counters.budgetBytes = bytes;
+    maxInFlight = std::max<size_t>(inFlight, 1);
+}
+
+void GLTF_Streamer::request(int resource, float priority) {
+    Resource& entry = resources[resource];
+    if (entry.lastUsed != frame) {
+        entry.lastUsed = frame;
+        entry.priority = priority;
+        requested.push_back(resource);
+    }
+    else {
+        entry.priority = std::max(entry.priority, priority);
+    }
+}
+
+void GLTF_Streamer::setState(int resource, State state) {
+    Resource& entry = resources[resource];
+    if (entry.state == state) return;
+    if (state == Absent && entry.state == Resident) {
+        counters.evictedBytes += entry.bytes;
+        counters.evictions++;
+    }
+    account(entry, false);
+    entry.state = state;
+    account(entry, true);
+}
+
+void GLTF_Streamer::schedule(std::vector<int>& fetch, std::vector<int>& evict) {
+    fetch.clear();
+    evict.clear();
+    std::sort(requested.begin(), requested.end(),
+        [this](int a, int b) { return resources[a].priority > resources[b].priority; });
+    //eviction candidates, not wanted this frame and least recently wanted first
+    std::vector<int> victims;
+    for (size_t i = 0; i < resources.size(); ++i) {
+        if (resources[i].state == Resident && resources[i].lastUsed < frame) victims.push_back((int)i);
+    }
+    std::sort(victims.begin(), victims.end(),
+        [this](int a, int b) { return resources[a].lastUsed < resources[b].lastUsed; });
+    size_t nextVictim = 0;
+    auto makeRoom = [&](size_t bytes) {
+        while (counters.residentBytes + counters.inFlightBytes + bytes > counters.budgetBytes && nextVictim < victims.size()) {
+            int victim = victims[nextVictim++];
+            setState(victim, Absent);
+            evict.push_back(victim);
+        }
+        return counters.residentBytes + counters.inFlightBytes + bytes <= counters.budgetBytes;
+    };
+    //a budget lowered at runtime takes effect right away
+    makeRoom(0);
+
+    counters.requested = requested.size();
+    counters.starved = 0;
+    for (int resource : requested) {
+        if (resources[resource].state != Absent) continue;
+        if (counters.inFlight >= maxInFlight || !makeRoom(resources[resource].bytes)) {
+            counters.starved++;
+            continue;
+        }
+        setState(resource, Fetching);
+        fetch.push_back(resource);
+    }
+    requested.clear();
+    frame++;
+}
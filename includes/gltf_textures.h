@@ -0,0 +1,394 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <GLFW/glfw3.h>
+
+#include <tiny_gltf.h>
+#include "gltf_gl.h"
+#include "gltf_trace.h"
+
+#ifdef GLTF_USE_BASISU
+#include <basisu_transcoder.h>
+#endif
+
+
+// CPU side of one texture: GL formats and every mip level, ready to upload
+struct GLTF_TextureData {
+    struct Level {
+        int width = 0;
+        int height = 0;
+        size_t offset = 0;
+        size_t size = 0;
+    };
+    GLenum internalFormat = 0;
+    GLenum format = 0;                  //unused for compressed data
+    GLenum type = 0;
+    bool compressed = false;
+    int components = 4;
+    bool greyscale = false;             //a decoded 1 or 2 channel image, swizzled to grey (+alpha)
+    std::vector<Level> levels;
+    std::vector<unsigned char> bytes;
+    //or the levels live in a mapped file (a baked scene) that keepAlive holds open
+    const unsigned char* mapped = nullptr;
+    size_t mappedSize = 0;
+    std::shared_ptr<const void> keepAlive;
+    bool valid() const { return !levels.empty(); }
+    const unsigned char* data() const { return mapped ? mapped : bytes.data(); }
+    size_t size() const { return mapped ? mappedSize : bytes.size(); }
+};
+
+// filtering and wrapping of a glTF texture
+struct GLTF_SamplerState {
+    GLint minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    GLint magFilter = GL_LINEAR;
+    GLint wrapS = GL_REPEAT;
+    GLint wrapT = GL_REPEAT;
+    bool mipmapped() const { return minFilter != GL_NEAREST && minFilter != GL_LINEAR; }
+};
+
+// decodes glTF images into GLTF_TextureData on any thread and uploads them on the GL thread.
+// plain images come from stb through tinygltf; KTX2 files (KHR_texture_basisu) are read
+// directly when they hold a block format the context samples, and Basis Universal
+// payloads are transcoded when built with GLTF_USE_BASISU
+class GLTF_TextureDecoder
+{
+public:
+    //block formats the context can sample, query on the GL thread
+    struct Caps {
+        bool s3tc = false;
+        bool rgtc = true;               //core since GL 3.0
+        bool bptc = false;
+        bool etc2 = false;
+        bool astc = false;
+        uint32_t mask() const { return (s3tc ? 1u : 0u) | (rgtc ? 2u : 0u) | (bptc ? 4u : 0u) | (etc2 ? 8u : 0u) | (astc ? 16u : 0u); }
+    };
+    static Caps queryCaps();
+
+    static bool isKtx2(const unsigned char* bytes, size_t size);
+    //GPU bytes an encoded image takes with its mips, from the PNG or JPEG header without
+    //decoding; KTX2 uploads about as stored, anything else is a guess from the file size
+    static size_t estimateBytes(const unsigned char* bytes, size_t size);
+    //image index a texture samples, preferring the KHR_texture_basisu source when it can be decoded
+    static int textureSource(const tinygltf::Texture& texture);
+    //wrap decoded pixels, srgb picks an sRGB internal format for color data
+    static bool fromPixels(tinygltf::Image& image, bool srgb, GLTF_TextureData& out);
+    static bool decodeKtx2(const unsigned char* bytes, size_t size, bool srgb, const Caps& caps, GLTF_TextureData& out);
+    static GLTF_SamplerState sampler(const tinygltf::Model& model, const tinygltf::Texture& texture);
+    //upload every level, through the staging unpack buffer when one is given
+    static size_t upload(GLuint texture, const GLTF_TextureData& data, const GLTF_SamplerState& sampler, GLuint stagingPbo);
+
+private:
+    enum BlockFormat : GLenum {
+        COMPRESSED_RGB_S3TC_DXT1 = 0x83F0,
+        COMPRESSED_RGBA_S3TC_DXT1 = 0x83F1,
+        COMPRESSED_RGBA_S3TC_DXT5 = 0x83F3,
+        COMPRESSED_SRGB_S3TC_DXT1 = 0x8C4C,
+        COMPRESSED_SRGB_ALPHA_S3TC_DXT1 = 0x8C4D,
+        COMPRESSED_SRGB_ALPHA_S3TC_DXT5 = 0x8C4F,
+        COMPRESSED_RED_RGTC1 = 0x8DBB,
+        COMPRESSED_RG_RGTC2 = 0x8DBD,
+        COMPRESSED_RGBA_BPTC_UNORM = 0x8E8C,
+        COMPRESSED_SRGB_ALPHA_BPTC_UNORM = 0x8E8D,
+        COMPRESSED_RGB8_ETC2 = 0x9274,
+        COMPRESSED_SRGB8_ETC2 = 0x9275,
+        COMPRESSED_RGBA8_ETC2_EAC = 0x9278,
+        COMPRESSED_SRGB8_ALPHA8_ETC2_EAC = 0x9279,
+        COMPRESSED_RGBA_ASTC_4x4 = 0x93B0,
+        COMPRESSED_SRGB8_ALPHA8_ASTC_4x4 = 0x93D0
+    };
+    static bool vkFormatToGL(uint32_t vkFormat, const Caps& caps, GLTF_TextureData& out);
+#ifdef GLTF_USE_BASISU
+    static bool transcodeBasis(const unsigned char* bytes, size_t size, bool srgb, const Caps& caps, GLTF_TextureData& out);
+#endif
+};
+
+
+GLTF_TextureDecoder::Caps GLTF_TextureDecoder::queryCaps() {
+    Caps caps;
+    GLint count = 0;
+    GLTF_GL::getIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const char* name = (const char*)GLTF_GL::getStringi(GL_EXTENSIONS, i);
+        if (!name) continue;
+        std::string extension(name);
+        if (extension == "GL_EXT_texture_compression_s3tc") caps.s3tc = true;
+        else if (extension == "GL_ARB_texture_compression_bptc") caps.bptc = true;
+        else if (extension == "GL_ARB_ES3_compatibility") caps.etc2 = true;
+        else if (extension == "GL_KHR_texture_compression_astc_ldr") caps.astc = true;
+    }
+    return caps;
+}
+
+bool GLTF_TextureDecoder::isKtx2(const unsigned char* bytes, size_t size) {
+    static const unsigned char identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    return size >= 80 && memcmp(bytes, identifier, sizeof(identifier)) == 0;
+}
+
+size_t GLTF_TextureDecoder::estimateBytes(const unsigned char* bytes, size_t size) {
+    if (isKtx2(bytes, size)) return size;
+    static const unsigned char png[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    size_t width = 0;
+    size_t height = 0;
+    if (size >= 24 && memcmp(bytes, png, sizeof(png)) == 0) {
+        //IHDR is always the first chunk
+        width = (size_t)bytes[16] << 24 | (size_t)bytes[17] << 16 | (size_t)bytes[18] << 8 | bytes[19];
+        height = (size_t)bytes[20] << 24 | (size_t)bytes[21] << 16 | (size_t)bytes[22] << 8 | bytes[23];
+    }
+    else if (size >= 4 && bytes[0] == 0xFF && bytes[1] == 0xD8) {
+        //walk the segments up to the frame header
+        size_t at = 2;
+        while (at + 9 < size && bytes[at] == 0xFF) {
+            unsigned char marker = bytes[at + 1];
+            if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+                height = (size_t)bytes[at + 5] << 8 | bytes[at + 6];
+                width = (size_t)bytes[at + 7] << 8 | bytes[at + 8];
+                break;
+            }
+            at += 2 + ((size_t)bytes[at + 2] << 8 | bytes[at + 3]);
+        }
+    }
+    //RGBA8 and a third more for the mip chain
+    if (width && height) return width * height * 4 * 4 / 3;
+    return size * 4;
+}
+
+int GLTF_TextureDecoder::textureSource(const tinygltf::Texture& texture) {
+    auto extension = texture.extensions.find("KHR_texture_basisu");
+    if (extension != texture.extensions.end() && extension->second.Has("source")) {
+        int basisSource = extension->second.Get("source").GetNumberAsInt();
+#ifdef GLTF_USE_BASISU
+        return basisSource;
+#else
+        //without a transcoder only uncompressed-supercompression KTX2 can be read, keep the fallback if any
+        return texture.source >= 0 ? texture.source : basisSource;
+#endif
+    }
+    return texture.source;
+}
+
+bool GLTF_TextureDecoder::fromPixels(tinygltf::Image& image, bool srgb, GLTF_TextureData& out) {
+    if (image.image.empty() || image.width <= 0 || image.height <= 0) return false;
+    static const GLenum formats[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    static const GLenum formats8[4] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+    static const GLenum formats16[4] = { GL_R16, GL_RG16, GL_RGB16, GL_RGBA16 };
+    int components = std::min(std::max(image.component, 1), 4);
+    bool wide = image.bits == 16;
+
+    out = GLTF_TextureData();
+    out.components = components;
+    out.greyscale = components <= 2;
+    out.format = formats[components - 1];
+    out.type = wide ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+    out.internalFormat = wide ? formats16[components - 1] : formats8[components - 1];
+    //there is no core sRGB format for one or two channels or 16 bits
+    if (srgb && !wide && components == 3) out.internalFormat = GL_SRGB8;
+    if (srgb && !wide && components == 4) out.internalFormat = GL_SRGB8_ALPHA8;
+
+    GLTF_TextureData::Level level;
+    level.width = image.width;
+    level.height = image.height;
+    level.size = image.image.size();
+    out.levels.push_back(level);
+    //take the pixels over, the image copy is not needed any more
+    out.bytes.swap(image.image);
+    return true;
+}
+
+// KTX2: 80 byte header and index, then one (offset, length, uncompressed length) entry per level
+bool GLTF_TextureDecoder::decodeKtx2(const unsigned char* bytes, size_t size, bool srgb, const Caps& caps, GLTF_TextureData& out) {
+    if (!isKtx2(bytes, size)) return false;
+    uint32_t header[9];
+    memcpy(header, bytes + 12, sizeof(header));
+    uint32_t vkFormat = header[0];
+    int width = (int)header[2];
+    int height = (int)std::max(header[3], 1u);
+    uint32_t levelCount = std::max(header[7], 1u);
+    uint32_t supercompression = header[8];
+    //an int side has at most 32 levels, and the level index must fit the file
+    if (levelCount > 32 || (uint64_t)size < 80 + (uint64_t)levelCount * 24) return false;
+
+    if (vkFormat == 0 || supercompression != 0) {
+#ifdef GLTF_USE_BASISU
+        return transcodeBasis(bytes, size, srgb, caps, out);
+#else
+        GLTF_LOG_WARN("KTX2 needs Basis Universal (GLTF_USE_BASISU) to transcode");
+        return false;
+#endif
+    }
+
+    out = GLTF_TextureData();
+    if (!vkFormatToGL(vkFormat, caps, out)) {
+        GLTF_LOG_WARN("KTX2 vkFormat " << vkFormat << " not supported by this context");
+        return false;
+    }
+    (void)srgb;     //the vkFormat already says whether the data is sRGB
+    for (uint32_t i = 0; i < levelCount; ++i) {
+        uint64_t entry[3];
+        memcpy(entry, bytes + 80 + i * 24, sizeof(entry));
+        if (entry[0] > size || entry[1] > size - entry[0]) return false;
+        GLTF_TextureData::Level level;
+        level.width = std::max(width >> i, 1);
+        level.height = std::max(height >> i, 1);
+        level.offset = out.bytes.size();
+        level.size = (size_t)entry[1];
+        out.bytes.insert(out.bytes.end(), bytes + entry[0], bytes + entry[0] + entry[1]);
+        out.levels.push_back(level);
+    }
+    return true;
+}
+
+bool GLTF_TextureDecoder::vkFormatToGL(uint32_t vkFormat, const Caps& caps, GLTF_TextureData& out) {
+    out.compressed = true;
+    switch (vkFormat) {
+    case 37: out.compressed = false; out.internalFormat = GL_RGBA8; out.format = GL_RGBA; out.type = GL_UNSIGNED_BYTE; return true;
+    case 43: out.compressed = false; out.internalFormat = GL_SRGB8_ALPHA8; out.format = GL_RGBA; out.type = GL_UNSIGNED_BYTE; return true;
+    case 131: out.internalFormat = COMPRESSED_RGB_S3TC_DXT1; return caps.s3tc;
+    case 132: out.internalFormat = COMPRESSED_SRGB_S3TC_DXT1; return caps.s3tc;
+    case 133: out.internalFormat = COMPRESSED_RGBA_S3TC_DXT1; return caps.s3tc;
+    case 134: out.internalFormat = COMPRESSED_SRGB_ALPHA_S3TC_DXT1; return caps.s3tc;
+    case 137: out.internalFormat = COMPRESSED_RGBA_S3TC_DXT5; return caps.s3tc;
+    case 138: out.internalFormat = COMPRESSED_SRGB_ALPHA_S3TC_DXT5; return caps.s3tc;
+    case 139: out.internalFormat = COMPRESSED_RED_RGTC1; out.components = 1; return caps.rgtc;
+    case 141: out.internalFormat = COMPRESSED_RG_RGTC2; out.components = 2; return caps.rgtc;
+    case 145: out.internalFormat = COMPRESSED_RGBA_BPTC_UNORM; return caps.bptc;
+    case 146: out.internalFormat = COMPRESSED_SRGB_ALPHA_BPTC_UNORM; return caps.bptc;
+    case 147: out.internalFormat = COMPRESSED_RGB8_ETC2; return caps.etc2;
+    case 148: out.internalFormat = COMPRESSED_SRGB8_ETC2; return caps.etc2;
+    case 151: out.internalFormat = COMPRESSED_RGBA8_ETC2_EAC; return caps.etc2;
+    case 152: out.internalFormat = COMPRESSED_SRGB8_ALPHA8_ETC2_EAC; return caps.etc2;
+    case 157: out.internalFormat = COMPRESSED_RGBA_ASTC_4x4; return caps.astc;
+    case 158: out.internalFormat = COMPRESSED_SRGB8_ALPHA8_ASTC_4x4; return caps.astc;
+    default: return false;
+    }
+}
+
+#ifdef GLTF_USE_BASISU
+// ETC1S and UASTC payloads, transcoded to the best block format the context samples
+bool GLTF_TextureDecoder::transcodeBasis(const unsigned char* bytes, size_t size, bool srgb, const Caps& caps, GLTF_TextureData& out) {
+    static bool initialized = (basist::basisu_transcoder_init(), true);
+    (void)initialized;
+    basist::ktx2_transcoder transcoder;
+    if (!transcoder.init(bytes, (uint32_t)size) || !transcoder.start_transcoding()) return false;
+
+    basist::transcoder_texture_format target = basist::transcoder_texture_format::cTFRGBA32;
+    out = GLTF_TextureData();
+    out.compressed = true;
+    if (caps.astc) {
+        target = basist::transcoder_texture_format::cTFASTC_4x4_RGBA;
+        out.internalFormat = srgb ? COMPRESSED_SRGB8_ALPHA8_ASTC_4x4 : COMPRESSED_RGBA_ASTC_4x4;
+    }
+    else if (caps.bptc) {
+        target = basist::transcoder_texture_format::cTFBC7_RGBA;
+        out.internalFormat = srgb ? COMPRESSED_SRGB_ALPHA_BPTC_UNORM : COMPRESSED_RGBA_BPTC_UNORM;
+    }
+    else if (caps.etc2) {
+        target = basist::transcoder_texture_format::cTFETC2_RGBA;
+        out.internalFormat = srgb ? COMPRESSED_SRGB8_ALPHA8_ETC2_EAC : COMPRESSED_RGBA8_ETC2_EAC;
+    }
+    else if (caps.s3tc) {
+        target = basist::transcoder_texture_format::cTFBC3_RGBA;
+        out.internalFormat = srgb ? COMPRESSED_SRGB_ALPHA_S3TC_DXT5 : COMPRESSED_RGBA_S3TC_DXT5;
+    }
+    else {
+        out.compressed = false;
+        out.internalFormat = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+        out.format = GL_RGBA;
+        out.type = GL_UNSIGNED_BYTE;
+    }
+
+    uint32_t unitSize = basist::basis_get_bytes_per_block_or_pixel(target);
+    for (uint32_t i = 0; i < transcoder.get_levels(); ++i) {
+        basist::ktx2_image_level_info info;
+        if (!transcoder.get_image_level_info(info, i, 0, 0)) return false;
+        uint32_t units = out.compressed ? info.m_total_blocks : info.m_orig_width * info.m_orig_height;
+        GLTF_TextureData::Level level;
+        level.width = (int)info.m_orig_width;
+        level.height = (int)info.m_orig_height;
+        level.offset = out.bytes.size();
+        level.size = (size_t)units * unitSize;
+        out.bytes.resize(level.offset + level.size);
+        if (!transcoder.transcode_image_level(i, 0, 0, out.bytes.data() + level.offset, units, target)) return false;
+        out.levels.push_back(level);
+    }
+    return true;
+}
+#endif
+
+GLTF_SamplerState GLTF_TextureDecoder::sampler(const tinygltf::Model& model, const tinygltf::Texture& texture) {
+    GLTF_SamplerState state;
+    if (texture.sampler < 0 || texture.sampler >= (int)model.samplers.size()) return state;
+    //glTF filter and wrap values are the GL enums, -1 leaves the default
+    const tinygltf::Sampler& sampler = model.samplers[texture.sampler];
+    if (sampler.minFilter >= 0) state.minFilter = sampler.minFilter;
+    if (sampler.magFilter >= 0) state.magFilter = sampler.magFilter;
+    state.wrapS = sampler.wrapS;
+    state.wrapT = sampler.wrapT;
+    return state;
+}
+
+size_t GLTF_TextureDecoder::upload(GLuint texture, const GLTF_TextureData& data, const GLTF_SamplerState& sampler, GLuint stagingPbo) {
+    if (!data.valid()) return 0;
+    //stage the levels in an orphaned unpack buffer so the copy to the texture does not stall
+    const unsigned char* source = data.data();
+    if (stagingPbo) {
+        GLTF_GL::bindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingPbo);
+        GLTF_GL::bufferData(GL_PIXEL_UNPACK_BUFFER, data.size(), NULL, GL_STREAM_DRAW);
+        void* staging = GLTF_GL::mapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, data.size(),
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (staging) {
+            memcpy(staging, data.data(), data.size());
+            GLTF_GL::unmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            source = NULL;
+        }
+        else {
+            GLTF_GL::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+
+    GLTF_GL::bindTexture(GL_TEXTURE_2D, texture);
+    GLTF_GL::pixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    //a single level with a mipmapped filter gets its chain generated on the GPU
+    bool generate = sampler.mipmapped() && data.levels.size() == 1 && !data.compressed;
+    bool mipmapped = sampler.mipmapped() && (generate || data.levels.size() > 1);
+    GLTF_GL::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmapped ? sampler.minFilter :
+        (sampler.minFilter == GL_NEAREST_MIPMAP_NEAREST || sampler.minFilter == GL_NEAREST_MIPMAP_LINEAR ? GL_NEAREST :
+        sampler.mipmapped() ? GL_LINEAR : sampler.minFilter));
+    GLTF_GL::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter);
+    GLTF_GL::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
+    GLTF_GL::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
+    GLTF_GL::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    GLTF_GL::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, generate ? 1000 : (GLint)data.levels.size() - 1);
+    //grey and grey-alpha images sample like the RGBA they stand for; BC4/BC5 red and red-green
+    //data (normal maps) is left as it is
+    if (data.greyscale && data.components == 1) {
+        GLTF_GL::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+        GLTF_GL::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+    }
+    else if (data.greyscale && data.components == 2) {
+        GLTF_GL::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+        GLTF_GL::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+        GLTF_GL::texParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_GREEN);
+    }
+
+    for (size_t i = 0; i < data.levels.size(); ++i) {
+        const GLTF_TextureData::Level& level = data.levels[i];
+        const void* pixels = source ? (const void*)(source + level.offset) : (const void*)(uintptr_t)level.offset;
+        if (data.compressed) {
+            GLTF_GL::compressedTexImage2D(GL_TEXTURE_2D, (GLint)i, data.internalFormat, level.width, level.height, 0,
+                (GLsizei)level.size, pixels);
+        }
+        else {
+            GLTF_GL::texImage2D(GL_TEXTURE_2D, (GLint)i, data.internalFormat, level.width, level.height, 0,
+                data.format, data.type, pixels);
+        }
+    }
+    if (generate) GLTF_GL::generateMipmap(GL_TEXTURE_2D);
+    if (stagingPbo) GLTF_GL::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return data.size();
+}
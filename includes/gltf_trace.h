@@ -0,0 +1,333 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gltf_gl.h"
+
+//messages above this level are compiled out: 0 errors, 1 warnings, 2 info, 3 debug
+#ifndef GLTF_LOG_LEVEL
+#define GLTF_LOG_LEVEL 2
+#endif
+//0 compiles every trace span away, spans are collected only while GLTF_Trace is enabled
+#ifndef GLTF_TRACING
+#define GLTF_TRACING 1
+#endif
+
+//message is a stream expression: GLTF_LOG_INFO("loaded " << path)
+#define GLTF_LOG_AT(level, message) \
+    do { \
+        if ((level) <= GLTF_LOG_LEVEL && GLTF_Trace::logs(level)) { \
+            std::ostringstream gltfLogLine; \
+            gltfLogLine << message; \
+            GLTF_Trace::log(level, gltfLogLine.str()); \
+        } \
+    } while (0)
+#define GLTF_LOG_ERROR(message) GLTF_LOG_AT(GLTF_Trace::Error, message)
+#define GLTF_LOG_WARN(message) GLTF_LOG_AT(GLTF_Trace::Warning, message)
+#define GLTF_LOG_INFO(message) GLTF_LOG_AT(GLTF_Trace::Info, message)
+#define GLTF_LOG_DEBUG(message) GLTF_LOG_AT(GLTF_Trace::Debug, message)
+
+#define GLTF_TRACE_JOIN2(a, b) a##b
+#define GLTF_TRACE_JOIN(a, b) GLTF_TRACE_JOIN2(a, b)
+#if GLTF_TRACING
+//a span from here to the end of the scope; name and category must outlive the trace (literals)
+#define GLTF_TRACE_SCOPE(name, category) GLTF_TraceSpan GLTF_TRACE_JOIN(gltfTraceSpan, __LINE__)(name, category)
+//a span that was timed already
+#define GLTF_TRACE_SPAN(name, category, begin, end) GLTF_Trace::span(name, category, begin, end)
+#else
+#define GLTF_TRACE_SCOPE(name, category) ((void)0)
+#define GLTF_TRACE_SPAN(name, category, begin, end) ((void)0)
+#endif
+
+
+// logging and tracing of loads and frames. logs go to one stream, a line at a time and
+// unflushed. trace events are kept in memory until written in the Chrome trace event
+// format (chrome://tracing, Perfetto). thread safe
+class GLTF_Trace
+{
+public:
+    enum Level { Error, Warning, Info, Debug };
+    typedef std::chrono::steady_clock Clock;
+
+    static bool logs(int level) { return level <= settings().logLevel.load(std::memory_order_relaxed); }
+    static void setLogLevel(int level) { settings().logLevel = level; }
+    static void setLogStream(std::ostream* stream);
+    static void log(int level, const std::string& line);
+
+    static bool enabled() { return settings().enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled) { settings().enabled = enabled; }
+    static void span(const char* name, const char* category, Clock::time_point begin, Clock::time_point end);
+    static void counter(const char* name, double value);
+    static void clear();
+    static void writeChromeTrace(std::ostream& out);
+    static bool writeChromeTrace(const std::string& path);
+
+    //counters of one frame, from the GL dispatch counters; call endFrame() once a frame
+    struct FrameCounters {
+        size_t frame = 0;
+        double milliseconds = 0.0;      //since the previous endFrame()
+        size_t draws = 0;
+        size_t triangles = 0;
+        size_t binds = 0;               //programs, vertex arrays, buffers and textures
+        size_t uploadBytes = 0;         //buffer and texture data
+        size_t glCalls = 0;
+    };
+    static void endFrame();
+    static FrameCounters lastFrame();
+
+private:
+    struct Event {
+        const char* name;
+        const char* category;
+        char phase;                     //'X' span, 'C' counter
+        int64_t start;                  //microseconds since the trace epoch
+        int64_t duration;
+        double value;
+        int thread;
+    };
+    struct Settings {
+        std::atomic<int> logLevel{ GLTF_LOG_LEVEL };
+        std::atomic<bool> enabled{ false };
+        std::mutex mutex;
+        std::ostream* stream = &std::cout;
+        std::vector<Event> events;
+        size_t dropped = 0;
+        Clock::time_point epoch = Clock::now();
+        //frames
+        GLTF_GL::Counters frameStart;
+        Clock::time_point frameTime = Clock::now();
+        FrameCounters last;
+    };
+    static const size_t maxEvents = 1 << 20;    //beyond this events are counted and dropped
+
+    static Settings& settings();
+    static int threadIndex();
+    static void add(const Event& event);
+};
+
+
+// RAII span, costs a branch while tracing is off
+class GLTF_TraceSpan
+{
+public:
+    GLTF_TraceSpan(const char* name, const char* category) : name(name), category(category) {
+        if (GLTF_Trace::enabled()) {
+            active = true;
+            begin = GLTF_Trace::Clock::now();
+        }
+    }
+    ~GLTF_TraceSpan() {
+        if (active) GLTF_Trace::span(name, category, begin, GLTF_Trace::Clock::now());
+    }
+    GLTF_TraceSpan(const GLTF_TraceSpan&) = delete;
+    GLTF_TraceSpan& operator=(const GLTF_TraceSpan&) = delete;
+
+private:
+    const char* name;
+    const char* category;
+    bool active = false;
+    GLTF_Trace::Clock::time_point begin;
+};
+
+
+// GPU time of a pass from GL_TIME_ELAPSED queries. results are read a few frames later, when
+// they are ready, so measuring never stalls; milliseconds() is the latest one. GL thread only
+class GLTF_GpuTimer
+{
+public:
+    GLTF_GpuTimer() {}
+    GLTF_GpuTimer(const GLTF_GpuTimer&) = delete;
+    GLTF_GpuTimer& operator=(const GLTF_GpuTimer&) = delete;
+    ~GLTF_GpuTimer();
+    //time elapsed queries do not nest, one timer runs at a time
+    void begin();
+    void end();
+    double milliseconds() const { return latest; }
+
+private:
+    static const int depth = 4;         //frames in flight
+    GLuint queries[depth] = {};
+    bool pending[depth] = {};
+    int next = 0;
+    bool running = false;
+    double latest = 0.0;
+
+    void collect();
+};
+
+
+GLTF_Trace::Settings& GLTF_Trace::settings() {
+    static Settings current;
+    return current;
+}
+
+int GLTF_Trace::threadIndex() {
+    static std::atomic<int> count{ 0 };
+    thread_local int index = ++count;
+    return index;
+}
+
+void GLTF_Trace::setLogStream(std::ostream* stream) {
+    std::lock_guard<std::mutex> lock(settings().mutex);
+    settings().stream = stream;
+}
+
+void GLTF_Trace::log(int level, const std::string& line) {
+    static const char* prefixes[] = { "ERR: ", "WARN: ", "", "" };
+    Settings& current = settings();
+    std::lock_guard<std::mutex> lock(current.mutex);
+    if (!current.stream) return;
+    *current.stream << prefixes[std::min(std::max(level, 0), 3)] << line << '\n';
+    //errors are worth a flush, the rest is not
+    if (level == Error) current.stream->flush();
+}
+
+void GLTF_Trace::add(const Event& event) {
+    Settings& current = settings();
+    std::lock_guard<std::mutex> lock(current.mutex);
+    if (current.events.size() >= maxEvents) {
+        current.dropped++;
+        return;
+    }
+    current.events.push_back(event);
+}
+
+void GLTF_Trace::span(const char* name, const char* category, Clock::time_point begin, Clock::time_point end) {
+    if (!enabled()) return;
+    Event event;
+    event.name = name;
+    event.category = category;
+    event.phase = 'X';
+    event.start = std::chrono::duration_cast<std::chrono::microseconds>(begin - settings().epoch).count();
+    event.duration = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+    event.value = 0.0;
+    event.thread = threadIndex();
+    add(event);
+}
+
+void GLTF_Trace::counter(const char* name, double value) {
+    if (!enabled()) return;
+    Event event;
+    event.name = name;
+    event.category = "counter";
+    event.phase = 'C';
+    event.start = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - settings().epoch).count();
+    event.duration = 0;
+    event.value = value;
+    event.thread = threadIndex();
+    add(event);
+}
+
+void GLTF_Trace::clear() {
+    std::lock_guard<std::mutex> lock(settings().mutex);
+    settings().events.clear();
+    settings().dropped = 0;
+}
+
+void GLTF_Trace::writeChromeTrace(std::ostream& out) {
+    std::vector<Event> events;
+    size_t dropped;
+    {
+        std::lock_guard<std::mutex> lock(settings().mutex);
+        events = settings().events;
+        dropped = settings().dropped;
+    }
+    out << "{\"traceEvents\": [";
+    for (size_t i = 0; i < events.size(); ++i) {
+        const Event& event = events[i];
+        out << (i ? ",\n" : "\n") << "{\"name\": \"" << event.name << "\", \"cat\": \"" << event.category
+            << "\", \"ph\": \"" << event.phase << "\", \"ts\": " << event.start << ", \"pid\": 1, \"tid\": " << event.thread;
+        if (event.phase == 'X') out << ", \"dur\": " << event.duration;
+        else out << ", \"args\": {\"value\": " << event.value << "}";
+        out << "}";
+    }
+    out << "\n], \"otherData\": {\"droppedEvents\": " << dropped << "}}\n";
+}
+
+bool GLTF_Trace::writeChromeTrace(const std::string& path) {
+    std::ofstream out(path);
+    writeChromeTrace(out);
+    if (!out) GLTF_LOG_ERROR("Failed to write trace: " << path);
+    return (bool)out;
+}
+
+// counters are deltas since the last call; a reset of the GL counters starts them over
+void GLTF_Trace::endFrame() {
+    GLTF_GL::Counters now = GLTF_GL::counters();
+    Clock::time_point time = Clock::now();
+    FrameCounters frame;
+    {
+        Settings& current = settings();
+        std::lock_guard<std::mutex> lock(current.mutex);
+        const GLTF_GL::Counters& start = current.frameStart;
+        auto delta = [](size_t after, size_t before) { return after >= before ? after - before : after; };
+        frame.frame = current.last.frame + 1;
+        frame.milliseconds = std::chrono::duration<double, std::milli>(time - current.frameTime).count();
+        frame.draws = delta(now.drawCalls, start.drawCalls);
+        frame.triangles = delta(now.triangles, start.triangles);
+        frame.binds = delta(now.binds, start.binds);
+        frame.uploadBytes = delta(now.bufferBytes + now.textureBytes, start.bufferBytes + start.textureBytes);
+        frame.glCalls = delta(now.calls, start.calls);
+        current.frameStart = now;
+        current.frameTime = time;
+        current.last = frame;
+    }
+    if (!enabled()) return;
+    counter("frame ms", frame.milliseconds);
+    counter("draws", (double)frame.draws);
+    counter("triangles", (double)frame.triangles);
+    counter("binds", (double)frame.binds);
+    counter("upload bytes", (double)frame.uploadBytes);
+}
+
+GLTF_Trace::FrameCounters GLTF_Trace::lastFrame() {
+    std::lock_guard<std::mutex> lock(settings().mutex);
+    return settings().last;
+}
+
+GLTF_GpuTimer::~GLTF_GpuTimer() {
+    if (queries[0]) GLTF_GL::deleteQueries(depth, queries);
+}
+
+void GLTF_GpuTimer::begin() {
+    if (running) return;
+    if (!queries[0]) GLTF_GL::genQueries(depth, queries);
+    collect();
+    //every query still in flight: skip this frame rather than wait
+    if (pending[next]) return;
+    GLTF_GL::beginQuery(GL_TIME_ELAPSED, queries[next]);
+    running = true;
+}
+
+void GLTF_GpuTimer::end() {
+    if (!running) return;
+    GLTF_GL::endQuery(GL_TIME_ELAPSED);
+    pending[next] = true;
+    next = (next + 1) % depth;
+    running = false;
+}
+
+void GLTF_GpuTimer::collect() {
+    //oldest first, results come back in order
+    for (int i = 1; i <= depth; ++i) {
+        int query = (next + i) % depth;
+        if (!pending[query]) continue;
+        GLint available = 0;
+        GLTF_GL::getQueryObjectiv(queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+        GLuint64 nanoseconds = 0;
+        GLTF_GL::getQueryObjectui64v(queries[query], GL_QUERY_RESULT, &nanoseconds);
+        pending[query] = false;
+        latest = nanoseconds / 1e6;
+        GLTF_Trace::counter("gpu ms", latest);
+    }
+}
@@ -0,0 +1,357 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <tiny_gltf.h>
+#include "gltf_jobs.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define GLTF_TRANSFORMS_SSE
+#endif
+
+
+// node transforms of one scene
+// nodes are stored by slot in depth-first order, so the subtree of a slot is
+// the contiguous range [slot, subtreeEnd[slot]) and parents always come first
+class GLTF_Transforms
+{
+public:
+    void build(const tinygltf::Model& model, int sceneIndex);
+    //change the local transform of a node, world matrices follow on the next update
+    void setLocalTransform(int node, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale);
+    void setLocalMatrix(int node, const glm::mat4& matrix);
+    //one part of the local TRS, as animation channels write them
+    void setTranslation(int node, const glm::vec3& translation);
+    void setRotation(int node, const glm::quat& rotation);
+    void setScale(int node, const glm::vec3& scale);
+    //recompute the subtrees below edited nodes, returns false if nothing changed.
+    //maxThreads > 1 spreads large updates over GLTF_ThreadPool::shared(), 0 uses all of it
+    bool update(size_t maxThreads = 1);
+
+    size_t size() const { return nodeOfSlot.size(); }
+    int slot(int node) const { return (node >= 0 && node < (int)slotOfNode.size()) ? slotOfNode[node] : -1; }
+    int node(int slot) const { return nodeOfSlot[slot]; }
+    int parent(int slot) const { return parents[slot]; }
+    int subtreeEnd(int slot) const { return subtreeEnds[slot]; }
+    const glm::mat4& world(int slot) const { return worldMatrices[slot]; }
+    const std::vector<glm::mat4>& worlds() const { return worldMatrices; }
+    unsigned version() const { return changeCount; }    //bumped by every update that changed something
+    //slot ranges [first, end) recomputed by the last build or update
+    const std::vector<std::pair<int, int>>& lastUpdated() const { return updatedRanges; }
+
+private:
+    //local TRS per slot (SoA)
+    std::vector<float> tx, ty, tz;
+    std::vector<float> rx, ry, rz, rw;
+    std::vector<float> sx, sy, sz;
+    std::vector<uint8_t> hasMatrix;     //local matrix was given directly and is not composed from TRS
+    std::vector<glm::mat4> localMatrices;
+    std::vector<glm::mat4> worldMatrices;
+    //hierarchy
+    std::vector<int> parents;           //parent slot, -1 for scene roots
+    std::vector<int> subtreeEnds;
+    std::vector<int> slotOfNode;
+    std::vector<int> nodeOfSlot;
+    //edits since the last update
+    std::vector<int> dirtySlots;
+    std::vector<uint8_t> dirty;
+    std::vector<int> composeList;
+    std::vector<std::pair<int, int>> updatedRanges;
+    std::vector<std::pair<int, int>> pieces;    //subtrees recomputed as one task
+    std::vector<size_t> batches;                //first piece of each task
+    unsigned changeCount = 0;
+    static const int parallelSlots = 4096;      //below this an update stays on the calling thread
+
+    void addSlot(const tinygltf::Node& node, int nodeIndex, int parentSlot);
+    void markDirty(int slot);
+    void composeLocals(const int* slots, size_t count);
+    void composeLocal(int slot);
+    void computeWorlds(int first, int end);
+    void computeParallel(size_t maxThreads);
+#ifdef GLTF_TRANSFORMS_SSE
+    void composeLocals4(const int* slots);
+#endif
+};
+
+
+void GLTF_Transforms::build(const tinygltf::Model& model, int sceneIndex) {
+    *this = GLTF_Transforms();
+    slotOfNode.assign(model.nodes.size(), -1);
+    if (sceneIndex < 0 || sceneIndex >= (int)model.scenes.size()) return;
+
+    //iterative pre-order walk, deep hierarchies must not overflow the stack
+    std::vector<std::pair<int, int>> stack;         //node, parent slot
+    const tinygltf::Scene& scene = model.scenes[sceneIndex];
+    for (size_t i = scene.nodes.size(); i-- > 0;) {
+        stack.push_back({ scene.nodes[i], -1 });
+    }
+    while (!stack.empty()) {
+        std::pair<int, int> entry = stack.back();
+        stack.pop_back();
+        assert((entry.first >= 0) && (entry.first < (int)model.nodes.size()));
+        if (slotOfNode[entry.first] >= 0) continue;     //not a tree, keep the first occurrence
+        const tinygltf::Node& node = model.nodes[entry.first];
+        int slot = (int)nodeOfSlot.size();
+        addSlot(node, entry.first, entry.second);
+        for (size_t i = node.children.size(); i-- > 0;) {
+            stack.push_back({ node.children[i], slot });
+        }
+    }
+
+    //children follow their parent, so one backwards pass closes every range
+    for (int slot = (int)size() - 1; slot >= 0; --slot) {
+        if (parents[slot] >= 0)
+            subtreeEnds[parents[slot]] = std::max(subtreeEnds[parents[slot]], subtreeEnds[slot]);
+    }
+
+    dirty.assign(size(), 0);
+    worldMatrices.assign(size(), glm::mat4(1.0f));
+    for (int slot = 0; slot < (int)size(); ++slot) {
+        if (!hasMatrix[slot]) composeList.push_back(slot);
+    }
+    composeLocals(composeList.data(), composeList.size());
+    composeList.clear();
+    for (int slot = 0; slot < (int)size(); ++slot) {
+        worldMatrices[slot] = parents[slot] < 0 ? localMatrices[slot] : worldMatrices[parents[slot]] * localMatrices[slot];
+    }
+    updatedRanges.assign(1, { 0, (int)size() });
+    changeCount++;
+}
+
+void GLTF_Transforms::addSlot(const tinygltf::Node& node, int nodeIndex, int parentSlot) {
+    slotOfNode[nodeIndex] = (int)nodeOfSlot.size();
+    nodeOfSlot.push_back(nodeIndex);
+    parents.push_back(parentSlot);
+    subtreeEnds.push_back((int)nodeOfSlot.size());
+
+    bool t = node.translation.size() == 3;
+    bool r = node.rotation.size() == 4;
+    bool s = node.scale.size() == 3;
+    tx.push_back(t ? (float)node.translation[0] : 0.0f);
+    ty.push_back(t ? (float)node.translation[1] : 0.0f);
+    tz.push_back(t ? (float)node.translation[2] : 0.0f);
+    rx.push_back(r ? (float)node.rotation[0] : 0.0f);
+    ry.push_back(r ? (float)node.rotation[1] : 0.0f);
+    rz.push_back(r ? (float)node.rotation[2] : 0.0f);
+    rw.push_back(r ? (float)node.rotation[3] : 1.0f);
+    sx.push_back(s ? (float)node.scale[0] : 1.0f);
+    sy.push_back(s ? (float)node.scale[1] : 1.0f);
+    sz.push_back(s ? (float)node.scale[2] : 1.0f);
+
+    // glTF matrices are column-major like glm
+    if (node.matrix.size() == 16) {
+        hasMatrix.push_back(1);
+        localMatrices.push_back(glm::make_mat4(node.matrix.data()));
+    }
+    else {
+        hasMatrix.push_back(0);
+        localMatrices.push_back(glm::mat4(1.0f));
+    }
+}
+
+void GLTF_Transforms::setLocalTransform(int node, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale) {
+    int s = slot(node);
+    if (s < 0) return;
+    tx[s] = translation.x; ty[s] = translation.y; tz[s] = translation.z;
+    rx[s] = rotation.x; ry[s] = rotation.y; rz[s] = rotation.z; rw[s] = rotation.w;
+    sx[s] = scale.x; sy[s] = scale.y; sz[s] = scale.z;
+    hasMatrix[s] = 0;
+    markDirty(s);
+}
+
+void GLTF_Transforms::setLocalMatrix(int node, const glm::mat4& matrix) {
+    int s = slot(node);
+    if (s < 0) return;
+    localMatrices[s] = matrix;
+    hasMatrix[s] = 1;
+    markDirty(s);
+}
+
+void GLTF_Transforms::setTranslation(int node, const glm::vec3& translation) {
+    int s = slot(node);
+    if (s < 0) return;
+    tx[s] = translation.x; ty[s] = translation.y; tz[s] = translation.z;
+    hasMatrix[s] = 0;
+    markDirty(s);
+}
+
+void GLTF_Transforms::setRotation(int node, const glm::quat& rotation) {
+    int s = slot(node);
+    if (s < 0) return;
+    rx[s] = rotation.x; ry[s] = rotation.y; rz[s] = rotation.z; rw[s] = rotation.w;
+    hasMatrix[s] = 0;
+    markDirty(s);
+}
+
+void GLTF_Transforms::setScale(int node, const glm::vec3& scale) {
+    int s = slot(node);
+    if (s < 0) return;
+    sx[s] = scale.x; sy[s] = scale.y; sz[s] = scale.z;
+    hasMatrix[s] = 0;
+    markDirty(s);
+}
+
+void GLTF_Transforms::markDirty(int slot) {
+    if (dirty[slot]) return;
+    dirty[slot] = 1;
+    dirtySlots.push_back(slot);
+}
+
+bool GLTF_Transforms::update(size_t maxThreads) {
+    if (dirtySlots.empty()) return false;
+
+    for (int slot : dirtySlots) {
+        if (!hasMatrix[slot]) composeList.push_back(slot);
+    }
+    bool parallel = maxThreads != 1 && GLTF_ThreadPool::shared().size() > 0;
+    if (parallel && composeList.size() >= (size_t)parallelSlots) {
+        //chunks stay multiples of four for the SSE path
+        GLTF_ThreadPool::shared().parallelChunks(composeList.size(), parallelSlots / 4,
+            [this](size_t, size_t begin, size_t end) { composeLocals(composeList.data() + begin, end - begin); }, maxThreads);
+    }
+    else {
+        composeLocals(composeList.data(), composeList.size());
+    }
+    composeList.clear();
+
+    //walk the edited subtrees in slot order, a subtree inside one already
+    //recomputed is skipped
+    std::sort(dirtySlots.begin(), dirtySlots.end());
+    updatedRanges.clear();
+    int end = -1;
+    int total = 0;
+    for (int first : dirtySlots) {
+        dirty[first] = 0;
+        if (first < end) continue;
+        end = subtreeEnds[first];
+        updatedRanges.push_back({ first, end });
+        total += end - first;
+    }
+    dirtySlots.clear();
+    if (parallel && total >= 2 * parallelSlots) {
+        computeParallel(maxThreads);
+    }
+    else {
+        for (auto& range : updatedRanges) computeWorlds(range.first, range.second);
+    }
+    changeCount++;
+    return true;
+}
+
+void GLTF_Transforms::computeWorlds(int first, int end) {
+    for (int slot = first; slot < end; ++slot) {
+        worldMatrices[slot] = parents[slot] < 0 ? localMatrices[slot] : worldMatrices[parents[slot]] * localMatrices[slot];
+    }
+}
+
+// fork-join over subtrees: a range too large for one task has its root computed here and
+// its child subtrees handed out instead. small neighbouring subtrees share a task. every
+// slot is written by exactly one task after its parent, so the result matches the serial one
+void GLTF_Transforms::computeParallel(size_t maxThreads) {
+    pieces.clear();
+    std::vector<std::pair<int, int>> work(updatedRanges.rbegin(), updatedRanges.rend());
+    while (!work.empty()) {
+        std::pair<int, int> range = work.back();
+        work.pop_back();
+        if (range.second - range.first <= parallelSlots) {
+            pieces.push_back(range);
+            continue;
+        }
+        computeWorlds(range.first, range.first + 1);
+        size_t children = work.size();
+        for (int child = range.first + 1; child < range.second; child = subtreeEnds[child]) {
+            work.push_back({ child, subtreeEnds[child] });
+        }
+        std::reverse(work.begin() + children, work.end());
+    }
+
+    batches.clear();
+    int slots = parallelSlots;
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        if (slots >= parallelSlots) {
+            batches.push_back(i);
+            slots = 0;
+        }
+        slots += pieces[i].second - pieces[i].first;
+    }
+    batches.push_back(pieces.size());
+    GLTF_ThreadPool::shared().parallelFor(batches.size() - 1, [this](size_t batch) {
+        for (size_t i = batches[batch]; i < batches[batch + 1]; ++i) computeWorlds(pieces[i].first, pieces[i].second);
+    }, maxThreads);
+}
+
+// T * R * S for a list of slots, four at a time when SSE is available
+void GLTF_Transforms::composeLocals(const int* slots, size_t count) {
+    size_t i = 0;
+#ifdef GLTF_TRANSFORMS_SSE
+    for (; i + 4 <= count; i += 4) {
+        composeLocals4(slots + i);
+    }
+#endif
+    for (; i < count; ++i) {
+        composeLocal(slots[i]);
+    }
+}
+
+void GLTF_Transforms::composeLocal(int s) {
+    float x = rx[s], y = ry[s], z = rz[s], w = rw[s];
+    glm::mat4& m = localMatrices[s];
+    m[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y), 0.0f) * sx[s];
+    m[1] = glm::vec4(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x), 0.0f) * sy[s];
+    m[2] = glm::vec4(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y), 0.0f) * sz[s];
+    m[3] = glm::vec4(tx[s], ty[s], tz[s], 1.0f);
+}
+
+#ifdef GLTF_TRANSFORMS_SSE
+void GLTF_Transforms::composeLocals4(const int* slots) {
+    int a = slots[0], b = slots[1], c = slots[2], d = slots[3];
+    //one lane per node
+    __m128 x = _mm_set_ps(rx[d], rx[c], rx[b], rx[a]);
+    __m128 y = _mm_set_ps(ry[d], ry[c], ry[b], ry[a]);
+    __m128 z = _mm_set_ps(rz[d], rz[c], rz[b], rz[a]);
+    __m128 w = _mm_set_ps(rw[d], rw[c], rw[b], rw[a]);
+    __m128 scaleX = _mm_set_ps(sx[d], sx[c], sx[b], sx[a]);
+    __m128 scaleY = _mm_set_ps(sy[d], sy[c], sy[b], sy[a]);
+    __m128 scaleZ = _mm_set_ps(sz[d], sz[c], sz[b], sz[a]);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 two = _mm_set1_ps(2.0f);
+
+    __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+    __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+    __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+    __m128 cols[4][4];
+    cols[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), scaleX);
+    cols[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), scaleX);
+    cols[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), scaleX);
+    cols[0][3] = _mm_setzero_ps();
+    cols[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), scaleY);
+    cols[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), scaleY);
+    cols[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), scaleY);
+    cols[1][3] = _mm_setzero_ps();
+    cols[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), scaleZ);
+    cols[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), scaleZ);
+    cols[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), scaleZ);
+    cols[2][3] = _mm_setzero_ps();
+    cols[3][0] = _mm_set_ps(tx[d], tx[c], tx[b], tx[a]);
+    cols[3][1] = _mm_set_ps(ty[d], ty[c], ty[b], ty[a]);
+    cols[3][2] = _mm_set_ps(tz[d], tz[c], tz[b], tz[a]);
+    cols[3][3] = one;
+
+    //transpose lanes back into one column per node
+    for (int col = 0; col < 4; ++col) {
+        _MM_TRANSPOSE4_PS(cols[col][0], cols[col][1], cols[col][2], cols[col][3]);
+        _mm_storeu_ps(&localMatrices[a][col][0], cols[col][0]);
+        _mm_storeu_ps(&localMatrices[b][col][0], cols[col][1]);
+        _mm_storeu_ps(&localMatrices[c][col][0], cols[col][2]);
+        _mm_storeu_ps(&localMatrices[d][col][0], cols[col][3]);
+    }
+}
+#endif
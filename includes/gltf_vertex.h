@@ -0,0 +1,556 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <tiny_gltf.h>
+#include "gltf_accessor.h"
+#include "gltf_file.h"
+#include "gltf_jobs.h"
+#include "gltf_trace.h"
+
+//vertex attributes come in at fixed locations. TANGENT is a vec4 with the bitangent sign in w,
+//JOINTS_0 a uvec4; vec3 colors leave alpha at GL's default of 1
+#define GLTF_POSITION_LOCATION 0
+#define GLTF_NORMAL_LOCATION 1
+#define GLTF_TEXCOORD0_LOCATION 2
+#define GLTF_TANGENT_LOCATION 3
+#define GLTF_JOINTS_LOCATION 4
+#define GLTF_WEIGHTS_LOCATION 5
+#define GLTF_TEXCOORD1_LOCATION 6
+#define GLTF_COLOR_LOCATION 7
+
+
+// load-time vertex layout: the attributes of each primitive are packed into one interleaved,
+// tightly packed vertex buffer (a bufferView with a byteStride), sparse accessors written
+// out in full, and tangents generated where a normal mapped material lacks them. the
+// primitives point at new accessors into that buffer, so each VAO binds one buffer at one
+// stride; attributes no location takes are dropped from the primitives
+class GLTF_VertexFormat
+{
+public:
+    struct Settings {
+        bool interleave = true;
+        bool generateTangents = true;   //for primitives with a normalTexture and no TANGENT
+        uint32_t mask() const { return interleave ? 1u | (generateTangents ? 2u : 0u) : 0u; }
+    };
+    struct Report {
+        size_t primitives = 0;          //interleaved
+        size_t vertexBuffers = 0;       //primitives with the same attributes share one
+        size_t tangentsGenerated = 0;   //vertex buffers
+        size_t verticesSplit = 0;       //copies made where tangent spaces differ
+        size_t sparseAccessors = 0;     //written out in full
+        size_t bytes = 0;
+    };
+
+    //location of a semantic, -1 for attributes no shader input takes
+    static int location(const std::string& semantic);
+    //attributes that stay integers in the shader
+    static bool integer(const std::string& semantic) { return semantic == "JOINTS_0"; }
+    //rewrite the primitives of every mesh, the layouts are built on GLTF_ThreadPool::shared()
+    static void interleave(tinygltf::Model& model, GLTF_BufferData& data, const Settings& settings, Report& report);
+    //MikkTSpace tangents of an indexed triangle list, xyz and the bitangent sign in w. a vertex
+    //whose corners get different tangent spaces is split: the indices are rewritten to the copies
+    //and vertices[v] is the vertex v was copied from, tangents are by new vertex.
+    //positions and normals are 3 floats per vertex, texcoords 2
+    static void generateTangents(const std::vector<float>& positions, const std::vector<float>& normals,
+        const std::vector<float>& texcoords, std::vector<uint32_t>& indices, std::vector<float>& tangents,
+        std::vector<uint32_t>& vertices);
+
+private:
+    struct Attribute {
+        std::string semantic;
+        int source = -1;                //accessor, -1 for generated tangents
+        size_t elementSize = 0;
+        size_t offset = 0;              //in the vertex
+        std::vector<unsigned char> values;
+    };
+    //one interleaved vertex buffer and what it is made from
+    struct Layout {
+        std::map<std::string, int> attributes;
+        int indices = -1;               //tangents only
+        int tangentTexcoord = -1;       //set the tangents follow, -1 for none
+        std::vector<Attribute> packed;
+        size_t count = 0;
+        size_t stride = 0;
+        std::vector<unsigned char> bytes;
+        //when tangents split vertices, the triangles rewritten to the copies
+        size_t split = 0;
+        int indexType = -1;
+        std::vector<unsigned char> indexBytes;
+        bool built = false;
+    };
+    static int tangentTexcoord(const tinygltf::Model& model, const tinygltf::Primitive& primitive);
+    static bool interleaved(const tinygltf::Model& model, const tinygltf::Primitive& primitive);
+    static void build(const tinygltf::Model& model, const GLTF_BufferData& data, Layout& layout);
+};
+
+
+int GLTF_VertexFormat::location(const std::string& semantic) {
+    static const std::map<std::string, int> locations = {
+        { "POSITION", GLTF_POSITION_LOCATION }, { "NORMAL", GLTF_NORMAL_LOCATION },
+        { "TEXCOORD_0", GLTF_TEXCOORD0_LOCATION }, { "TANGENT", GLTF_TANGENT_LOCATION },
+        { "JOINTS_0", GLTF_JOINTS_LOCATION }, { "WEIGHTS_0", GLTF_WEIGHTS_LOCATION },
+        { "TEXCOORD_1", GLTF_TEXCOORD1_LOCATION }, { "COLOR_0", GLTF_COLOR_LOCATION }
+    };
+    auto found = locations.find(semantic);
+    return found == locations.end() ? -1 : found->second;
+}
+
+// the texcoord set of the material's normal map when the primitive needs tangents made for it
+int GLTF_VertexFormat::tangentTexcoord(const tinygltf::Model& model, const tinygltf::Primitive& primitive) {
+    if (primitive.material < 0 || primitive.material >= (int)model.materials.size()) return -1;
+    if (primitive.mode != -1 && primitive.mode != TINYGLTF_MODE_TRIANGLES) return -1;
+    if (primitive.attributes.count("TANGENT") || !primitive.attributes.count("POSITION") || !primitive.attributes.count("NORMAL"))
+        return -1;
+    const tinygltf::Material& material = model.materials[primitive.material];
+    auto normal = material.additionalValues.find("normalTexture");
+    if (normal == material.additionalValues.end()) return -1;
+    int set = normal->second.TextureTexCoord();
+    if (!primitive.attributes.count("TEXCOORD_" + std::to_string(set))) return -1;
+    return set;
+}
+
+// every attribute with a location already in one strided view, as static batches are made
+bool GLTF_VertexFormat::interleaved(const tinygltf::Model& model, const tinygltf::Primitive& primitive) {
+    int view = -1;
+    for (auto& attrib : primitive.attributes) {
+        if (location(attrib.first) < 0) continue;
+        if (attrib.second < 0 || attrib.second >= (int)model.accessors.size()) return false;
+        const tinygltf::Accessor& accessor = model.accessors[attrib.second];
+        if (accessor.sparse.isSparse || accessor.bufferView < 0 || accessor.bufferView >= (int)model.bufferViews.size()) return false;
+        if (view >= 0 && accessor.bufferView != view) return false;
+        view = accessor.bufferView;
+    }
+    return view >= 0 && model.bufferViews[view].byteStride > 0;
+}
+
+void GLTF_VertexFormat::interleave(tinygltf::Model& model, GLTF_BufferData& data, const Settings& settings, Report& report) {
+    report = Report();
+    if (!settings.interleave) return;
+
+    //primitives with the same attributes (and, when tangents are made, the same triangles
+    //and texcoord set) share one layout
+    std::vector<Layout> layouts;
+    std::map<std::tuple<std::map<std::string, int>, int, int>, size_t> layoutIndex;
+    std::vector<std::pair<tinygltf::Primitive*, size_t>> primitives;
+    for (tinygltf::Mesh& mesh : model.meshes) {
+        for (tinygltf::Primitive& primitive : mesh.primitives) {
+            if (primitive.attributes.empty()) continue;
+            int set = settings.generateTangents ? tangentTexcoord(model, primitive) : -1;
+            if (set < 0 && interleaved(model, primitive)) continue;
+            std::map<std::string, int> attributes;
+            for (auto& attrib : primitive.attributes) {
+                if (location(attrib.first) >= 0) attributes.insert(attrib);
+            }
+            auto key = std::make_tuple(attributes, set >= 0 ? primitive.indices : -1, set);
+            auto found = layoutIndex.find(key);
+            if (found == layoutIndex.end()) {
+                found = layoutIndex.insert({ key, layouts.size() }).first;
+                layouts.emplace_back();
+                layouts.back().attributes = attributes;
+                layouts.back().indices = set >= 0 ? primitive.indices : -1;
+                layouts.back().tangentTexcoord = set;
+            }
+            primitives.push_back({ &primitive, found->second });
+        }
+    }
+    GLTF_ThreadPool::shared().parallelFor(layouts.size(), [&](size_t i) {
+        build(model, data, layouts[i]);
+    });
+
+    //one new buffer, one view per layout and one accessor per attribute
+    int buffer = (int)model.buffers.size();
+    std::vector<unsigned char> bytes;
+    std::vector<std::map<std::string, int>> accessors(layouts.size());
+    std::vector<int> indexAccessors(layouts.size(), -1);
+    for (size_t i = 0; i < layouts.size(); ++i) {
+        Layout& layout = layouts[i];
+        if (!layout.built) continue;
+        size_t offset = (bytes.size() + 15) & ~(size_t)15;
+        bytes.resize(offset);
+        bytes.insert(bytes.end(), layout.bytes.begin(), layout.bytes.end());
+        std::vector<unsigned char>().swap(layout.bytes);
+        tinygltf::BufferView view;
+        view.buffer = buffer;
+        view.byteOffset = offset;
+        view.byteLength = layout.count * layout.stride;
+        view.byteStride = layout.stride;
+        view.target = TINYGLTF_TARGET_ARRAY_BUFFER;
+        model.bufferViews.push_back(view);
+        for (const Attribute& attribute : layout.packed) {
+            tinygltf::Accessor accessor;
+            if (attribute.source >= 0) {
+                //bounds, names and formats stay, the data is read in full
+                accessor = model.accessors[attribute.source];
+                if (accessor.sparse.isSparse) report.sparseAccessors++;
+                accessor.sparse = tinygltf::Accessor::Sparse();
+                accessor.count = layout.count;  //with the copies of split vertices
+            }
+            else {
+                accessor.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+                accessor.type = TINYGLTF_TYPE_VEC4;
+                accessor.count = layout.count;
+                report.tangentsGenerated++;
+            }
+            accessor.bufferView = (int)model.bufferViews.size() - 1;
+            accessor.byteOffset = attribute.offset;
+            accessors[i][attribute.semantic] = (int)model.accessors.size();
+            model.accessors.push_back(accessor);
+        }
+        if (!layout.indexBytes.empty()) {
+            //the layout's triangles with the split vertices, in a view of their own
+            size_t indexOffset = (bytes.size() + 15) & ~(size_t)15;
+            bytes.resize(indexOffset);
+            bytes.insert(bytes.end(), layout.indexBytes.begin(), layout.indexBytes.end());
+            tinygltf::BufferView indexView;
+            indexView.buffer = buffer;
+            indexView.byteOffset = indexOffset;
+            indexView.byteLength = layout.indexBytes.size();
+            indexView.target = TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
+            model.bufferViews.push_back(indexView);
+            tinygltf::Accessor accessor;
+            accessor.bufferView = (int)model.bufferViews.size() - 1;
+            accessor.componentType = layout.indexType;
+            accessor.type = TINYGLTF_TYPE_SCALAR;
+            accessor.count = layout.indexBytes.size() / tinygltf::GetComponentSizeInBytes(layout.indexType);
+            indexAccessors[i] = (int)model.accessors.size();
+            model.accessors.push_back(accessor);
+            std::vector<unsigned char>().swap(layout.indexBytes);
+            report.verticesSplit += layout.split;
+        }
+        report.vertexBuffers++;
+    }
+    if (bytes.empty()) return;
+
+    //attributes without a location were never bound, they are dropped with the old layout
+    for (auto& entry : primitives) {
+        if (!layouts[entry.second].built) continue;
+        entry.first->attributes = accessors[entry.second];
+        if (indexAccessors[entry.second] >= 0) entry.first->indices = indexAccessors[entry.second];
+        report.primitives++;
+    }
+    report.bytes = bytes.size();
+    data.append(model, std::move(bytes));
+}
+
+// read every attribute in its own format, make tangents, then interleave with each element
+// on a 4 byte boundary. a primitive whose attributes disagree on the vertex count keeps its layout
+void GLTF_VertexFormat::build(const tinygltf::Model& model, const GLTF_BufferData& data, Layout& layout) {
+    GLTF_TRACE_SCOPE("vertex layout", "load");
+    std::vector<std::pair<int, std::string>> order;
+    for (auto& attrib : layout.attributes) {
+        order.push_back({ location(attrib.first), attrib.first });
+    }
+    std::sort(order.begin(), order.end());
+    layout.count = 0;
+    for (auto& entry : order) {
+        int source = layout.attributes[entry.second];
+        if (source < 0 || source >= (int)model.accessors.size()) return;
+        const tinygltf::Accessor& accessor = model.accessors[source];
+        if (layout.packed.size() && accessor.count != layout.count) return;
+        layout.count = accessor.count;
+        Attribute attribute;
+        attribute.semantic = entry.second;
+        attribute.source = source;
+        attribute.elementSize = gltfComponentCount(accessor.type) * tinygltf::GetComponentSizeInBytes(accessor.componentType);
+        if (!gltfReadElements(model, data, source, attribute.values)) return;
+        layout.packed.push_back(std::move(attribute));
+    }
+    if (layout.count == 0) return;
+
+    if (layout.tangentTexcoord >= 0) {
+        std::vector<float> positions, normals, texcoords;
+        std::vector<uint32_t> indices;
+        std::vector<unsigned char> indexBytes;
+        bool read = gltfReadFloats(model, data, layout.attributes["POSITION"], positions) &&
+            gltfReadFloats(model, data, layout.attributes["NORMAL"], normals) &&
+            gltfReadFloats(model, data, layout.attributes["TEXCOORD_" + std::to_string(layout.tangentTexcoord)], texcoords);
+        if (read && layout.indices >= 0 && gltfReadElements(model, data, layout.indices, indexBytes)) {
+            const tinygltf::Accessor& accessor = model.accessors[layout.indices];
+            int size = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+            indices.resize(accessor.count);
+            for (size_t i = 0; i < accessor.count; ++i) {
+                indices[i] = (uint32_t)gltfReadIndex(indexBytes.data() + i * size, accessor.componentType);
+            }
+        }
+        else if (read) {
+            indices.resize(layout.count);
+            for (size_t i = 0; i < layout.count; ++i) indices[i] = (uint32_t)i;
+        }
+        if (read && positions.size() == layout.count * 3 && normals.size() == layout.count * 3 && texcoords.size() == layout.count * 2) {
+            std::vector<float> tangents;
+            std::vector<uint32_t> vertices;
+            generateTangents(positions, normals, texcoords, indices, tangents, vertices);
+            if (vertices.size() > layout.count && layout.indices >= 0) {
+                //copies take every attribute of the vertex they were made from
+                for (Attribute& packed : layout.packed) {
+                    std::vector<unsigned char> values(vertices.size() * packed.elementSize);
+                    for (size_t v = 0; v < vertices.size(); ++v) {
+                        memcpy(values.data() + v * packed.elementSize, packed.values.data() + vertices[v] * packed.elementSize,
+                            packed.elementSize);
+                    }
+                    packed.values.swap(values);
+                }
+                layout.split = vertices.size() - layout.count;
+                layout.count = vertices.size();
+                //the index type widens only when the copies no longer fit it
+                int type = model.accessors[layout.indices].componentType;
+                if (type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE && layout.count > 255) type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT;
+                if (type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT && layout.count > 65535) type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT;
+                int size = tinygltf::GetComponentSizeInBytes(type);
+                layout.indexType = type;
+                layout.indexBytes.resize(indices.size() * size);
+                for (size_t i = 0; i < indices.size(); ++i) {
+                    unsigned char* to = layout.indexBytes.data() + i * size;
+                    uint16_t narrow = (uint16_t)indices[i];
+                    if (size == 1) *to = (unsigned char)indices[i];
+                    else if (size == 2) memcpy(to, &narrow, 2);
+                    else memcpy(to, &indices[i], 4);
+                }
+            }
+            Attribute attribute;
+            attribute.semantic = "TANGENT";
+            attribute.elementSize = 4 * sizeof(float);
+            attribute.values.resize(tangents.size() * sizeof(float));
+            memcpy(attribute.values.data(), tangents.data(), attribute.values.size());
+            //right after the normal, in location order
+            auto at = std::find_if(layout.packed.begin(), layout.packed.end(),
+                [](const Attribute& packed) { return location(packed.semantic) > GLTF_TANGENT_LOCATION; });
+            layout.packed.insert(at, std::move(attribute));
+        }
+    }
+
+    layout.stride = 0;
+    for (Attribute& attribute : layout.packed) {
+        attribute.offset = layout.stride;
+        layout.stride += (attribute.elementSize + 3) & ~(size_t)3;
+    }
+    layout.bytes.assign(layout.count * layout.stride, 0);
+    for (const Attribute& attribute : layout.packed) {
+        for (size_t v = 0; v < layout.count; ++v) {
+            memcpy(layout.bytes.data() + v * layout.stride + attribute.offset, attribute.values.data() + v * attribute.elementSize,
+                attribute.elementSize);
+        }
+    }
+    for (Attribute& attribute : layout.packed) {
+        std::vector<unsigned char>().swap(attribute.values);
+    }
+    layout.built = true;
+}
+
+// MikkTSpace (Mikkelsen, "Simulation of Wrinkled Surfaces Revisited"), as its reference code
+// groups and averages: vertices with the same position, normal and texcoord are one, and the
+// corners of one vertex form a group when their triangles are joined by edges and agree on
+// whether their UVs are mirrored. each group gets the corner angle weighted sum of its
+// triangles' texture space s directions projected into the tangent plane, and the sign of
+// its side. triangles without UV area take the side of a neighbour, those without area join
+// nothing and take a group of their vertex. the default 180 degree angular threshold never
+// splits a group further
+void GLTF_VertexFormat::generateTangents(const std::vector<float>& positions, const std::vector<float>& normals,
+    const std::vector<float>& texcoords, std::vector<uint32_t>& indices, std::vector<float>& tangents, std::vector<uint32_t>& vertices) {
+    size_t count = positions.size() / 3;
+    size_t triangleCount = indices.size() / 3;
+    auto position = [&](uint32_t v) { return glm::vec3(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]); };
+    auto normal = [&](uint32_t v) { return glm::vec3(normals[v * 3], normals[v * 3 + 1], normals[v * 3 + 2]); };
+    auto texcoord = [&](uint32_t v) { return glm::vec2(texcoords[v * 2], texcoords[v * 2 + 1]); };
+
+    //welded vertex of every vertex, the first one with the same bits
+    struct Key {
+        float values[8];
+        uint32_t vertex;
+    };
+    std::vector<Key> keys(count);
+    for (uint32_t v = 0; v < (uint32_t)count; ++v) {
+        memcpy(keys[v].values, &positions[v * 3], 3 * sizeof(float));
+        memcpy(keys[v].values + 3, &normals[v * 3], 3 * sizeof(float));
+        memcpy(keys[v].values + 6, &texcoords[v * 2], 2 * sizeof(float));
+        keys[v].vertex = v;
+    }
+    std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) {
+        int order = memcmp(a.values, b.values, sizeof(a.values));
+        return order < 0 || (order == 0 && a.vertex < b.vertex);
+    });
+    std::vector<uint32_t> welded(count);
+    for (size_t k = 0; k < count; ++k) {
+        bool same = k > 0 && memcmp(keys[k].values, keys[k - 1].values, sizeof(keys[k].values)) == 0;
+        welded[keys[k].vertex] = same ? welded[keys[k - 1].vertex] : keys[k].vertex;
+    }
+
+    //s direction and side of every triangle
+    enum { Unused = 0, Preserving = 1, Mirrored = 2, AnySide = 3 };
+    std::vector<uint8_t> side(triangleCount, Unused);
+    std::vector<glm::vec3> directions(triangleCount, glm::vec3(0.0f));
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const uint32_t* corner = &indices[t * 3];
+        if (corner[0] >= count || corner[1] >= count || corner[2] >= count) continue;
+        glm::vec3 p0 = position(corner[0]), p1 = position(corner[1]), p2 = position(corner[2]);
+        if (p0 == p1 || p0 == p2 || p1 == p2) continue;
+        glm::vec3 edge1 = p1 - p0;
+        glm::vec3 edge2 = p2 - p0;
+        glm::vec2 uv1 = texcoord(corner[1]) - texcoord(corner[0]);
+        glm::vec2 uv2 = texcoord(corner[2]) - texcoord(corner[0]);
+        float area = uv1.x * uv2.y - uv1.y * uv2.x;
+        glm::vec3 s = edge1 * uv2.y - edge2 * uv1.y;
+        float length = glm::length(s);
+        if (area == 0.0f) {
+            side[t] = AnySide;
+            continue;
+        }
+        side[t] = area > 0.0f ? Preserving : Mirrored;
+        if (length > 0.0f) directions[t] = s * ((area > 0.0f ? 1.0f : -1.0f) / length);
+    }
+
+    //triangles sharing an edge of welded vertices
+    std::vector<std::tuple<uint32_t, uint32_t, uint32_t>> edges;
+    edges.reserve(triangleCount * 3);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (side[t] == Unused) continue;
+        for (int k = 0; k < 3; ++k) {
+            uint32_t a = welded[indices[t * 3 + k]], b = welded[indices[t * 3 + (k + 1) % 3]];
+            edges.emplace_back(std::min(a, b), std::max(a, b), (uint32_t)t);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    struct Neighbours {
+        uint32_t triangles[2];
+        uint32_t vertices[2];           //welded, of the shared edge
+    };
+    std::vector<Neighbours> neighbours;
+    for (size_t first = 0, end = 0; first < edges.size(); first = end) {
+        end = first + 1;
+        while (end < edges.size() && std::get<0>(edges[end]) == std::get<0>(edges[first]) &&
+            std::get<1>(edges[end]) == std::get<1>(edges[first]))
+            end++;
+        for (size_t i = first; i < end; ++i) {
+            for (size_t j = i + 1; j < end; ++j) {
+                neighbours.push_back({ { std::get<2>(edges[i]), std::get<2>(edges[j]) },
+                    { std::get<0>(edges[first]), std::get<1>(edges[first]) } });
+            }
+        }
+    }
+    std::vector<uint32_t> offsets(triangleCount + 1, 0);
+    for (const Neighbours& pair : neighbours) {
+        offsets[pair.triangles[0] + 1]++;
+        offsets[pair.triangles[1] + 1]++;
+    }
+    for (size_t t = 0; t < triangleCount; ++t) offsets[t + 1] += offsets[t];
+    std::vector<uint32_t> adjacent(neighbours.size() * 2);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (const Neighbours& pair : neighbours) {
+        adjacent[fill[pair.triangles[0]]++] = pair.triangles[1];
+        adjacent[fill[pair.triangles[1]]++] = pair.triangles[0];
+    }
+
+    //triangles without UV area take the side the first neighbour reaching them has, else preserving
+    std::vector<uint32_t> queue;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (side[t] == Preserving || side[t] == Mirrored) queue.push_back((uint32_t)t);
+    }
+    for (size_t head = 0;; ++head) {
+        if (head == queue.size()) {
+            auto unsided = std::find(side.begin(), side.end(), (uint8_t)AnySide);
+            if (unsided == side.end()) break;
+            *unsided = Preserving;
+            queue.push_back((uint32_t)(unsided - side.begin()));
+        }
+        uint32_t t = queue[head];
+        for (uint32_t a = offsets[t]; a < offsets[t + 1]; ++a) {
+            if (side[adjacent[a]] != AnySide) continue;
+            side[adjacent[a]] = side[t];
+            queue.push_back(adjacent[a]);
+        }
+    }
+
+    //groups of corners, joined across the shared edges of triangles on the same side
+    std::vector<uint32_t> groups(triangleCount * 3);
+    for (uint32_t c = 0; c < (uint32_t)groups.size(); ++c) groups[c] = c;
+    auto root = [&](uint32_t c) {
+        while (groups[c] != c) c = groups[c] = groups[groups[c]];
+        return c;
+    };
+    auto cornerAt = [&](uint32_t t, uint32_t vertex) {
+        for (uint32_t k = 0; k < 3; ++k) {
+            if (welded[indices[t * 3 + k]] == vertex) return t * 3 + k;
+        }
+        return ~0u;
+    };
+    for (const Neighbours& pair : neighbours) {
+        if (side[pair.triangles[0]] != side[pair.triangles[1]]) continue;
+        for (uint32_t vertex : pair.vertices) {
+            groups[root(cornerAt(pair.triangles[0], vertex))] = root(cornerAt(pair.triangles[1], vertex));
+        }
+    }
+
+    //angle weighted sums, edges and directions projected into the tangent plane of the vertex
+    std::vector<glm::vec3> sums(groups.size(), glm::vec3(0.0f));
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (side[t] == Unused) continue;
+        for (int k = 0; k < 3; ++k) {
+            uint32_t v = indices[t * 3 + k];
+            glm::vec3 n = normal(v);
+            glm::vec3 toPrevious = position(indices[t * 3 + (k + 2) % 3]) - position(v);
+            glm::vec3 toNext = position(indices[t * 3 + (k + 1) % 3]) - position(v);
+            toPrevious -= n * glm::dot(n, toPrevious);
+            toNext -= n * glm::dot(n, toNext);
+            float lengths = glm::length(toPrevious) * glm::length(toNext);
+            float angle = lengths > 0.0f ? std::acos(std::max(-1.0f, std::min(1.0f, glm::dot(toPrevious, toNext) / lengths))) : 0.0f;
+            glm::vec3 s = directions[t] - n * glm::dot(n, directions[t]);
+            float length = glm::length(s);
+            if (length > 0.0f) sums[root((uint32_t)(t * 3 + k))] += s * (angle / length);
+        }
+    }
+
+    //one vertex per vertex and group: the first group keeps the vertex, any other gets a copy
+    const uint32_t none = ~0u;
+    std::vector<uint32_t> vertexGroups(count, none);
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> copies;
+    vertices.resize(count);
+    for (uint32_t v = 0; v < (uint32_t)count; ++v) vertices[v] = v;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (side[t] == Unused) continue;
+        for (int k = 0; k < 3; ++k) {
+            uint32_t& v = indices[t * 3 + k];
+            uint32_t group = root((uint32_t)(t * 3 + k));
+            if (vertexGroups[v] == none) vertexGroups[v] = group;
+            if (vertexGroups[v] == group) continue;
+            auto copy = copies.insert({ { v, group }, (uint32_t)vertices.size() });
+            if (copy.second) {
+                vertices.push_back(v);
+                vertexGroups.push_back(group);
+            }
+            v = copy.first->second;
+        }
+    }
+
+    tangents.assign(vertices.size() * 4, 0.0f);
+    for (size_t v = 0; v < vertices.size(); ++v) {
+        uint32_t group = vertexGroups[v];
+        glm::vec3 n = normal(vertices[v]);
+        glm::vec3 tangent = group != none ? sums[group] - n * glm::dot(n, sums[group]) : glm::vec3(0.0f);
+        float length = glm::length(tangent);
+        if (length > 1e-12f) {
+            tangent /= length;
+        }
+        else {
+            //no usable texture space: any direction across the normal
+            glm::vec3 axis = std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            tangent = axis - n * glm::dot(n, axis);
+            length = glm::length(tangent);
+            tangent = length > 0.0f ? tangent / length : glm::vec3(1.0f, 0.0f, 0.0f);
+        }
+        bool mirrored = group != none && side[group / 3] == Mirrored;
+        tangents[v * 4] = tangent.x;
+        tangents[v * 4 + 1] = tangent.y;
+        tangents[v * 4 + 2] = tangent.z;
+        tangents[v * 4 + 3] = mirrored ? -1.0f : 1.0f;
+    }
+}